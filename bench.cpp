@@ -0,0 +1,542 @@
+// Headless benchmarks for the file and tree paths. Builds synthetic workspaces in a
+// scratch directory and prints one JSON object per benchmark, so runs from two commits
+// can be diffed or plotted:
+//
+//     librenote_bench [--quick] [--runs N] [--filter substring] [--out results.jsonl]
+//                     [--dir scratch-dir] [--keep]
+//
+// Needs no display; the tree benchmark uses a Gtk::TreeStore without opening one.
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <unistd.h>
+#include <vector>
+#include <gtkmm/main.h>
+
+#include "dir_scanner.h"
+#include "doc_stats.h"
+#include "explorer_rows.h"
+#include "file_loader.h"
+#include "file_sniffer.h"
+#include "ignore_rules.h"
+#include "path_index.h"
+#include "piece_table.h"
+#include "save_queue.h"
+#include "site_export.h"
+#include "text_encoding.h"
+#include "tree_snapshot.h"
+
+namespace {
+
+struct Options {
+    bool quick = false;
+    int runs = 5;
+    std::string filter;
+    std::string out_path;
+    std::filesystem::path dir;
+    bool keep = false;
+};
+
+struct Workspace {
+    std::filesystem::path root;
+    size_t files = 0;
+    size_t dirs = 0;
+    uint64_t bytes = 0;
+};
+
+// Deterministic filler, so every run and every commit benchmarks the same bytes
+class TextGenerator {
+public:
+    std::string line() {
+        static const char* words[] = {"note", "the", "lorem", "ipsum", "markdown", "link", "draft", "idea",
+                                      "todo", "[[index]]", "#tag", "`code`", "**bold**", "and", "of", "a"};
+        std::string text;
+        while (text.size() < 60) {
+            text += words[next() % 16];
+            text.push_back(' ');
+        }
+        text.back() = '\n';
+        return text;
+    }
+
+    std::string text(size_t size) {
+        std::string out;
+        out.reserve(size + 80);
+        while (out.size() < size) {
+            out += line();
+        }
+        out.resize(size);
+        return out;
+    }
+
+private:
+    uint64_t state_ = 0x9e3779b97f4a7c15;
+
+    uint64_t next() {
+        state_ = state_ * 6364136223846793005 + 1442695040888963407;
+        return state_ >> 33;
+    }
+};
+
+void write_file(const std::filesystem::path& path, const std::string& contents) {
+    std::ofstream file(path, std::ios::binary);
+    file.write(contents.data(), contents.size());
+}
+
+// Every tenth file is a PNG-looking binary, so the sniffer sees both verdicts
+void add_files(Workspace& workspace, const std::filesystem::path& dir, size_t count, TextGenerator& text) {
+    static const std::string binary = std::string("\x89PNG\r\n\x1a\n", 8) + std::string(248, '\0');
+    for (size_t i = 0; i < count; i++) {
+        char name[32];
+        bool is_binary = i % 10 == 9;
+        std::snprintf(name, sizeof(name), is_binary ? "image_%05zu.png" : "note_%05zu.md", i);
+        std::string contents = is_binary ? binary : text.text(256);
+        write_file(dir / name, contents);
+        workspace.files++;
+        workspace.bytes += contents.size();
+    }
+}
+
+// One folder with a lot of files in it
+Workspace make_wide(const std::filesystem::path& root, size_t files) {
+    Workspace workspace{root};
+    TextGenerator text;
+    std::filesystem::create_directories(root);
+    workspace.dirs = 1;
+    add_files(workspace, root, files, text);
+    return workspace;
+}
+
+// A long chain of nested folders with a few files on every level
+Workspace make_deep(const std::filesystem::path& root, size_t depth, size_t files_per_level) {
+    Workspace workspace{root};
+    TextGenerator text;
+    std::filesystem::path dir = root;
+    for (size_t level = 0; level < depth; level++) {
+        std::filesystem::create_directories(dir);
+        workspace.dirs++;
+        add_files(workspace, dir, files_per_level, text);
+        dir /= "level_" + std::to_string(level);
+    }
+    return workspace;
+}
+
+// A realistic big workspace: top folders, each with subfolders full of notes
+Workspace make_many(const std::filesystem::path& root, size_t top, size_t sub, size_t files_per_dir) {
+    Workspace workspace{root};
+    TextGenerator text;
+    for (size_t i = 0; i < top; i++) {
+        for (size_t j = 0; j < sub; j++) {
+            std::filesystem::path dir = root / ("area_" + std::to_string(i)) / ("topic_" + std::to_string(j));
+            std::filesystem::create_directories(dir);
+            workspace.dirs++;
+            add_files(workspace, dir, files_per_dir, text);
+        }
+        workspace.dirs++;
+    }
+    workspace.dirs++;
+    return workspace;
+}
+
+Workspace make_large(const std::filesystem::path& root, size_t size) {
+    Workspace workspace{root};
+    TextGenerator text;
+    std::filesystem::create_directories(root);
+    write_file(root / "large.md", text.text(size));
+    workspace.dirs = 1;
+    workspace.files = 1;
+    workspace.bytes = size;
+    return workspace;
+}
+
+class Bench {
+public:
+    explicit Bench(const Options& options) : options_(options) {}
+
+    // Runs body options.runs times (once if single) and reports items and bytes per second
+    void run(const std::string& name, const std::string& workspace, size_t items, uint64_t bytes,
+             const std::function<void()>& body, bool single = false) {
+        if (!options_.filter.empty() && name.find(options_.filter) == std::string::npos) {
+            return;
+        }
+        std::cerr << "Running " << name << " on " << workspace << "..." << std::endl;
+
+        int runs = single ? 1 : options_.runs;
+        std::vector<double> seconds;
+        for (int i = 0; i < runs; i++) {
+            auto start = std::chrono::steady_clock::now();
+            body();
+            seconds.push_back(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+        }
+        std::sort(seconds.begin(), seconds.end());
+        double median = seconds[seconds.size() / 2];
+
+        char line[512];
+        std::snprintf(line, sizeof(line),
+                      "{\"name\":\"%s\",\"workspace\":\"%s\",\"runs\":%d,\"items\":%zu,\"bytes\":%llu,"
+                      "\"min_s\":%.6f,\"median_s\":%.6f,\"items_per_s\":%.1f,\"mb_per_s\":%.1f}",
+                      name.c_str(), workspace.c_str(), runs, items, static_cast<unsigned long long>(bytes), seconds.front(),
+                      median, median > 0 ? items / median : 0.0, median > 0 ? bytes / median / (1024 * 1024) : 0.0);
+        results_.push_back(line);
+    }
+
+    const std::vector<std::string>& results() const { return results_; }
+
+private:
+    const Options& options_;
+    std::vector<std::string> results_;
+};
+
+// Blocks until a worker's notify callback has fired since the last call
+class Waiter {
+public:
+    std::function<void()> notifier() {
+        return [this]() {
+            std::lock_guard<std::mutex> lock(mutex_);
+            signalled_ = true;
+            cv_.notify_one();
+        };
+    }
+
+    void wait() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cv_.wait(lock, [this] { return signalled_; });
+        signalled_ = false;
+    }
+
+private:
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    bool signalled_ = false;
+};
+
+// Lists every folder through the scanner's worker, the way expanding the whole tree would
+size_t scan_everything(const std::filesystem::path& root) {
+    Waiter waiter;
+    DirScanner scanner;
+    scanner.set_notify(waiter.notifier());
+    size_t outstanding = 1;
+    size_t entries = 0;
+    scanner.request(root);
+    while (outstanding > 0) {
+        waiter.wait();
+        for (const auto& result : scanner.take_results()) {
+            outstanding--;
+            entries += result.entries.size();
+            for (const auto& entry : result.entries) {
+                if (entry.is_directory) {
+                    scanner.request(result.path / entry.name);
+                    outstanding++;
+                }
+            }
+        }
+    }
+    return entries;
+}
+
+std::vector<std::string> all_files(const std::filesystem::path& root) {
+    std::vector<std::string> files;
+    DirScanner::walk_files(root, [&](const std::filesystem::path& path, const struct stat&) {
+        files.push_back(path.string());
+        return true;
+    });
+    return files;
+}
+
+// Streams a file through the loader into a piece table, as a tab does while loading
+PieceTable load_document(const std::string& file_path) {
+    Waiter waiter;
+    FileLoader loader;
+    loader.set_notify(waiter.notifier());
+    PieceTable document;
+    loader.load(file_path);
+    while (true) {
+        while (!loader.has_chunks()) {
+            waiter.wait();
+        }
+        LoadChunk chunk = loader.take_chunk();
+        document.insert(document.size(), chunk.text);
+        if (chunk.done) {
+            return document;
+        }
+    }
+}
+
+// Lists dir into rows as the explorer does: every folder first gets a placeholder, which
+// goes once the folder itself has been listed
+size_t populate_tree(ExplorerRows& rows, const Gtk::TreeModel::Row& parent, const std::filesystem::path& dir, bool recursive) {
+    size_t count = 0;
+    for (const auto& entry : DirScanner::list_directory(dir)) {
+        std::filesystem::path path = dir / entry.name;
+        Gtk::TreeModel::Row row = *rows.append(parent, entry, path.string());
+        count++;
+        if (entry.is_directory && recursive) {
+            count += populate_tree(rows, row, path, true);
+            rows.remove_placeholder(row);
+            row[rows.columns().column_scanned] = true;
+        }
+    }
+    return count;
+}
+
+void snapshot_dirs(const std::filesystem::path& root, const std::filesystem::path& dir, std::vector<SnapshotDir>& dirs) {
+    SnapshotDir snapshot_dir;
+    std::string path = dir.string();
+    snapshot_dir.relative_path = dir == root ? std::string() : path.substr(root.string().size() + 1);
+    snapshot_dir.mtime_ns = 0;
+    snapshot_dir.expanded = true;
+    snapshot_dir.entries = DirScanner::list_directory(dir);
+    std::vector<std::filesystem::path> subfolders;
+    for (const auto& entry : snapshot_dir.entries) {
+        if (entry.is_directory) {
+            subfolders.push_back(dir / entry.name);
+        }
+    }
+    dirs.push_back(std::move(snapshot_dir));
+    for (const auto& subfolder : subfolders) {
+        snapshot_dirs(root, subfolder, dirs);
+    }
+}
+
+bool parse_options(int argc, char* argv[], Options& options) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "--quick") {
+            options.quick = true;
+        } else if (arg == "--keep") {
+            options.keep = true;
+        } else if (arg == "--runs" && has_value) {
+            options.runs = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--filter" && has_value) {
+            options.filter = argv[++i];
+        } else if (arg == "--out" && has_value) {
+            options.out_path = argv[++i];
+        } else if (arg == "--dir" && has_value) {
+            options.dir = argv[++i];
+        } else {
+            std::cerr << "Usage: " << argv[0]
+                      << " [--quick] [--runs N] [--filter substring] [--out file] [--dir scratch-dir] [--keep]" << std::endl;
+            return false;
+        }
+    }
+    if (options.dir.empty()) {
+        options.dir = std::filesystem::temp_directory_path() / ("librenote-bench-" + std::to_string(getpid()));
+    }
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    Options options;
+    if (!parse_options(argc, argv, options)) {
+        return 2;
+    }
+    if (std::filesystem::exists(options.dir) && !std::filesystem::is_empty(options.dir)) {
+        std::cerr << "Scratch directory is not empty: " << options.dir << std::endl;
+        return 1;
+    }
+    Gtk::Main::init_gtkmm_internals();
+
+    std::cerr << "Generating workspaces in " << options.dir << "..." << std::endl;
+    size_t scale = options.quick ? 10 : 1;
+    Workspace wide = make_wide(options.dir / "wide", 20000 / scale);
+    Workspace deep = make_deep(options.dir / "deep", 256, 4);
+    Workspace many = make_many(options.dir / "many", 100 / scale, 10, 100);
+    Workspace large = make_large(options.dir / "large", (options.quick ? 16 : 128) * 1024 * 1024);
+    std::string large_file = (large.root / "large.md").string();
+
+    Bench bench(options);
+
+    bench.run("scan.list_directory", "wide", wide.files, 0, [&]() {
+        DirScanner::list_directory(wide.root);
+    });
+    for (const Workspace* workspace : {&deep, &many}) {
+        const char* name = workspace == &deep ? "deep" : "many";
+        bench.run("scan.walk_files", name, workspace->files, 0, [&]() {
+            all_files(workspace->root);
+        });
+        bench.run("scan.scanner_worker", name, workspace->files + workspace->dirs, 0, [&]() {
+            scan_everything(workspace->root);
+        });
+    }
+
+    // The first pass reads every prefix, later ones only stat thanks to the verdict cache
+    std::vector<std::string> many_files = all_files(many.root);
+
+    // A typical mix: names, extensions, anchored globs and a re-include
+    IgnoreRules rules(many.root);
+    rules.add_rules("node_modules/\nbuild/\n*.png\n!image_00009.png\n/area_1*/\ndocs/**/tmp\n*~\n");
+    bench.run("ignore.walk_files", "many", many.files, 0, [&]() {
+        DirScanner::walk_files(many.root, [](const std::filesystem::path&, const struct stat&) { return true; }, &rules);
+    });
+    bench.run("ignore.match", "many", many_files.size(), 0, [&]() {
+        size_t root_size = many.root.native().size() + 1;
+        for (const auto& file : many_files) {
+            rules.is_ignored_path(std::string_view(file).substr(root_size), false);
+        }
+    });
+
+    // The first export renders everything, after that only changes are
+    std::filesystem::path site_dir = options.dir / "site";
+    auto export_site = [&]() {
+        SiteExporter exporter(many.root, site_dir);
+        ExportStats stats;
+        exporter.run(stats);
+    };
+    bench.run("export.full", "many", many.files, 0, export_site, true);
+    bench.run("export.unchanged", "many", many.files, 0, export_site);
+
+    auto sniff_all = [&]() {
+        for (const auto& file : many_files) {
+            sniff_file(file);
+        }
+    };
+    bench.run("sniff.uncached", "many", many_files.size(), 0, sniff_all, true);
+    bench.run("sniff.cached", "many", many_files.size(), 0, sniff_all);
+    std::string prefix = TextGenerator().text(kSniffPrefixSize);
+    bench.run("sniff.buffer", "8k-text", 10000, 10000 * prefix.size(), [&]() {
+        for (int i = 0; i < 10000; i++) {
+            sniff_buffer(prefix.data(), prefix.size());
+        }
+    });
+
+    bench.run("load.file_loader", "large", 1, large.bytes, [&]() {
+        load_document(large_file);
+    });
+
+    // Includes the fsyncs, so this is durable-write throughput
+    PieceTable document = load_document(large_file);
+    // Both run on the loader thread; validation should be far below read time
+    std::string large_text = document.snapshot().text();
+    size_t valid = 0;
+    bench.run("load.utf8_validate", "large", 1, large_text.size(), [&]() {
+        valid = utf8_valid_length(large_text.data(), large_text.size());
+    });
+    if (valid != large_text.size()) {
+        std::cerr << "Generated text is not valid UTF-8 at " << valid << std::endl;
+    }
+    std::string utf16;
+    std::string encode_error;
+    encode_text(large_text, {Charset::Utf16LE, true}, utf16, encode_error);
+    bench.run("load.decode_utf16", "large", 1, utf16.size(), [&]() {
+        std::string text = utf16;
+        std::string carry;
+        TextDecoder({Charset::Utf16LE, true}).decode(text, carry, true);
+    });
+
+    // A full recount, as a selection of the whole note costs, against typing into its
+    // middle, which should not depend on the note's size
+    bench.run("stats.count_words", "large", 1, large_text.size(), [&]() {
+        DocStats::count_words(large_text);
+    });
+    const size_t keystrokes = 10000;
+    bench.run("stats.typing", "large", keystrokes, 0, [&]() {
+        PieceTable typed;
+        typed.insert(0, large_text);
+        DocStats stats;
+        size_t offset = typed.size() / 2;
+        for (size_t i = 0; i < keystrokes; i++) {
+            std::string key(1, i % 6 == 5 ? ' ' : 'a');
+            stats.insert(typed, offset, key);
+            typed.insert(offset++, key);
+        }
+    });
+    std::string save_path = (large.root / "saved.md").string();
+    bench.run("save.write_atomically", "large", 1, document.size(), [&]() {
+        std::string error;
+        if (!SaveQueue::write_atomically(save_path, document.snapshot(), error)) {
+            std::cerr << "Save failed: " << error << std::endl;
+        }
+    });
+    std::vector<std::string> wide_files = all_files(wide.root);
+    size_t small_saves = std::min<size_t>(wide_files.size(), 200);
+    PieceTable small_document;
+    small_document.insert(0, TextGenerator().text(4096));
+    bench.run("save.queue_small", "wide", small_saves, small_saves * small_document.size(), [&]() {
+        Waiter waiter;
+        SaveQueue queue;
+        queue.set_notify(waiter.notifier());
+        for (size_t i = 0; i < small_saves; i++) {
+            queue.save(wide_files[i], small_document.snapshot(), i);
+        }
+        size_t done = 0;
+        while (done < small_saves) {
+            waiter.wait();
+            done += queue.take_results().size();
+        }
+    });
+
+    // Stand-ins for the explorer's icons, which are loaded from its assets folder
+    Glib::RefPtr<Gdk::Pixbuf> folder_icon = Gdk::Pixbuf::create(Gdk::COLORSPACE_RGB, true, 8, 16, 16);
+    Glib::RefPtr<Gdk::Pixbuf> file_icon = Gdk::Pixbuf::create(Gdk::COLORSPACE_RGB, true, 8, 16, 16);
+    bench.run("tree.populate_folder", "wide", wide.files, 0, [&]() {
+        ExplorerRows rows;
+        rows.set_icons(folder_icon, file_icon);
+        populate_tree(rows, Gtk::TreeModel::Row(), wide.root, false);
+    });
+    bench.run("tree.populate_all", "many", many.files + many.dirs, 0, [&]() {
+        ExplorerRows rows;
+        rows.set_icons(folder_icon, file_icon);
+        populate_tree(rows, Gtk::TreeModel::Row(), many.root, true);
+    });
+
+    std::vector<SnapshotDir> dirs;
+    snapshot_dirs(many.root, many.root, dirs);
+    std::string encoded = encode_tree_snapshot(many.root.string(), dirs);
+    bench.run("tree.snapshot_encode", "many", many.files + many.dirs, encoded.size(), [&]() {
+        encode_tree_snapshot(many.root.string(), dirs);
+    });
+    bench.run("tree.snapshot_decode", "many", many.files + many.dirs, encoded.size(), [&]() {
+        std::vector<SnapshotDir> decoded;
+        decode_tree_snapshot(encoded, many.root.string(), decoded);
+    });
+
+    // One keystroke of quick-open over every path in the workspace
+    Waiter index_waiter;
+    PathIndex path_index;
+    path_index.set_notify(index_waiter.notifier());
+    path_index.open(many.root);
+    while (path_index.size() == 0) {
+        index_waiter.wait();
+    }
+    for (const char* pattern : {"n", "note12", "topic3/nt"}) {
+        bench.run(std::string("quickopen.query.") + pattern, "many", path_index.size(), 0, [&]() {
+            path_index.query(pattern, 50);
+            bool done = false;
+            while (!done) {
+                index_waiter.wait();
+                path_index.results(done);
+            }
+        });
+    }
+
+    if (!options.keep) {
+        std::error_code ec;
+        std::filesystem::remove_all(options.dir, ec);
+    }
+
+    std::ofstream out_file;
+    if (!options.out_path.empty()) {
+        out_file.open(options.out_path);
+        if (!out_file) {
+            std::cerr << "Error opening " << options.out_path << std::endl;
+            return 1;
+        }
+    }
+    std::ostream& out = options.out_path.empty() ? std::cout : out_file;
+    for (const auto& result : bench.results()) {
+        out << result << "\n";
+    }
+    return 0;
+}
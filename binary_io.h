@@ -0,0 +1,47 @@
+#ifndef BINARY_IO_H
+#define BINARY_IO_H
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+// Little helpers for the on-disk caches (link graph, tree snapshot, export manifest).
+// Values are written in host byte order; the caches are local to the machine anyway.
+
+inline void put_u32(std::string& out, uint32_t value) {
+    out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+inline void put_u64(std::string& out, uint64_t value) {
+    out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+// Length-prefixed
+inline void put_string(std::string& out, std::string_view value) {
+    put_u32(out, static_cast<uint32_t>(value.size()));
+    out.append(value.data(), value.size());
+}
+
+// Reads a T at pos and advances past it; false, leaving value alone, if data ends first
+template <typename T>
+bool get(std::string_view data, size_t& pos, T& value) {
+    if (data.size() - pos < sizeof(T)) {
+        return false;
+    }
+    std::memcpy(&value, data.data() + pos, sizeof(T));
+    pos += sizeof(T);
+    return true;
+}
+
+inline bool get_string(std::string_view data, size_t& pos, std::string& value) {
+    uint32_t len;
+    if (!get(data, pos, len) || data.size() - pos < len) {
+        return false;
+    }
+    value.assign(data.data() + pos, len);
+    pos += len;
+    return true;
+}
+
+#endif // BINARY_IO_H
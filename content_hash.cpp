@@ -0,0 +1,127 @@
+#include "content_hash.h"
+
+#include <cstring>
+
+namespace {
+
+const uint64_t kPrime1 = 0x9e3779b185ebca87ULL;
+const uint64_t kPrime2 = 0xc2b2ae3d27d4eb4fULL;
+const uint64_t kPrime3 = 0x165667b19e3779f9ULL;
+const uint64_t kPrime4 = 0x85ebca77c2b2ae63ULL;
+const uint64_t kPrime5 = 0x27d4eb2f165667c5ULL;
+
+inline uint64_t rotl(uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+// Little-endian loads; memcpy compiles to a plain move
+inline uint64_t read64(const unsigned char* p) {
+    uint64_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+inline uint32_t read32(const unsigned char* p) {
+    uint32_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+inline uint64_t round(uint64_t acc, uint64_t input) {
+    acc += input * kPrime2;
+    acc = rotl(acc, 31);
+    return acc * kPrime1;
+}
+
+inline uint64_t merge_round(uint64_t acc, uint64_t value) {
+    acc ^= round(0, value);
+    return acc * kPrime1 + kPrime4;
+}
+
+} // namespace
+
+ContentHash::ContentHash(uint64_t seed) : seed_(seed) {
+    acc_[0] = seed + kPrime1 + kPrime2;
+    acc_[1] = seed + kPrime2;
+    acc_[2] = seed;
+    acc_[3] = seed - kPrime1;
+}
+
+void ContentHash::update(const void* data, size_t len) {
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+    const unsigned char* end = p + len;
+    total_ += len;
+
+    if (buffered_ + len < sizeof(buffer_)) {
+        std::memcpy(buffer_ + buffered_, p, len);
+        buffered_ += len;
+        return;
+    }
+    if (buffered_ > 0) {
+        size_t fill = sizeof(buffer_) - buffered_;
+        std::memcpy(buffer_ + buffered_, p, fill);
+        p += fill;
+        for (int i = 0; i < 4; i++) {
+            acc_[i] = round(acc_[i], read64(buffer_ + i * 8));
+        }
+        buffered_ = 0;
+    }
+
+    // Four independent lanes, so the multiplies overlap
+    uint64_t a0 = acc_[0], a1 = acc_[1], a2 = acc_[2], a3 = acc_[3];
+    for (; p + 32 <= end; p += 32) {
+        a0 = round(a0, read64(p));
+        a1 = round(a1, read64(p + 8));
+        a2 = round(a2, read64(p + 16));
+        a3 = round(a3, read64(p + 24));
+    }
+    acc_[0] = a0;
+    acc_[1] = a1;
+    acc_[2] = a2;
+    acc_[3] = a3;
+
+    buffered_ = end - p;
+    std::memcpy(buffer_, p, buffered_);
+}
+
+uint64_t ContentHash::digest() const {
+    uint64_t h;
+    if (total_ >= sizeof(buffer_)) {
+        h = rotl(acc_[0], 1) + rotl(acc_[1], 7) + rotl(acc_[2], 12) + rotl(acc_[3], 18);
+        for (int i = 0; i < 4; i++) {
+            h = merge_round(h, acc_[i]);
+        }
+    } else {
+        h = seed_ + kPrime5;
+    }
+    h += total_;
+
+    const unsigned char* p = buffer_;
+    const unsigned char* end = buffer_ + buffered_;
+    for (; p + 8 <= end; p += 8) {
+        h ^= round(0, read64(p));
+        h = rotl(h, 27) * kPrime1 + kPrime4;
+    }
+    if (p + 4 <= end) {
+        h ^= static_cast<uint64_t>(read32(p)) * kPrime1;
+        h = rotl(h, 23) * kPrime2 + kPrime3;
+        p += 4;
+    }
+    for (; p < end; p++) {
+        h ^= *p * kPrime5;
+        h = rotl(h, 11) * kPrime1;
+    }
+
+    h ^= h >> 33;
+    h *= kPrime2;
+    h ^= h >> 29;
+    h *= kPrime3;
+    h ^= h >> 32;
+    return h;
+}
+
+uint64_t ContentHash::hash(const void* data, size_t len, uint64_t seed) {
+    ContentHash hasher(seed);
+    hasher.update(data, len);
+    return hasher.digest();
+}
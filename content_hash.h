@@ -0,0 +1,27 @@
+#ifndef CONTENT_HASH_H
+#define CONTENT_HASH_H
+
+#include <cstddef>
+#include <cstdint>
+
+// XXH64, fed incrementally so files can be hashed while they stream in or out. Only
+// used to tell whether a file's bytes changed, never for anything adversarial.
+class ContentHash {
+public:
+    explicit ContentHash(uint64_t seed = 0);
+
+    void update(const void* data, size_t len);
+    uint64_t digest() const;
+
+    static uint64_t hash(const void* data, size_t len, uint64_t seed = 0);
+
+private:
+    uint64_t seed_;
+    uint64_t acc_[4];
+    uint64_t total_ = 0;
+    // Input that doesn't fill a 32-byte stripe yet
+    unsigned char buffer_[32];
+    size_t buffered_ = 0;
+};
+
+#endif // CONTENT_HASH_H
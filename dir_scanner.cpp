@@ -0,0 +1,165 @@
+#include "dir_scanner.h"
+
+#include <algorithm>
+
+#include "trace.h"
+
+DirScanner::DirScanner() : worker_(&DirScanner::run, this) {}
+
+DirScanner::~DirScanner() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    cv_.notify_all();
+    worker_.join();
+}
+
+uint64_t DirScanner::request(const std::filesystem::path& path, int64_t known_mtime_ns) {
+    uint64_t id;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        id = next_id_++;
+        requests_.push_back({id, path, known_mtime_ns});
+    }
+    cv_.notify_one();
+    return id;
+}
+
+std::vector<ScanResult> DirScanner::take_results() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<ScanResult> results;
+    results.swap(results_);
+    return results;
+}
+
+void DirScanner::set_notify(std::function<void()> notify) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    notify_ = std::move(notify);
+}
+
+void DirScanner::set_ignore_rules(std::shared_ptr<const IgnoreRules> rules) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    rules_ = std::move(rules);
+}
+
+std::vector<DirEntry> DirScanner::list_directory(const std::filesystem::path& path, const IgnoreRules* rules, size_t* pruned) {
+    std::vector<DirEntry> entries;
+    std::error_code ec;
+    std::filesystem::directory_iterator it(path, ec);
+    if (ec) {
+        return entries;
+    }
+
+    // Entries are matched by their path below the rules' root, built in one buffer
+    std::string relative;
+    if (rules) {
+        const std::string& root = rules->root().native();
+        const std::string& dir = path.native();
+        if (dir.compare(0, root.size(), root) != 0 || (dir.size() > root.size() && dir[root.size()] != '/')) {
+            rules = nullptr;
+        } else if (dir.size() > root.size() + 1) {
+            relative = dir.substr(root.size() + 1);
+            if (relative.back() != '/') {
+                relative += '/';
+            }
+        }
+    }
+    size_t prefix = relative.size();
+
+    for (; it != std::filesystem::directory_iterator(); it.increment(ec)) {
+        if (ec) {
+            break;
+        }
+        std::error_code type_ec;
+        bool is_dir = it->is_directory(type_ec);
+        if (!is_dir && !it->is_regular_file(type_ec)) {
+            continue;
+        }
+        std::string name = it->path().filename().string();
+        if (rules) {
+            relative.resize(prefix);
+            relative += name;
+            if (rules->is_ignored(relative, is_dir)) {
+                if (pruned) {
+                    (*pruned)++;
+                }
+                continue;
+            }
+        }
+        entries.push_back({std::move(name), is_dir});
+    }
+
+    std::sort(entries.begin(), entries.end(), [](const DirEntry& a, const DirEntry& b) {
+        if (a.is_directory != b.is_directory) {
+            return a.is_directory;
+        }
+        return a.name < b.name;
+    });
+    return entries;
+}
+
+size_t DirScanner::walk_files(const std::filesystem::path& root,
+                              const std::function<bool(const std::filesystem::path&, const struct stat&)>& visit,
+                              const IgnoreRules* rules) {
+    size_t pruned = 0;
+    std::vector<std::filesystem::path> dirs{root};
+    while (!dirs.empty()) {
+        std::filesystem::path dir = std::move(dirs.back());
+        dirs.pop_back();
+
+        for (const auto& entry : list_directory(dir, rules, &pruned)) {
+            std::filesystem::path path = dir / entry.name;
+            struct stat st {};
+            if (lstat(path.c_str(), &st) != 0) {
+                continue;
+            }
+            if (S_ISDIR(st.st_mode)) {
+                dirs.push_back(path);
+            } else if (S_ISREG(st.st_mode) && !visit(path, st)) {
+                return pruned;
+            }
+        }
+    }
+    return pruned;
+}
+
+void DirScanner::run() {
+    Tracer::set_thread_name("DirScanner");
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        cv_.wait(lock, [this] { return stop_ || !requests_.empty(); });
+        if (stop_) {
+            return;
+        }
+
+        Request request = std::move(requests_.front());
+        requests_.pop_front();
+        std::shared_ptr<const IgnoreRules> rules = rules_;
+
+        lock.unlock();
+        ScanResult result;
+        result.id = request.id;
+        result.path = request.path;
+        struct stat st {};
+        if (stat(request.path.c_str(), &st) == 0) {
+            result.mtime_ns = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+        }
+        // Anything created while listing moves the mtime past the one recorded here
+        result.unchanged = request.known_mtime_ns >= 0 && request.known_mtime_ns == result.mtime_ns;
+        if (!result.unchanged) {
+            TRACE_SCOPE("List directory", request.path.string());
+            result.entries = list_directory(request.path, rules.get(), &result.pruned);
+            if (result.pruned > 0 && Tracer::enabled()) {
+                uint64_t now = Tracer::now_ns();
+                Tracer::record("Pruned ignored entries", now, now, std::to_string(result.pruned) + " in " + request.path.string());
+            }
+        }
+        lock.lock();
+
+        results_.push_back(std::move(result));
+        if (notify_) {
+            notify_();
+        }
+    }
+}
@@ -0,0 +1,81 @@
+#ifndef DIR_SCANNER_H
+#define DIR_SCANNER_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <sys/stat.h>
+#include <thread>
+#include <vector>
+
+#include "ignore_rules.h"
+
+struct DirEntry {
+    std::string name;
+    bool is_directory = false;
+};
+
+struct ScanResult {
+    uint64_t id = 0;
+    std::filesystem::path path;
+    std::vector<DirEntry> entries;
+    // Of the directory itself, taken before listing it
+    int64_t mtime_ns = 0;
+    // The directory still had the mtime the request asked about, so it wasn't listed
+    bool unchanged = false;
+    // Entries left out by the ignore rules
+    size_t pruned = 0;
+};
+
+// Lists directories on a worker thread so the UI never blocks on the filesystem.
+// Requests are served in order; finished listings are picked up with take_results()
+// after the notify callback fires (from the worker thread).
+class DirScanner {
+public:
+    DirScanner();
+    ~DirScanner();
+
+    // With known_mtime_ns set, the directory is only listed if its mtime differs
+    uint64_t request(const std::filesystem::path& path, int64_t known_mtime_ns = -1);
+    std::vector<ScanResult> take_results();
+    void set_notify(std::function<void()> notify);
+    // Applied to every listing requested afterwards
+    void set_ignore_rules(std::shared_ptr<const IgnoreRules> rules);
+
+    // Directories first, then files, each sorted by name. Entries the rules ignore are
+    // left out and counted in pruned.
+    static std::vector<DirEntry> list_directory(const std::filesystem::path& path, const IgnoreRules* rules = nullptr,
+                                                size_t* pruned = nullptr);
+    // Calls visit for every regular file below root. Symlinked folders aren't followed
+    // and folders the rules ignore (VCS data and our own state, by default) are never
+    // opened. Stops once visit returns false. Returns how many entries the rules pruned.
+    static size_t walk_files(const std::filesystem::path& root,
+                             const std::function<bool(const std::filesystem::path&, const struct stat&)>& visit,
+                             const IgnoreRules* rules = nullptr);
+
+private:
+    struct Request {
+        uint64_t id;
+        std::filesystem::path path;
+        int64_t known_mtime_ns;
+    };
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::deque<Request> requests_;
+    std::vector<ScanResult> results_;
+    std::function<void()> notify_;
+    std::shared_ptr<const IgnoreRules> rules_;
+    uint64_t next_id_ = 1;
+    bool stop_ = false;
+    std::thread worker_;
+
+    void run();
+};
+
+#endif // DIR_SCANNER_H
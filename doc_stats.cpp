@@ -0,0 +1,83 @@
+#include "doc_stats.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+inline bool is_word_byte(unsigned char c) {
+    return c != ' ' && (c < '\t' || c > '\r');
+}
+
+// Whether the byte just before offset ends a word
+bool word_before(const PieceTable& document, size_t offset) {
+    return offset > 0 && is_word_byte(document.substr(offset - 1, 1)[0]);
+}
+
+// Whether the byte at offset starts one
+bool word_at(const PieceTable& document, size_t offset) {
+    return offset < document.size() && is_word_byte(document.substr(offset, 1)[0]);
+}
+
+} // namespace
+
+// Counts the places where a word byte follows a non-word byte
+size_t DocStats::count_words(std::string_view text) {
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(text.data());
+    size_t len = text.size();
+    size_t words = 0;
+    size_t i = 0;
+    bool in_word = false;
+#ifdef __SSE2__
+    const __m128i space = _mm_set1_epi8(' ');
+    // Bytes 0x09-0x0d, shifted down to 0-4 and compared as signed
+    const __m128i control_base = _mm_set1_epi8('\t');
+    const __m128i control_max = _mm_set1_epi8('\r' - '\t' + 1);
+    const __m128i minus_one = _mm_set1_epi8(-1);
+    for (; i + 16 <= len; i += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i));
+        __m128i shifted = _mm_sub_epi8(v, control_base);
+        __m128i control = _mm_and_si128(_mm_cmpgt_epi8(shifted, minus_one),
+                                        _mm_cmplt_epi8(shifted, control_max));
+        __m128i blank = _mm_or_si128(_mm_cmpeq_epi8(v, space), control);
+        unsigned word = ~static_cast<unsigned>(_mm_movemask_epi8(blank)) & 0xffff;
+        unsigned starts = word & ~((word << 1) | (in_word ? 1u : 0u));
+        words += __builtin_popcount(starts);
+        in_word = word & 0x8000;
+    }
+#endif
+    for (; i < len; i++) {
+        bool word = is_word_byte(p[i]);
+        words += word && !in_word;
+        in_word = word;
+    }
+    return words;
+}
+
+// Splitting the document at offset and putting text in between: text's words are
+// added, less one for each side it glues onto an existing word, plus one if it splits
+// a word in two
+void DocStats::insert(const PieceTable& document, size_t offset, std::string_view text) {
+    if (text.empty()) {
+        return;
+    }
+    bool before = word_before(document, offset);
+    bool after = word_at(document, offset);
+    size_t words = words_ + count_words(text) + (before && after);
+    words -= before && is_word_byte(text.front());
+    words -= after && is_word_byte(text.back());
+    words_ = words;
+}
+
+// The reverse of insert, with the bytes around the erased range
+void DocStats::erase(const PieceTable& document, size_t offset, std::string_view erased) {
+    if (erased.empty()) {
+        return;
+    }
+    bool before = word_before(document, offset);
+    bool after = word_at(document, offset + erased.size());
+    size_t words = words_ + (before && is_word_byte(erased.front())) + (after && is_word_byte(erased.back()));
+    words -= count_words(erased) + (before && after);
+    words_ = words;
+}
@@ -0,0 +1,31 @@
+#ifndef DOC_STATS_H
+#define DOC_STATS_H
+
+#include <cstddef>
+#include <string_view>
+
+#include "piece_table.h"
+
+// Word count of a document, kept up to date from its edits instead of recounting.
+// A word is a run of anything but ASCII whitespace, as with wc -w. An edit only
+// recounts the text it inserts or removes and looks at the byte on either side of it
+// to tell whether words were split or joined, so typing costs the same in any size of
+// note. Character and line counts come from the piece table, which tracks them already.
+class DocStats {
+public:
+    // Both go before the edit is applied to document; offsets are in bytes
+    void insert(const PieceTable& document, size_t offset, std::string_view text);
+    void erase(const PieceTable& document, size_t offset, std::string_view erased);
+    void clear() { words_ = 0; }
+
+    size_t words() const { return words_; }
+
+    static size_t count_words(std::string_view text);
+    // At 200 words a minute, rounded up
+    static size_t reading_minutes(size_t words) { return (words + 199) / 200; }
+
+private:
+    size_t words_ = 0;
+};
+
+#endif // DOC_STATS_H
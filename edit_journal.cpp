@@ -0,0 +1,410 @@
+#include "edit_journal.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "save_queue.h"
+
+namespace {
+
+enum RecordType : uint8_t {
+    kOpen = 1,       // u64 size, i64 mtime_ns, path: the on-disk base the edits apply to
+    kInsert = 2,     // u64 offset, text
+    kDelete = 3,     // u64 offset, u64 count
+    kCheckpoint = 4, // u64 checkpoint
+    kSaved = 5,      // u64 checkpoint, u64 size, i64 mtime_ns
+    kClean = 6,      // no payload
+};
+
+const size_t kRecordHeaderSize = 1 + 4 + 4;
+const size_t kCompactThreshold = 256 * 1024;
+// FileLoader guesses the encoding from its first read; look at as much for the same guess
+const size_t kDetectSampleSize = 1024 * 1024;
+
+struct Record {
+    uint8_t type;
+    uint32_t id;
+    std::string payload;
+};
+
+struct ReplayFile {
+    std::string path;
+    uint64_t size = 0;
+    int64_t mtime_ns = 0;
+    std::vector<Record> ops;
+};
+
+template <typename T>
+void put(std::string& out, T value) {
+    out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+template <typename T>
+T get(const std::string& in, size_t offset) {
+    T value{};
+    if (offset + sizeof(T) <= in.size()) {
+        std::memcpy(&value, in.data() + offset, sizeof(T));
+    }
+    return value;
+}
+
+void encode(std::string& out, uint8_t type, uint32_t id, const std::string& payload) {
+    put<uint8_t>(out, type);
+    put<uint32_t>(out, id);
+    put<uint32_t>(out, static_cast<uint32_t>(payload.size()));
+    out += payload;
+}
+
+bool stat_file(const std::string& file_path, uint64_t& size, int64_t& mtime_ns) {
+    struct stat st {};
+    if (stat(file_path.c_str(), &st) != 0) {
+        return false;
+    }
+    size = st.st_size;
+    mtime_ns = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+    return true;
+}
+
+std::string open_payload(const std::string& file_path) {
+    uint64_t size = 0;
+    int64_t mtime_ns = 0;
+    stat_file(file_path, size, mtime_ns);
+    std::string payload;
+    put(payload, size);
+    put(payload, mtime_ns);
+    payload += file_path;
+    return payload;
+}
+
+// Stops at the first incomplete record: a crash can only ever tear the tail
+std::vector<Record> read_records(const std::string& journal_path) {
+    std::ifstream file(journal_path, std::ios::binary);
+    std::string data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+    std::vector<Record> records;
+    size_t offset = 0;
+    while (offset + kRecordHeaderSize <= data.size()) {
+        uint8_t type = get<uint8_t>(data, offset);
+        uint32_t id = get<uint32_t>(data, offset + 1);
+        uint32_t len = get<uint32_t>(data, offset + 5);
+        if (offset + kRecordHeaderSize + len > data.size()) {
+            break;
+        }
+        records.push_back({type, id, data.substr(offset + kRecordHeaderSize, len)});
+        offset += kRecordHeaderSize + len;
+    }
+    return records;
+}
+
+// Folds the log into the edits still outstanding for each file
+std::map<uint32_t, ReplayFile> replay(const std::vector<Record>& records) {
+    std::map<uint32_t, ReplayFile> files;
+    for (const auto& record : records) {
+        switch (record.type) {
+            case kOpen: {
+                ReplayFile& file = files[record.id];
+                file.size = get<uint64_t>(record.payload, 0);
+                file.mtime_ns = get<int64_t>(record.payload, 8);
+                file.path = record.payload.size() > 16 ? record.payload.substr(16) : std::string();
+                file.ops.clear();
+                break;
+            }
+            case kInsert:
+            case kDelete:
+            case kCheckpoint:
+                files[record.id].ops.push_back(record);
+                break;
+            case kSaved: {
+                ReplayFile& file = files[record.id];
+                uint64_t checkpoint = get<uint64_t>(record.payload, 0);
+                for (size_t i = 0; i < file.ops.size(); i++) {
+                    if (file.ops[i].type == kCheckpoint && get<uint64_t>(file.ops[i].payload, 0) == checkpoint) {
+                        file.ops.erase(file.ops.begin(), file.ops.begin() + i + 1);
+                        file.size = get<uint64_t>(record.payload, 8);
+                        file.mtime_ns = get<int64_t>(record.payload, 16);
+                        break;
+                    }
+                }
+                break;
+            }
+            case kClean:
+                files[record.id].ops.clear();
+                break;
+        }
+    }
+
+    for (auto it = files.begin(); it != files.end();) {
+        bool has_edits = false;
+        for (const auto& op : it->second.ops) {
+            has_edits |= op.type != kCheckpoint;
+        }
+        it = has_edits && !it->second.path.empty() ? std::next(it) : files.erase(it);
+    }
+    return files;
+}
+
+// Maps character offsets to byte offsets, walking from the previous position since
+// consecutive edits are usually close to each other.
+class Utf8Cursor {
+public:
+    explicit Utf8Cursor(const std::string& text) : text_(text) {}
+
+    size_t byte_offset(size_t char_offset) {
+        while (char_pos_ > char_offset && byte_pos_ > 0) {
+            byte_pos_--;
+            while (byte_pos_ > 0 && (static_cast<unsigned char>(text_[byte_pos_]) & 0xc0) == 0x80) {
+                byte_pos_--;
+            }
+            char_pos_--;
+        }
+        while (char_pos_ < char_offset && byte_pos_ < text_.size()) {
+            byte_pos_++;
+            while (byte_pos_ < text_.size() && (static_cast<unsigned char>(text_[byte_pos_]) & 0xc0) == 0x80) {
+                byte_pos_++;
+            }
+            char_pos_++;
+        }
+        return byte_pos_;
+    }
+
+    // Text before char_offset is unchanged by an edit there, so the position stays valid
+    void set(size_t char_offset, size_t byte_offset) {
+        char_pos_ = char_offset;
+        byte_pos_ = byte_offset;
+    }
+
+private:
+    const std::string& text_;
+    size_t char_pos_ = 0;
+    size_t byte_pos_ = 0;
+};
+
+} // namespace
+
+EditJournal::~EditJournal() {
+    flush();
+    if (fd_ >= 0) {
+        close(fd_);
+    }
+}
+
+std::vector<RecoveredFile> EditJournal::open(const std::string& journal_path) {
+    path_ = journal_path;
+    std::error_code ec;
+    std::filesystem::create_directories(std::filesystem::path(path_).parent_path(), ec);
+
+    std::vector<RecoveredFile> recovered;
+    std::map<uint32_t, ReplayFile> files = replay(read_records(path_));
+    for (auto it = files.begin(); it != files.end();) {
+        ReplayFile& file = it->second;
+        uint64_t size = 0;
+        int64_t mtime_ns = 0;
+        if (!stat_file(file.path, size, mtime_ns) || size != file.size || mtime_ns != file.mtime_ns) {
+            // The file changed on disk since, the offsets no longer apply to it
+            it = files.erase(it);
+            continue;
+        }
+
+        std::ifstream in(file.path, std::ios::binary);
+        std::string text((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        // The offsets count characters of the text the editor had, so decode it the same way
+        TextEncoding encoding = detect_encoding(text.data(), std::min(text.size(), kDetectSampleSize));
+        TextDecoder decoder(encoding);
+        std::string carry;
+        decoder.decode(text, carry, true);
+        Utf8Cursor cursor(text);
+        for (const auto& op : file.ops) {
+            if (op.type == kCheckpoint) {
+                continue;
+            }
+            uint64_t start = get<uint64_t>(op.payload, 0);
+            size_t offset = cursor.byte_offset(start);
+            if (op.type == kInsert) {
+                text.insert(offset, op.payload, 8, std::string::npos);
+            } else {
+                size_t end = cursor.byte_offset(start + get<uint64_t>(op.payload, 8));
+                text.erase(offset, end - offset);
+            }
+            cursor.set(start, offset);
+        }
+        recovered.push_back({file.path, std::move(text), encoding});
+        ++it;
+    }
+
+    for (const auto& [id, file] : files) {
+        files_[file.path] = {id, true};
+        next_id_ = std::max(next_id_, id + 1);
+        for (const auto& op : file.ops) {
+            if (op.type == kCheckpoint) {
+                next_checkpoint_ = std::max(next_checkpoint_, get<uint64_t>(op.payload, 0) + 1);
+            }
+        }
+    }
+    compact();
+    return recovered;
+}
+
+void EditJournal::record_insert(const std::string& file_path, size_t offset, const std::string& text) {
+    std::string payload;
+    put<uint64_t>(payload, offset);
+    payload += text;
+    append(kInsert, file_state(file_path), payload);
+}
+
+void EditJournal::record_delete(const std::string& file_path, size_t offset, size_t count) {
+    std::string payload;
+    put<uint64_t>(payload, offset);
+    put<uint64_t>(payload, count);
+    append(kDelete, file_state(file_path), payload);
+}
+
+uint64_t EditJournal::checkpoint(const std::string& file_path) {
+    auto it = files_.find(file_path);
+    if (it == files_.end() || !it->second.dirty) {
+        return 0;
+    }
+
+    uint64_t checkpoint = next_checkpoint_++;
+    std::string payload;
+    put<uint64_t>(payload, checkpoint);
+    append(kCheckpoint, it->second, payload);
+    it->second.last_checkpoint = checkpoint;
+    it->second.edited_since_checkpoint = false;
+    return checkpoint;
+}
+
+void EditJournal::mark_saved(const std::string& file_path, uint64_t checkpoint) {
+    auto it = files_.find(file_path);
+    if (checkpoint == 0 || it == files_.end() || !it->second.dirty) {
+        return;
+    }
+
+    uint64_t size = 0;
+    int64_t mtime_ns = 0;
+    stat_file(file_path, size, mtime_ns);
+    std::string payload;
+    put<uint64_t>(payload, checkpoint);
+    put<uint64_t>(payload, size);
+    put<int64_t>(payload, mtime_ns);
+    append(kSaved, it->second, payload);
+
+    FileState& state = it->second;
+    if (state.last_checkpoint == checkpoint && !state.edited_since_checkpoint) {
+        state.dirty = false;
+        obsolete_bytes_ += state.live_bytes;
+        state.live_bytes = 0;
+    }
+}
+
+void EditJournal::discard(const std::string& file_path) {
+    auto it = files_.find(file_path);
+    if (it == files_.end() || !it->second.dirty) {
+        return;
+    }
+
+    append(kClean, it->second, std::string());
+    it->second.dirty = false;
+    obsolete_bytes_ += it->second.live_bytes;
+    it->second.live_bytes = 0;
+}
+
+void EditJournal::flush() {
+    if (fd_ < 0 || pending_.empty()) {
+        return;
+    }
+
+    write_pending();
+    fdatasync(fd_);
+
+    if (obsolete_bytes_ > kCompactThreshold && obsolete_bytes_ * 2 > journal_bytes_) {
+        compact();
+    }
+}
+
+void EditJournal::write_pending() {
+    const char* data = pending_.data();
+    size_t len = pending_.size();
+    while (len > 0) {
+        ssize_t n = write(fd_, data, len);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        data += n;
+        len -= n;
+    }
+    pending_.clear();
+}
+
+EditJournal::FileState& EditJournal::file_state(const std::string& file_path) {
+    auto it = files_.find(file_path);
+    if (it == files_.end()) {
+        it = files_.emplace(file_path, FileState{next_id_++}).first;
+    }
+
+    FileState& state = it->second;
+    if (!state.dirty) {
+        // First edit since the file was last clean: remember what the edits apply to
+        state.dirty = true;
+        append(kOpen, state, open_payload(file_path));
+    }
+    state.edited_since_checkpoint = true;
+    return state;
+}
+
+void EditJournal::append(uint8_t type, FileState& state, const std::string& payload) {
+    size_t before = pending_.size();
+    encode(pending_, type, state.id, payload);
+    size_t bytes = pending_.size() - before;
+    state.live_bytes += bytes;
+    journal_bytes_ += bytes;
+}
+
+// Rewrites the journal with only the edits that are still unsaved
+void EditJournal::compact() {
+    if (fd_ >= 0) {
+        write_pending();
+        close(fd_);
+        fd_ = -1;
+    }
+
+    std::map<uint32_t, ReplayFile> files = replay(read_records(path_));
+    std::string out;
+    for (auto& [path, state] : files_) {
+        state.live_bytes = 0;
+    }
+    for (const auto& [id, file] : files) {
+        auto state = files_.find(file.path);
+        if (state == files_.end() || !state->second.dirty) {
+            continue;
+        }
+
+        size_t before = out.size();
+        std::string payload;
+        put(payload, file.size);
+        put(payload, file.mtime_ns);
+        payload += file.path;
+        encode(out, kOpen, id, payload);
+        for (const auto& op : file.ops) {
+            encode(out, op.type, id, op.payload);
+        }
+        state->second.live_bytes = out.size() - before;
+    }
+
+    std::string error;
+    SaveQueue::write_atomically(path_, out, error);
+    journal_bytes_ = out.size();
+    obsolete_bytes_ = 0;
+
+    fd_ = ::open(path_.c_str(), O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0600);
+}
@@ -0,0 +1,70 @@
+#ifndef EDIT_JOURNAL_H
+#define EDIT_JOURNAL_H
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "text_encoding.h"
+
+struct RecoveredFile {
+    std::string file_path;
+    // UTF-8, like the buffer it goes back into
+    std::string text;
+    // What the file on disk is stored as, for saving the text back
+    TextEncoding encoding;
+};
+
+// Append-only log of the edits made to open files since they were last saved. Each
+// record only carries the edit itself (offset plus inserted text or deleted length), so
+// journaling costs the size of the edit, not of the document. On startup the edits of
+// files that were never saved are replayed on top of the on-disk contents.
+//
+// Offsets are in characters of the decoded text, like Gtk::TextIter offsets.
+class EditJournal {
+public:
+    EditJournal() = default;
+    ~EditJournal();
+
+    // Loads the journal at journal_path, returns the unsaved files it describes and
+    // starts a fresh, compacted journal that keeps tracking them.
+    std::vector<RecoveredFile> open(const std::string& journal_path);
+
+    void record_insert(const std::string& file_path, size_t offset, const std::string& text);
+    void record_delete(const std::string& file_path, size_t offset, size_t count);
+    // Marks the point a save snapshot was taken; pass the id to mark_saved() once the
+    // write succeeded, everything before it is then obsolete.
+    uint64_t checkpoint(const std::string& file_path);
+    void mark_saved(const std::string& file_path, uint64_t checkpoint);
+    // The edits were thrown away (tab closed without saving)
+    void discard(const std::string& file_path);
+
+    // Writes buffered records out and compacts the journal once enough of it is obsolete
+    void flush();
+
+private:
+    struct FileState {
+        uint32_t id;
+        bool dirty = false;
+        size_t live_bytes = 0;
+        uint64_t last_checkpoint = 0;
+        bool edited_since_checkpoint = false;
+    };
+
+    std::string path_;
+    int fd_ = -1;
+    std::string pending_;
+    std::unordered_map<std::string, FileState> files_;
+    uint32_t next_id_ = 1;
+    uint64_t next_checkpoint_ = 1;
+    size_t journal_bytes_ = 0;
+    size_t obsolete_bytes_ = 0;
+
+    FileState& file_state(const std::string& file_path);
+    void append(uint8_t type, FileState& state, const std::string& payload);
+    void write_pending();
+    void compact();
+};
+
+#endif // EDIT_JOURNAL_H
@@ -1,63 +1,364 @@
 #include "editor.h"
-#include <fstream>
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
 #include <iostream>
 #include <gtkmm/messagedialog.h>
 #include <gtkmm/cssprovider.h>
 #include <gtkmm/scrolledwindow.h>
+#include <glibmm/main.h>
 
+#include "trace.h"
 #include "util.h"
 
+// Files at least this big open in a read-only LargeFileView instead of a TextView
+static const uintmax_t kLargeFileSize = 32 * 1024 * 1024;
+
 Editor::Editor() : Gtk::Box(Gtk::ORIENTATION_VERTICAL) {
     pack_start(notebook_, Gtk::PACK_EXPAND_WIDGET);
+    statsLabel_.set_halign(Gtk::ALIGN_END);
+    statsLabel_.set_margin_end(5);
+    pack_start(statsLabel_, Gtk::PACK_SHRINK);
     notebook_.signal_switch_page().connect(sigc::mem_fun(*this, &Editor::on_switch_page));
     show_all_children();
 
     add_events(Gdk::KEY_PRESS_MASK);
     set_font_size(14);
+
+    loadDispatcher_.connect(sigc::mem_fun(*this, &Editor::on_load_ready));
+    loader_.set_notify([this]() { loadDispatcher_.emit(); });
+
+    saveDispatcher_.connect(sigc::mem_fun(*this, &Editor::on_save_done));
+    saveQueue_.set_notify([this]() { saveDispatcher_.emit(); });
+
+    reloadDispatcher_.connect(sigc::mem_fun(*this, &Editor::on_reload_ready));
+    reloadChecker_.set_notify([this]() { reloadDispatcher_.emit(); });
+    if (monitor_.fd() >= 0) {
+        monitorIo_ = Glib::signal_io().connect(sigc::mem_fun(*this, &Editor::on_monitor_event), monitor_.fd(), Glib::IO_IN);
+    }
+
+    std::filesystem::path journal_path = std::filesystem::current_path() / ".librenote" / "journal";
+    for (auto& file : journal_.open(journal_path.string())) {
+        std::string file_path = file.file_path;
+        recovered_[file_path] = std::move(file);
+    }
+    // Tabs are opened once the editor is in its window, which error dialogs need as parent
+    recoverIdle_ = Glib::signal_idle().connect([this]() {
+        std::vector<std::string> paths;
+        for (const auto& [file_path, file] : recovered_) {
+            paths.push_back(file_path);
+        }
+        std::sort(paths.begin(), paths.end());
+        for (const auto& file_path : paths) {
+            open_new_tab(file_path);
+        }
+        return false;
+    });
+    journalFlush_ = Glib::signal_timeout().connect_seconds([this]() {
+        journal_.flush();
+        return true;
+    }, 1);
 }
 
 // Destructor
-Editor::~Editor() = default;
+Editor::~Editor() {
+    loadIdle_.disconnect();
+    recoverIdle_.disconnect();
+    journalFlush_.disconnect();
+    monitorIo_.disconnect();
+}
 
+void Editor::set_autosave(bool enabled) {
+    autosave_ = enabled;
+}
+
+void Editor::set_undo_limits(size_t per_tab, size_t total) {
+    undoTabLimit_ = per_tab;
+    for (auto& [page, tab] : tabs_) {
+        tab.history->set_limit(per_tab);
+    }
+    undoBudget_.set_limit(total);
+}
+
+void Editor::set_memory_budget(size_t bytes) {
+    memoryBudget_ = bytes;
+    enforce_memory_budget(current_tab());
+}
+
+Tab* Editor::find_tab(const std::string& file_path) {
+    auto page = tabsByPath_.find(file_path);
+    if (page == tabsByPath_.end()) {
+        return nullptr;
+    }
+    auto it = tabs_.find(page->second);
+    return it == tabs_.end() ? nullptr : &it->second;
+}
+
+Tab* Editor::current_tab() {
+    auto it = tabs_.find(notebook_.get_nth_page(notebook_.get_current_page()));
+    return it == tabs_.end() ? nullptr : &it->second;
+}
+
+// Hands a snapshot of the buffer to the save queue; the tab label is updated once the
+// write has landed on disk (see on_save_done).
 void Editor::save_file(const std::string& file_path) {
-    auto it = std::find_if(tabs_.begin(), tabs_.end(), [&file_path](const auto& pair) {
-        return pair.second.file_path == file_path;
-    });
+    TRACE_SCOPE("Editor::save_file", file_path);
+    Tab* found = find_tab(file_path);
+    if (!found) {
+        return;
+    }
 
-    if (it != tabs_.end()) {
-        std::ofstream file(file_path);
-        if (file.is_open()) {
-            file << it->second.text_buffer->get_text();
-            file.close();
-            std::cout << "File saved: " << file_path << std::endl;
-            it->second.modified = false;
-            update_tab_label(it->first);
+    Tab& tab = *found;
+    // Also covers hibernated tabs, whose buffer is empty
+    if (!tab.loaded) {
+        return;
+    }
+
+    tab.saving = true;
+    tab.save_checkpoints[tab.version] = journal_.checkpoint(file_path);
+    saveQueue_.save(file_path, tab.document.snapshot(), tab.version, tab.encoding);
+    update_tab_label(tab);
+}
+
+void Editor::on_save_done() {
+    for (const auto& result : saveQueue_.take_results()) {
+        Tab* found = find_tab(result.file_path);
+        if (!found) {
+            continue;
+        }
+
+        Tab& tab = *found;
+        auto checkpoint = tab.save_checkpoints.find(result.version);
+        if (result.ok) {
+            if (tab.version == result.version) {
+                tab.modified = false;
+                tab.recovered = false;
+            }
+            tab.disk_hash = result.hash;
+            tab.disk_conflict = false;
+            if (checkpoint != tab.save_checkpoints.end()) {
+                journal_.mark_saved(result.file_path, checkpoint->second);
+            }
+            file_saved_signal_.emit(result.file_path);
         } else {
-            std::cerr << "Error saving file: " << file_path << std::endl;
+            std::cerr << "Error saving file: " << result.file_path << ": " << result.error << std::endl;
+            show_error_dialog(this->get_toplevel(), "Error saving " + result.file_path + ": " + result.error);
+        }
+
+        // Older saves were coalesced into this one
+        tab.save_checkpoints.erase(tab.save_checkpoints.begin(), tab.save_checkpoints.upper_bound(result.version));
+        tab.saving = !tab.save_checkpoints.empty();
+        update_tab_label(tab);
+        if (!tab.saving && tab.recheck_disk) {
+            check_disk(tab);
         }
     }
 }
 
+bool Editor::on_monitor_event(Glib::IOCondition condition) {
+    for (const auto& file_path : monitor_.read_events()) {
+        if (Tab* tab = find_tab(file_path)) {
+            check_disk(*tab);
+        }
+    }
+    return true;
+}
+
+// Hashes the file on the checker's thread and, if it really changed, diffs it against
+// the text as it is now
+void Editor::check_disk(Tab& tab) {
+    if (tab.load_id != 0 || tab.saving) {
+        // The load may have read the old bytes; our own save would look like a change
+        tab.recheck_disk = true;
+        return;
+    }
+    tab.recheck_disk = false;
+    // A hibernated tab reads the file again when shown
+    if (tab.loaded) {
+        reloadChecker_.check(tab.file_path, tab.disk_hash, tab.document.snapshot(), tab.version);
+    }
+}
+
+void Editor::on_reload_ready() {
+    for (const auto& result : reloadChecker_.take_results()) {
+        Tab* found = find_tab(result.file_path);
+        if (!found) {
+            continue;
+        }
+        Tab& tab = *found;
+        // A file that can't be read (removed, or caught between writes) keeps its tab as is
+        if (!result.ok || !result.changed || !tab.loaded) {
+            continue;
+        }
+        if (tab.saving || tab.load_id != 0) {
+            tab.recheck_disk = true;
+            continue;
+        }
+
+        if (result.edits.empty()) {
+            // Rewritten with the same text, or a different encoding of it
+            tab.disk_hash = result.hash;
+        } else if (result.version != tab.version) {
+            // The edits are against text the user has changed since; diff again
+            check_disk(tab);
+        } else if (tab.modified) {
+            tab.disk_hash = result.hash;
+            rebase_journal(tab, result);
+            if (!tab.disk_conflict) {
+                tab.disk_conflict = true;
+                update_tab_label(tab);
+                std::cerr << "File changed on disk with unsaved changes open: " << result.file_path << std::endl;
+                show_error_dialog(this->get_toplevel(), result.file_path +
+                                  " changed on disk while it has unsaved changes here. Saving will overwrite the version on disk.");
+            }
+        } else {
+            apply_reload(tab, result);
+        }
+    }
+}
+
+// Only the lines that differ are replaced, so the cursor, scroll position and marks
+// elsewhere stay put, and one undo brings the old text back
+void Editor::apply_reload(Tab& tab, const ReloadResult& result) {
+    TRACE_SCOPE("Editor::apply_reload", result.file_path);
+    Glib::RefPtr<Gtk::TextBuffer> buffer = tab.text_buffer;
+    reloading_ = true;
+    tab.history->begin_group();
+    for (auto edit = result.edits.rbegin(); edit != result.edits.rend(); ++edit) {
+        Gtk::TextBuffer::iterator start = buffer->get_iter_at_offset(edit->offset);
+        if (edit->length > 0) {
+            start = buffer->erase(start, buffer->get_iter_at_offset(edit->offset + edit->length));
+        }
+        if (!edit->text.empty()) {
+            buffer->insert(start, edit->text.data(), edit->text.data() + edit->text.size());
+        }
+    }
+    tab.history->end_group();
+    reloading_ = false;
+
+    tab.disk_hash = result.hash;
+    tab.encoding = result.encoding;
+    tab.lossy_load = result.lossy;
+    tab.modified = false;
+    tab.recovered = false;
+    update_tab_label(tab);
+}
+
+// The journaled edits apply to the file as it was, so recovery would drop them once it
+// changed. Record the whole text against the new file instead.
+void Editor::rebase_journal(Tab& tab, const ReloadResult& result) {
+    if (!autosave_) {
+        return;
+    }
+    // result.edits turn the document into the new file, which tells its length
+    size_t disk_chars = tab.document.char_count();
+    for (const auto& edit : result.edits) {
+        disk_chars = disk_chars + g_utf8_strlen(edit.text.data(), edit.text.size()) - edit.length;
+    }
+    journal_.discard(tab.file_path);
+    journal_.record_delete(tab.file_path, 0, disk_chars);
+    journal_.record_insert(tab.file_path, 0, tab.document.substr(0, tab.document.size()));
+}
+
+void Editor::on_text_inserted(const std::string& file_path, const Gtk::TextBuffer::iterator& pos, const Glib::ustring& text) {
+    Tab* found = find_tab(file_path);
+    if (!found) {
+        return;
+    }
+
+    Tab& tab = *found;
+    size_t offset = tab.document.byte_offset(pos.get_offset());
+    tab.stats.insert(tab.document, offset, text.raw());
+    tab.document.insert(offset, text.raw());
+    if (suppressJournal_ || !tab.loaded) {
+        return;
+    }
+
+    if (!applyingUndo_) {
+        tab.history->record_insert(pos.get_offset(), text.raw());
+    }
+    if (autosave_ && !reloading_) {
+        journal_.record_insert(file_path, pos.get_offset(), text.raw());
+    }
+}
+
+void Editor::on_text_erased(const std::string& file_path, const Gtk::TextBuffer::iterator& start, const Gtk::TextBuffer::iterator& end) {
+    Tab* found = find_tab(file_path);
+    if (!found) {
+        return;
+    }
+
+    Tab& tab = *found;
+    size_t from = tab.document.byte_offset(start.get_offset());
+    size_t to = tab.document.byte_offset(end.get_offset());
+    // Taken from the document before it changes, no need to walk the buffer
+    std::string erased = tab.document.substr(from, to - from);
+    tab.stats.erase(tab.document, from, erased);
+    if (!suppressJournal_ && tab.loaded && !applyingUndo_) {
+        tab.history->record_delete(start.get_offset(), erased);
+    }
+    tab.document.erase(from, to - from);
+    if (suppressJournal_ || !tab.loaded) {
+        return;
+    }
+
+    if (autosave_ && !reloading_) {
+        journal_.record_delete(file_path, start.get_offset(), end.get_offset() - start.get_offset());
+    }
+}
+
 void Editor::save_current_tab() {
-    int current_page = notebook_.get_current_page();
-    auto it = tabs_.find(current_page);
-    if (it != tabs_.end()) {
-        save_file(it->second.file_path);
+    if (Tab* tab = current_tab()) {
+        save_file(tab->file_path);
+    }
+}
+
+void Editor::undo_current_tab() {
+    Tab* tab = current_tab();
+    std::vector<EditOp> ops;
+    if (tab && tab->loaded && tab->history->undo(ops)) {
+        apply_edit_ops(*tab, ops);
     }
 }
 
+void Editor::redo_current_tab() {
+    Tab* tab = current_tab();
+    std::vector<EditOp> ops;
+    if (tab && tab->loaded && tab->history->redo(ops)) {
+        apply_edit_ops(*tab, ops);
+    }
+}
+
+void Editor::apply_edit_ops(Tab& tab, const std::vector<EditOp>& ops) {
+    Glib::RefPtr<Gtk::TextBuffer> buffer = tab.text_buffer;
+    applyingUndo_ = true;
+    for (const auto& op : ops) {
+        Gtk::TextBuffer::iterator start = buffer->get_iter_at_offset(op.offset);
+        if (op.kind == EditOp::Insert) {
+            buffer->place_cursor(buffer->insert(start, op.text.data(), op.text.data() + op.text.size()));
+        } else {
+            buffer->place_cursor(buffer->erase(start, buffer->get_iter_at_offset(op.offset + op.chars)));
+        }
+    }
+    applyingUndo_ = false;
+    tab.text_view->scroll_to(buffer->get_insert());
+}
+
 void Editor::open_new_tab(const std::string& file_path) {
+    TRACE_SCOPE("Editor::open_new_tab", file_path);
     if (is_binary_file(file_path)) {
         error_bell();
         show_error_dialog(this->get_toplevel(), "Error: cannot open binary file: " + file_path);
         return;
     }
 
-    for (const auto& [num, tab] : tabs_) {
-        if (tab.file_path == file_path) {
-            notebook_.set_current_page(num);
-            return;
-        }
+    auto existing = tabsByPath_.find(file_path);
+    if (existing != tabsByPath_.end()) {
+        notebook_.set_current_page(notebook_.page_num(*existing->second));
+        return;
+    }
+    if (open_large_file(file_path)) {
+        return;
     }
 
     Gtk::ScrolledWindow* scrolled_window = Gtk::manage(new Gtk::ScrolledWindow());
@@ -79,7 +380,7 @@ void Editor::open_new_tab(const std::string& file_path) {
     scrolled_window->add(*text_view);
 
     std::string filename = file_path.substr(file_path.find_last_of('/') + 1);
-    for (const auto& [num, tab] : tabs_) {
+    for (const auto& [page, tab] : tabs_) {
         if (tab.file_path.substr(tab.file_path.find_last_of('/') + 1) == filename) {
             filename = file_path.substr(0, file_path.find_last_of('/'));
             break;
@@ -91,10 +392,17 @@ void Editor::open_new_tab(const std::string& file_path) {
     Gtk::Button* close_button = Gtk::manage(new Gtk::Button("x"));
     tab_label->set_margin_end(5);
 
-    int page_num = notebook_.append_page(*scrolled_window, *tab_box);
+    Gtk::Box* page = Gtk::manage(new Gtk::Box(Gtk::ORIENTATION_VERTICAL));
+    Gtk::Box* backlinks_bar = Gtk::manage(new Gtk::Box(Gtk::ORIENTATION_HORIZONTAL));
+    backlinks_bar->set_spacing(5);
+    backlinks_bar->set_margin_start(5);
+    page->pack_start(*scrolled_window, Gtk::PACK_EXPAND_WIDGET);
+    page->pack_start(*backlinks_bar, Gtk::PACK_SHRINK);
+
+    int page_num = notebook_.append_page(*page, *tab_box);
 
-    close_button->signal_clicked().connect([this, page_num]() {
-        on_tab_close_button_clicked(page_num);
+    close_button->signal_clicked().connect([this, page]() {
+        on_tab_close_button_clicked(page);
     });
 
     tab_box->pack_start(*tab_label, Gtk::PACK_EXPAND_WIDGET);
@@ -102,74 +410,494 @@ void Editor::open_new_tab(const std::string& file_path) {
 
     notebook_.set_current_page(page_num);
 
-    tabs_[page_num] = {file_path, text_buffer, scrolled_window, tab_label, false};
+    Tab& tab = tabs_[page];
+    tab = {file_path, text_buffer, page, tab_label, false};
+    tab.text_view = text_view;
+    tab.backlinks_bar = backlinks_bar;
+    tab.history = std::make_unique<UndoHistory>(&undoBudget_, undoTabLimit_);
+    tab.last_used = ++useCounter_;
+    tabsByPath_[file_path] = page;
+    monitor_.watch(file_path);
+    start_load(tab);
 
-    text_buffer->signal_changed().connect([this, page_num]() {
-        on_text_buffer_changed(page_num);
+    text_buffer->signal_changed().connect([this, page]() {
+        on_text_buffer_changed(page);
+    });
+    // Connected before the default handlers so the offsets still describe the old text
+    text_buffer->signal_insert().connect([this, file_path](const Gtk::TextBuffer::iterator& pos, const Glib::ustring& text, int bytes) {
+        on_text_inserted(file_path, pos, text);
+    }, false);
+    text_buffer->signal_erase().connect([this, file_path](const Gtk::TextBuffer::iterator& start, const Gtk::TextBuffer::iterator& end) {
+        on_text_erased(file_path, start, end);
+    }, false);
+    // Cursor moves change the selection the status bar counts
+    text_buffer->signal_mark_set().connect([this, file_path](const Gtk::TextBuffer::iterator&, const Glib::RefPtr<Gtk::TextBuffer::Mark>& mark) {
+        Tab* tab = current_tab();
+        if (!tab || tab->file_path != file_path) {
+            return;
+        }
+        if (mark == tab->text_buffer->get_insert() || mark == tab->text_buffer->get_selection_bound()) {
+            update_stats(tab);
+        }
+    });
+    text_buffer->signal_begin_user_action().connect([this, file_path]() {
+        if (Tab* tab = find_tab(file_path)) {
+            tab->history->begin_group();
+        }
+    });
+    text_buffer->signal_end_user_action().connect([this, file_path]() {
+        if (Tab* tab = find_tab(file_path)) {
+            tab->history->end_group();
+        }
     });
 
     tab_box->show_all();
     notebook_.show_all();
+    update_backlinks(tab);
+}
+
+void Editor::open_at_line(const std::string& file_path, int line) {
+    open_new_tab(file_path);
+    if (LargeFileView* view = find_large_view(file_path)) {
+        view->go_to_line(line);
+        return;
+    }
+    Tab* found = find_tab(file_path);
+    if (!found) {
+        return;
+    }
+
+    Tab& tab = *found;
+    if (tab.load_id != 0) {
+        tab.pending_line = line;
+    } else {
+        go_to_line(tab, line);
+    }
+}
+
+void Editor::go_to_line(Tab& tab, int line) {
+    Gtk::TextBuffer::iterator iter = tab.text_buffer->get_iter_at_line(std::max(line - 1, 0));
+    tab.text_buffer->place_cursor(iter);
+    tab.text_view->scroll_to(tab.text_buffer->get_insert(), 0.0, 0.0, 0.3);
+    tab.text_view->grab_focus();
+}
+
+// Puts the cursor and the first visible line back where they were before hibernating
+void Editor::restore_view(Tab& tab) {
+    Glib::RefPtr<Gtk::TextBuffer> buffer = tab.text_buffer;
+    buffer->place_cursor(buffer->get_iter_at_offset(tab.saved_cursor));
+
+    // Scrolling to a mark waits for the new text to be laid out
+    Gtk::TextBuffer::iterator top = buffer->get_iter_at_offset(tab.saved_top);
+    Glib::RefPtr<Gtk::TextMark> mark = buffer->get_mark("restore-top");
+    if (mark) {
+        buffer->move_mark(mark, top);
+    } else {
+        mark = buffer->create_mark("restore-top", top);
+    }
+    tab.text_view->scroll_to(mark, 0.0, 0.0, 0.0);
+}
+
+void Editor::set_link_graph(LinkGraph* links) {
+    linkGraph_ = links;
+    update_backlinks();
+}
+
+void Editor::update_backlinks() {
+    for (auto& [page, tab] : tabs_) {
+        update_backlinks(tab);
+    }
+}
+
+void Editor::update_backlinks(Tab& tab) {
+    for (Gtk::Widget* child : tab.backlinks_bar->get_children()) {
+        delete child;
+    }
+
+    std::vector<std::string> sources = linkGraph_ ? linkGraph_->backlinks(tab.file_path) : std::vector<std::string>();
+    if (sources.empty()) {
+        tab.backlinks_bar->hide();
+        return;
+    }
+
+    tab.backlinks_bar->pack_start(*Gtk::manage(new Gtk::Label("Linked from:")), Gtk::PACK_SHRINK);
+    for (const std::string& source : sources) {
+        Gtk::Button* button = Gtk::manage(new Gtk::Button(std::filesystem::path(source).stem().string()));
+        button->set_relief(Gtk::RELIEF_NONE);
+        button->set_tooltip_text(source);
+        button->signal_clicked().connect([this, source]() {
+            open_new_tab(source);
+        });
+        tab.backlinks_bar->pack_start(*button, Gtk::PACK_SHRINK);
+    }
+    tab.backlinks_bar->show_all();
 }
 
 void Editor::on_switch_page(Gtk::Widget* page, guint page_num) {
-    auto it = tabs_.find(page_num);
-    if (it != tabs_.end()) {
-        Tab& tab = it->second;
-        if (tab.text_buffer->get_text().empty()) {
-            std::ifstream file(tab.file_path, std::ios::in | std::ios::binary);
-            if (file.is_open()) {
-                std::stringstream buffer;
-                buffer << file.rdbuf();
-                tab.text_buffer->set_text(buffer.str());
+    auto it = tabs_.find(page);
+    Tab* tab = it == tabs_.end() ? nullptr : &it->second;
+    if (tab) {
+        tab->last_used = ++useCounter_;
+        if (!tab->loaded && tab->load_id == 0) {
+            start_load(*tab);
+        } else {
+            // Catches changes the monitor missed, e.g. without inotify
+            check_disk(*tab);
+        }
+    }
+    update_stats(tab);
+    enforce_memory_budget(tab);
+}
+
+// Rough footprint of a loaded tab: the buffer's line tree holds about twice the text,
+// the piece table one more copy, plus the undo history. A hibernated tab's history is
+// left to the undo budget.
+size_t Editor::tab_memory(const Tab& tab) const {
+    return tab.loaded ? tab.document.size() * 3 + tab.history->memory_usage() : 0;
+}
+
+void Editor::enforce_memory_budget(const Tab* keep) {
+    size_t total = 0;
+    for (const auto& [page, tab] : tabs_) {
+        total += tab_memory(tab);
+    }
+
+    while (total > memoryBudget_) {
+        Tab* oldest = nullptr;
+        for (auto& [page, tab] : tabs_) {
+            // Modified tabs hold the only copy of their text
+            bool evictable = tab.loaded && !tab.modified && !tab.saving && &tab != keep;
+            if (evictable && (!oldest || tab.last_used < oldest->last_used)) {
+                oldest = &tab;
             }
         }
+        if (!oldest) {
+            break;
+        }
+        total -= tab_memory(*oldest);
+        hibernate(*oldest);
+    }
+}
+
+void Editor::hibernate(Tab& tab) {
+    TRACE_SCOPE("Editor::hibernate", tab.file_path);
+    Gdk::Rectangle visible;
+    tab.text_view->get_visible_rect(visible);
+    Gtk::TextBuffer::iterator top;
+    tab.text_view->get_iter_at_location(top, visible.get_x(), visible.get_y());
+    tab.saved_top = top.get_offset();
+    tab.saved_cursor = tab.text_buffer->get_insert()->get_iter().get_offset();
+
+    // Not loaded, so clearing the buffer is neither journaled nor counted as an edit;
+    // typing into it would be neither too, so it stays read-only until the reload
+    tab.text_view->set_editable(false);
+    tab.loaded = false;
+    tab.hibernated = true;
+    tab.highlighter.reset();
+    tab.text_buffer->set_text("");
+    // Drops the piece table's blocks too, which erasing alone keeps
+    tab.document.clear();
+    tab.stats.clear();
+    // The history stays, already capped by the shared undo budget, so undo works as
+    // before once the tab is shown again
+}
+
+void Editor::start_load(Tab& tab) {
+    tab.text_view->set_editable(false);
+    if (tab.load_failed) {
+        // Retried on switching back; the part read last time goes first
+        tab.text_buffer->set_text("");
+        tab.document.clear();
+        tab.stats.clear();
+    }
+    tab.load_percent = 0;
+    tab.lossy_load = false;
+    tab.load_failed = false;
+    tab.load_started_ns = Tracer::now_ns();
+    tab.load_id = loader_.load(tab.file_path);
+}
+
+void Editor::on_load_ready() {
+    if (!loadIdle_.connected()) {
+        loadIdle_ = Glib::signal_idle().connect(sigc::mem_fun(*this, &Editor::on_load_idle));
     }
 }
 
+// Feeds loaded text into the buffers in small slices and gives the main loop back after a
+// few milliseconds, so typing in other tabs stays responsive while a big file streams in.
+bool Editor::on_load_idle() {
+    TRACE_SCOPE("Editor::on_load_idle");
+    const size_t slice_size = 64 * 1024;
+    const auto budget = std::chrono::milliseconds(8);
+    auto start = std::chrono::steady_clock::now();
+
+    while (std::chrono::steady_clock::now() - start < budget) {
+        if (pendingChunk_.id == 0 || (pendingOffset_ == pendingChunk_.text.size() && !pendingChunk_.done)) {
+            if (!loader_.has_chunks()) {
+                return false;
+            }
+            pendingChunk_ = loader_.take_chunk();
+            pendingOffset_ = 0;
+        }
+
+        auto it = find_tab_by_load(pendingChunk_.id);
+        if (it == tabs_.end()) {
+            pendingChunk_ = LoadChunk();
+            continue;
+        }
+        Tab* tab = &it->second;
+        tab->encoding = pendingChunk_.encoding;
+        tab->lossy_load = tab->lossy_load || pendingChunk_.lossy;
+
+        const std::string& text = pendingChunk_.text;
+        if (pendingOffset_ < text.size()) {
+            size_t end = std::min(pendingOffset_ + slice_size, text.size());
+            // Never split a UTF-8 sequence between two inserts
+            while (end < text.size() && (static_cast<unsigned char>(text[end]) & 0xc0) == 0x80) {
+                end--;
+            }
+            tab->text_buffer->insert(tab->text_buffer->end(), text.data() + pendingOffset_, text.data() + end);
+            pendingOffset_ = end;
+        }
+
+        int percent = pendingChunk_.total_bytes ? static_cast<int>(pendingChunk_.bytes_read * 100 / pendingChunk_.total_bytes) : 100;
+        if (percent != tab->load_percent) {
+            tab->load_percent = percent;
+            update_tab_label(*tab);
+        }
+
+        if (pendingChunk_.done && pendingOffset_ == text.size()) {
+            if (pendingChunk_.failed) {
+                // Left unloaded: save_file refuses it and the journal keeps any recovered edits
+                tab->load_id = 0;
+                tab->load_failed = true;
+                update_tab_label(*tab);
+                pendingChunk_ = LoadChunk();
+                error_bell();
+                show_error_dialog(this->get_toplevel(), "Error: cannot read file: " + tab->file_path +
+                                  "; the tab shows only part of it and is read-only");
+                continue;
+            }
+            if (tab->lossy_load) {
+                // Saving would write the replacement characters back
+                show_error_dialog(this->get_toplevel(), "Warning: " + tab->file_path + " is not valid " + tab->encoding.name() +
+                                  "; undecodable bytes were replaced with U+FFFD");
+            }
+            if (Tracer::enabled()) {
+                Tracer::record("Load file", tab->load_started_ns, Tracer::now_ns(), tab->file_path);
+            }
+            if (tab->hibernated && pendingChunk_.hash != tab->disk_hash) {
+                // Its undo steps were for the text as it was before the file changed
+                tab->history->clear();
+            }
+            tab->load_id = 0;
+            tab->loaded = true;
+            tab->disk_hash = pendingChunk_.hash;
+            tab->text_view->set_editable(true);
+
+            auto recovered = recovered_.find(tab->file_path);
+            if (recovered != recovered_.end()) {
+                // The journal already holds these edits
+                suppressJournal_ = true;
+                tab->text_buffer->set_text(recovered->second.text);
+                tab->encoding = recovered->second.encoding;
+                tab->recovered = true;
+                suppressJournal_ = false;
+                recovered_.erase(recovered);
+            }
+            if (LinkGraph::is_note(tab->file_path)) {
+                tab->highlighter = std::make_unique<MarkdownHighlighter>(tab->text_buffer);
+            }
+            tab->text_buffer->place_cursor(tab->text_buffer->begin());
+            if (tab->pending_line > 0) {
+                go_to_line(*tab, tab->pending_line);
+                tab->pending_line = 0;
+            } else if (tab->hibernated) {
+                restore_view(*tab);
+            }
+            tab->hibernated = false;
+            update_tab_label(*tab);
+            if (tab->recheck_disk) {
+                check_disk(*tab);
+            }
+            pendingChunk_ = LoadChunk();
+            enforce_memory_budget(current_tab());
+        }
+    }
+    return true;
+}
+
+std::map<Gtk::Widget*, Tab>::iterator Editor::find_tab_by_load(uint64_t load_id) {
+    return std::find_if(tabs_.begin(), tabs_.end(), [load_id](const auto& pair) {
+        return pair.second.load_id == load_id;
+    });
+}
+
 bool Editor::on_key_press_event(GdkEventKey* event) {
     if ((event->state & GDK_CONTROL_MASK) && event->keyval == GDK_KEY_s) {
         save_current_tab();
         return true;
     }
 
+    if ((event->state & GDK_CONTROL_MASK) && event->keyval == GDK_KEY_z) {
+        undo_current_tab();
+        return true;
+    }
+
+    if ((event->state & GDK_CONTROL_MASK) && (event->keyval == GDK_KEY_Z || event->keyval == GDK_KEY_y)) {
+        redo_current_tab();
+        return true;
+    }
+
     return Gtk::Box::on_key_press_event(event);
 }
 
-void Editor::on_tab_close_button_clicked(int page_num) {
-    auto it = tabs_.find(page_num);
+void Editor::on_tab_close_button_clicked(Gtk::Widget* page) {
+    auto it = tabs_.find(page);
     if (it != tabs_.end()) {
+        if (it->second.load_id != 0) {
+            loader_.cancel(it->second.load_id);
+        }
+        if (it->second.modified) {
+            journal_.discard(it->second.file_path);
+        }
+        monitor_.unwatch(it->second.file_path);
+        tabsByPath_.erase(it->second.file_path);
         tabs_.erase(it);
-        notebook_.remove_page(page_num);
+    } else if (auto* view = dynamic_cast<LargeFileView*>(page)) {
+        tabsByPath_.erase(view->file_path());
     }
+    notebook_.remove_page(*page);
+    update_stats(current_tab());
 }
 
-void Editor::on_text_buffer_changed(int page_num) {
-    auto it = tabs_.find(page_num);
-    if (it != tabs_.end() && !it->second.modified) {
-        it->second.modified = true;
-        update_tab_label(page_num);
+// Returns false if the file is small enough for a normal tab
+bool Editor::open_large_file(const std::string& file_path) {
+    std::error_code ec;
+    uintmax_t size = std::filesystem::file_size(file_path, ec);
+    if (ec || size < kLargeFileSize) {
+        return false;
     }
+
+    auto opened = std::make_unique<LargeFileView>(font_size_);
+    std::string error;
+    if (!opened->open(file_path, error)) {
+        error_bell();
+        show_error_dialog(this->get_toplevel(), "Error: cannot open file: " + file_path + " (" + error + ")");
+        return true;
+    }
+    LargeFileView* view = Gtk::manage(opened.release());
+
+    Gtk::Box* tab_box = Gtk::manage(new Gtk::Box(Gtk::ORIENTATION_HORIZONTAL));
+    Gtk::Label* tab_label = Gtk::manage(new Gtk::Label(file_path.substr(file_path.find_last_of('/') + 1) + " (read-only)"));
+    Gtk::Button* close_button = Gtk::manage(new Gtk::Button("x"));
+    tab_label->set_margin_end(5);
+    tab_box->pack_start(*tab_label, Gtk::PACK_EXPAND_WIDGET);
+    tab_box->pack_start(*close_button, Gtk::PACK_SHRINK);
+
+    int page_num = notebook_.append_page(*view, *tab_box);
+    tabsByPath_[file_path] = view;
+    close_button->signal_clicked().connect([this, view]() {
+        on_tab_close_button_clicked(view);
+    });
+
+    tab_box->show_all();
+    notebook_.show_all();
+    notebook_.set_current_page(page_num);
+    return true;
 }
 
-void Editor::update_tab_label(int page_num) {
-    auto it = tabs_.find(page_num);
-    if (it != tabs_.end()) {
-        std::string label_text = it->second.file_path.substr(it->second.file_path.find_last_of('/') + 1);
-        if (it->second.modified) {
-            label_text += " *";
-        }
-        it->second.tab_label->set_text(label_text);
+LargeFileView* Editor::find_large_view(const std::string& file_path) {
+    auto page = tabsByPath_.find(file_path);
+    return page == tabsByPath_.end() ? nullptr : dynamic_cast<LargeFileView*>(page->second);
+}
+
+void Editor::on_text_buffer_changed(Gtk::Widget* page) {
+    auto it = tabs_.find(page);
+    if (it == tabs_.end()) {
+        return;
+    }
+    Tab& tab = it->second;
+    if (&tab == current_tab()) {
+        update_stats(&tab);
+    }
+    if (!tab.loaded) {
+        return;
+    }
+
+    tab.version++;
+    if (!tab.modified) {
+        tab.modified = true;
+        update_tab_label(tab);
+    }
+}
+
+void Editor::update_tab_label(Tab& tab) {
+    std::string label_text = tab.file_path.substr(tab.file_path.find_last_of('/') + 1);
+    if (!tab.encoding.is_utf8()) {
+        label_text += " [" + tab.encoding.name() + "]";
+    }
+    if (tab.load_id != 0) {
+        label_text += " (" + std::to_string(tab.load_percent) + "%)";
     }
+    if (tab.modified) {
+        label_text += " *";
+    }
+    if (tab.recovered) {
+        label_text += " (recovered)";
+    }
+    if (tab.disk_conflict) {
+        label_text += " (changed on disk)";
+    }
+    if (tab.saving) {
+        label_text += " (saving)";
+    }
+    if (tab.load_failed) {
+        label_text += " (read error)";
+    }
+    tab.tab_label->set_text(label_text);
+}
+
+// Only the selection is recounted; the document's own counts are kept up to date by its edits
+void Editor::update_stats(const Tab* current) {
+    if (!current) {
+        statsLabel_.set_text("");
+        return;
+    }
+
+    const Tab& tab = *current;
+    Gtk::TextBuffer::iterator start, end;
+    std::string text;
+    if (tab.text_buffer->get_selection_bounds(start, end)) {
+        size_t from = tab.document.byte_offset(start.get_offset());
+        size_t to = tab.document.byte_offset(end.get_offset());
+        text = "Selection: " + std::to_string(DocStats::count_words(tab.document.substr(from, to - from))) + " words, " +
+               std::to_string(end.get_offset() - start.get_offset()) + " characters, " +
+               std::to_string(end.get_line() - start.get_line() + 1) + " lines";
+    } else {
+        text = std::to_string(tab.stats.words()) + " words, " + std::to_string(tab.document.char_count()) + " characters, " +
+               std::to_string(tab.document.line_count()) + " lines, " +
+               std::to_string(DocStats::reading_minutes(tab.stats.words())) + " min read";
+    }
+    statsLabel_.set_text(text);
+}
+
+sigc::signal<void, const std::string&> Editor::signal_file_saved() {
+    return file_saved_signal_;
 }
 
 void Editor::set_font_size(int size) {
     font_size_ = size;
-    for (const auto& [num, tab] : tabs_) {
+    for (const auto& [page, tab] : tabs_) {
         Pango::FontDescription font_desc;
         font_desc.set_size(font_size_ * PANGO_SCALE);
         tab.text_buffer->get_insert()->get_iter().get_buffer()->get_tag_table()->foreach([font_desc](const Glib::RefPtr<Gtk::TextTag>& tag) {
             tag->property_font_desc() = font_desc;
         });
     }
+    for (const auto& [path, page] : tabsByPath_) {
+        if (auto* view = dynamic_cast<LargeFileView*>(page)) {
+            view->set_font_size(size);
+        }
+    }
 }
\ No newline at end of file
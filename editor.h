@@ -8,9 +8,26 @@
 #include <gtkmm/box.h>
 #include <gtkmm/button.h>
 #include <gtkmm/cssprovider.h>
+#include <gtkmm/label.h>
 #include <gtkmm/notebook.h>
 #include <gtkmm/textview.h>
 #include <gtkmm/scale.h>
+#include <glibmm/dispatcher.h>
+#include <map>
+#include <memory>
+#include <unordered_map>
+
+#include "doc_stats.h"
+#include "edit_journal.h"
+#include "file_loader.h"
+#include "file_monitor.h"
+#include "large_file_view.h"
+#include "link_graph.h"
+#include "markdown_highlighter.h"
+#include "piece_table.h"
+#include "reload_checker.h"
+#include "save_queue.h"
+#include "undo_history.h"
 
 struct Tab {
     std::string file_path;
@@ -18,6 +35,52 @@ struct Tab {
     Gtk::Widget* parent;
     Gtk::Label* tab_label;
     bool modified = false;
+    Gtk::TextView* text_view = nullptr;
+    bool loaded = false;
+    // Non-zero while the file is still streaming into text_buffer
+    uint64_t load_id = 0;
+    int load_percent = 0;
+    // When the current load started, for tracing
+    uint64_t load_started_ns = 0;
+    // Bumped on every edit, so a finished save knows whether it caught the latest one
+    uint64_t version = 0;
+    bool saving = false;
+    // Journal checkpoint taken for each in-flight save, keyed by the saved version
+    std::map<uint64_t, uint64_t> save_checkpoints;
+    std::unique_ptr<UndoHistory> history;
+    // Notes linking here, shown under the text
+    Gtk::Box* backlinks_bar = nullptr;
+    // Line to jump to once loading finishes, 0 for none
+    int pending_line = 0;
+    // Mirror of text_buffer kept in sync from its signals; saves and searches read
+    // snapshots of this instead of copying the buffer out
+    PieceTable document;
+    // Word count of document, updated along with it
+    DocStats stats;
+    // Only for Markdown notes, created once loading finishes
+    std::unique_ptr<MarkdownHighlighter> highlighter;
+    // Set when an idle tab gave up its text to stay within the memory budget; it is
+    // loaded again when shown, with the cursor and first visible line put back
+    bool hibernated = false;
+    int saved_cursor = 0;
+    int saved_top = 0;
+    // Order in which tabs were last shown, for picking the least recently used
+    uint64_t last_used = 0;
+    // Encoding found on load, used again when saving
+    TextEncoding encoding;
+    bool lossy_load = false;
+    // Reading the file failed partway; the tab shows what was read, read-only and
+    // never saved, so the partial text can't replace the file
+    bool load_failed = false;
+    // ContentHash of the file as last loaded or saved, so our own saves and mere
+    // touches aren't taken for changes
+    uint64_t disk_hash = 0;
+    // The file changed while loading or saving; checked again once that is done
+    bool recheck_disk = false;
+    // The file changed on disk while the tab had unsaved edits, which were kept
+    bool disk_conflict = false;
+    // Holds unsaved edits replayed from the journal after a crash, until saved
+    bool recovered = false;
 };
 
 class Editor : public Gtk::Box {
@@ -27,20 +90,104 @@ public:
 
     void save_file(const std::string& file_path);
     void open_new_tab(const std::string& file_path);
+    // Opens the file and puts the cursor at the start of a 1-based line
+    void open_at_line(const std::string& file_path, int line);
     void set_font_size(int size);
+    // Journals every edit so unsaved tabs survive a crash
+    void set_autosave(bool enabled);
+    void set_undo_limits(size_t per_tab, size_t total);
+    // Unmodified background tabs are unloaded, least recently used first, while all
+    // open tabs together take more than this
+    void set_memory_budget(size_t bytes);
+    void set_link_graph(LinkGraph* links);
+    // Rebuilds every tab's backlinks bar from the link graph
+    void update_backlinks();
+
+    // Emitted once a save has landed on disk
+    sigc::signal<void, const std::string&> signal_file_saved();
 
 protected:
     Gtk::TextView text_view_;
-    std::map<int, Tab> tabs_;
+    // Declared before tabs_ so it outlives every tab's history
+    UndoBudget undoBudget_{64 * 1024 * 1024};
+    size_t undoTabLimit_ = 16 * 1024 * 1024;
+    bool applyingUndo_ = false;
+    size_t memoryBudget_ = 256 * 1024 * 1024;
+    uint64_t useCounter_ = 0;
+    // Keyed by the notebook page holding the tab; page numbers shift when a tab closes
+    std::map<Gtk::Widget*, Tab> tabs_;
+    // Page of every open file. Files too big for a TextBuffer have no Tab; their page
+    // is the read-only LargeFileView itself
+    std::unordered_map<std::string, Gtk::Widget*> tabsByPath_;
     Gtk::Notebook notebook_;
+    // Counts for the current tab, or its selection
+    Gtk::Label statsLabel_;
     int font_size_ = 16;
 
+    Glib::Dispatcher loadDispatcher_;
+    FileLoader loader_;
+    sigc::connection loadIdle_;
+    LoadChunk pendingChunk_;
+    size_t pendingOffset_ = 0;
+
+    LinkGraph* linkGraph_ = nullptr;
+
+    Glib::Dispatcher saveDispatcher_;
+    SaveQueue saveQueue_;
+
+    FileMonitor monitor_;
+    sigc::connection monitorIo_;
+    Glib::Dispatcher reloadDispatcher_;
+    ReloadChecker reloadChecker_;
+    // Edits from a reload are undoable but not journaled: the file on disk has them
+    bool reloading_ = false;
+
+    EditJournal journal_;
+    bool autosave_ = true;
+    bool suppressJournal_ = false;
+    sigc::connection journalFlush_;
+    // Unsaved contents replayed from the journal, applied once the tab has loaded
+    std::unordered_map<std::string, RecoveredFile> recovered_;
+    sigc::connection recoverIdle_;
+
     bool on_key_press_event(GdkEventKey* event) override;
     void save_current_tab();
-    void on_tab_close_button_clicked(int page_num);
+    void undo_current_tab();
+    void redo_current_tab();
+    void apply_edit_ops(Tab& tab, const std::vector<EditOp>& ops);
+    void on_tab_close_button_clicked(Gtk::Widget* page);
+    bool open_large_file(const std::string& file_path);
+    LargeFileView* find_large_view(const std::string& file_path);
     void on_switch_page(Gtk::Widget* page, guint page_num);
-    void on_text_buffer_changed(int page_num);
-    void update_tab_label(int page_num);
+    Tab* find_tab(const std::string& file_path);
+    // The tab on the notebook's current page, if that is a text tab
+    Tab* current_tab();
+    void on_text_buffer_changed(Gtk::Widget* page);
+    void update_tab_label(Tab& tab);
+    // Clears the status bar for nullptr
+    void update_stats(const Tab* tab);
+
+    void start_load(Tab& tab);
+    void on_load_ready();
+    bool on_load_idle();
+    std::map<Gtk::Widget*, Tab>::iterator find_tab_by_load(uint64_t load_id);
+    void on_save_done();
+    bool on_monitor_event(Glib::IOCondition condition);
+    void check_disk(Tab& tab);
+    void on_reload_ready();
+    void apply_reload(Tab& tab, const ReloadResult& result);
+    void rebase_journal(Tab& tab, const ReloadResult& result);
+    void on_text_inserted(const std::string& file_path, const Gtk::TextBuffer::iterator& pos, const Glib::ustring& text);
+    void on_text_erased(const std::string& file_path, const Gtk::TextBuffer::iterator& start, const Gtk::TextBuffer::iterator& end);
+    void go_to_line(Tab& tab, int line);
+    void restore_view(Tab& tab);
+    void update_backlinks(Tab& tab);
+    size_t tab_memory(const Tab& tab) const;
+    void enforce_memory_budget(const Tab* keep);
+    void hibernate(Tab& tab);
+
+private:
+    sigc::signal<void, const std::string&> file_saved_signal_;
 };
 
 
@@ -1,17 +1,33 @@
 #include "explorer.h"
+#include <fcntl.h>
 #include <filesystem>
 #include <iostream>
 #include <fstream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <unordered_set>
 #include <gtkmm/box.h>
 #include <gtkmm/dialog.h>
+#include <glibmm/main.h>
 
+#include "save_queue.h"
+#include "trace.h"
 #include "util.h"
 
+namespace {
+
+// Same name but a file turned into a folder (or back) counts as a different entry
+std::string entry_key(const std::string& name, bool is_directory) {
+    return is_directory ? name + "/" : name;
+}
+
+} // namespace
+
 Explorer::Explorer() {
     treeView_.set_headers_visible(true);
     add(treeView_);
 
-    treeModel_ = Gtk::TreeStore::create(columns_);
     treeView_.set_model(treeModel_);
 
     std::string path = std::filesystem::current_path().string();
@@ -33,6 +49,7 @@ Explorer::Explorer() {
     column->set_sizing(Gtk::TREE_VIEW_COLUMN_AUTOSIZE);
 
     treeView_.signal_row_activated().connect(sigc::mem_fun(*this, &Explorer::on_row_activated));
+    treeView_.signal_row_expanded().connect(sigc::mem_fun(*this, &Explorer::on_row_expanded));
     treeView_.signal_button_press_event().connect(sigc::mem_fun(*this, &Explorer::on_button_press));
 
     createFileMenuItem_.set_label("New File");
@@ -49,49 +66,509 @@ Explorer::Explorer() {
 
     contextMenu_.show_all();
 
-    folderIcon_ = Gdk::Pixbuf::create_from_file("assets/folder.png");
-    fileIcon_ = Gdk::Pixbuf::create_from_file("assets/file.png");
+    rows_.set_icons(Gdk::Pixbuf::create_from_file("assets/folder.png"), Gdk::Pixbuf::create_from_file("assets/file.png"));
+
+    scanDispatcher_.connect(sigc::mem_fun(*this, &Explorer::on_scan_ready));
+    scanner_.set_notify([this]() { scanDispatcher_.emit(); });
+    ignoreRules_ = IgnoreRules::load(std::filesystem::current_path());
+    scanner_.set_ignore_rules(ignoreRules_);
+    watcher_.set_ignore_rules(ignoreRules_);
+
+    if (watcher_.fd() >= 0) {
+        watchIo_ = Glib::signal_io().connect(sigc::mem_fun(*this, &Explorer::on_watch_event), watcher_.fd(), Glib::IO_IN);
+    }
 
-    populate();
+    opsDispatcher_.connect(sigc::mem_fun(*this, &Explorer::on_ops_ready));
+    fileOps_.set_notify([this]() { opsDispatcher_.emit(); });
+    fileOps_.set_trash_dir(std::filesystem::current_path() / ".librenote" / "trash");
+    opsBar_.set_spacing(5);
+    opsBar_.set_margin_start(5);
+    opsLabel_.set_ellipsize(Pango::ELLIPSIZE_MIDDLE);
+    opsLabel_.set_halign(Gtk::ALIGN_START);
+    opsProgress_.set_valign(Gtk::ALIGN_CENTER);
+    opsCancel_.set_label("Cancel");
+    opsCancel_.signal_clicked().connect([this]() {
+        if (!runningOps_.empty()) {
+            fileOps_.cancel(runningOps_.begin()->first);
+        }
+    });
+    opsBar_.pack_start(opsLabel_, Gtk::PACK_EXPAND_WIDGET);
+    opsBar_.pack_start(opsProgress_, Gtk::PACK_SHRINK);
+    opsBar_.pack_start(opsCancel_, Gtk::PACK_SHRINK);
+    opsBar_.show_all_children();
+    opsBar_.set_no_show_all(true);
+
+    // Show the tree as it was last time right away, then check it against the disk
+    snapshotPath_ = (std::filesystem::current_path() / ".librenote" / "tree").string();
+    if (!restore_snapshot()) {
+        populate();
+    }
 
     // Setup drag and drop
     std::vector<Gtk::TargetEntry> target_entries;
     target_entries.push_back(Gtk::TargetEntry("text/uri-list", Gtk::TARGET_SAME_WIDGET));
 
-    treeView_.enable_model_drag_source(target_entries, Gdk::BUTTON1_MASK, Gdk::DragAction::ACTION_MOVE);
-    treeView_.enable_model_drag_dest(target_entries, Gdk::DragAction::ACTION_MOVE);
+    // Holding Ctrl while dropping copies instead
+    treeView_.enable_model_drag_source(target_entries, Gdk::BUTTON1_MASK, Gdk::DragAction::ACTION_MOVE | Gdk::DragAction::ACTION_COPY);
+    treeView_.enable_model_drag_dest(target_entries, Gdk::DragAction::ACTION_MOVE | Gdk::DragAction::ACTION_COPY);
     treeView_.signal_drag_begin().connect(sigc::mem_fun(*this, &Explorer::on_drag_begin));
     treeView_.signal_drag_data_get().connect(sigc::mem_fun(*this, &Explorer::on_drag_data_get));
     treeView_.signal_drag_data_received().connect(sigc::mem_fun(*this, &Explorer::on_drag_data_received));
 }
 
-Explorer::~Explorer() = default;
+Explorer::~Explorer() {
+    save_snapshot();
+    insertIdle_.disconnect();
+    flushTimeout_.disconnect();
+    watchIo_.disconnect();
+}
 
+// Rows are built lazily: only the top level is listed here, and every folder gets a
+// placeholder child that is replaced with its real contents the first time it is expanded.
 void Explorer::populate() {
+    TRACE_SCOPE("Explorer::populate");
+    treeModel_->clear();
+    rowIndex_.clear();
+    pendingScans_.clear();
+    readyScans_.clear();
+    deferredChanges_.clear();
+    scanMtimes_.clear();
+    pendingChecks_.clear();
+    rootPath_ = std::filesystem::current_path();
+    populate_directory(rootPath_, Gtk::TreeModel::Row());
+}
+
+bool Explorer::restore_snapshot() {
+    TRACE_SCOPE("Explorer::restore_snapshot");
+    int fd = open(snapshotPath_.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st {};
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        close(fd);
+        return false;
+    }
+    void* map = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return false;
+    }
+
+    bool ok = load_snapshot(std::string_view(static_cast<const char*>(map), st.st_size));
+    munmap(map, st.st_size);
+    if (!ok) {
+        std::cerr << "Ignoring invalid tree snapshot: " << snapshotPath_ << std::endl;
+    }
+    return ok;
+}
+
+// Only folders that had been listed are in the snapshot, so restoring costs what was on
+// screen, not the size of the workspace
+bool Explorer::load_snapshot(std::string_view data) {
     treeModel_->clear();
-    std::filesystem::path path = std::filesystem::current_path();
-    populate_directory(path, Gtk::TreeModel::Row());
+    rowIndex_.clear();
+    pendingScans_.clear();
+    readyScans_.clear();
+    deferredChanges_.clear();
+    scanMtimes_.clear();
+    pendingChecks_.clear();
+    rootPath_ = std::filesystem::current_path();
+
+    std::vector<SnapshotDir> dirs;
+    if (!decode_tree_snapshot(data, rootPath_.string(), dirs) || dirs.empty() || !dirs.front().relative_path.empty()) {
+        return false;
+    }
+
+    std::vector<Gtk::TreeModel::Path> expanded;
+    for (size_t i = 0; i < dirs.size(); i++) {
+        const SnapshotDir& snapshot_dir = dirs[i];
+        std::filesystem::path dir = rootPath_;
+        Gtk::TreeModel::Row row;
+        // Rules may have changed since the snapshot was written
+        if (i > 0 && ignoreRules_->is_ignored_path(snapshot_dir.relative_path, true)) {
+            continue;
+        }
+        if (i > 0) {
+            // Parents come first, so the folder's row is already there
+            dir /= snapshot_dir.relative_path;
+            Gtk::TreeModel::iterator iter = find_row(dir);
+            if (snapshot_dir.relative_path.empty() || !iter || !(*iter)[columns_.column_is_dir] || (*iter)[columns_.column_scanned]) {
+                return false;
+            }
+            row = *iter;
+        }
+
+        std::string prefix = snapshot_dir.relative_path.empty() ? std::string() : snapshot_dir.relative_path + "/";
+        for (const DirEntry& entry : snapshot_dir.entries) {
+            if (!ignoreRules_->is_ignored(prefix + entry.name, entry.is_directory)) {
+                append_entry(row, entry);
+            }
+        }
+        if (row) {
+            rows_.remove_placeholder(row);
+            row[columns_.column_scanned] = true;
+            if (snapshot_dir.expanded) {
+                expanded.push_back(treeModel_->get_path(row));
+            }
+        }
+
+        // Only listed again if it changed since
+        watcher_.add_directory(dir);
+        scanMtimes_[dir.string()] = snapshot_dir.mtime_ns;
+        pendingChecks_[scanner_.request(dir, snapshot_dir.mtime_ns)] = dir.string();
+    }
+
+    for (const auto& path : expanded) {
+        treeView_.expand_row(path, false);
+    }
+    return true;
+}
+
+void Explorer::save_snapshot() {
+    if (rootPath_.empty() || is_scan_pending(Gtk::TreeModel::iterator())) {
+        return;
+    }
+
+    std::vector<SnapshotDir> dirs;
+    collect_directories(dirs, Gtk::TreeModel::iterator());
+    std::string data = encode_tree_snapshot(rootPath_.string(), dirs);
+
+    std::error_code ec;
+    std::filesystem::create_directories(std::filesystem::path(snapshotPath_).parent_path(), ec);
+    std::string error;
+    if (!SaveQueue::write_atomically(snapshotPath_, data, error)) {
+        std::cerr << "Error writing tree snapshot: " << snapshotPath_ << ": " << error << std::endl;
+    }
+}
+
+// Adds a listed folder and then, recursively, its listed subfolders
+void Explorer::collect_directories(std::vector<SnapshotDir>& dirs, const Gtk::TreeModel::iterator& dir) {
+    std::string path = dir ? get_row_path(dir).string() : rootPath_.string();
+    auto mtime = scanMtimes_.find(path);
+
+    SnapshotDir snapshot_dir;
+    snapshot_dir.relative_path = dir ? path.substr(rootPath_.string().size() + 1) : std::string();
+    snapshot_dir.mtime_ns = mtime != scanMtimes_.end() ? mtime->second : -1;
+    snapshot_dir.expanded = dir && treeView_.row_expanded(treeModel_->get_path(dir));
+
+    Gtk::TreeModel::Children children = dir ? dir->children() : treeModel_->children();
+    std::vector<Gtk::TreeModel::iterator> subfolders;
+    for (auto child = children.begin(); child != children.end(); ++child) {
+        if ((*child)[columns_.column_placeholder]) {
+            continue;
+        }
+        bool is_directory = (*child)[columns_.column_is_dir];
+        Glib::ustring name = (*child)[columns_.column_name];
+        snapshot_dir.entries.push_back({name.raw(), is_directory});
+        if (is_directory && (*child)[columns_.column_scanned] && !is_scan_pending(child)) {
+            subfolders.push_back(child);
+        }
+    }
+    dirs.push_back(std::move(snapshot_dir));
+
+    for (const auto& subfolder : subfolders) {
+        collect_directories(dirs, subfolder);
+    }
+}
+
+// Brings a folder restored from the snapshot in line with a fresh listing, touching only
+// the rows that differ so expanded subfolders stay as they are
+void Explorer::resync_directory(const ScanResult& result) {
+    Gtk::TreeModel::iterator dir;
+    if (result.path != rootPath_) {
+        dir = find_row(result.path);
+        if (!dir || !(*dir)[columns_.column_scanned]) {
+            return;
+        }
+    }
+    if (is_scan_pending(dir)) {
+        return;
+    }
+    scanMtimes_[result.path.string()] = result.mtime_ns;
+
+    std::unordered_set<std::string> listed;
+    for (const auto& entry : result.entries) {
+        listed.insert(entry_key(entry.name, entry.is_directory));
+    }
+
+    std::unordered_set<std::string> present;
+    Gtk::TreeModel::Children children = dir ? dir->children() : treeModel_->children();
+    for (auto child = children.begin(); child != children.end();) {
+        auto next = child;
+        ++next;
+        if (!(*child)[columns_.column_placeholder]) {
+            Glib::ustring name = (*child)[columns_.column_name];
+            std::string key = entry_key(name.raw(), (*child)[columns_.column_is_dir]);
+            if (listed.count(key)) {
+                present.insert(key);
+            } else {
+                erase_row(child);
+            }
+        }
+        child = next;
+    }
+
+    for (const auto& entry : result.entries) {
+        if (!present.count(entry_key(entry.name, entry.is_directory))) {
+            insert_entry(dir ? *dir : Gtk::TreeModel::Row(), entry);
+        }
+    }
 }
 
 void Explorer::populate_directory(const std::filesystem::path& path, const Gtk::TreeModel::Row& parent_row) {
-    for (const auto& entry : std::filesystem::directory_iterator(path)) {
-        Gtk::TreeModel::Row row = *(parent_row ? treeModel_->append(parent_row.children()) : treeModel_->append());
-        row[columns_.column_name] = entry.path().filename().string();
-        if (entry.is_regular_file()) {
-            row[columns_.column_icon] = fileIcon_;
-        } else if (entry.is_directory()) {
-            row[columns_.column_icon] = folderIcon_;
-            populate_directory(entry.path(), row);
+    TRACE_SCOPE("Explorer::populate_directory", path.string());
+    // Watch before listing so nothing created in between is missed
+    watcher_.add_directory(path);
+    uint64_t id = scanner_.request(path);
+    if (parent_row) {
+        parent_row[columns_.column_scanned] = true;
+        pendingScans_[id] = Gtk::TreeRowReference(treeModel_, treeModel_->get_path(parent_row));
+    } else {
+        rootScan_ = id;
+        pendingScans_[id] = Gtk::TreeRowReference();
+    }
+}
+
+void Explorer::on_scan_ready() {
+    for (auto& result : scanner_.take_results()) {
+        auto check = pendingChecks_.find(result.id);
+        if (check != pendingChecks_.end()) {
+            pendingChecks_.erase(check);
+            if (!result.unchanged) {
+                resync_directory(result);
+            }
+            continue;
+        }
+        if (pendingScans_.count(result.id)) {
+            scanMtimes_[result.path.string()] = result.mtime_ns;
+            readyScans_.push_back({std::move(result), 0});
+        }
+    }
+
+    if (!readyScans_.empty() && !insertIdle_.connected()) {
+        insertIdle_ = Glib::signal_idle().connect(sigc::mem_fun(*this, &Explorer::on_insert_idle));
+    }
+}
+
+// Inserts at most a fixed number of rows per call so huge folders never stall the main loop.
+bool Explorer::on_insert_idle() {
+    TRACE_SCOPE("Explorer::on_insert_idle");
+    const size_t batch_size = 256;
+    size_t inserted = 0;
+
+    while (!readyScans_.empty() && inserted < batch_size) {
+        PendingInsert& pending = readyScans_.front();
+        auto ref = pendingScans_.find(pending.result.id);
+        if (ref == pendingScans_.end()) {
+            readyScans_.pop_front();
+            continue;
+        }
+
+        bool is_root = pending.result.id == rootScan_;
+        Gtk::TreeModel::Row parent_row;
+        if (!is_root) {
+            if (!ref->second.is_valid()) {
+                // The folder was removed while it was being listed
+                pendingScans_.erase(ref);
+                readyScans_.pop_front();
+                continue;
+            }
+            parent_row = *treeModel_->get_iter(ref->second.get_path());
+        }
+
+        const auto& entries = pending.result.entries;
+        while (pending.next < entries.size() && inserted < batch_size) {
+            append_entry(parent_row, entries[pending.next++]);
+            inserted++;
+        }
+
+        if (pending.next == entries.size()) {
+            if (parent_row) {
+                rows_.remove_placeholder(parent_row);
+            }
+            pendingScans_.erase(ref);
+            readyScans_.pop_front();
+
+            if (!deferredChanges_.empty()) {
+                std::vector<FsChange> deferred;
+                deferred.swap(deferredChanges_);
+                apply_changes(deferred);
+            }
+        }
+    }
+
+    return !readyScans_.empty();
+}
+
+void Explorer::append_entry(const Gtk::TreeModel::Row& parent_row, const DirEntry& entry) {
+    std::filesystem::path path = (parent_row ? get_row_path(parent_row) : rootPath_) / entry.name;
+    rowIndex_[path.string()] = rows_.append(parent_row, entry, path.string());
+}
+
+void Explorer::insert_entry(const Gtk::TreeModel::Row& parent_row, const DirEntry& entry) {
+    std::filesystem::path path = (parent_row ? get_row_path(parent_row) : rootPath_) / entry.name;
+    rowIndex_[path.string()] = rows_.insert(parent_row, entry, path.string());
+}
+
+std::filesystem::path Explorer::get_row_path(const Gtk::TreeModel::iterator& iter) {
+    std::string path = (*iter)[columns_.column_path];
+    return path;
+}
+
+void Explorer::erase_row(const Gtk::TreeModel::iterator& iter) {
+    unindex_rows(iter);
+    treeModel_->erase(iter);
+}
+
+void Explorer::unindex_rows(const Gtk::TreeModel::iterator& iter) {
+    std::string path = (*iter)[columns_.column_path];
+    rowIndex_.erase(path);
+    for (const auto& child : iter->children()) {
+        unindex_rows(child);
+    }
+}
+
+// Rewrites the stored path of a row and everything below it, e.g. after a rename
+void Explorer::reindex_rows(const Gtk::TreeModel::iterator& iter, const std::filesystem::path& path) {
+    if ((*iter)[columns_.column_placeholder]) {
+        return;
+    }
+    std::string old_path = (*iter)[columns_.column_path];
+    rowIndex_.erase(old_path);
+    rowIndex_[path.string()] = iter;
+    (*iter)[columns_.column_path] = path.string();
+
+    for (const auto& child : iter->children()) {
+        Glib::ustring name = child[columns_.column_name];
+        reindex_rows(child, path / name.raw());
+    }
+}
+
+void Explorer::on_row_expanded(const Gtk::TreeModel::iterator& iter, const Gtk::TreeModel::Path& path) {
+    Gtk::TreeModel::Row row = *iter;
+    if (!row[columns_.column_scanned]) {
+        populate_directory(get_row_path(iter), row);
+    }
+}
+
+bool Explorer::on_watch_event(Glib::IOCondition condition) {
+    watcher_.read_events();
+
+    auto now = std::chrono::steady_clock::now();
+    if (!flushTimeout_.connected()) {
+        firstEvent_ = now;
+        flushTimeout_ = Glib::signal_timeout().connect(sigc::mem_fun(*this, &Explorer::on_flush_changes), 100);
+    }
+    lastEvent_ = now;
+    return true;
+}
+
+// Waits for a burst of events (git checkout, unpacking an archive, ...) to settle so it
+// lands in the tree as a single batch, but never holds changes back for more than a second.
+bool Explorer::on_flush_changes() {
+    auto now = std::chrono::steady_clock::now();
+    if (now - lastEvent_ < std::chrono::milliseconds(100) && now - firstEvent_ < std::chrono::seconds(1)) {
+        return true;
+    }
+
+    if (watcher_.overflowed()) {
+        watcher_.take_changes();
+        populate();
+    } else if (watcher_.has_changes()) {
+        std::vector<FsChange> changes;
+        for (auto& change : watcher_.take_changes()) {
+            if (is_busy(change.path) || (change.kind == FsChange::Renamed && is_busy(change.old_path))) {
+                heldChanges_.push_back(std::move(change));
+            } else {
+                changes.push_back(std::move(change));
+            }
         }
+        apply_changes(changes);
+        changes_signal_.emit(changes);
     }
+    return false;
+}
+
+// Every change is checked against the filesystem before it touches the model, so stale
+// or out-of-order events can't leave phantom rows behind.
+void Explorer::apply_changes(const std::vector<FsChange>& changes) {
+    TRACE_SCOPE("Explorer::apply_changes");
+    for (const auto& change : changes) {
+        std::filesystem::path parent = change.path.parent_path();
+        Gtk::TreeModel::iterator parent_iter;
+        if (parent != rootPath_) {
+            parent_iter = find_row(parent);
+            if (!parent_iter || !(*parent_iter)[columns_.column_scanned]) {
+                // Not listed yet, expanding it will pick the change up
+                if (change.kind == FsChange::Renamed) {
+                    if (auto old_iter = find_row(change.old_path)) {
+                        erase_row(old_iter);
+                    }
+                }
+                continue;
+            }
+        }
+        if (is_scan_pending(parent_iter)) {
+            deferredChanges_.push_back(change);
+            continue;
+        }
+
+        std::error_code ec;
+        bool exists = std::filesystem::exists(change.path, ec);
+        Gtk::TreeModel::iterator iter = find_row(change.path);
+        DirEntry entry{change.path.filename().string(), std::filesystem::is_directory(change.path, ec)};
+
+        if (change.kind == FsChange::Renamed) {
+            Gtk::TreeModel::iterator old_iter = find_row(change.old_path);
+            if (old_iter && exists && !iter && change.old_path.parent_path() == parent) {
+                // Same folder: rename in place so an expanded subtree stays expanded
+                (*old_iter)[columns_.column_name] = entry.name;
+                reindex_rows(old_iter, change.path);
+                Gtk::TreeModel::Children siblings = parent_iter ? parent_iter->children() : treeModel_->children();
+                treeModel_->move(old_iter, rows_.sorted_position(siblings, entry));
+                continue;
+            }
+            if (old_iter) {
+                erase_row(old_iter);
+            }
+        }
+
+        if (exists && !iter && change.kind != FsChange::Removed) {
+            insert_entry(parent_iter ? *parent_iter : Gtk::TreeModel::Row(), entry);
+        } else if (!exists && iter) {
+            erase_row(iter);
+        }
+    }
+}
+
+// Tree store iterators stay valid until their row is removed, so the index can hand
+// them out directly without walking the tree.
+Gtk::TreeModel::iterator Explorer::find_row(const std::filesystem::path& path) {
+    auto it = rowIndex_.find(path.string());
+    if (it == rowIndex_.end()) {
+        return Gtk::TreeModel::iterator();
+    }
+    return it->second;
+}
+
+bool Explorer::is_scan_pending(const Gtk::TreeModel::iterator& dir) {
+    if (!dir) {
+        return pendingScans_.count(rootScan_) > 0;
+    }
+    Gtk::TreeModel::Path dir_path = treeModel_->get_path(dir);
+    for (const auto& [id, ref] : pendingScans_) {
+        if (id != rootScan_ && ref.is_valid() && ref.get_path() == dir_path) {
+            return true;
+        }
+    }
+    return false;
 }
 
 void Explorer::on_row_activated(const Gtk::TreeModel::Path& path, Gtk::TreeViewColumn* column) {
     Gtk::TreeModel::iterator iter = treeModel_->get_iter(path);
     if (iter) {
-        Gtk::TreeModel::Row row = *iter;
-        Glib::ustring name = row[columns_.column_name];
-        std::filesystem::path file_path = std::filesystem::current_path() / name.raw();
+        std::filesystem::path file_path = get_row_path(iter);
         if (std::filesystem::is_regular_file(file_path)) {
             file_selected_signal_.emit(file_path.string());
         }
@@ -113,29 +590,13 @@ bool Explorer::on_button_press(GdkEventButton* event) {
     return false;
 }
 
+
 void Explorer::on_create_file_menu_item() {
     Gtk::TreeModel::iterator iter = treeView_.get_selection()->get_selected();
     if (iter) {
-        Gtk::TreeModel::Row row = *iter;
-        Glib::ustring name = row[columns_.column_name];
-
-        // Get the full path of the selected item
-        Gtk::TreeModel::Path tree_path = treeModel_->get_path(iter);
-        std::filesystem::path full_path = std::filesystem::current_path();
-
-        // Traverse up the tree to construct the full path
-        while (tree_path.up()) {
-            Gtk::TreeModel::iterator parent_iter = treeModel_->get_iter(tree_path);
-            if (parent_iter) {
-                Gtk::TreeModel::Row parent_row = *parent_iter;
-                Glib::ustring parent_name = parent_row[columns_.column_name];
-                full_path /= parent_name.c_str();
-            }
-        }
-        full_path /= name.c_str();
-
+        std::filesystem::path full_path = get_row_path(iter);
         if (!std::filesystem::is_directory(full_path)) {
-            full_path = std::filesystem::current_path();
+            full_path = rootPath_;
         }
 
         std::string file_name = get_user_input("New File", "Enter file name:");
@@ -143,7 +604,6 @@ void Explorer::on_create_file_menu_item() {
             std::filesystem::path file_path = full_path / file_name;
             std::ofstream ofs(file_path, std::ofstream::out);
             ofs.close();
-            populate();
         } else {
             show_error_dialog(this->get_toplevel(), "Empty file name provided.");
         }
@@ -153,41 +613,20 @@ void Explorer::on_create_file_menu_item() {
 void Explorer::on_create_folder_menu_item() {
     Gtk::TreeModel::iterator iter = treeView_.get_selection()->get_selected();
     if (iter) {
-        Gtk::TreeModel::Row row = *iter;
-        Glib::ustring name = row[columns_.column_name];
-
-        // Get the full path of the selected item
-        Gtk::TreeModel::Path tree_path = treeModel_->get_path(iter);
-        std::filesystem::path full_path = std::filesystem::current_path();
-
-        // Traverse up the tree to construct the full path
-        std::vector<std::string> path_components;
-        while (tree_path.size() > 0) {
-            Gtk::TreeModel::iterator parent_iter = treeModel_->get_iter(tree_path);
-            if (parent_iter) {
-                Gtk::TreeModel::Row parent_row = *parent_iter;
-                Glib::ustring parent_name = parent_row[columns_.column_name];
-                path_components.push_back(parent_name.c_str());
-            }
-            tree_path.up();
-        }
-
-        // Reverse the path components to construct the correct path
-        std::reverse(path_components.begin(), path_components.end());
-        for (const auto& component : path_components) {
-            full_path /= component;
-        }
-        std::cout << "Creating folder in: " << full_path << std::endl;
+        std::filesystem::path full_path = get_row_path(iter);
 
         if (!std::filesystem::is_directory(full_path)) {
-            full_path = std::filesystem::current_path();
+            full_path = rootPath_;
         }
 
         std::string folder_name = get_user_input("New Folder", "Enter folder name:");
         if (!folder_name.empty()) {
             std::filesystem::path new_dir_path = full_path / folder_name;
             std::filesystem::create_directory(new_dir_path);
-            populate();
+            if (Tracer::enabled()) {
+                uint64_t now = Tracer::now_ns();
+                Tracer::record("Create folder", now, now, new_dir_path.string());
+            }
         } else {
             show_error_dialog(this->get_toplevel(), "Empty folder name provided.");
         }
@@ -197,38 +636,102 @@ void Explorer::on_create_folder_menu_item() {
 void Explorer::on_delete_menu_item() {
     Gtk::TreeModel::iterator iter = treeView_.get_selection()->get_selected();
     if (iter) {
-        Gtk::TreeModel::Row row = *iter;
-        Glib::ustring name = row[columns_.column_name];
-
-        // Get the full path of the selected item
-        Gtk::TreeModel::Path tree_path = treeModel_->get_path(iter);
-        std::filesystem::path full_path = std::filesystem::current_path();
-
-        // Traverse up the tree to construct the full path
-        std::vector<std::string> path_components;
-        while (tree_path.size() > 0) {
-            Gtk::TreeModel::iterator parent_iter = treeModel_->get_iter(tree_path);
-            if (parent_iter) {
-                Gtk::TreeModel::Row parent_row = *parent_iter;
-                Glib::ustring parent_name = parent_row[columns_.column_name];
-                path_components.push_back(parent_name.c_str());
-            }
-            tree_path.up();
+        std::filesystem::path full_path = get_row_path(iter);
+
+        if (std::filesystem::exists(full_path)) {
+            start_operation(fileOps_.remove(full_path), FileOpStatus::Delete, full_path, std::filesystem::path());
+        }
+    }
+}
+
+void Explorer::start_operation(uint64_t id, FileOpStatus::Kind kind, const std::filesystem::path& source, const std::filesystem::path& destination) {
+    FileOpStatus& status = runningOps_[id];
+    status.id = id;
+    status.kind = kind;
+    status.source = source;
+    status.destination = destination;
+    update_ops_bar();
+}
+
+void Explorer::on_ops_ready() {
+    for (const auto& status : fileOps_.take_updates()) {
+        if (status.finished) {
+            runningOps_.erase(status.id);
+            finish_operation(status);
+        } else if (runningOps_.count(status.id)) {
+            runningOps_[status.id] = status;
         }
+    }
+    update_ops_bar();
+}
 
-        // Reverse the path components to construct the correct path
-        std::reverse(path_components.begin(), path_components.end());
-        for (const auto& component : path_components) {
-            full_path /= component;
+// The tree only now learns about the operation, checked against the disk like any change
+void Explorer::finish_operation(const FileOpStatus& status) {
+    std::vector<FsChange> changes;
+    for (auto it = heldChanges_.begin(); it != heldChanges_.end();) {
+        if (!is_busy(it->path) && (it->kind != FsChange::Renamed || !is_busy(it->old_path))) {
+            changes.push_back(std::move(*it));
+            it = heldChanges_.erase(it);
+        } else {
+            ++it;
         }
+    }
 
-        std::cout << "Deleting: " << full_path << std::endl;
+    std::error_code ec;
+    switch (status.kind) {
+    case FileOpStatus::Move:
+        changes.push_back({FsChange::Renamed, status.destination, status.source, std::filesystem::is_directory(status.destination, ec)});
+        break;
+    case FileOpStatus::Copy:
+        changes.push_back({FsChange::Added, status.destination, {}, std::filesystem::is_directory(status.destination, ec)});
+        break;
+    case FileOpStatus::Delete:
+        changes.push_back({FsChange::Removed, status.source, {}, false});
+        break;
+    }
+    watcher_.drop_ignored(changes);
+    apply_changes(changes);
+    changes_signal_.emit(changes);
 
-        if (std::filesystem::exists(full_path)) {
-            std::filesystem::remove_all(full_path);
-            populate();
+    if (!status.ok && !status.cancelled) {
+        error_bell();
+        show_error_dialog(this->get_toplevel(), "Error: " + status.error);
+    }
+}
+
+void Explorer::update_ops_bar() {
+    if (runningOps_.empty()) {
+        opsBar_.hide();
+        return;
+    }
+
+    static const char* const kVerbs[] = {"Moving", "Copying", "Deleting"};
+    const FileOpStatus& status = runningOps_.begin()->second;
+    std::string text = std::string(kVerbs[status.kind]) + " " + status.source.filename().string();
+    if (runningOps_.size() > 1) {
+        text += " (+" + std::to_string(runningOps_.size() - 1) + " more)";
+    }
+    opsLabel_.set_text(text);
+    if (status.bytes_total > 0) {
+        opsProgress_.set_fraction(static_cast<double>(status.bytes_done) / status.bytes_total);
+    } else {
+        opsProgress_.pulse();
+    }
+    opsBar_.show_all();
+}
+
+bool Explorer::is_busy(const std::filesystem::path& path) const {
+    auto under = [&path](const std::filesystem::path& root) {
+        const std::string& p = path.native();
+        const std::string& r = root.native();
+        return !r.empty() && p.compare(0, r.size(), r) == 0 && (p.size() == r.size() || p[r.size()] == '/');
+    };
+    for (const auto& [id, status] : runningOps_) {
+        if (under(status.source) || (!status.destination.empty() && (under(status.destination) || under(FileOps::staging_path(status.destination))))) {
+            return true;
         }
     }
+    return false;
 }
 
 std::string Explorer::get_user_input(const std::string& title, const std::string& label) {
@@ -257,77 +760,33 @@ sigc::signal<void, const std::string&> Explorer::signal_file_selected() {
     return file_selected_signal_;
 }
 
+sigc::signal<void, const std::vector<FsChange>&> Explorer::signal_changes() {
+    return changes_signal_;
+}
+
 // Drag-and-Drop handlers
 void Explorer::on_drag_begin(const Glib::RefPtr<Gdk::DragContext>& context) {
     Gtk::TreeModel::iterator iter = treeView_.get_selection()->get_selected();
     if (iter) {
-        Gtk::TreeModel::Row row = *iter;
-        Glib::ustring name = row[columns_.column_name];
-
-        // Get the full path of the selected item
-        Gtk::TreeModel::Path tree_path = treeModel_->get_path(iter);
-        std::filesystem::path full_path = std::filesystem::current_path();
-
-        // Traverse up the tree to construct the full path
-        std::vector<std::string> path_components;
-        while (tree_path.size() > 0) {
-            Gtk::TreeModel::iterator parent_iter = treeModel_->get_iter(tree_path);
-            if (parent_iter) {
-                Gtk::TreeModel::Row parent_row = *parent_iter;
-                Glib::ustring parent_name = parent_row[columns_.column_name];
-                path_components.push_back(parent_name.c_str());
-            }
-            tree_path.up();
-        }
-
-        // Reverse the path components to construct the correct path
-        std::reverse(path_components.begin(), path_components.end());
-        for (const auto& component : path_components) {
-            full_path /= component;
-        }
+        drag_data_ = get_row_path(iter).string();
 
         // Set the drag data to the full path
-        context->set_data("text/uri-list", reinterpret_cast<void*>(const_cast<char*>(full_path.string().c_str())));
+        context->set_data("text/uri-list", reinterpret_cast<void*>(const_cast<char*>(drag_data_.c_str())));
     }
 }
 
 void Explorer::on_drag_data_get(const Glib::RefPtr<Gdk::DragContext>& context, Gtk::SelectionData& selection_data, guint info, guint time) {
     Gtk::TreeModel::iterator iter = treeView_.get_selection()->get_selected();
     if (iter) {
-        Gtk::TreeModel::Row row = *iter;
-        Glib::ustring name = row[columns_.column_name];
-
-        // Get the full path of the selected item
-        Gtk::TreeModel::Path tree_path = treeModel_->get_path(iter);
-        std::filesystem::path full_path = std::filesystem::current_path();
-
-        // Traverse up the tree to construct the full path
-        std::vector<std::string> path_components;
-        while (tree_path.size() > 0) {
-            Gtk::TreeModel::iterator parent_iter = treeModel_->get_iter(tree_path);
-            if (parent_iter) {
-                Gtk::TreeModel::Row parent_row = *parent_iter;
-                Glib::ustring parent_name = parent_row[columns_.column_name];
-                path_components.push_back(parent_name.c_str());
-            }
-            tree_path.up();
-        }
-
-        // Reverse the path components to construct the correct path
-        std::reverse(path_components.begin(), path_components.end());
-        for (const auto& component : path_components) {
-            full_path /= component;
-        }
-
         // Set the selection data to the full path
-        std::string data = full_path.string();
+        std::string data = get_row_path(iter).string();
         selection_data.set(selection_data.get_target(), 8, (const guchar*)data.c_str(), data.size());
     }
 }
 
 void Explorer::on_drag_data_received(const Glib::RefPtr<Gdk::DragContext>& context, int x, int y, const Gtk::SelectionData& selection_data, guint info, guint time) {
     if (selection_data.get_data_type() == "text/uri-list") {
-        drag_data_ = std::string((const char*)selection_data.get_data());
+        drag_data_ = std::string((const char*)selection_data.get_data(), selection_data.get_length());
 
         Gtk::TreeModel::Path dest_path;
         Gtk::TreeViewColumn* dest_column;
@@ -336,31 +795,10 @@ void Explorer::on_drag_data_received(const Glib::RefPtr<Gdk::DragContext>& conte
         treeView_.convert_widget_to_tree_coords(x, y, cell_x, cell_y);
 
         if (treeView_.get_path_at_pos(cell_x, cell_y, dest_path, dest_column, cell_x, cell_y)) {
-            std::cout << "Destination path found" << std::endl;
             Gtk::TreeModel::iterator dest_iter = treeModel_->get_iter(dest_path);
             if (dest_iter) {
-                Gtk::TreeModel::Row dest_row = *dest_iter;
-                Glib::ustring dest_name = dest_row[columns_.column_name];
-
-                // Get the full path of the destination item
-                std::filesystem::path dest_full_path = std::filesystem::current_path();
-                std::vector<std::string> path_components;
-                while (dest_path.size() > 0) {
-                    Gtk::TreeModel::iterator parent_iter = treeModel_->get_iter(dest_path);
-                    if (parent_iter) {
-                        Gtk::TreeModel::Row parent_row = *parent_iter;
-                        Glib::ustring parent_name = parent_row[columns_.column_name];
-                        path_components.push_back(parent_name.c_str());
-                    }
-                    dest_path.up();
-                }
-
-                std::reverse(path_components.begin(), path_components.end());
-                for (const auto& component : path_components) {
-                    dest_full_path /= component;
-                }
-
-                std::filesystem::path source_path = std::filesystem::current_path() / drag_data_;
+                std::filesystem::path dest_full_path = get_row_path(dest_iter);
+                std::filesystem::path source_path = drag_data_;
 
                 if (source_path == dest_full_path) {
                     error_bell();
@@ -374,21 +812,22 @@ void Explorer::on_drag_data_received(const Glib::RefPtr<Gdk::DragContext>& conte
                     return;
                 }
 
-                if (dest_full_path.parent_path() == std::filesystem::current_path() && std::filesystem::is_regular_file(dest_full_path)) {
-                    dest_full_path = std::filesystem::current_path();
+                if (dest_full_path.parent_path() == rootPath_ && std::filesystem::is_regular_file(dest_full_path)) {
+                    dest_full_path = rootPath_;
                 }
 
                 if (std::filesystem::is_directory(dest_full_path)) {
-                    std::filesystem::path source_path = std::filesystem::current_path() / drag_data_;
                     if (std::filesystem::exists(source_path)) {
                         std::filesystem::path destination_path = dest_full_path / source_path.filename();
-                        std::filesystem::rename(source_path, destination_path);
-                        populate();
+                        if (context->get_selected_action() == Gdk::ACTION_COPY) {
+                            start_operation(fileOps_.copy(source_path, destination_path), FileOpStatus::Copy, source_path, destination_path);
+                        } else {
+                            start_operation(fileOps_.move(source_path, destination_path), FileOpStatus::Move, source_path, destination_path);
+                        }
                     }
                 } else {
                     error_bell();
                     show_error_dialog(this->get_toplevel(), "Destination is not a directory");
-                    std::cout << "Destination is not a directory" << std::endl;
                 }
             }
         }
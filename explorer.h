@@ -1,11 +1,28 @@
 #ifndef EXPLORER_H
 #define EXPLORER_H
 
+#include <gtkmm/box.h>
+#include <gtkmm/button.h>
+#include <gtkmm/label.h>
+#include <gtkmm/progressbar.h>
 #include <gtkmm/scrolledwindow.h>
 #include <gtkmm/treemodel.h>
 #include <gtkmm/treeview.h>
 #include <gtkmm/treestore.h>
+#include <glibmm/dispatcher.h>
+#include <chrono>
 #include <filesystem>
+#include <deque>
+#include <map>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "dir_scanner.h"
+#include "explorer_rows.h"
+#include "file_ops.h"
+#include "file_watcher.h"
+#include "tree_snapshot.h"
 
 class Explorer : public Gtk::ScrolledWindow {
 public:
@@ -15,30 +32,92 @@ public:
     void populate();
 
     sigc::signal<void, const std::string&> signal_file_selected();
+    // Watcher changes under listed folders, after they were applied to the tree
+    sigc::signal<void, const std::vector<FsChange>&> signal_changes();
+    // Progress of moves, copies and deletes with a cancel button, hidden while idle;
+    // for the window to place
+    Gtk::Widget& operations_bar() { return opsBar_; }
+    // Workspace .gitignore / .librenoteignore rules, loaded once at startup
+    std::shared_ptr<const IgnoreRules> ignore_rules() const { return ignoreRules_; }
 
 protected:
     Gtk::Menu contextMenu_;
     Gtk::MenuItem createFileMenuItem_;
     Gtk::MenuItem createFolderMenuItem_;
     Gtk::MenuItem deleteMenuItem_;
-    class ModelColumns : public Gtk::TreeModel::ColumnRecord {
-    public:
-        ModelColumns() {
-            add(column_name);
-            add(column_icon);
-        }
-
-        Gtk::TreeModelColumn<Glib::ustring> column_name;
-        Gtk::TreeModelColumn<Glib::RefPtr<Gdk::Pixbuf>> column_icon;
+
+    // A finished listing waiting to be inserted under its parent row
+    struct PendingInsert {
+        ScanResult result;
+        size_t next = 0;
     };
 
-    ModelColumns columns_;
-    Glib::RefPtr<Gtk::TreeStore> treeModel_;
+    ExplorerRows rows_;
+    const ExplorerColumns& columns_ = rows_.columns();
+    Glib::RefPtr<Gtk::TreeStore> treeModel_ = rows_.store();
     Gtk::TreeView treeView_;
-    Glib::RefPtr<Gdk::Pixbuf> folderIcon_;
-    Glib::RefPtr<Gdk::Pixbuf> fileIcon_;
 
+    Glib::Dispatcher scanDispatcher_;
+    DirScanner scanner_;
+    std::map<uint64_t, Gtk::TreeRowReference> pendingScans_;
+    uint64_t rootScan_ = 0;
+    std::deque<PendingInsert> readyScans_;
+    sigc::connection insertIdle_;
+    std::filesystem::path rootPath_;
+    std::shared_ptr<const IgnoreRules> ignoreRules_;
+    std::unordered_map<std::string, Gtk::TreeModel::iterator> rowIndex_;
+    // Directory mtime each listed folder had when it was listed
+    std::unordered_map<std::string, int64_t> scanMtimes_;
+    // Folders restored from the snapshot whose mtime is being checked, by request id
+    std::unordered_map<uint64_t, std::string> pendingChecks_;
+    std::string snapshotPath_;
+
+    FileWatcher watcher_;
+    sigc::connection watchIo_;
+    sigc::connection flushTimeout_;
+    std::chrono::steady_clock::time_point firstEvent_;
+    std::chrono::steady_clock::time_point lastEvent_;
+    // Changes under folders whose listing is still in flight, replayed once it lands
+    std::vector<FsChange> deferredChanges_;
+
+    Glib::Dispatcher opsDispatcher_;
+    FileOps fileOps_;
+    // Queued and running operations; their paths only change in the tree once they finish
+    std::map<uint64_t, FileOpStatus> runningOps_;
+    // Watcher changes under those paths, applied along with the operation's result
+    std::vector<FsChange> heldChanges_;
+    Gtk::Box opsBar_;
+    Gtk::Label opsLabel_;
+    Gtk::ProgressBar opsProgress_;
+    Gtk::Button opsCancel_;
+
+    bool restore_snapshot();
+    bool load_snapshot(std::string_view data);
+    void save_snapshot();
+    void collect_directories(std::vector<SnapshotDir>& dirs, const Gtk::TreeModel::iterator& dir);
+    void resync_directory(const ScanResult& result);
     void populate_directory(const std::filesystem::path& path, const Gtk::TreeModel::Row& parent_row);
+    void on_scan_ready();
+    bool on_insert_idle();
+    void append_entry(const Gtk::TreeModel::Row& parent_row, const DirEntry& entry);
+    void insert_entry(const Gtk::TreeModel::Row& parent_row, const DirEntry& entry);
+    std::filesystem::path get_row_path(const Gtk::TreeModel::iterator& iter);
+    void erase_row(const Gtk::TreeModel::iterator& iter);
+    void unindex_rows(const Gtk::TreeModel::iterator& iter);
+    void reindex_rows(const Gtk::TreeModel::iterator& iter, const std::filesystem::path& path);
+    void on_row_expanded(const Gtk::TreeModel::iterator& iter, const Gtk::TreeModel::Path& path);
+
+    void start_operation(uint64_t id, FileOpStatus::Kind kind, const std::filesystem::path& source, const std::filesystem::path& destination);
+    void on_ops_ready();
+    void finish_operation(const FileOpStatus& status);
+    void update_ops_bar();
+    bool is_busy(const std::filesystem::path& path) const;
+
+    bool on_watch_event(Glib::IOCondition condition);
+    bool on_flush_changes();
+    void apply_changes(const std::vector<FsChange>& changes);
+    Gtk::TreeModel::iterator find_row(const std::filesystem::path& path);
+    bool is_scan_pending(const Gtk::TreeModel::iterator& dir);
     void on_row_activated(const Gtk::TreeModel::Path& path, Gtk::TreeViewColumn* column);
     bool on_button_press(GdkEventButton* event);
     void on_create_file_menu_item();
@@ -55,6 +134,7 @@ protected:
 
 private:
     sigc::signal<void, const std::string&> file_selected_signal_;
+    sigc::signal<void, const std::vector<FsChange>&> changes_signal_;
 };
 
 #endif // EXPLORER_H
\ No newline at end of file
@@ -0,0 +1,65 @@
+#include "explorer_rows.h"
+
+ExplorerRows::ExplorerRows() : store_(Gtk::TreeStore::create(columns_)) {}
+
+void ExplorerRows::set_icons(const Glib::RefPtr<Gdk::Pixbuf>& folder_icon, const Glib::RefPtr<Gdk::Pixbuf>& file_icon) {
+    folder_icon_ = folder_icon;
+    file_icon_ = file_icon;
+}
+
+Gtk::TreeModel::iterator ExplorerRows::append(const Gtk::TreeModel::Row& parent_row, const DirEntry& entry, const std::string& path) {
+    Gtk::TreeModel::iterator row = parent_row ? store_->append(parent_row.children()) : store_->append();
+    fill(*row, entry, path);
+    return row;
+}
+
+Gtk::TreeModel::iterator ExplorerRows::insert(const Gtk::TreeModel::Row& parent_row, const DirEntry& entry, const std::string& path) {
+    Gtk::TreeModel::Children children = parent_row ? parent_row.children() : store_->children();
+    Gtk::TreeModel::iterator position = sorted_position(children, entry);
+    if (!position) {
+        return append(parent_row, entry, path);
+    }
+    Gtk::TreeModel::iterator row = store_->insert(position);
+    fill(*row, entry, path);
+    return row;
+}
+
+Gtk::TreeModel::iterator ExplorerRows::sorted_position(const Gtk::TreeModel::Children& children, const DirEntry& entry) const {
+    for (auto child = children.begin(); child != children.end(); ++child) {
+        if ((*child)[columns_.column_placeholder]) {
+            continue;
+        }
+        bool child_is_dir = (*child)[columns_.column_is_dir];
+        Glib::ustring child_name = (*child)[columns_.column_name];
+        if ((entry.is_directory && !child_is_dir) ||
+            (entry.is_directory == child_is_dir && entry.name < child_name.raw())) {
+            return child;
+        }
+    }
+    return Gtk::TreeModel::iterator();
+}
+
+void ExplorerRows::fill(const Gtk::TreeModel::Row& row, const DirEntry& entry, const std::string& path) {
+    row[columns_.column_name] = entry.name;
+    row[columns_.column_path] = path;
+    row[columns_.column_is_dir] = entry.is_directory;
+    row[columns_.column_placeholder] = false;
+    row[columns_.column_scanned] = false;
+    if (entry.is_directory) {
+        row[columns_.column_icon] = folder_icon_;
+        Gtk::TreeModel::Row placeholder = *store_->append(row.children());
+        placeholder[columns_.column_name] = "Loading...";
+        placeholder[columns_.column_placeholder] = true;
+    } else {
+        row[columns_.column_icon] = file_icon_;
+    }
+}
+
+void ExplorerRows::remove_placeholder(const Gtk::TreeModel::Row& parent_row) {
+    for (auto child = parent_row.children().begin(); child != parent_row.children().end(); ++child) {
+        if ((*child)[columns_.column_placeholder]) {
+            store_->erase(child);
+            return;
+        }
+    }
+}
@@ -0,0 +1,61 @@
+#ifndef EXPLORER_ROWS_H
+#define EXPLORER_ROWS_H
+
+#include <gdkmm/pixbuf.h>
+#include <gtkmm/treemodel.h>
+#include <gtkmm/treestore.h>
+#include <string>
+
+#include "dir_scanner.h"
+
+class ExplorerColumns : public Gtk::TreeModel::ColumnRecord {
+public:
+    ExplorerColumns() {
+        add(column_name);
+        add(column_icon);
+        add(column_path);
+        add(column_is_dir);
+        add(column_placeholder);
+        add(column_scanned);
+    }
+
+    Gtk::TreeModelColumn<Glib::ustring> column_name;
+    Gtk::TreeModelColumn<Glib::RefPtr<Gdk::Pixbuf>> column_icon;
+    // Absolute path of the entry, so handlers never have to rebuild it from ancestors
+    Gtk::TreeModelColumn<std::string> column_path;
+    Gtk::TreeModelColumn<bool> column_is_dir;
+    // Dummy child shown under a folder until its contents have been listed
+    Gtk::TreeModelColumn<bool> column_placeholder;
+    Gtk::TreeModelColumn<bool> column_scanned;
+};
+
+// The explorer's TreeStore and how directory entries become rows in it. Needs no widget
+// or display, so the benchmarks fill a store through the same code as the explorer.
+class ExplorerRows {
+public:
+    ExplorerRows();
+
+    const ExplorerColumns& columns() const { return columns_; }
+    const Glib::RefPtr<Gtk::TreeStore>& store() const { return store_; }
+    void set_icons(const Glib::RefPtr<Gdk::Pixbuf>& folder_icon, const Glib::RefPtr<Gdk::Pixbuf>& file_icon);
+
+    // Row for entry, which lives at path, under parent_row or at the top level if it is
+    // empty. A folder gets a placeholder child until remove_placeholder() after its listing.
+    Gtk::TreeModel::iterator append(const Gtk::TreeModel::Row& parent_row, const DirEntry& entry, const std::string& path);
+    // Same, at entry's place among the rows already there
+    Gtk::TreeModel::iterator insert(const Gtk::TreeModel::Row& parent_row, const DirEntry& entry, const std::string& path);
+    void remove_placeholder(const Gtk::TreeModel::Row& parent_row);
+    // Keeps the scanner's order: folders first, then files, each sorted by name.
+    // Empty if entry goes last.
+    Gtk::TreeModel::iterator sorted_position(const Gtk::TreeModel::Children& children, const DirEntry& entry) const;
+
+private:
+    ExplorerColumns columns_;
+    Glib::RefPtr<Gtk::TreeStore> store_;
+    Glib::RefPtr<Gdk::Pixbuf> folder_icon_;
+    Glib::RefPtr<Gdk::Pixbuf> file_icon_;
+
+    void fill(const Gtk::TreeModel::Row& row, const DirEntry& entry, const std::string& path);
+};
+
+#endif // EXPLORER_ROWS_H
@@ -0,0 +1,194 @@
+#include "file_loader.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "trace.h"
+
+namespace {
+
+const size_t kChunkSize = 1024 * 1024;
+const size_t kMaxQueuedBytes = 4 * kChunkSize;
+
+} // namespace
+
+FileLoader::FileLoader() : worker_(&FileLoader::run, this) {}
+
+FileLoader::~FileLoader() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    cv_.notify_all();
+    worker_.join();
+
+    for (auto& job : jobs_) {
+        if (job.fd >= 0) {
+            close(job.fd);
+        }
+    }
+}
+
+uint64_t FileLoader::load(const std::string& file_path) {
+    uint64_t id;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        id = next_id_++;
+        Job job;
+        job.id = id;
+        job.file_path = file_path;
+        jobs_.push_back(std::move(job));
+    }
+    cv_.notify_all();
+    return id;
+}
+
+void FileLoader::cancel(uint64_t id) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto it = jobs_.begin(); it != jobs_.end(); ++it) {
+        if (it->id == id) {
+            if (it->fd >= 0) {
+                close(it->fd);
+            }
+            jobs_.erase(it);
+            break;
+        }
+    }
+    if (id == current_id_) {
+        current_cancelled_ = true;
+    }
+
+    for (auto it = chunks_.begin(); it != chunks_.end();) {
+        if (it->id == id) {
+            queued_bytes_ -= it->text.size();
+            it = chunks_.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    cv_.notify_all();
+}
+
+bool FileLoader::has_chunks() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return !chunks_.empty();
+}
+
+LoadChunk FileLoader::take_chunk() {
+    LoadChunk chunk;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (chunks_.empty()) {
+            return chunk;
+        }
+        chunk = std::move(chunks_.front());
+        chunks_.pop_front();
+        queued_bytes_ -= chunk.text.size();
+    }
+    cv_.notify_all();
+    return chunk;
+}
+
+void FileLoader::set_notify(std::function<void()> notify) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    notify_ = std::move(notify);
+}
+
+void FileLoader::run() {
+    Tracer::set_thread_name("FileLoader");
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        cv_.wait(lock, [this] { return stop_ || (!jobs_.empty() && queued_bytes_ < kMaxQueuedBytes); });
+        if (stop_) {
+            return;
+        }
+
+        // Take the job out of the queue while reading so cancel() never closes its fd under us
+        Job job = std::move(jobs_.front());
+        jobs_.pop_front();
+        current_id_ = job.id;
+        current_cancelled_ = false;
+
+        lock.unlock();
+        LoadChunk chunk;
+        bool finished = read_chunk(job, chunk);
+        lock.lock();
+
+        current_id_ = 0;
+        if (current_cancelled_ || finished) {
+            if (job.fd >= 0) {
+                close(job.fd);
+            }
+        } else {
+            jobs_.push_back(std::move(job));
+        }
+        if (current_cancelled_) {
+            continue;
+        }
+
+        queued_bytes_ += chunk.text.size();
+        chunks_.push_back(std::move(chunk));
+        if (notify_) {
+            notify_();
+        }
+    }
+}
+
+// Returns true once the job has nothing more to read
+bool FileLoader::read_chunk(Job& job, LoadChunk& chunk) {
+    TRACE_SCOPE("Read chunk", job.file_path);
+    chunk.id = job.id;
+
+    if (job.fd < 0) {
+        job.fd = open(job.file_path.c_str(), O_RDONLY | O_CLOEXEC);
+        struct stat st {};
+        if (job.fd < 0 || fstat(job.fd, &st) != 0) {
+            chunk.done = true;
+            chunk.failed = true;
+            return true;
+        }
+        job.total_bytes = st.st_size;
+        posix_fadvise(job.fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    }
+
+    chunk.text.swap(job.carry);
+    size_t offset = chunk.text.size();
+    chunk.text.resize(offset + kChunkSize);
+
+    ssize_t n;
+    do {
+        n = read(job.fd, &chunk.text[offset], kChunkSize);
+    } while (n < 0 && errno == EINTR);
+
+    if (n < 0) {
+        chunk.text.resize(offset);
+        chunk.done = true;
+        chunk.failed = true;
+        return true;
+    }
+
+    chunk.text.resize(offset + n);
+    job.hasher.update(chunk.text.data() + offset, n);
+    job.bytes_read += n;
+    chunk.bytes_read = job.bytes_read;
+    chunk.total_bytes = std::max(job.total_bytes, job.bytes_read);
+
+    if (!job.detected) {
+        job.encoding = detect_encoding(chunk.text.data(), chunk.text.size());
+        job.decoder = TextDecoder(job.encoding);
+        job.detected = true;
+    }
+    job.decoder.decode(chunk.text, job.carry, n == 0);
+    chunk.encoding = job.encoding;
+    chunk.lossy = job.decoder.lossy();
+
+    if (n == 0) {
+        chunk.done = true;
+        chunk.hash = job.hasher.digest();
+        return true;
+    }
+    return false;
+}
@@ -0,0 +1,80 @@
+#ifndef FILE_LOADER_H
+#define FILE_LOADER_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "content_hash.h"
+#include "text_encoding.h"
+
+struct LoadChunk {
+    uint64_t id = 0;
+    // Always UTF-8, whatever the file's encoding
+    std::string text;
+    TextEncoding encoding;
+    // Some bytes couldn't be decoded and were replaced
+    bool lossy = false;
+    size_t bytes_read = 0;
+    size_t total_bytes = 0;
+    bool done = false;
+    bool failed = false;
+    // ContentHash of the file's bytes as read, set on the last chunk
+    uint64_t hash = 0;
+};
+
+// Reads files on a worker thread in large blocks and hands them out as chunks of UTF-8
+// that always end on a character boundary. The encoding is guessed from the first
+// block and later ones are transcoded on the way, so the common UTF-8 case only pays
+// for validation. Several loads are served round-robin so a
+// huge file never holds up a small one, and the reader pauses while too much data is
+// waiting to be consumed, so memory stays close to a single copy of the file.
+class FileLoader {
+public:
+    FileLoader();
+    ~FileLoader();
+
+    uint64_t load(const std::string& file_path);
+    void cancel(uint64_t id);
+
+    bool has_chunks();
+    LoadChunk take_chunk();
+    void set_notify(std::function<void()> notify);
+
+private:
+    struct Job {
+        uint64_t id;
+        std::string file_path;
+        int fd = -1;
+        size_t bytes_read = 0;
+        size_t total_bytes = 0;
+        std::string carry;
+        bool detected = false;
+        TextEncoding encoding;
+        TextDecoder decoder;
+        ContentHash hasher;
+    };
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::list<Job> jobs_;
+    std::deque<LoadChunk> chunks_;
+    size_t queued_bytes_ = 0;
+    std::function<void()> notify_;
+    uint64_t next_id_ = 1;
+    uint64_t current_id_ = 0;
+    bool current_cancelled_ = false;
+    bool stop_ = false;
+    std::thread worker_;
+
+    void run();
+    bool read_chunk(Job& job, LoadChunk& chunk);
+};
+
+#endif // FILE_LOADER_H
@@ -0,0 +1,110 @@
+#include "file_monitor.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+namespace {
+
+void split_path(const std::string& file_path, std::string& dir, std::string& name) {
+    size_t slash = file_path.find_last_of('/');
+    dir = slash == std::string::npos ? "." : slash == 0 ? "/" : file_path.substr(0, slash);
+    name = slash == std::string::npos ? file_path : file_path.substr(slash + 1);
+}
+
+} // namespace
+
+FileMonitor::FileMonitor() {
+    fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+}
+
+FileMonitor::~FileMonitor() {
+    if (fd_ >= 0) {
+        close(fd_);
+    }
+}
+
+void FileMonitor::watch(const std::string& file_path) {
+    if (fd_ < 0) {
+        return;
+    }
+
+    std::string dir_path, name;
+    split_path(file_path, dir_path, name);
+    Dir& dir = dirs_[dir_path];
+    if (dir.wd < 0) {
+        dir.wd = inotify_add_watch(fd_, dir_path.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_ONLYDIR);
+        if (dir.wd < 0) {
+            dirs_.erase(dir_path);
+            return;
+        }
+        paths_[dir.wd] = dir_path;
+    }
+    dir.names[name]++;
+}
+
+void FileMonitor::unwatch(const std::string& file_path) {
+    std::string dir_path, name;
+    split_path(file_path, dir_path, name);
+    auto dir = dirs_.find(dir_path);
+    if (dir == dirs_.end()) {
+        return;
+    }
+    auto it = dir->second.names.find(name);
+    if (it != dir->second.names.end() && --it->second == 0) {
+        dir->second.names.erase(it);
+    }
+    if (dir->second.names.empty()) {
+        inotify_rm_watch(fd_, dir->second.wd);
+        paths_.erase(dir->second.wd);
+        dirs_.erase(dir);
+    }
+}
+
+std::vector<std::string> FileMonitor::read_events() {
+    std::vector<std::string> changed;
+    if (fd_ < 0) {
+        return changed;
+    }
+
+    alignas(inotify_event) char buffer[16 * 1024];
+    while (true) {
+        ssize_t len = read(fd_, buffer, sizeof(buffer));
+        if (len <= 0) {
+            if (len < 0 && errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+
+        for (char* ptr = buffer; ptr < buffer + len;) {
+            auto* event = reinterpret_cast<inotify_event*>(ptr);
+            ptr += sizeof(inotify_event) + event->len;
+
+            auto path = paths_.find(event->wd);
+            if (path == paths_.end()) {
+                continue;
+            }
+            if (event->mask & IN_IGNORED) {
+                // The folder itself went away
+                dirs_.erase(path->second);
+                paths_.erase(path);
+                continue;
+            }
+            if (event->len == 0) {
+                continue;
+            }
+            const Dir& dir = dirs_[path->second];
+            std::string name = event->name;
+            if (!dir.names.count(name)) {
+                continue;
+            }
+            std::string file_path = path->second == "/" ? "/" + name : path->second + "/" + name;
+            if (std::find(changed.begin(), changed.end(), file_path) == changed.end()) {
+                changed.push_back(std::move(file_path));
+            }
+        }
+    }
+    return changed;
+}
@@ -0,0 +1,39 @@
+#ifndef FILE_MONITOR_H
+#define FILE_MONITOR_H
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Tells when open files are rewritten by someone else. The folder holding each file is
+// watched rather than the file, so a file replaced by rename (atomic saves, git, sync
+// tools) is still seen. Like FileWatcher, fd() is polled by the caller.
+class FileMonitor {
+public:
+    FileMonitor();
+    ~FileMonitor();
+
+    FileMonitor(const FileMonitor&) = delete;
+    FileMonitor& operator=(const FileMonitor&) = delete;
+
+    // -1 when inotify is unavailable
+    int fd() const { return fd_; }
+
+    void watch(const std::string& file_path);
+    void unwatch(const std::string& file_path);
+    // Watched files closed after writing or renamed into place since the last call
+    std::vector<std::string> read_events();
+
+private:
+    struct Dir {
+        int wd = -1;
+        // Watched file names in the folder, with how many times each was watched
+        std::unordered_map<std::string, int> names;
+    };
+
+    int fd_ = -1;
+    std::unordered_map<std::string, Dir> dirs_;
+    std::unordered_map<int, std::string> paths_;
+};
+
+#endif // FILE_MONITOR_H
@@ -0,0 +1,487 @@
+#include "file_ops.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <linux/fs.h>
+#endif
+
+#include "trace.h"
+
+namespace {
+
+const size_t kCopyChunk = 8 * 1024 * 1024;
+const size_t kFallbackBuffer = 1024 * 1024;
+const auto kProgressInterval = std::chrono::milliseconds(100);
+// Entries a purge removes between checks for waiting operations
+const size_t kPurgeBatch = 256;
+
+std::string describe_errno(const std::string& what, const std::filesystem::path& path) {
+    return what + " " + path.string() + ": " + std::strerror(errno);
+}
+
+uint64_t tree_size(const std::filesystem::path& path) {
+    struct stat st {};
+    if (lstat(path.c_str(), &st) != 0) {
+        return 0;
+    }
+    if (!S_ISDIR(st.st_mode)) {
+        return S_ISREG(st.st_mode) ? st.st_size : 0;
+    }
+
+    uint64_t total = 0;
+    std::error_code ec;
+    for (std::filesystem::recursive_directory_iterator it(path, ec), end; !ec && it != end; it.increment(ec)) {
+        if (lstat(it->path().c_str(), &st) == 0 && S_ISREG(st.st_mode)) {
+            total += st.st_size;
+        }
+    }
+    return total;
+}
+
+bool write_all(int fd, const char* data, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, data, len);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += n;
+        len -= n;
+    }
+    return true;
+}
+
+// A folder can't go inside itself
+bool is_within(const std::filesystem::path& path, const std::filesystem::path& folder) {
+    const std::string& p = path.native();
+    const std::string& f = folder.native();
+    return p.size() > f.size() && p.compare(0, f.size(), f) == 0 && p[f.size()] == '/';
+}
+
+} // namespace
+
+FileOps::FileOps() : worker_(&FileOps::run, this) {}
+
+FileOps::~FileOps() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    cancel_current_ = true;
+    cv_.notify_all();
+    worker_.join();
+}
+
+void FileOps::set_trash_dir(const std::filesystem::path& trash_dir) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        trash_dir_ = trash_dir;
+        std::error_code ec;
+        for (std::filesystem::directory_iterator it(trash_dir, ec), end; !ec && it != end; it.increment(ec)) {
+            purges_.push_back(it->path());
+        }
+    }
+    cv_.notify_all();
+}
+
+uint64_t FileOps::move(const std::filesystem::path& source, const std::filesystem::path& destination) {
+    return enqueue(FileOpStatus::Move, source, destination);
+}
+
+uint64_t FileOps::copy(const std::filesystem::path& source, const std::filesystem::path& destination) {
+    return enqueue(FileOpStatus::Copy, source, destination);
+}
+
+uint64_t FileOps::remove(const std::filesystem::path& path) {
+    return enqueue(FileOpStatus::Delete, path, std::filesystem::path());
+}
+
+uint64_t FileOps::enqueue(FileOpStatus::Kind kind, const std::filesystem::path& source, const std::filesystem::path& destination) {
+    uint64_t id;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        id = next_id_++;
+        FileOpStatus op;
+        op.id = id;
+        op.kind = kind;
+        op.source = source;
+        op.destination = destination;
+        queue_.push_back(std::move(op));
+        queued_++;
+    }
+    cv_.notify_all();
+    return id;
+}
+
+void FileOps::cancel(uint64_t id) {
+    FileOpStatus cancelled;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (id == current_id_) {
+            cancel_current_ = true;
+            return;
+        }
+        auto it = std::find_if(queue_.begin(), queue_.end(), [id](const FileOpStatus& op) { return op.id == id; });
+        if (it == queue_.end()) {
+            return;
+        }
+        cancelled = std::move(*it);
+        queue_.erase(it);
+        queued_--;
+    }
+    cancelled.finished = true;
+    cancelled.cancelled = true;
+    publish(cancelled);
+}
+
+std::vector<FileOpStatus> FileOps::take_updates() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<FileOpStatus> updates;
+    updates.swap(updates_);
+    return updates;
+}
+
+void FileOps::set_notify(std::function<void()> notify) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    notify_ = std::move(notify);
+}
+
+std::filesystem::path FileOps::staging_path(const std::filesystem::path& destination) {
+    return destination.parent_path() / ("." + destination.filename().string() + ".librenote-partial");
+}
+
+void FileOps::run() {
+    Tracer::set_thread_name("FileOps");
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        cv_.wait(lock, [this] { return stop_ || !queue_.empty() || !purges_.empty(); });
+        if (stop_) {
+            // Whatever is left in the trash gets purged next time
+            return;
+        }
+
+        if (!queue_.empty()) {
+            FileOpStatus op = std::move(queue_.front());
+            queue_.pop_front();
+            queued_--;
+            current_id_ = op.id;
+            cancel_current_ = false;
+
+            lock.unlock();
+            execute(op);
+            op.finished = true;
+            publish(op);
+            lock.lock();
+            current_id_ = 0;
+            continue;
+        }
+
+        // Only purge while nothing else is waiting
+        std::filesystem::path victim = purges_.back();
+        purges_.pop_back();
+        lock.unlock();
+        std::string error;
+        PurgeResult result = purge(victim, error);
+        if (result == PurgeResult::Failed) {
+            std::cerr << "Error purging trash: " << error << std::endl;
+        }
+        lock.lock();
+        if (result == PurgeResult::Interrupted) {
+            purges_.push_back(victim);
+        } else if (result == PurgeResult::Failed) {
+            failed_purges_.push_back(victim);
+        }
+    }
+}
+
+void FileOps::execute(FileOpStatus& op) {
+    static const char* const kNames[] = {"Move", "Copy", "Delete"};
+    TRACE_SCOPE(kNames[op.kind], op.source.string());
+
+    struct stat st {};
+    if (lstat(op.source.c_str(), &st) != 0) {
+        op.error = describe_errno("Can't read", op.source);
+        return;
+    }
+
+    if (op.kind == FileOpStatus::Delete) {
+        std::filesystem::path trash;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            trash = trash_dir_;
+        }
+        if (!trash.empty()) {
+            std::error_code ec;
+            std::filesystem::create_directories(trash, ec);
+            std::filesystem::path target = trash / (std::to_string(Tracer::now_ns()) + "-" + op.source.filename().string());
+            if (rename(op.source.c_str(), target.c_str()) == 0) {
+                std::lock_guard<std::mutex> lock(mutex_);
+                purges_.push_back(target);
+                purges_.insert(purges_.end(), failed_purges_.begin(), failed_purges_.end());
+                failed_purges_.clear();
+                op.ok = true;
+                return;
+            }
+            if (errno != EXDEV) {
+                op.error = describe_errno("Can't delete", op.source);
+                return;
+            }
+        }
+        // On another filesystem than the trash
+        std::error_code ec;
+        std::filesystem::remove_all(op.source, ec);
+        op.ok = !ec;
+        if (ec) {
+            op.error = "Can't delete " + op.source.string() + ": " + ec.message();
+        }
+        return;
+    }
+
+    struct stat dest_st {};
+    if (lstat(op.destination.c_str(), &dest_st) == 0) {
+        op.error = op.destination.string() + " already exists";
+        return;
+    }
+    if (S_ISDIR(st.st_mode) && is_within(op.destination, op.source)) {
+        op.error = "Can't put " + op.source.string() + " inside itself";
+        return;
+    }
+
+    if (op.kind == FileOpStatus::Move) {
+        if (rename(op.source.c_str(), op.destination.c_str()) == 0) {
+            op.ok = true;
+            return;
+        }
+        if (errno != EXDEV) {
+            op.error = describe_errno("Can't move", op.source);
+            return;
+        }
+    }
+
+    op.bytes_total = tree_size(op.source);
+    publish(op);
+
+    std::filesystem::path staging = staging_path(op.destination);
+    std::error_code ec;
+    std::filesystem::remove_all(staging, ec);
+    if (!copy_tree(op, op.source, staging)) {
+        std::filesystem::remove_all(staging, ec);
+        op.cancelled = cancel_current_;
+        return;
+    }
+    if (rename(staging.c_str(), op.destination.c_str()) != 0) {
+        op.error = describe_errno("Can't create", op.destination);
+        std::filesystem::remove_all(staging, ec);
+        return;
+    }
+
+    if (op.kind == FileOpStatus::Move) {
+        std::filesystem::remove_all(op.source, ec);
+        if (ec) {
+            op.error = "Copied to " + op.destination.string() + " but can't remove " + op.source.string() + ": " + ec.message();
+            return;
+        }
+    }
+    op.ok = true;
+}
+
+bool FileOps::copy_tree(FileOpStatus& op, const std::filesystem::path& from, const std::filesystem::path& to) {
+    if (cancel_current_) {
+        op.error = "Cancelled";
+        return false;
+    }
+
+    struct stat st {};
+    if (lstat(from.c_str(), &st) != 0) {
+        op.error = describe_errno("Can't read", from);
+        return false;
+    }
+
+    if (S_ISDIR(st.st_mode)) {
+        if (mkdir(to.c_str(), 0700) != 0) {
+            op.error = describe_errno("Can't create", to);
+            return false;
+        }
+        std::error_code ec;
+        for (std::filesystem::directory_iterator it(from, ec), end; it != end; it.increment(ec)) {
+            if (ec) {
+                break;
+            }
+            if (!copy_tree(op, it->path(), to / it->path().filename())) {
+                return false;
+            }
+        }
+        if (ec) {
+            op.error = "Can't list " + from.string() + ": " + ec.message();
+            return false;
+        }
+        chmod(to.c_str(), st.st_mode & 07777);
+        return true;
+    }
+
+    if (S_ISLNK(st.st_mode)) {
+        std::error_code ec;
+        std::filesystem::path target = std::filesystem::read_symlink(from, ec);
+        if (ec || symlink(target.c_str(), to.c_str()) != 0) {
+            op.error = describe_errno("Can't copy link", from);
+            return false;
+        }
+        return true;
+    }
+
+    if (S_ISREG(st.st_mode)) {
+        return copy_file(op, from, to, st.st_mode & 07777);
+    }
+    // Sockets, fifos and devices don't belong in notes
+    return true;
+}
+
+bool FileOps::copy_file(FileOpStatus& op, const std::filesystem::path& from, const std::filesystem::path& to, mode_t mode) {
+    int in = open(from.c_str(), O_RDONLY | O_CLOEXEC);
+    if (in < 0) {
+        op.error = describe_errno("Can't read", from);
+        return false;
+    }
+    int out = open(to.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+    if (out < 0) {
+        op.error = describe_errno("Can't create", to);
+        close(in);
+        return false;
+    }
+
+    bool ok = true;
+    bool cloned = false;
+#ifdef FICLONE
+    // Shares the blocks on btrfs, XFS and the like; only works within one filesystem
+    if (ioctl(out, FICLONE, in) == 0) {
+        struct stat st {};
+        fstat(in, &st);
+        op.bytes_done += st.st_size;
+        cloned = true;
+    }
+#endif
+
+    bool use_range = true;
+    std::vector<char> buffer;
+    while (!cloned) {
+        if (cancel_current_) {
+            op.error = "Cancelled";
+            ok = false;
+            break;
+        }
+
+        ssize_t n;
+        if (use_range) {
+            n = copy_file_range(in, nullptr, out, nullptr, kCopyChunk, 0);
+            if (n < 0 && (errno == EXDEV || errno == ENOSYS || errno == EINVAL || errno == EOPNOTSUPP)) {
+                use_range = false;
+                continue;
+            }
+        } else {
+            buffer.resize(kFallbackBuffer);
+            n = read(in, buffer.data(), buffer.size());
+            if (n > 0 && !write_all(out, buffer.data(), n)) {
+                n = -1;
+            }
+        }
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            op.error = describe_errno("Can't copy", from);
+            ok = false;
+            break;
+        }
+        if (n == 0) {
+            break;
+        }
+
+        op.bytes_done += n;
+        auto now = std::chrono::steady_clock::now();
+        if (now - last_progress_ >= kProgressInterval) {
+            last_progress_ = now;
+            publish(op);
+        }
+    }
+
+    // The source of a move is removed afterwards, so its copy has to be on disk first
+    if (ok && op.kind == FileOpStatus::Move && fsync(out) != 0) {
+        op.error = describe_errno("Can't write", to);
+        ok = false;
+    }
+    fchmod(out, mode);
+    if (close(out) != 0 && ok) {
+        op.error = describe_errno("Can't write", to);
+        ok = false;
+    }
+    close(in);
+    return ok;
+}
+
+// Removes bottom-up, giving up for now when an operation is waiting. Entries that
+// can't be removed are skipped so the rest still goes; error names the first of them.
+FileOps::PurgeResult FileOps::purge(const std::filesystem::path& path, std::string& error) {
+    TRACE_SCOPE("Purge trash", path.string());
+    std::vector<std::pair<std::filesystem::path, bool>> stack{{path, false}};
+    size_t removed = 0;
+    auto check = [&error](int rc, const char* what, const std::filesystem::path& entry) {
+        if (rc != 0 && errno != ENOENT && error.empty()) {
+            error = describe_errno(what, entry);
+        }
+    };
+    while (!stack.empty()) {
+        if (++removed % kPurgeBatch == 0 && queued_ > 0) {
+            return PurgeResult::Interrupted;
+        }
+
+        auto [current, listed] = stack.back();
+        struct stat st {};
+        if (lstat(current.c_str(), &st) != 0) {
+            stack.pop_back();
+            continue;
+        }
+        if (!S_ISDIR(st.st_mode)) {
+            check(unlink(current.c_str()), "Can't remove", current);
+            stack.pop_back();
+            continue;
+        }
+        if (listed) {
+            check(rmdir(current.c_str()), "Can't remove", current);
+            stack.pop_back();
+            continue;
+        }
+
+        stack.back().second = true;
+        std::error_code ec;
+        for (std::filesystem::directory_iterator it(current, ec), end; !ec && it != end; it.increment(ec)) {
+            stack.emplace_back(it->path(), false);
+        }
+    }
+    return error.empty() ? PurgeResult::Done : PurgeResult::Failed;
+}
+
+void FileOps::publish(const FileOpStatus& op) {
+    std::function<void()> notify;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        // Progress nobody has picked up yet is superseded
+        if (!updates_.empty() && updates_.back().id == op.id && !updates_.back().finished) {
+            updates_.back() = op;
+        } else {
+            updates_.push_back(op);
+        }
+        notify = notify_;
+    }
+    if (notify) {
+        notify();
+    }
+}
@@ -0,0 +1,97 @@
+#ifndef FILE_OPS_H
+#define FILE_OPS_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <sys/types.h>
+#include <thread>
+#include <vector>
+
+struct FileOpStatus {
+    enum Kind { Move, Copy, Delete };
+
+    uint64_t id = 0;
+    Kind kind = Move;
+    std::filesystem::path source;
+    // Full path the source ends up at; empty for deletes
+    std::filesystem::path destination;
+    uint64_t bytes_done = 0;
+    uint64_t bytes_total = 0;
+    bool finished = false;
+    bool ok = false;
+    bool cancelled = false;
+    std::string error;
+};
+
+// Moves, copies and deletes files and folders on a worker thread, one operation at a
+// time. A move is a rename when it can be; across filesystems (EXDEV) the tree is
+// copied into a hidden staging name next to the destination, renamed into place and
+// only then removed at the source, so a failed or cancelled move leaves the source
+// alone. File data is cloned where the filesystem supports it and otherwise copied
+// with copy_file_range, falling back to read/write.
+//
+// Deletes are renamed into the trash folder, which is quick and takes the entry out
+// of sight, and purged while no other operation is waiting.
+class FileOps {
+public:
+    FileOps();
+    ~FileOps();
+
+    FileOps(const FileOps&) = delete;
+    FileOps& operator=(const FileOps&) = delete;
+
+    // Leftovers from an earlier run are purged too. Without a trash folder, deletes
+    // remove in place.
+    void set_trash_dir(const std::filesystem::path& trash_dir);
+
+    uint64_t move(const std::filesystem::path& source, const std::filesystem::path& destination);
+    uint64_t copy(const std::filesystem::path& source, const std::filesystem::path& destination);
+    uint64_t remove(const std::filesystem::path& path);
+    // A move or copy in progress is undone; one that finished can't be
+    void cancel(uint64_t id);
+
+    // Progress and completion of operations since the last call, oldest first
+    std::vector<FileOpStatus> take_updates();
+    // Called from the worker thread when there are updates
+    void set_notify(std::function<void()> notify);
+
+    // Where a cross-device move or copy to destination is assembled
+    static std::filesystem::path staging_path(const std::filesystem::path& destination);
+
+private:
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::deque<FileOpStatus> queue_;
+    std::vector<FileOpStatus> updates_;
+    std::vector<std::filesystem::path> purges_;
+    // Trash entries a purge couldn't remove, tried again after the next delete
+    std::vector<std::filesystem::path> failed_purges_;
+    std::filesystem::path trash_dir_;
+    std::function<void()> notify_;
+    uint64_t next_id_ = 1;
+    uint64_t current_id_ = 0;
+    std::atomic<bool> cancel_current_{false};
+    // Lets a purge notice new work and step aside
+    std::atomic<size_t> queued_{0};
+    std::chrono::steady_clock::time_point last_progress_;
+    bool stop_ = false;
+    std::thread worker_;
+
+    uint64_t enqueue(FileOpStatus::Kind kind, const std::filesystem::path& source, const std::filesystem::path& destination);
+    void run();
+    void execute(FileOpStatus& op);
+    bool copy_tree(FileOpStatus& op, const std::filesystem::path& from, const std::filesystem::path& to);
+    bool copy_file(FileOpStatus& op, const std::filesystem::path& from, const std::filesystem::path& to, mode_t mode);
+    enum class PurgeResult { Done, Interrupted, Failed };
+    PurgeResult purge(const std::filesystem::path& path, std::string& error);
+    void publish(const FileOpStatus& op);
+};
+
+#endif // FILE_OPS_H
@@ -0,0 +1,431 @@
+#include "file_search.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <fcntl.h>
+#include <regex>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "dir_scanner.h"
+#include "file_sniffer.h"
+
+namespace {
+
+const size_t kMaxMatches = 10000;
+const size_t kMaxFileSize = 256 * 1024 * 1024;
+const size_t kMaxLineLength = 300;
+const size_t kReadBlock = 256 * 1024;
+// Matches are handed over in batches so the UI isn't woken for every line
+const size_t kBatchSize = 64;
+
+char fold(char c) {
+    return (c >= 'A' && c <= 'Z') ? c - 'A' + 'a' : c;
+}
+
+char other_case(char c) {
+    if (c >= 'a' && c <= 'z') {
+        return c - 'a' + 'A';
+    }
+    return (c >= 'A' && c <= 'Z') ? c - 'A' + 'a' : c;
+}
+
+// First occurrence of needle in [p, end). With fold set, needle is lowercase and
+// ASCII letters match either case.
+const char* find_literal(const char* p, const char* end, const std::string& needle, bool fold_case) {
+    size_t n = needle.size();
+    if (static_cast<size_t>(end - p) < n) {
+        return nullptr;
+    }
+    if (!fold_case) {
+        return static_cast<const char*>(memmem(p, end - p, needle.data(), n));
+    }
+
+    const char* last = end - n + 1;
+    char first = needle[0];
+    char first_other = other_case(first);
+    while (p < last) {
+        auto hit = static_cast<const char*>(std::memchr(p, first, last - p));
+        if (first_other != first) {
+            // Only look as far as the lowercase hit, so each byte is scanned once
+            auto other = static_cast<const char*>(std::memchr(p, first_other, (hit ? hit : last) - p));
+            if (other) {
+                hit = other;
+            }
+        }
+        if (!hit) {
+            return nullptr;
+        }
+        size_t i = 1;
+        while (i < n && fold(hit[i]) == needle[i]) {
+            i++;
+        }
+        if (i == n) {
+            return hit;
+        }
+        p = hit + 1;
+    }
+    return nullptr;
+}
+
+// Longest run of plain characters every match of the pattern must contain, or ""
+// when there is none (alternation, everything optional, ...). Only looks outside
+// groups and classes to stay on the safe side.
+std::string required_literal(const std::string& pattern) {
+    std::string best;
+    std::string run;
+    auto end_run = [&]() {
+        if (run.size() > best.size()) {
+            best = run;
+        }
+        run.clear();
+    };
+
+    int depth = 0;
+    for (size_t i = 0; i < pattern.size(); i++) {
+        char c = pattern[i];
+        if (c == '|' && depth == 0) {
+            return "";
+        }
+        if (c == '\\' && i + 1 < pattern.size()) {
+            char next = pattern[++i];
+            if (std::isalnum(static_cast<unsigned char>(next))) {
+                // \d, \w, \b, back references...
+                end_run();
+                continue;
+            }
+            c = next;
+        } else if (c == '[') {
+            end_run();
+            // Skip the class; a ']' right after '[' or '[^' is part of it
+            size_t j = i + 1;
+            if (j < pattern.size() && pattern[j] == '^') {
+                j++;
+            }
+            if (j < pattern.size() && pattern[j] == ']') {
+                j++;
+            }
+            while (j < pattern.size() && pattern[j] != ']') {
+                j += pattern[j] == '\\' ? 2 : 1;
+            }
+            i = j;
+            continue;
+        } else if (c == '(') {
+            depth++;
+            end_run();
+            continue;
+        } else if (c == ')') {
+            depth = std::max(depth - 1, 0);
+            end_run();
+            continue;
+        } else if (std::strchr(".^$", c)) {
+            end_run();
+            continue;
+        } else if (std::strchr("*?{", c)) {
+            // The previous character was optional after all
+            if (!run.empty()) {
+                run.pop_back();
+            }
+            end_run();
+            if (c == '{') {
+                while (i < pattern.size() && pattern[i] != '}') {
+                    i++;
+                }
+            }
+            continue;
+        } else if (c == '+') {
+            end_run();
+            continue;
+        }
+
+        if (depth == 0) {
+            run.push_back(c);
+        }
+    }
+    end_run();
+    return best;
+}
+
+} // namespace
+
+struct FileSearch::Search {
+    uint64_t id = 0;
+    std::shared_ptr<const IgnoreRules> rules;
+    std::unique_ptr<std::regex> regex;
+    // Prefilter: lines not containing this are never matched
+    std::string literal;
+    bool fold = false;
+    std::atomic<size_t> pending{0};
+    std::atomic<size_t> match_count{0};
+    std::atomic<bool> full{false};
+};
+
+FileSearch::FileSearch() = default;
+
+FileSearch::~FileSearch() {
+    cancel();
+}
+
+bool FileSearch::start(const std::filesystem::path& root, std::shared_ptr<const IgnoreRules> rules, const FindQuery& query,
+                       std::string& error) {
+    cancel();
+    if (query.pattern.empty()) {
+        return true;
+    }
+
+    auto search = std::make_shared<Search>();
+    search->rules = std::move(rules);
+    search->fold = !query.match_case;
+    if (query.regex) {
+        try {
+            auto flags = std::regex::ECMAScript | std::regex::optimize;
+            if (!query.match_case) {
+                flags |= std::regex::icase;
+            }
+            search->regex = std::make_unique<std::regex>(query.pattern, flags);
+        } catch (const std::regex_error& e) {
+            error = e.what();
+            return false;
+        }
+        search->literal = required_literal(query.pattern);
+    } else {
+        search->literal = query.pattern;
+    }
+    if (search->fold) {
+        std::transform(search->literal.begin(), search->literal.end(), search->literal.begin(), [](char c) { return fold(c); });
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        search->id = next_id_++;
+        current_ = search;
+        current_id_ = search->id;
+        done_ = false;
+    }
+
+    search->pending = 1;
+    pool_.submit([this, search, root]() {
+        walk(search, root);
+        finish_task(search);
+    });
+    return true;
+}
+
+void FileSearch::cancel() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    // Workers notice the id change and drop their remaining files
+    current_id_ = 0;
+    current_.reset();
+    matches_.clear();
+    done_ = true;
+}
+
+std::vector<FindMatch> FileSearch::take_matches() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<FindMatch> matches;
+    matches.swap(matches_);
+    return matches;
+}
+
+bool FileSearch::done() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return done_;
+}
+
+void FileSearch::set_notify(std::function<void()> notify) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    notify_ = std::move(notify);
+}
+
+bool FileSearch::cancelled(const Search& search) const {
+    return current_id_.load(std::memory_order_relaxed) != search.id || search.full.load(std::memory_order_relaxed);
+}
+
+// Lists one folder, queueing its files and subfolders as separate tasks
+void FileSearch::walk(const std::shared_ptr<Search>& search, const std::filesystem::path& dir) {
+    for (const auto& entry : DirScanner::list_directory(dir, search->rules.get())) {
+        if (cancelled(*search)) {
+            return;
+        }
+
+        std::filesystem::path path = dir / entry.name;
+        struct stat st {};
+        if (lstat(path.c_str(), &st) != 0) {
+            continue;
+        }
+        if (S_ISDIR(st.st_mode)) {
+            search->pending++;
+            pool_.submit([this, search, path]() {
+                walk(search, path);
+                finish_task(search);
+            });
+        } else if (S_ISREG(st.st_mode) && st.st_size > 0 && static_cast<size_t>(st.st_size) <= kMaxFileSize) {
+            search->pending++;
+            pool_.submit([this, search, file_path = path.string()]() {
+                scan_file(search, file_path);
+                finish_task(search);
+            });
+        }
+    }
+}
+
+void FileSearch::scan_file(const std::shared_ptr<Search>& search, const std::string& file_path) {
+    // Same check (and cached verdicts) as the editor's binary-file guard
+    if (cancelled(*search) || sniff_file(file_path).kind != FileKind::Text) {
+        return;
+    }
+
+    int fd = open(file_path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return;
+    }
+    struct stat st {};
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        close(fd);
+        return;
+    }
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    // Read rather than mapped: a file truncated mid-search would fault a mapping
+    // with SIGBUS, while a read just comes up short. Each worker keeps its buffer.
+    thread_local std::vector<char> buffer;
+    if (buffer.size() < kReadBlock) {
+        buffer.resize(kReadBlock);
+    }
+
+    size_t size = std::min<size_t>(st.st_size, kMaxFileSize);
+    size_t offset = 0;
+    // Bytes at the front of buffer left over from the last block: a line not yet ended
+    size_t carried = 0;
+    bool at_end = false;
+    std::vector<FindMatch> found;
+    size_t line = 1;
+    size_t checked = 0;
+
+    while (!at_end && !cancelled(*search)) {
+        if (carried == buffer.size()) {
+            // One line longer than the buffer; it has to be seen whole
+            buffer.resize(buffer.size() * 2);
+        }
+        size_t want = std::min(buffer.size() - carried, size - offset);
+        ssize_t got = want > 0 ? pread(fd, buffer.data() + carried, want, offset) : 0;
+        if (got < 0) {
+            break;
+        }
+        offset += got;
+        at_end = got == 0 || offset >= size;
+
+        const char* begin = buffer.data();
+        const char* end = begin + carried + got;
+        // Only whole lines are searched; the unfinished one goes with the next block
+        if (!at_end) {
+            auto last = static_cast<const char*>(memrchr(begin, '\n', end - begin));
+            if (!last) {
+                carried = end - begin;
+                continue;
+            }
+            end = last + 1;
+        }
+        const char* counted = begin;
+
+        auto emit = [&](const char* line_start, const char* line_end) {
+            line += std::count(counted, line_start, '\n');
+            counted = line_start;
+            size_t len = std::min<size_t>(line_end - line_start, kMaxLineLength);
+            while (len < static_cast<size_t>(line_end - line_start) && len > 0 &&
+                   (static_cast<unsigned char>(line_start[len]) & 0xc0) == 0x80) {
+                len--;
+            }
+            if (len > 0 && line_start[len - 1] == '\r') {
+                len--;
+            }
+            found.push_back({file_path, line, std::string(line_start, len)});
+            if (found.size() == kBatchSize) {
+                add_matches(search, found);
+            }
+        };
+
+        const char* p = begin;
+        while (p < end) {
+            if (++checked % 256 == 0 && cancelled(*search)) {
+                break;
+            }
+
+            const char* line_start = p;
+            if (!search->literal.empty()) {
+                // Jump straight to the next line containing the literal
+                const char* hit = find_literal(p, end, search->literal, search->fold);
+                if (!hit) {
+                    break;
+                }
+                auto newline = static_cast<const char*>(memrchr(p, '\n', hit - p));
+                line_start = newline ? newline + 1 : p;
+            }
+            auto newline = static_cast<const char*>(std::memchr(line_start, '\n', end - line_start));
+            const char* line_end = newline ? newline : end;
+
+            if (!search->regex || std::regex_search(line_start, line_end, *search->regex)) {
+                emit(line_start, line_end);
+            }
+            p = line_end + 1;
+        }
+
+        line += std::count(counted, end, '\n');
+        carried = buffer.data() + carried + got - end;
+        std::memmove(buffer.data(), end, carried);
+    }
+
+    close(fd);
+    add_matches(search, found);
+}
+
+void FileSearch::add_matches(const std::shared_ptr<Search>& search, std::vector<FindMatch>& matches) {
+    if (matches.empty()) {
+        return;
+    }
+
+    std::function<void()> notify;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (current_ != search || search->full) {
+            matches.clear();
+            return;
+        }
+        size_t room = kMaxMatches - search->match_count;
+        if (matches.size() >= room) {
+            matches.resize(room);
+            search->full = true;
+            done_ = true;
+        }
+        search->match_count += matches.size();
+        bool was_empty = matches_.empty();
+        std::move(matches.begin(), matches.end(), std::back_inserter(matches_));
+        if (was_empty || search->full) {
+            notify = notify_;
+        }
+    }
+    matches.clear();
+    if (notify) {
+        notify();
+    }
+}
+
+void FileSearch::finish_task(const std::shared_ptr<Search>& search) {
+    if (--search->pending > 0) {
+        return;
+    }
+
+    std::function<void()> notify;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (current_ != search) {
+            return;
+        }
+        done_ = true;
+        notify = notify_;
+    }
+    if (notify) {
+        notify();
+    }
+}
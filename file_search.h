@@ -0,0 +1,77 @@
+#ifndef FILE_SEARCH_H
+#define FILE_SEARCH_H
+
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "ignore_rules.h"
+#include "work_pool.h"
+
+struct FindQuery {
+    std::string pattern;
+    bool regex = false;
+    bool match_case = false;
+};
+
+struct FindMatch {
+    std::string file_path;
+    // 1-based
+    size_t line = 0;
+    std::string text;
+};
+
+// Grep over every text file under a folder, for queries the search index can't
+// answer. Files are spread over a work-stealing pool, read in blocks and scanned for a
+// literal taken from the query with memmem/memchr; only lines containing it are
+// handed to the regex. Matches are streamed back while the search runs.
+//
+// Starting a new search cancels the previous one, so it can run on every keystroke.
+class FileSearch {
+public:
+    FileSearch();
+    ~FileSearch();
+
+    FileSearch(const FileSearch&) = delete;
+    FileSearch& operator=(const FileSearch&) = delete;
+
+    // Entries the rules ignore are skipped, as in the explorer. Returns false with error
+    // set if the pattern is not a valid regex.
+    bool start(const std::filesystem::path& root, std::shared_ptr<const IgnoreRules> rules, const FindQuery& query,
+               std::string& error);
+    void cancel();
+
+    // Matches of the current search found since the last call
+    std::vector<FindMatch> take_matches();
+    // The current search has scanned everything (or hit the match limit)
+    bool done();
+    // Called from worker threads whenever new matches or completion are available
+    void set_notify(std::function<void()> notify);
+
+private:
+    struct Search;
+
+    std::mutex mutex_;
+    std::vector<FindMatch> matches_;
+    std::function<void()> notify_;
+    std::shared_ptr<Search> current_;
+    std::atomic<uint64_t> current_id_{0};
+    uint64_t next_id_ = 1;
+    bool done_ = true;
+
+    // Declared last so its workers are joined before anything they use goes away
+    WorkPool pool_;
+
+    void walk(const std::shared_ptr<Search>& search, const std::filesystem::path& dir);
+    void scan_file(const std::shared_ptr<Search>& search, const std::string& file_path);
+    void add_matches(const std::shared_ptr<Search>& search, std::vector<FindMatch>& matches);
+    void finish_task(const std::shared_ptr<Search>& search);
+    bool cancelled(const Search& search) const;
+};
+
+#endif // FILE_SEARCH_H
@@ -0,0 +1,178 @@
+#include "file_sniffer.h"
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <mutex>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <unordered_map>
+
+#include "text_encoding.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+struct Magic {
+    const char* bytes;
+    size_t offset;
+    size_t len;
+    const char* format;
+};
+
+const Magic kMagics[] = {
+    {"\x89PNG\r\n\x1a\n", 0, 8, "PNG"},
+    {"\xff\xd8\xff", 0, 3, "JPEG"},
+    {"GIF87a", 0, 6, "GIF"},
+    {"GIF89a", 0, 6, "GIF"},
+    {"WEBP", 8, 4, "WEBP"},
+    {"%PDF-", 0, 5, "PDF"},
+    {"PK\x03\x04", 0, 4, "ZIP"},
+    {"\x1f\x8b", 0, 2, "GZIP"},
+    {"\xfd" "7zXZ", 0, 5, "XZ"},
+    {"7z\xbc\xaf\x27\x1c", 0, 6, "7Z"},
+    {"\x28\xb5\x2f\xfd", 0, 4, "ZSTD"},
+    {"\x7f" "ELF", 0, 4, "ELF"},
+    {"\xcf\xfa\xed\xfe", 0, 4, "MACH-O"},
+    {"SQLite format 3", 0, 15, "SQLITE"},
+    {"OggS", 0, 4, "OGG"},
+    {"fLaC", 0, 4, "FLAC"},
+    {"RIFF", 0, 4, "RIFF"},
+    {"\x1a\x45\xdf\xa3", 0, 4, "MATROSKA"},
+};
+
+struct FileKey {
+    dev_t dev;
+    ino_t ino;
+
+    bool operator==(const FileKey& other) const {
+        return dev == other.dev && ino == other.ino;
+    }
+};
+
+struct FileKeyHash {
+    size_t operator()(const FileKey& key) const {
+        return std::hash<uint64_t>()(static_cast<uint64_t>(key.ino) * 31 + static_cast<uint64_t>(key.dev));
+    }
+};
+
+struct CachedVerdict {
+    off_t size;
+    int64_t mtime_ns;
+    SniffResult result;
+};
+
+const size_t kMaxCachedVerdicts = 64 * 1024;
+
+std::mutex cache_mutex;
+std::unordered_map<FileKey, CachedVerdict, FileKeyHash> cache;
+
+// Bytes below 0x20 that plain text uses: \b \t \n \f \r and ESC (ANSI colours in logs)
+inline bool is_text_control(unsigned char c) {
+    return c == 0x08 || c == 0x09 || c == 0x0a || c == 0x0c || c == 0x0d || c == 0x1b;
+}
+
+size_t count_suspicious_bytes(const unsigned char* data, size_t len) {
+    size_t count = 0;
+    size_t i = 0;
+#ifdef __SSE2__
+    const __m128i max_control = _mm_set1_epi8(0x1f);
+    const __m128i del = _mm_set1_epi8(0x7f);
+    const __m128i bs = _mm_set1_epi8(0x08);
+    const __m128i tab = _mm_set1_epi8(0x09);
+    const __m128i lf = _mm_set1_epi8(0x0a);
+    const __m128i ff = _mm_set1_epi8(0x0c);
+    const __m128i cr = _mm_set1_epi8(0x0d);
+    const __m128i esc = _mm_set1_epi8(0x1b);
+    for (; i + 16 <= len; i += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        __m128i control = _mm_cmpeq_epi8(_mm_min_epu8(v, max_control), v);
+        __m128i allowed = _mm_or_si128(
+            _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, bs), _mm_cmpeq_epi8(v, tab)),
+                         _mm_or_si128(_mm_cmpeq_epi8(v, lf), _mm_cmpeq_epi8(v, ff))),
+            _mm_or_si128(_mm_cmpeq_epi8(v, cr), _mm_cmpeq_epi8(v, esc)));
+        __m128i suspicious = _mm_or_si128(_mm_andnot_si128(allowed, control), _mm_cmpeq_epi8(v, del));
+        count += __builtin_popcount(_mm_movemask_epi8(suspicious));
+    }
+#endif
+    for (; i < len; i++) {
+        unsigned char c = data[i];
+        count += (c < 0x20 && !is_text_control(c)) || c == 0x7f;
+    }
+    return count;
+}
+
+} // namespace
+
+SniffResult sniff_buffer(const char* data, size_t len) {
+    for (const auto& magic : kMagics) {
+        if (len >= magic.offset + magic.len && std::memcmp(data + magic.offset, magic.bytes, magic.len) == 0) {
+            return {FileKind::Binary, magic.format};
+        }
+    }
+
+    // UTF-16 text is full of NULs
+    TextEncoding encoding;
+    if (detect_utf16(data, len, encoding)) {
+        return {FileKind::Text, nullptr};
+    }
+    if (std::memchr(data, '\0', len) != nullptr) {
+        return {FileKind::Binary, nullptr};
+    }
+
+    // Text may carry the odd stray control character, binary data is full of them
+    size_t suspicious = count_suspicious_bytes(reinterpret_cast<const unsigned char*>(data), len);
+    if (suspicious * 10 > len) {
+        return {FileKind::Binary, nullptr};
+    }
+    return {FileKind::Text, nullptr};
+}
+
+SniffResult sniff_file(const std::string& file_path) {
+    struct stat st {};
+    if (stat(file_path.c_str(), &st) != 0) {
+        return {FileKind::Unreadable, nullptr};
+    }
+
+    FileKey key{st.st_dev, st.st_ino};
+    int64_t mtime_ns = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+    {
+        std::lock_guard<std::mutex> lock(cache_mutex);
+        auto it = cache.find(key);
+        if (it != cache.end() && it->second.size == st.st_size && it->second.mtime_ns == mtime_ns) {
+            return it->second.result;
+        }
+    }
+
+    int fd = open(file_path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return {FileKind::Unreadable, nullptr};
+    }
+
+    char prefix[kSniffPrefixSize];
+    size_t len = 0;
+    while (len < sizeof(prefix)) {
+        ssize_t n = read(fd, prefix + len, sizeof(prefix) - len);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            break;
+        }
+        len += n;
+    }
+    close(fd);
+
+    SniffResult result = sniff_buffer(prefix, len);
+
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    if (cache.size() >= kMaxCachedVerdicts) {
+        cache.clear();
+    }
+    cache[key] = {st.st_size, mtime_ns, result};
+    return result;
+}
@@ -0,0 +1,28 @@
+#ifndef FILE_SNIFFER_H
+#define FILE_SNIFFER_H
+
+#include <cstddef>
+#include <string>
+
+enum class FileKind {
+    Text,
+    Binary,
+    Unreadable,
+};
+
+struct SniffResult {
+    FileKind kind = FileKind::Unreadable;
+    // Name of the recognised magic number ("PNG", "ZIP", ...) or nullptr
+    const char* format = nullptr;
+};
+
+// Only this many bytes from the start of a file are ever inspected
+constexpr size_t kSniffPrefixSize = 8192;
+
+// Classifies a file from its first kSniffPrefixSize bytes. Verdicts are cached by
+// (device, inode, size, mtime), so asking again about an unchanged file is just a stat.
+SniffResult sniff_file(const std::string& file_path);
+
+SniffResult sniff_buffer(const char* data, size_t len);
+
+#endif // FILE_SNIFFER_H
@@ -0,0 +1,163 @@
+#include "file_watcher.h"
+
+#include <cerrno>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+FileWatcher::FileWatcher() {
+    fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+}
+
+FileWatcher::~FileWatcher() {
+    if (fd_ >= 0) {
+        close(fd_);
+    }
+}
+
+bool FileWatcher::add_directory(const std::filesystem::path& path) {
+    if (fd_ < 0) {
+        return false;
+    }
+
+    const uint32_t mask = IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ONLYDIR;
+    int wd = inotify_add_watch(fd_, path.c_str(), mask);
+    if (wd < 0) {
+        return false;
+    }
+    watches_[wd] = path;
+    return true;
+}
+
+void FileWatcher::read_events() {
+    if (fd_ < 0) {
+        return;
+    }
+
+    alignas(inotify_event) char buffer[16 * 1024];
+    while (true) {
+        ssize_t len = read(fd_, buffer, sizeof(buffer));
+        if (len <= 0) {
+            if (len < 0 && errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+
+        for (char* ptr = buffer; ptr < buffer + len;) {
+            auto* event = reinterpret_cast<inotify_event*>(ptr);
+            ptr += sizeof(inotify_event) + event->len;
+
+            if (event->mask & IN_Q_OVERFLOW) {
+                overflow_ = true;
+                continue;
+            }
+            if (event->mask & IN_IGNORED) {
+                watches_.erase(event->wd);
+                continue;
+            }
+
+            auto watch = watches_.find(event->wd);
+            if (watch == watches_.end() || event->len == 0) {
+                continue;
+            }
+
+            std::filesystem::path path = watch->second / event->name;
+            bool is_dir = event->mask & IN_ISDIR;
+
+            if (event->mask & IN_CREATE) {
+                record(path, true, is_dir);
+            } else if (event->mask & IN_DELETE) {
+                record(path, false, is_dir);
+            } else if (event->mask & IN_MOVED_FROM) {
+                moves_[event->cookie] = {path, is_dir};
+            } else if (event->mask & IN_MOVED_TO) {
+                auto from = moves_.find(event->cookie);
+                if (from == moves_.end()) {
+                    // Moved in from somewhere we don't watch
+                    record(path, true, is_dir);
+                    continue;
+                }
+                renames_.push_back({FsChange::Renamed, path, from->second.first, is_dir});
+                if (is_dir) {
+                    rename_watches(from->second.first, path);
+                }
+                moves_.erase(from);
+            }
+        }
+    }
+}
+
+bool FileWatcher::has_changes() const {
+    return overflow_ || !moves_.empty() || !renames_.empty() || !states_.empty();
+}
+
+std::vector<FsChange> FileWatcher::take_changes() {
+    // A move whose destination never showed up left the watched tree
+    for (const auto& [cookie, from] : moves_) {
+        record(from.first, false, from.second);
+    }
+    moves_.clear();
+
+    std::vector<FsChange> changes;
+    changes.swap(renames_);
+    for (const auto& [path, state] : states_) {
+        if (state.existed_before == state.exists_now) {
+            continue;
+        }
+        changes.push_back({state.exists_now ? FsChange::Added : FsChange::Removed, path, {}, state.is_directory});
+    }
+    states_.clear();
+    overflow_ = false;
+    drop_ignored(changes);
+    return changes;
+}
+
+void FileWatcher::drop_ignored(std::vector<FsChange>& changes) const {
+    if (!rules_) {
+        return;
+    }
+
+    size_t kept = 0;
+    for (auto& change : changes) {
+        bool ignored = rules_->is_ignored_absolute(change.path, change.is_directory);
+        if (change.kind == FsChange::Renamed) {
+            bool was_ignored = rules_->is_ignored_absolute(change.old_path, change.is_directory);
+            if (ignored && was_ignored) {
+                continue;
+            }
+            if (ignored) {
+                // Moved out of sight
+                change.path = std::move(change.old_path);
+                change.old_path.clear();
+                change.kind = FsChange::Removed;
+            } else if (was_ignored) {
+                // A staged copy renamed into place, say
+                change.old_path.clear();
+                change.kind = FsChange::Added;
+            }
+        } else if (ignored) {
+            continue;
+        }
+        changes[kept++] = std::move(change);
+    }
+    changes.resize(kept);
+}
+
+void FileWatcher::record(const std::filesystem::path& path, bool exists, bool is_directory) {
+    auto it = states_.find(path);
+    if (it == states_.end()) {
+        states_[path] = {!exists, exists, is_directory};
+    } else {
+        it->second.exists_now = exists;
+        it->second.is_directory = is_directory;
+    }
+}
+
+void FileWatcher::rename_watches(const std::filesystem::path& from, const std::filesystem::path& to) {
+    for (auto& [wd, path] : watches_) {
+        auto rel = path.lexically_relative(from);
+        if (!rel.empty() && *rel.begin() != "..") {
+            path = rel == "." ? to : to / rel;
+        }
+    }
+}
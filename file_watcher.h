@@ -0,0 +1,65 @@
+#ifndef FILE_WATCHER_H
+#define FILE_WATCHER_H
+
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "ignore_rules.h"
+
+struct FsChange {
+    enum Kind { Added, Removed, Renamed };
+
+    Kind kind;
+    std::filesystem::path path;
+    std::filesystem::path old_path; // Renamed only
+    bool is_directory = false;
+};
+
+// Thin wrapper around inotify. Raw events are folded as they are read, so a burst of
+// events on the same entry (create + delete, repeated rewrites, ...) comes out of
+// take_changes() as at most one change per path.
+class FileWatcher {
+public:
+    FileWatcher();
+    ~FileWatcher();
+
+    // -1 when inotify is unavailable; poll it for readability and call read_events()
+    int fd() const { return fd_; }
+
+    bool add_directory(const std::filesystem::path& path);
+    void read_events();
+
+    bool has_changes() const;
+    // The kernel queue overflowed and events were lost: the caller has to rescan
+    bool overflowed() const { return overflow_; }
+    std::vector<FsChange> take_changes();
+
+    // Changes to ignored paths are dropped from take_changes()
+    void set_ignore_rules(std::shared_ptr<const IgnoreRules> rules) { rules_ = std::move(rules); }
+    // Drops changes to ignored paths; a rename across the rules becomes an add or a remove
+    void drop_ignored(std::vector<FsChange>& changes) const;
+
+private:
+    struct PathState {
+        bool existed_before;
+        bool exists_now;
+        bool is_directory;
+    };
+
+    int fd_ = -1;
+    std::unordered_map<int, std::filesystem::path> watches_;
+    std::unordered_map<uint32_t, std::pair<std::filesystem::path, bool>> moves_;
+    std::vector<FsChange> renames_;
+    std::map<std::filesystem::path, PathState> states_;
+    bool overflow_ = false;
+    std::shared_ptr<const IgnoreRules> rules_;
+
+    void record(const std::filesystem::path& path, bool exists, bool is_directory);
+    void rename_watches(const std::filesystem::path& from, const std::filesystem::path& to);
+};
+
+#endif // FILE_WATCHER_H
@@ -0,0 +1,299 @@
+#include "ignore_rules.h"
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+namespace {
+
+const char* const kBuiltinRules =
+    ".git/\n"
+    ".hg/\n"
+    ".svn/\n"
+    ".librenote/\n"
+    "*.librenote-partial\n";
+
+bool has_glob(std::string_view pattern) {
+    return pattern.find_first_of("*?[\\") != std::string_view::npos;
+}
+
+// Matches c against the class starting at pattern[i] == '['. Returns -1 when the class
+// is never closed (the '[' is then a plain character), else whether c is in it, with
+// end set just past the ']'.
+int match_class(std::string_view pattern, size_t i, char c, size_t& end) {
+    size_t j = i + 1;
+    bool negated = j < pattern.size() && (pattern[j] == '!' || pattern[j] == '^');
+    if (negated) {
+        j++;
+    }
+    bool matched = false;
+    bool first = true;
+    while (j < pattern.size() && (pattern[j] != ']' || first)) {
+        first = false;
+        char lo = pattern[j];
+        if (lo == '\\' && j + 1 < pattern.size()) {
+            lo = pattern[++j];
+        }
+        char hi = lo;
+        if (j + 2 < pattern.size() && pattern[j + 1] == '-' && pattern[j + 2] != ']') {
+            j += 2;
+            hi = pattern[j];
+            if (hi == '\\' && j + 1 < pattern.size()) {
+                hi = pattern[++j];
+            }
+        }
+        if (static_cast<unsigned char>(c) >= static_cast<unsigned char>(lo) &&
+            static_cast<unsigned char>(c) <= static_cast<unsigned char>(hi)) {
+            matched = true;
+        }
+        j++;
+    }
+    if (j >= pattern.size()) {
+        return -1;
+    }
+    end = j + 1;
+    return matched != negated;
+}
+
+} // namespace
+
+IgnoreRules::IgnoreRules(std::filesystem::path root) : root_(std::move(root)) {
+    add_rules(kBuiltinRules);
+}
+
+std::shared_ptr<const IgnoreRules> IgnoreRules::load(const std::filesystem::path& root) {
+    auto rules = std::make_shared<IgnoreRules>(root);
+    for (const char* name : {".gitignore", ".librenoteignore"}) {
+        std::ifstream file(root / name, std::ios::binary);
+        if (file) {
+            std::ostringstream text;
+            text << file.rdbuf();
+            rules->add_rules(text.str());
+        }
+    }
+    return rules;
+}
+
+void IgnoreRules::add_rules(std::string_view text) {
+    size_t start = 0;
+    while (start < text.size()) {
+        size_t end = text.find('\n', start);
+        if (end == std::string_view::npos) {
+            end = text.size();
+        }
+        add_line(text.substr(start, end - start));
+        start = end + 1;
+    }
+    compile();
+}
+
+void IgnoreRules::add_line(std::string_view line) {
+    if (!line.empty() && line.back() == '\r') {
+        line.remove_suffix(1);
+    }
+    if (line.empty() || line[0] == '#') {
+        return;
+    }
+    // Trailing spaces don't count unless escaped
+    while (!line.empty() && line.back() == ' ' && !(line.size() > 1 && line[line.size() - 2] == '\\')) {
+        line.remove_suffix(1);
+    }
+
+    Rule rule;
+    if (!line.empty() && line[0] == '!') {
+        rule.negated = true;
+        line.remove_prefix(1);
+    }
+    while (!line.empty() && line.back() == '/') {
+        rule.directory_only = true;
+        line.remove_suffix(1);
+    }
+    // A slash anywhere but at the end ties the pattern to the root
+    rule.anchored = line.find('/') != std::string_view::npos;
+    while (!line.empty() && line[0] == '/') {
+        line.remove_prefix(1);
+    }
+    if (line.empty()) {
+        return;
+    }
+    rule.pattern = std::string(line);
+    if (!has_glob(line.substr(0, 1))) {
+        rule.first = line.front();
+    }
+    // A ']' may close a class, a '\\' only makes sense escaping something
+    if (std::string_view("*?]\\").find(line.back()) == std::string_view::npos) {
+        rule.last = line.back();
+    }
+    rules_.push_back(std::move(rule));
+}
+
+void IgnoreRules::compile() {
+    names_.clear();
+    suffixes_.clear();
+    globs_.clear();
+
+    for (int i = 0; i < static_cast<int>(rules_.size()); i++) {
+        const Rule& rule = rules_[i];
+        std::string_view pattern = rule.pattern;
+        std::unordered_map<std::string_view, Best>* table = nullptr;
+        if (!rule.anchored && !has_glob(pattern)) {
+            table = &names_;
+        } else if (!rule.anchored && pattern.size() > 2 && pattern[0] == '*' && pattern[1] == '.' && !has_glob(pattern.substr(1))) {
+            table = &suffixes_;
+            pattern.remove_prefix(1);
+        }
+
+        if (table) {
+            Best& best = (*table)[pattern];
+            (rule.directory_only ? best.directory : best.any) = i;
+        } else {
+            globs_.push_back(i);
+        }
+    }
+    std::reverse(globs_.begin(), globs_.end());
+}
+
+bool IgnoreRules::is_ignored(std::string_view relative, bool is_directory) const {
+    size_t slash = relative.rfind('/');
+    std::string_view name = slash == std::string_view::npos ? relative : relative.substr(slash + 1);
+
+    int best = -1;
+    auto take = [&best, is_directory](const Best& hit) {
+        best = std::max(best, hit.any);
+        if (is_directory) {
+            best = std::max(best, hit.directory);
+        }
+    };
+
+    if (!names_.empty()) {
+        auto it = names_.find(name);
+        if (it != names_.end()) {
+            take(it->second);
+        }
+    }
+    if (!suffixes_.empty()) {
+        for (size_t dot = name.find('.'); dot != std::string_view::npos; dot = name.find('.', dot + 1)) {
+            auto it = suffixes_.find(name.substr(dot));
+            if (it != suffixes_.end()) {
+                take(it->second);
+            }
+        }
+    }
+
+    for (int i : globs_) {
+        if (i <= best) {
+            break;
+        }
+        const Rule& rule = rules_[i];
+        if (rule.directory_only && !is_directory) {
+            continue;
+        }
+        std::string_view text = rule.anchored ? relative : name;
+        if (text.empty() || (rule.first && text.front() != rule.first) || (rule.last && text.back() != rule.last)) {
+            continue;
+        }
+        if (glob_match(rule.pattern, text)) {
+            best = i;
+            break;
+        }
+    }
+    return best >= 0 && !rules_[best].negated;
+}
+
+bool IgnoreRules::is_ignored_path(std::string_view relative, bool is_directory) const {
+    // Nothing inside an ignored folder can be re-included, as in git
+    for (size_t slash = relative.find('/'); slash != std::string_view::npos; slash = relative.find('/', slash + 1)) {
+        if (is_ignored(relative.substr(0, slash), true)) {
+            return true;
+        }
+    }
+    return is_ignored(relative, is_directory);
+}
+
+bool IgnoreRules::is_ignored_absolute(const std::filesystem::path& path, bool is_directory) const {
+    const std::string& full = path.native();
+    const std::string& root = root_.native();
+    if (full.size() <= root.size() + 1 || full.compare(0, root.size(), root) != 0 || full[root.size()] != '/') {
+        return false;
+    }
+    return is_ignored_path(std::string_view(full).substr(root.size() + 1), is_directory);
+}
+
+bool IgnoreRules::glob_match(std::string_view pattern, std::string_view text) {
+    size_t p = 0;
+    size_t t = 0;
+    size_t star = std::string_view::npos;
+    size_t star_text = 0;
+
+    while (t < text.size()) {
+        if (p < pattern.size()) {
+            char c = pattern[p];
+            if (c == '*') {
+                bool segment = p + 1 < pattern.size() && pattern[p + 1] == '*' && (p == 0 || pattern[p - 1] == '/') &&
+                               (p + 2 == pattern.size() || pattern[p + 2] == '/');
+                if (segment) {
+                    if (p + 2 == pattern.size()) {
+                        return true;
+                    }
+                    // "**/" matches no folders, or any run of them
+                    std::string_view rest = pattern.substr(p + 3);
+                    if (glob_match(rest, text.substr(t))) {
+                        return true;
+                    }
+                    for (size_t k = t; k < text.size(); k++) {
+                        if (text[k] == '/' && glob_match(rest, text.substr(k + 1))) {
+                            return true;
+                        }
+                    }
+                    return false;
+                }
+                star = p++;
+                star_text = t;
+                continue;
+            }
+            if (c == '?') {
+                if (text[t] != '/') {
+                    p++;
+                    t++;
+                    continue;
+                }
+            } else if (c == '[') {
+                size_t end = 0;
+                int matched = text[t] == '/' ? 0 : match_class(pattern, p, text[t], end);
+                if (matched == 1) {
+                    p = end;
+                    t++;
+                    continue;
+                }
+                if (matched == -1 && text[t] == '[') {
+                    p++;
+                    t++;
+                    continue;
+                }
+            } else {
+                size_t width = 1;
+                if (c == '\\' && p + 1 < pattern.size()) {
+                    c = pattern[p + 1];
+                    width = 2;
+                }
+                if (c == text[t]) {
+                    p += width;
+                    t++;
+                    continue;
+                }
+            }
+        }
+        // Let the last '*' take one more character, never a '/'
+        if (star != std::string_view::npos && text[star_text] != '/') {
+            p = star + 1;
+            t = ++star_text;
+            continue;
+        }
+        return false;
+    }
+
+    while (p < pattern.size() && pattern[p] == '*') {
+        p++;
+    }
+    return p == pattern.size();
+}
@@ -0,0 +1,71 @@
+#ifndef IGNORE_RULES_H
+#define IGNORE_RULES_H
+
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// .gitignore-style rules for the workspace. Lines are compiled once: plain names and
+// "*.ext" patterns go into hash tables, anything else is globbed, and only rules that
+// could still override the best match so far are tried. As in git, the last matching
+// rule wins and "!" re-includes.
+class IgnoreRules {
+public:
+    // Just the built-in rules: VCS folders, our own state and partial copies
+    explicit IgnoreRules(std::filesystem::path root);
+
+    // Built-in rules, then root/.gitignore, then root/.librenoteignore
+    static std::shared_ptr<const IgnoreRules> load(const std::filesystem::path& root);
+
+    // Appends the lines of an ignore file; they override the rules added before
+    void add_rules(std::string_view text);
+
+    const std::filesystem::path& root() const { return root_; }
+    size_t size() const { return rules_.size(); }
+
+    // relative is below root with '/' separators. Only the entry's own rules are
+    // checked, which is all a walk that never enters ignored folders needs.
+    bool is_ignored(std::string_view relative, bool is_directory) const;
+    // Also true when a folder above is ignored, for paths that didn't come from a walk
+    bool is_ignored_path(std::string_view relative, bool is_directory) const;
+    // Same for an absolute path; false outside root
+    bool is_ignored_absolute(const std::filesystem::path& path, bool is_directory) const;
+
+    // Glob with gitignore semantics: '*' and '?' stop at '/', "**" as a whole segment
+    // spans folders, [a-z] / [!a-z] classes and '\' escapes
+    static bool glob_match(std::string_view pattern, std::string_view text);
+
+private:
+    struct Rule {
+        std::string pattern;
+        bool negated = false;
+        bool directory_only = false;
+        // Matched against the whole relative path rather than just the name
+        bool anchored = false;
+        // Literal characters the text has to start / end with, 0 if any will do
+        char first = 0;
+        char last = 0;
+    };
+
+    // Highest rule index among the table rules matching a key, for files and folders
+    struct Best {
+        int any = -1;
+        int directory = -1;
+    };
+
+    std::filesystem::path root_;
+    std::vector<Rule> rules_;
+    // Keys point into rules_, so both are rebuilt together by compile()
+    std::unordered_map<std::string_view, Best> names_;
+    std::unordered_map<std::string_view, Best> suffixes_;
+    // Everything else, highest index first
+    std::vector<int> globs_;
+
+    void add_line(std::string_view line);
+    void compile();
+};
+
+#endif // IGNORE_RULES_H
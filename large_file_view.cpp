@@ -0,0 +1,380 @@
+#include "large_file_view.h"
+
+#include <algorithm>
+#include <cmath>
+#include <glib.h>
+
+namespace {
+
+// Longer lines are cut off when drawn; find still sees all of them
+const size_t kMaxShownBytes = 4096;
+const int kPadding = 5;
+
+// Pango wants valid UTF-8 without NULs, and a CRLF's CR would show as a box
+std::string displayable(std::string_view line) {
+    if (!line.empty() && line.back() == '\r') {
+        line.remove_suffix(1);
+    }
+    bool cut = line.size() > kMaxShownBytes;
+    std::string text(line.substr(0, kMaxShownBytes));
+    std::replace(text.begin(), text.end(), '\0', ' ');
+    gchar* valid = g_utf8_make_valid(text.data(), text.size());
+    text = valid;
+    g_free(valid);
+    if (cut) {
+        text += "…";
+    }
+    return text;
+}
+
+std::string with_separators(size_t value) {
+    std::string digits = std::to_string(value);
+    for (int i = static_cast<int>(digits.size()) - 3; i > 0; i -= 3) {
+        digits.insert(i, ",");
+    }
+    return digits;
+}
+
+} // namespace
+
+LargeFileView::LargeFileView(int font_size)
+    : Gtk::Box(Gtk::ORIENTATION_VERTICAL),
+      toolbar_(Gtk::ORIENTATION_HORIZONTAL),
+      body_(Gtk::ORIENTATION_HORIZONTAL),
+      adjustment_(Gtk::Adjustment::create(0, 0, 1, 1, 10, 10)),
+      scrollbar_(adjustment_, Gtk::ORIENTATION_VERTICAL) {
+    statusLabel_.set_halign(Gtk::ALIGN_START);
+    gotoEntry_.set_placeholder_text("Go to line");
+    gotoEntry_.set_width_chars(12);
+    findEntry_.set_placeholder_text("Find");
+    toolbar_.set_spacing(5);
+    toolbar_.set_margin_start(5);
+    toolbar_.pack_start(statusLabel_, Gtk::PACK_EXPAND_WIDGET);
+    toolbar_.pack_start(gotoEntry_, Gtk::PACK_SHRINK);
+    toolbar_.pack_start(findEntry_, Gtk::PACK_SHRINK);
+    body_.pack_start(drawingArea_, Gtk::PACK_EXPAND_WIDGET);
+    body_.pack_start(scrollbar_, Gtk::PACK_SHRINK);
+    pack_start(toolbar_, Gtk::PACK_SHRINK);
+    pack_start(body_, Gtk::PACK_EXPAND_WIDGET);
+
+    // Drawn like a text view
+    drawingArea_.get_style_context()->add_class("view");
+    drawingArea_.set_can_focus(true);
+    drawingArea_.add_events(Gdk::SCROLL_MASK | Gdk::SMOOTH_SCROLL_MASK | Gdk::KEY_PRESS_MASK | Gdk::BUTTON_PRESS_MASK);
+    drawingArea_.signal_draw().connect(sigc::mem_fun(*this, &LargeFileView::on_draw_lines));
+    drawingArea_.signal_size_allocate().connect(sigc::mem_fun(*this, &LargeFileView::on_area_resized));
+    drawingArea_.signal_scroll_event().connect(sigc::mem_fun(*this, &LargeFileView::on_area_scroll));
+    drawingArea_.signal_key_press_event().connect(sigc::mem_fun(*this, &LargeFileView::on_area_key_press), false);
+    drawingArea_.signal_button_press_event().connect(sigc::mem_fun(*this, &LargeFileView::on_area_button_press));
+    adjustment_->signal_value_changed().connect([this]() { drawingArea_.queue_draw(); });
+    gotoEntry_.signal_activate().connect(sigc::mem_fun(*this, &LargeFileView::on_goto_activate));
+    findEntry_.signal_activate().connect(sigc::mem_fun(*this, &LargeFileView::on_find_activate));
+
+    indexDispatcher_.connect(sigc::mem_fun(*this, &LargeFileView::on_index_progress));
+    index_.set_notify([this]() { indexDispatcher_.emit(); });
+    findDispatcher_.connect(sigc::mem_fun(*this, &LargeFileView::on_find_done));
+
+    set_font_size(font_size);
+    show_all_children();
+}
+
+LargeFileView::~LargeFileView() {
+    stop_find();
+}
+
+bool LargeFileView::open(const std::string& file_path, std::string& error) {
+    filePath_ = file_path;
+    if (!index_.open(file_path, error)) {
+        return false;
+    }
+    update_status();
+    return true;
+}
+
+void LargeFileView::set_font_size(int size) {
+    font_ = Pango::FontDescription("monospace");
+    font_.set_size(size * PANGO_SCALE);
+    update_metrics();
+    drawingArea_.queue_draw();
+}
+
+void LargeFileView::update_metrics() {
+    Pango::FontMetrics metrics = drawingArea_.get_pango_context()->get_metrics(font_);
+    lineHeight_ = std::max(1, static_cast<int>(std::ceil(static_cast<double>(metrics.get_ascent() + metrics.get_descent()) / PANGO_SCALE)));
+    charWidth_ = std::max(1, metrics.get_approximate_char_width() / PANGO_SCALE);
+    int height = drawingArea_.get_allocated_height();
+    if (height > 0) {
+        adjustment_->set_page_size(std::max(1, height / lineHeight_));
+        adjustment_->set_page_increment(std::max(1, height / lineHeight_));
+    }
+}
+
+void LargeFileView::update_status() {
+    std::string status = with_separators(index_.line_count()) + " lines, read-only";
+    if (!index_.complete() && index_.size() > 0) {
+        status += " (indexing " + std::to_string(index_.indexed_bytes() * 100 / index_.size()) + "%)";
+    }
+    if (!findStatus_.empty()) {
+        status += " — " + findStatus_;
+    }
+    statusLabel_.set_text(status);
+}
+
+void LargeFileView::on_index_progress() {
+    size_t count = index_.line_count();
+    adjustment_->set_upper(std::max<double>(count, selectedLine_ + 1));
+    if (pendingLine_ > 0 && (pendingLine_ <= count || index_.complete())) {
+        int line = static_cast<int>(pendingLine_);
+        pendingLine_ = 0;
+        go_to_line(line);
+    }
+    update_status();
+    drawingArea_.queue_draw();
+}
+
+// Only the lines in the window are fetched and laid out
+bool LargeFileView::on_draw_lines(const Cairo::RefPtr<Cairo::Context>& cr) {
+    int width = drawingArea_.get_allocated_width();
+    int height = drawingArea_.get_allocated_height();
+    Glib::RefPtr<Gtk::StyleContext> style = drawingArea_.get_style_context();
+    style->render_background(cr, 0, 0, width, height);
+    Gdk::RGBA fg = style->get_color(style->get_state());
+
+    size_t top = static_cast<size_t>(adjustment_->get_value());
+    index_.lines(top, height / lineHeight_ + 1, visible_);
+    int gutter = static_cast<int>(std::to_string(index_.line_count()).size() + 1) * charWidth_ + kPadding;
+
+    Glib::RefPtr<Pango::Layout> layout = drawingArea_.create_pango_layout("");
+    layout->set_font_description(font_);
+    for (size_t i = 0; i < visible_.size(); i++) {
+        size_t line = top + i;
+        int y = static_cast<int>(i) * lineHeight_;
+        if (line == selectedLine_) {
+            cr->set_source_rgba(fg.get_red(), fg.get_green(), fg.get_blue(), 0.08);
+            cr->rectangle(0, y, width, lineHeight_);
+            cr->fill();
+        }
+
+        layout->set_text(std::to_string(line + 1));
+        int number_width, number_height;
+        layout->get_pixel_size(number_width, number_height);
+        cr->set_source_rgba(fg.get_red(), fg.get_green(), fg.get_blue(), 0.45);
+        cr->move_to(gutter - kPadding - number_width, y);
+        layout->show_in_cairo_context(cr);
+
+        cr->save();
+        cr->rectangle(gutter, y, width - gutter, lineHeight_);
+        cr->clip();
+        std::string text = displayable(visible_[i]);
+        layout->set_text(text);
+        int x = gutter - xOffset_;
+
+        size_t line_offset = visible_[i].data() - index_.data();
+        if (matchOffset_ != std::string::npos && matchOffset_ >= line_offset && matchOffset_ < line_offset + visible_[i].size()) {
+            int start = static_cast<int>(std::min(matchOffset_ - line_offset, text.size()));
+            int end = static_cast<int>(std::min(matchOffset_ - line_offset + matchLength_, text.size()));
+            Pango::Rectangle from = layout->index_to_pos(start);
+            Pango::Rectangle to = layout->index_to_pos(end);
+            cr->set_source_rgba(1.0, 0.85, 0.0, 0.6);
+            cr->rectangle(x + from.get_x() / PANGO_SCALE, y, (to.get_x() - from.get_x()) / PANGO_SCALE, lineHeight_);
+            cr->fill();
+        }
+
+        cr->set_source_rgba(fg.get_red(), fg.get_green(), fg.get_blue(), fg.get_alpha());
+        cr->move_to(x, y);
+        layout->show_in_cairo_context(cr);
+        cr->restore();
+    }
+    return true;
+}
+
+void LargeFileView::on_area_resized(Gtk::Allocation& allocation) {
+    int page = std::max(1, allocation.get_height() / lineHeight_);
+    adjustment_->set_page_size(page);
+    adjustment_->set_page_increment(page);
+    adjustment_->set_upper(std::max<double>(index_.line_count(), selectedLine_ + 1));
+}
+
+bool LargeFileView::on_area_scroll(GdkEventScroll* event) {
+    double lines = 0;
+    double columns = 0;
+    switch (event->direction) {
+    case GDK_SCROLL_UP:
+        lines = -3;
+        break;
+    case GDK_SCROLL_DOWN:
+        lines = 3;
+        break;
+    case GDK_SCROLL_LEFT:
+        columns = -3;
+        break;
+    case GDK_SCROLL_RIGHT:
+        columns = 3;
+        break;
+    case GDK_SCROLL_SMOOTH:
+        lines = event->delta_y * 3;
+        columns = event->delta_x * 3;
+        break;
+    }
+    if (event->state & GDK_SHIFT_MASK) {
+        columns += lines;
+        lines = 0;
+    }
+
+    xOffset_ = std::max(0, xOffset_ + static_cast<int>(columns * charWidth_));
+    adjustment_->set_value(adjustment_->get_value() + lines);
+    drawingArea_.queue_draw();
+    return true;
+}
+
+bool LargeFileView::on_area_key_press(GdkEventKey* event) {
+    bool control = event->state & GDK_CONTROL_MASK;
+    size_t page = static_cast<size_t>(adjustment_->get_page_size());
+    size_t last = std::max<size_t>(index_.line_count(), 1) - 1;
+
+    if (control && event->keyval == GDK_KEY_g) {
+        gotoEntry_.grab_focus();
+    } else if (control && event->keyval == GDK_KEY_f) {
+        findEntry_.grab_focus();
+    } else if (event->keyval == GDK_KEY_F3) {
+        on_find_activate();
+    } else if (event->keyval == GDK_KEY_Up) {
+        scroll_to_line(selectedLine_ > 0 ? selectedLine_ - 1 : 0);
+    } else if (event->keyval == GDK_KEY_Down) {
+        scroll_to_line(std::min(selectedLine_ + 1, last));
+    } else if (event->keyval == GDK_KEY_Page_Up) {
+        scroll_to_line(selectedLine_ > page ? selectedLine_ - page : 0);
+    } else if (event->keyval == GDK_KEY_Page_Down) {
+        scroll_to_line(std::min(selectedLine_ + page, last));
+    } else if (control && event->keyval == GDK_KEY_Home) {
+        scroll_to_line(0);
+    } else if (control && event->keyval == GDK_KEY_End) {
+        scroll_to_line(last);
+    } else if (event->keyval == GDK_KEY_Left) {
+        xOffset_ = std::max(0, xOffset_ - 4 * charWidth_);
+    } else if (event->keyval == GDK_KEY_Right) {
+        xOffset_ += 4 * charWidth_;
+    } else if (event->keyval == GDK_KEY_Home) {
+        xOffset_ = 0;
+    } else {
+        return false;
+    }
+    drawingArea_.queue_draw();
+    return true;
+}
+
+bool LargeFileView::on_area_button_press(GdkEventButton* event) {
+    drawingArea_.grab_focus();
+    size_t line = static_cast<size_t>(adjustment_->get_value()) + static_cast<size_t>(event->y / lineHeight_);
+    if (line < index_.line_count()) {
+        selectedLine_ = line;
+        drawingArea_.queue_draw();
+    }
+    return true;
+}
+
+// Selects line, scrolling only if it's off screen and then putting it a third down
+void LargeFileView::scroll_to_line(size_t line) {
+    selectedLine_ = line;
+    adjustment_->set_upper(std::max<double>(index_.line_count(), line + 1));
+    size_t top = static_cast<size_t>(adjustment_->get_value());
+    size_t page = static_cast<size_t>(adjustment_->get_page_size());
+    if (line < top || line >= top + page) {
+        adjustment_->set_value(line > page / 3 ? line - page / 3 : 0);
+    }
+    drawingArea_.queue_draw();
+}
+
+void LargeFileView::go_to_line(int line) {
+    size_t target = line > 0 ? line - 1 : 0;
+    if (target >= index_.line_count() && !index_.complete()) {
+        // Jumps once indexing gets there
+        pendingLine_ = target + 1;
+        return;
+    }
+    matchOffset_ = std::string::npos;
+    scroll_to_line(std::min(target, std::max<size_t>(index_.line_count(), 1) - 1));
+    drawingArea_.grab_focus();
+}
+
+void LargeFileView::on_goto_activate() {
+    try {
+        go_to_line(std::stoi(gotoEntry_.get_text().raw()));
+    } catch (const std::exception&) {
+        gotoEntry_.set_text("");
+    }
+}
+
+// Continues after the current match, or from the selected line for a new needle, and
+// wraps around to the start once
+void LargeFileView::on_find_activate() {
+    std::string needle = findEntry_.get_text().raw();
+    if (needle.empty()) {
+        return;
+    }
+    stop_find();
+
+    size_t from = index_.line_start(selectedLine_);
+    if (needle == findNeedle_ && matchOffset_ != std::string::npos) {
+        from = matchOffset_ + 1;
+    } else if (from == std::string::npos) {
+        from = 0;
+    }
+    findNeedle_ = needle;
+    findCancel_ = false;
+    findDone_ = false;
+    findStatus_ = "Searching...";
+    update_status();
+
+    findThread_ = std::thread([this, needle, from]() {
+        size_t hit = index_.find(needle, from, findCancel_);
+        bool wrapped = false;
+        if (hit == std::string::npos && from > 0 && !findCancel_) {
+            hit = index_.find(needle, 0, findCancel_);
+            wrapped = hit != std::string::npos;
+        }
+        findWrapped_ = wrapped;
+        findResult_ = hit;
+        findDone_ = true;
+        findDispatcher_.emit();
+    });
+}
+
+void LargeFileView::on_find_done() {
+    if (!findDone_.exchange(false)) {
+        return;
+    }
+    if (findThread_.joinable()) {
+        findThread_.join();
+    }
+
+    size_t hit = findResult_;
+    if (hit == std::string::npos) {
+        matchOffset_ = std::string::npos;
+        findStatus_ = "Not found";
+        update_status();
+        drawingArea_.queue_draw();
+        return;
+    }
+
+    matchOffset_ = hit;
+    matchLength_ = findNeedle_.size();
+    findStatus_ = findWrapped_ ? "Wrapped around" : "";
+    scroll_to_line(index_.line_at(hit));
+
+    // Bring the match into view horizontally, assuming mostly single-width characters
+    size_t column = hit - index_.line_start(selectedLine_);
+    int visible_width = drawingArea_.get_allocated_width() - 10 * charWidth_;
+    int match_x = static_cast<int>(std::min(column, kMaxShownBytes)) * charWidth_;
+    if (match_x < xOffset_ || match_x > xOffset_ + visible_width) {
+        xOffset_ = std::max(0, match_x - visible_width / 2);
+    }
+    update_status();
+}
+
+void LargeFileView::stop_find() {
+    findCancel_ = true;
+    if (findThread_.joinable()) {
+        findThread_.join();
+    }
+}
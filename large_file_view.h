@@ -0,0 +1,83 @@
+#ifndef LARGE_FILE_VIEW_H
+#define LARGE_FILE_VIEW_H
+
+#include <atomic>
+#include <gtkmm/adjustment.h>
+#include <gtkmm/box.h>
+#include <gtkmm/drawingarea.h>
+#include <gtkmm/entry.h>
+#include <gtkmm/label.h>
+#include <gtkmm/scrollbar.h>
+#include <gtkmm/searchentry.h>
+#include <glibmm/dispatcher.h>
+#include <thread>
+
+#include "line_index.h"
+
+// Read-only view for files too big for a TextBuffer. The file stays mmapped in a
+// LineIndex and only the lines on screen are turned into Pango layouts when drawing, so
+// memory and redraw cost don't depend on the file size. Goto-line (Ctrl+G) and find
+// (Ctrl+F, Enter for the next match) work on the mapping; find runs on its own thread.
+class LargeFileView : public Gtk::Box {
+public:
+    explicit LargeFileView(int font_size);
+    ~LargeFileView() override;
+
+    bool open(const std::string& file_path, std::string& error);
+    const std::string& file_path() const { return filePath_; }
+    // 1-based; waits for indexing if the line isn't known yet
+    void go_to_line(int line);
+    void set_font_size(int size);
+
+protected:
+    Gtk::Box toolbar_;
+    Gtk::Label statusLabel_;
+    Gtk::Entry gotoEntry_;
+    Gtk::SearchEntry findEntry_;
+    Gtk::Box body_;
+    Gtk::DrawingArea drawingArea_;
+    Glib::RefPtr<Gtk::Adjustment> adjustment_;
+    Gtk::Scrollbar scrollbar_;
+
+    std::string filePath_;
+    Pango::FontDescription font_;
+    int lineHeight_ = 16;
+    int charWidth_ = 8;
+    // Horizontal scroll in pixels, lines aren't wrapped
+    int xOffset_ = 0;
+    // Highlighted line and match, 0-based
+    size_t selectedLine_ = 0;
+    size_t matchOffset_ = std::string::npos;
+    size_t matchLength_ = 0;
+    size_t pendingLine_ = 0;
+    std::vector<std::string_view> visible_;
+
+    // Declared before the index and the find thread so it outlives both
+    Glib::Dispatcher indexDispatcher_;
+    Glib::Dispatcher findDispatcher_;
+    LineIndex index_;
+    std::thread findThread_;
+    std::atomic<bool> findCancel_{false};
+    std::atomic<size_t> findResult_{std::string::npos};
+    std::atomic<bool> findWrapped_{false};
+    // Set by the find thread, cleared once its result was shown; stale wakeups see false
+    std::atomic<bool> findDone_{false};
+    std::string findNeedle_;
+    std::string findStatus_;
+
+    void update_metrics();
+    void update_status();
+    void on_index_progress();
+    bool on_draw_lines(const Cairo::RefPtr<Cairo::Context>& cr);
+    void on_area_resized(Gtk::Allocation& allocation);
+    bool on_area_scroll(GdkEventScroll* event);
+    bool on_area_key_press(GdkEventKey* event);
+    bool on_area_button_press(GdkEventButton* event);
+    void scroll_to_line(size_t line);
+    void on_goto_activate();
+    void on_find_activate();
+    void on_find_done();
+    void stop_find();
+};
+
+#endif // LARGE_FILE_VIEW_H
@@ -0,0 +1,175 @@
+#include "line_diff.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+
+namespace {
+
+struct Line {
+    std::string_view text;
+    size_t hash;
+};
+
+// Each line keeps its '\n'; the last one may not have one
+std::vector<Line> split_lines(std::string_view text) {
+    std::vector<Line> lines;
+    std::hash<std::string_view> hasher;
+    size_t start = 0;
+    while (start < text.size()) {
+        size_t end = text.find('\n', start);
+        end = end == std::string_view::npos ? text.size() : end + 1;
+        std::string_view line = text.substr(start, end - start);
+        lines.push_back({line, hasher(line)});
+        start = end;
+    }
+    return lines;
+}
+
+inline bool same(const Line& a, const Line& b) {
+    return a.hash == b.hash && a.text == b.text;
+}
+
+size_t count_chars(std::string_view text) {
+    size_t chars = 0;
+    for (unsigned char c : text) {
+        chars += (c & 0xc0) != 0x80;
+    }
+    return chars;
+}
+
+// A run of old lines [old_begin, old_end) replaced by new lines [new_begin, new_end)
+struct Hunk {
+    size_t old_begin, old_end;
+    size_t new_begin, new_end;
+};
+
+// Greedy Myers over a[0, n) and b[0, m), keeping each round's frontier for the walk
+// back. False when more than max_d lines differ.
+bool myers(const Line* a, size_t n, const Line* b, size_t m, size_t max_d, size_t old_base, size_t new_base,
+           std::vector<Hunk>& hunks) {
+    const long N = static_cast<long>(n);
+    const long M = static_cast<long>(m);
+    const long max = std::min<long>(N + M, static_cast<long>(max_d));
+    // v[k + offset] is the furthest x reached on diagonal k
+    const long offset = max + 1;
+    std::vector<long> v(2 * offset + 1, 0);
+    std::vector<std::vector<long>> trace;
+
+    long found = -1;
+    for (long d = 0; d <= max && found < 0; d++) {
+        trace.emplace_back(v.begin() + (offset - d), v.begin() + (offset + d + 1));
+        for (long k = -d; k <= d; k += 2) {
+            long x;
+            if (k == -d || (k != d && v[offset + k - 1] < v[offset + k + 1])) {
+                x = v[offset + k + 1];
+            } else {
+                x = v[offset + k - 1] + 1;
+            }
+            long y = x - k;
+            while (x < N && y < M && same(a[x], b[y])) {
+                x++;
+                y++;
+            }
+            v[offset + k] = x;
+            if (x >= N && y >= M) {
+                found = d;
+                break;
+            }
+        }
+    }
+    if (found < 0) {
+        return false;
+    }
+
+    // Walk back from the end, collecting the single-line steps in reverse
+    struct Step {
+        bool insert;
+        long x, y;
+    };
+    std::vector<Step> steps;
+    long x = N;
+    long y = M;
+    for (long d = found; d > 0; d--) {
+        const std::vector<long>& prev = trace[d];
+        // The frontier before round d, diagonal k at index k + d
+        auto at = [&prev, d](long k) { return prev[k + d]; };
+        long k = x - y;
+        long prev_k;
+        if (k == -d || (k != d && at(k - 1) < at(k + 1))) {
+            prev_k = k + 1;
+        } else {
+            prev_k = k - 1;
+        }
+        long prev_x = at(prev_k);
+        long prev_y = prev_x - prev_k;
+        // Moving down inserts b[prev_y] before a[prev_x], moving right deletes a[prev_x];
+        // the common lines after it are skipped by starting from there
+        steps.push_back({prev_k == k + 1, prev_x, prev_y});
+        x = prev_x;
+        y = prev_y;
+    }
+    std::reverse(steps.begin(), steps.end());
+
+    // Adjacent steps with no common line between them form one hunk
+    for (const Step& step : steps) {
+        size_t old_line = old_base + step.x;
+        size_t new_line = new_base + step.y;
+        if (!hunks.empty() && hunks.back().old_end == old_line && hunks.back().new_end == new_line) {
+            (step.insert ? hunks.back().new_end : hunks.back().old_end)++;
+        } else if (step.insert) {
+            hunks.push_back({old_line, old_line, new_line, new_line + 1});
+        } else {
+            hunks.push_back({old_line, old_line + 1, new_line, new_line});
+        }
+    }
+    return true;
+}
+
+} // namespace
+
+std::vector<TextEdit> line_diff(std::string_view old_text, std::string_view new_text, size_t max_changes) {
+    std::vector<Line> a = split_lines(old_text);
+    std::vector<Line> b = split_lines(new_text);
+
+    size_t prefix = 0;
+    while (prefix < a.size() && prefix < b.size() && same(a[prefix], b[prefix])) {
+        prefix++;
+    }
+    size_t suffix = 0;
+    while (suffix < a.size() - prefix && suffix < b.size() - prefix &&
+           same(a[a.size() - 1 - suffix], b[b.size() - 1 - suffix])) {
+        suffix++;
+    }
+
+    std::vector<Hunk> hunks;
+    size_t n = a.size() - prefix - suffix;
+    size_t m = b.size() - prefix - suffix;
+    if (n == 0 && m == 0) {
+        return {};
+    }
+    if (n == 0 || m == 0 || !myers(a.data() + prefix, n, b.data() + prefix, m, max_changes, prefix, prefix, hunks)) {
+        hunks.assign(1, {prefix, prefix + n, prefix, prefix + m});
+    }
+
+    // Character offsets of the old lines, counted once up to the last hunk
+    std::vector<TextEdit> edits;
+    size_t line = 0;
+    size_t chars = 0;
+    for (const Hunk& hunk : hunks) {
+        for (; line < hunk.old_begin; line++) {
+            chars += count_chars(a[line].text);
+        }
+        TextEdit edit;
+        edit.offset = chars;
+        for (; line < hunk.old_end; line++) {
+            edit.length += count_chars(a[line].text);
+        }
+        chars += edit.length;
+        for (size_t i = hunk.new_begin; i < hunk.new_end; i++) {
+            edit.text.append(b[i].text);
+        }
+        edits.push_back(std::move(edit));
+    }
+    return edits;
+}
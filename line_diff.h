@@ -0,0 +1,23 @@
+#ifndef LINE_DIFF_H
+#define LINE_DIFF_H
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Replaces length characters at offset (both in characters of the old text, as
+// Gtk::TextIter counts them) with text
+struct TextEdit {
+    size_t offset = 0;
+    size_t length = 0;
+    std::string text;
+};
+
+// Edits turning old_text into new_text, each replacing whole lines; sorted by offset
+// and never overlapping, so applying them last to first keeps the offsets valid.
+// Lines in common are found with Myers' algorithm after trimming the common start and
+// end. Past max_changes differing lines the middle is replaced in one edit.
+std::vector<TextEdit> line_diff(std::string_view old_text, std::string_view new_text, size_t max_changes = 1000);
+
+#endif // LINE_DIFF_H
@@ -0,0 +1,284 @@
+#include "line_index.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "trace.h"
+
+namespace {
+
+const size_t kCheckpointLines = 256;
+// Indexed per lock/notify round, about 10 ms of work
+const size_t kIndexBlock = 16 * 1024 * 1024;
+// Searched per cancellation check
+const size_t kFindBlock = 64 * 1024 * 1024;
+
+#if defined(__SSE2__)
+// Bit i set where p[i] is a newline, for 64 bytes
+inline uint64_t newline_mask(const char* p) {
+    const __m128i newline = _mm_set1_epi8('\n');
+    uint64_t m0 = static_cast<uint16_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p)), newline)));
+    uint64_t m1 = static_cast<uint16_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 16)), newline)));
+    uint64_t m2 = static_cast<uint16_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 32)), newline)));
+    uint64_t m3 = static_cast<uint16_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 48)), newline)));
+    return m0 | (m1 << 16) | (m2 << 32) | (m3 << 48);
+}
+#endif
+
+// Counts the newlines in [p, p + len) and calls checkpoint(offset) with the start of
+// every line whose number becomes a multiple of kCheckpointLines; newlines is the count
+// before p and is advanced
+template <typename Checkpoint>
+void scan_newlines(const char* p, size_t len, size_t base, size_t& newlines, Checkpoint checkpoint) {
+    size_t i = 0;
+#if defined(__SSE2__)
+    for (; i + 64 <= len; i += 64) {
+        uint64_t mask = newline_mask(p + i);
+        size_t found = __builtin_popcountll(mask);
+        size_t next = (newlines / kCheckpointLines + 1) * kCheckpointLines;
+        // Only look at single bits when a checkpoint falls in this block
+        if (newlines + found >= next) {
+            while (mask) {
+                newlines++;
+                size_t bit = __builtin_ctzll(mask);
+                if (newlines % kCheckpointLines == 0) {
+                    checkpoint(base + i + bit + 1);
+                }
+                mask &= mask - 1;
+            }
+        } else {
+            newlines += found;
+        }
+    }
+#endif
+    for (; i < len; i++) {
+        if (p[i] == '\n' && ++newlines % kCheckpointLines == 0) {
+            checkpoint(base + i + 1);
+        }
+    }
+}
+
+} // namespace
+
+LineIndex::LineIndex() = default;
+
+LineIndex::~LineIndex() {
+    stop_ = true;
+    if (worker_.joinable()) {
+        worker_.join();
+    }
+    if (data_) {
+        munmap(const_cast<char*>(data_), size_);
+    }
+    if (fd_ >= 0) {
+        close(fd_);
+    }
+}
+
+bool LineIndex::open(const std::string& file_path, std::string& error) {
+    int fd = ::open(file_path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        error = std::strerror(errno);
+        return false;
+    }
+    struct stat st {};
+    if (fstat(fd, &st) != 0) {
+        error = std::strerror(errno);
+        close(fd);
+        return false;
+    }
+
+    size_ = st.st_size;
+    if (size_ > 0) {
+        void* map = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map == MAP_FAILED) {
+            error = std::strerror(errno);
+            close(fd);
+            size_ = 0;
+            return false;
+        }
+        data_ = static_cast<const char*>(map);
+    }
+    // Kept open to notice the file shrinking
+    fd_ = fd;
+    backed_ = size_;
+
+    checkpoints_.push_back(0);
+    worker_ = std::thread(&LineIndex::run, this);
+    return true;
+}
+
+size_t LineIndex::line_count() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return newlines_ + 1;
+}
+
+bool LineIndex::complete() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return complete_;
+}
+
+size_t LineIndex::indexed_bytes() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return indexed_;
+}
+
+void LineIndex::set_notify(std::function<void()> notify) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    notify_ = std::move(notify);
+}
+
+size_t LineIndex::backed_size() const {
+    struct stat st {};
+    size_t backed = backed_.load();
+    if (fstat(fd_, &st) == 0 && static_cast<size_t>(st.st_size) < backed) {
+        backed = st.st_size;
+        backed_ = backed;
+    }
+    return backed;
+}
+
+size_t LineIndex::count_newlines(const char* data, size_t len) {
+    size_t newlines = 0;
+    size_t i = 0;
+#if defined(__SSE2__)
+    for (; i + 64 <= len; i += 64) {
+        newlines += __builtin_popcountll(newline_mask(data + i));
+    }
+#endif
+    return newlines + std::count(data + i, data + len, '\n');
+}
+
+// Index of the last checkpoint at or before line, with its offset
+size_t LineIndex::nearest_checkpoint(size_t line, size_t& offset) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    size_t k = std::min(line / kCheckpointLines, checkpoints_.size() - 1);
+    offset = checkpoints_[k];
+    return k * kCheckpointLines;
+}
+
+size_t LineIndex::line_start(size_t line) {
+    if (line >= line_count()) {
+        return std::string::npos;
+    }
+    size_t backed = backed_size();
+    size_t offset;
+    size_t current = nearest_checkpoint(line, offset);
+    while (current < line) {
+        if (offset >= backed) {
+            return std::string::npos;
+        }
+        auto newline = static_cast<const char*>(std::memchr(data_ + offset, '\n', backed - offset));
+        if (!newline) {
+            return std::string::npos;
+        }
+        offset = newline - data_ + 1;
+        current++;
+    }
+    return offset;
+}
+
+size_t LineIndex::lines(size_t first, size_t count, std::vector<std::string_view>& out) {
+    out.clear();
+    size_t known = line_count();
+    bool done = complete();
+    size_t offset = line_start(first);
+    size_t backed = backed_size();
+    for (size_t line = first; line < first + count && line < known && offset < backed; line++) {
+        auto newline = static_cast<const char*>(std::memchr(data_ + offset, '\n', backed - offset));
+        if (!newline && !done && line + 1 == known) {
+            // The last line known so far may still be growing into the unindexed part
+            break;
+        }
+        size_t end = newline ? newline - data_ : backed;
+        out.emplace_back(data_ + offset, end - offset);
+        offset = newline ? end + 1 : std::string::npos;
+    }
+    return out.size();
+}
+
+size_t LineIndex::line_at(size_t offset) {
+    offset = std::min(offset, backed_size());
+    size_t line;
+    size_t start;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        // Last checkpoint starting at or before offset
+        auto it = std::upper_bound(checkpoints_.begin(), checkpoints_.end(), static_cast<uint64_t>(offset));
+        size_t k = it - checkpoints_.begin() - 1;
+        line = k * kCheckpointLines;
+        start = checkpoints_[k];
+    }
+    return line + count_newlines(data_ + start, offset - start);
+}
+
+size_t LineIndex::find(std::string_view needle, size_t from, const std::atomic<bool>& cancel) const {
+    if (needle.empty()) {
+        return std::string::npos;
+    }
+    for (size_t start = from;; start += kFindBlock) {
+        size_t backed = backed_size();
+        if (needle.size() > backed || start > backed - needle.size() ||
+            cancel.load(std::memory_order_relaxed)) {
+            return std::string::npos;
+        }
+        size_t last = backed - needle.size();
+        // Blocks overlap by the needle, so matches across a boundary aren't missed
+        size_t end = std::min(start + kFindBlock, last) + needle.size();
+        auto hit = static_cast<const char*>(memmem(data_ + start, end - start, needle.data(), needle.size()));
+        if (hit) {
+            return hit - data_;
+        }
+    }
+}
+
+void LineIndex::run() {
+    TRACE_SCOPE("Index lines");
+    size_t newlines = 0;
+    std::vector<uint64_t> found;
+    std::vector<char> block(std::min(kIndexBlock, size_));
+    for (size_t offset = 0; offset < size_ && !stop_;) {
+        ssize_t len = pread(fd_, block.data(), std::min(kIndexBlock, size_ - offset), offset);
+        if (len < 0 && errno == EINTR) {
+            continue;
+        }
+        if (len <= 0) {
+            // Shrunk since it was opened; the rest of the mapping can't be touched
+            backed_ = std::min(backed_.load(), offset);
+            break;
+        }
+        found.clear();
+        scan_newlines(block.data(), len, offset, newlines, [&](size_t start) { found.push_back(start); });
+        offset += len;
+
+        std::function<void()> notify;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            checkpoints_.insert(checkpoints_.end(), found.begin(), found.end());
+            newlines_ = newlines;
+            indexed_ = offset;
+            notify = notify_;
+        }
+        if (notify) {
+            notify();
+        }
+    }
+
+    std::function<void()> notify;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        complete_ = !stop_;
+        notify = notify_;
+    }
+    if (notify) {
+        notify();
+    }
+}
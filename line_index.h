@@ -0,0 +1,80 @@
+#ifndef LINE_INDEX_H
+#define LINE_INDEX_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+// Line access to a file too big for a text buffer. The file is mmapped and a worker
+// finds its newlines, keeping only the offset of every 256th line start, so the index
+// of a multi-GB log with tens of millions of lines stays around a megabyte. A line is
+// reached from the nearest checkpoint with at most 255 short memchr hops.
+//
+// Lines are 0-based here. Everything can be asked while indexing is still running; it
+// then answers for the part indexed so far.
+//
+// Touching a mapped page past the end of a file that shrank raises SIGBUS, so the worker
+// reads with pread and every access through the mapping is first clamped to the file's
+// current size.
+class LineIndex {
+public:
+    LineIndex();
+    ~LineIndex();
+
+    LineIndex(const LineIndex&) = delete;
+    LineIndex& operator=(const LineIndex&) = delete;
+
+    bool open(const std::string& file_path, std::string& error);
+
+    const char* data() const { return data_; }
+    size_t size() const { return size_; }
+
+    // Lines known so far; once complete, every line including a last empty one
+    size_t line_count();
+    bool complete();
+    // Bytes indexed so far
+    size_t indexed_bytes();
+
+    // Lines [first, first + count) without their newline, fewer if not indexed yet
+    size_t lines(size_t first, size_t count, std::vector<std::string_view>& out);
+    // Offset where line starts, or npos if it isn't indexed yet
+    size_t line_start(size_t line);
+    // Line containing offset
+    size_t line_at(size_t offset);
+    // First occurrence of needle at or after from, npos if none or cancelled
+    size_t find(std::string_view needle, size_t from, const std::atomic<bool>& cancel) const;
+
+    // Called from the worker thread as indexing progresses
+    void set_notify(std::function<void()> notify);
+
+    static size_t count_newlines(const char* data, size_t len);
+
+private:
+    const char* data_ = nullptr;
+    size_t size_ = 0;
+    int fd_ = -1;
+    // Bytes at the start of the mapping the file still backs; only ever shrinks
+    mutable std::atomic<size_t> backed_{0};
+
+    std::mutex mutex_;
+    // checkpoints_[k] is the offset of line k * kCheckpointLines
+    std::vector<uint64_t> checkpoints_;
+    size_t newlines_ = 0;
+    size_t indexed_ = 0;
+    bool complete_ = false;
+    std::function<void()> notify_;
+    std::atomic<bool> stop_{false};
+    std::thread worker_;
+
+    void run();
+    size_t backed_size() const;
+    size_t nearest_checkpoint(size_t line, size_t& offset);
+};
+
+#endif // LINE_INDEX_H
@@ -0,0 +1,562 @@
+#include "link_graph.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <set>
+#include <sstream>
+#include <sys/stat.h>
+
+#include "binary_io.h"
+#include "dir_scanner.h"
+#include "save_queue.h"
+
+namespace {
+
+const char kMagic[8] = {'L', 'N', 'L', 'I', 'N', 'K', 'S', '1'};
+const size_t kMaxNoteSize = 16 * 1024 * 1024;
+const auto kWriteDelay = std::chrono::seconds(5);
+// What makes a file a note; [text](other) links reach other with any of these too
+const char* const kNoteExtensions[] = {".md", ".markdown"};
+
+std::string lowercase(std::string text) {
+    std::transform(text.begin(), text.end(), text.begin(), [](char c) {
+        return (c >= 'A' && c <= 'Z') ? c - 'A' + 'a' : c;
+    });
+    return text;
+}
+
+std::string_view trim(std::string_view text) {
+    while (!text.empty() && (text.front() == ' ' || text.front() == '\t')) {
+        text.remove_prefix(1);
+    }
+    while (!text.empty() && (text.back() == ' ' || text.back() == '\t' || text.back() == '\r')) {
+        text.remove_suffix(1);
+    }
+    return text;
+}
+
+bool has_note_extension(const std::string& name) {
+    std::string lower = lowercase(name);
+    for (const char* ext : kNoteExtensions) {
+        size_t len = std::strlen(ext);
+        if (lower.size() > len && lower.compare(lower.size() - len, len, ext) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+std::string percent_decode(std::string_view text) {
+    std::string decoded;
+    for (size_t i = 0; i < text.size(); i++) {
+        if (text[i] == '%' && i + 2 < text.size() && std::isxdigit(static_cast<unsigned char>(text[i + 1])) &&
+            std::isxdigit(static_cast<unsigned char>(text[i + 2]))) {
+            decoded.push_back(static_cast<char>(std::stoi(std::string(text.substr(i + 1, 2)), nullptr, 16)));
+            i += 2;
+        } else {
+            decoded.push_back(text[i]);
+        }
+    }
+    return decoded;
+}
+
+int64_t mtime_ns(const struct stat& st) {
+    return static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+}
+
+} // namespace
+
+std::string LinkResolver::name_key(const std::string& file_name) {
+    std::string key = lowercase(file_name);
+    if (has_note_extension(key)) {
+        key.erase(key.rfind('.'));
+    }
+    return key;
+}
+
+void LinkResolver::add_file(const std::string& file_path) {
+    if (files_.insert(file_path).second) {
+        by_name_[name_key(std::filesystem::path(file_path).filename().string())].push_back(file_path);
+    }
+}
+
+void LinkResolver::remove_file(const std::string& file_path) {
+    if (!files_.erase(file_path)) {
+        return;
+    }
+    auto named = by_name_.find(name_key(std::filesystem::path(file_path).filename().string()));
+    if (named != by_name_.end()) {
+        auto& paths = named->second;
+        paths.erase(std::remove(paths.begin(), paths.end(), file_path), paths.end());
+        if (paths.empty()) {
+            by_name_.erase(named);
+        }
+    }
+}
+
+std::string LinkResolver::link_key(const std::string& source, const NoteLink& link) const {
+    if (link.kind == NoteLink::Wiki) {
+        std::string target = link.target;
+        size_t slash = target.find_last_of('/');
+        return name_key(slash == std::string::npos ? target : target.substr(slash + 1));
+    }
+
+    std::string target = percent_decode(link.target.substr(0, link.target.find_first_of("#?")));
+    if (target.empty()) {
+        return "";
+    }
+    std::filesystem::path path = target.front() == '/' ? root_ / target.substr(1)
+                                                       : std::filesystem::path(source).parent_path() / target;
+    return path.lexically_normal().string();
+}
+
+std::string LinkResolver::resolve(const std::string& source, const NoteLink& link) const {
+    std::string key = link_key(source, link);
+    if (link.kind == NoteLink::Path) {
+        if (files_.count(key)) {
+            return key;
+        }
+        // [text](other) for other.md or other.markdown
+        for (const char* ext : kNoteExtensions) {
+            if (files_.count(key + ext)) {
+                return key + ext;
+            }
+        }
+        return "";
+    }
+
+    auto named = by_name_.find(key);
+    if (named == by_name_.end()) {
+        return "";
+    }
+    const std::vector<std::string>& candidates = named->second;
+    if (candidates.size() == 1) {
+        return candidates.front();
+    }
+
+    // [[folder/note]] picks the note in that folder
+    std::string target = lowercase(link.target);
+    if (target.find('/') != std::string::npos) {
+        if (has_note_extension(target)) {
+            target.erase(target.rfind('.'));
+        }
+        for (const std::string& candidate : candidates) {
+            std::string stem = lowercase(candidate);
+            if (has_note_extension(stem)) {
+                stem.erase(stem.rfind('.'));
+            }
+            if (stem.size() > target.size() && stem.compare(stem.size() - target.size(), target.size(), target) == 0 &&
+                stem[stem.size() - target.size() - 1] == '/') {
+                return candidate;
+            }
+        }
+    }
+
+    // Otherwise prefer the source's own folder, then the shallowest path
+    std::string dir = std::filesystem::path(source).parent_path().string();
+    const std::string* best = nullptr;
+    for (const std::string& candidate : candidates) {
+        if (std::filesystem::path(candidate).parent_path().string() == dir) {
+            return candidate;
+        }
+        if (!best || candidate.size() < best->size() || (candidate.size() == best->size() && candidate < *best)) {
+            best = &candidate;
+        }
+    }
+    return *best;
+}
+
+std::vector<NoteLink> LinkGraph::parse_links(std::string_view text) {
+    std::vector<NoteLink> links;
+    bool in_fence = false;
+    size_t line_start = 0;
+    while (line_start < text.size()) {
+        size_t line_end = text.find('\n', line_start);
+        if (line_end == std::string_view::npos) {
+            line_end = text.size();
+        }
+        std::string_view line = text.substr(line_start, line_end - line_start);
+        line_start = line_end + 1;
+
+        std::string_view trimmed = trim(line);
+        if (trimmed.substr(0, 3) == "```" || trimmed.substr(0, 3) == "~~~") {
+            in_fence = !in_fence;
+            continue;
+        }
+        if (in_fence) {
+            continue;
+        }
+
+        size_t open_bracket = std::string_view::npos;
+        for (size_t i = 0; i < line.size(); i++) {
+            char c = line[i];
+            if (c == '`') {
+                // Skip inline code
+                size_t close = line.find('`', i + 1);
+                if (close == std::string_view::npos) {
+                    break;
+                }
+                i = close;
+            } else if (line.compare(i, 2, "[[") == 0) {
+                size_t close = line.find("]]", i + 2);
+                if (close == std::string_view::npos) {
+                    break;
+                }
+                std::string_view inner = line.substr(i + 2, close - i - 2);
+                inner = trim(inner.substr(0, std::min(inner.find('|'), inner.find('#'))));
+                if (!inner.empty()) {
+                    links.push_back({NoteLink::Wiki, std::string(inner)});
+                }
+                i = close + 1;
+                open_bracket = std::string_view::npos;
+            } else if (c == '[') {
+                open_bracket = i;
+            } else if (c == ']' && open_bracket != std::string_view::npos && i + 1 < line.size() && line[i + 1] == '(') {
+                size_t close = line.find(')', i + 2);
+                if (close == std::string_view::npos) {
+                    break;
+                }
+                std::string_view url = trim(line.substr(i + 2, close - i - 2));
+                if (!url.empty() && url.front() == '<') {
+                    url = url.substr(1, url.find('>') - 1);
+                } else {
+                    // Drop an optional "title"
+                    url = url.substr(0, url.find(' '));
+                }
+                bool external = url.find("://") != std::string_view::npos || url.substr(0, 7) == "mailto:";
+                if (!url.empty() && url.front() != '#' && !external) {
+                    links.push_back({NoteLink::Path, std::string(url)});
+                }
+                i = close;
+                open_bracket = std::string_view::npos;
+            }
+        }
+    }
+    return links;
+}
+
+bool LinkGraph::is_note(const std::filesystem::path& path) {
+    return has_note_extension(path.filename().string());
+}
+
+LinkGraph::LinkGraph() : worker_(&LinkGraph::run, this) {}
+
+LinkGraph::~LinkGraph() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    cv_.notify_all();
+    worker_.join();
+}
+
+void LinkGraph::open(const std::string& graph_path, const std::filesystem::path& root,
+                     std::shared_ptr<const IgnoreRules> rules) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        graph_path_ = graph_path;
+        root_ = root;
+        resolver_.set_root(root);
+        rules_ = std::move(rules);
+        load();
+        refresh_ = true;
+    }
+    cv_.notify_one();
+}
+
+void LinkGraph::update_file(const std::string& file_path) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        queue_update(file_path);
+    }
+    cv_.notify_one();
+}
+
+void LinkGraph::apply_changes(const std::vector<FsChange>& changes) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (const FsChange& change : changes) {
+            if (change.is_directory) {
+                // Whatever the folder holds moved with it
+                refresh_ = true;
+                continue;
+            }
+            queue_update(change.path.string());
+            if (change.kind == FsChange::Renamed) {
+                queue_update(change.old_path.string());
+            }
+        }
+    }
+    cv_.notify_one();
+}
+
+// Called with mutex_ held
+void LinkGraph::queue_update(const std::string& file_path) {
+    if (rules_ && rules_->is_ignored_absolute(file_path, false)) {
+        return;
+    }
+    if (std::find(updates_.begin(), updates_.end(), file_path) == updates_.end()) {
+        updates_.push_back(file_path);
+    }
+}
+
+std::vector<std::string> LinkGraph::backlinks(const std::string& file_path) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::set<std::string> sources;
+    std::filesystem::path path(file_path);
+    std::vector<std::string> keys{LinkResolver::name_key(path.filename().string()), file_path};
+    // [text](other) is keyed without the extension but reaches other.md too
+    for (const char* ext : kNoteExtensions) {
+        size_t len = std::strlen(ext);
+        if (file_path.size() > len && file_path.compare(file_path.size() - len, len, ext) == 0) {
+            keys.push_back(file_path.substr(0, file_path.size() - len));
+        }
+    }
+    for (const std::string& key : keys) {
+        auto referrers = referrers_.find(key);
+        if (referrers == referrers_.end()) {
+            continue;
+        }
+        for (const std::string& source : referrers->second) {
+            if (sources.count(source)) {
+                continue;
+            }
+            // Two notes may share a name; only count links that really end up here
+            for (const NoteLink& link : files_[source].links) {
+                if (resolver_.link_key(source, link) == key && resolver_.resolve(source, link) == file_path) {
+                    sources.insert(source);
+                    break;
+                }
+            }
+        }
+    }
+    sources.erase(file_path);
+    return {sources.begin(), sources.end()};
+}
+
+std::string LinkGraph::resolve(const std::string& source, const NoteLink& link) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return resolver_.resolve(source, link);
+}
+
+void LinkGraph::set_notify(std::function<void()> notify) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    notify_ = std::move(notify);
+}
+
+void LinkGraph::run() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        auto has_work = [this] { return stop_ || refresh_ || !updates_.empty(); };
+        if (dirty_) {
+            cv_.wait_until(lock, last_write_ + kWriteDelay, has_work);
+        } else {
+            cv_.wait(lock, has_work);
+        }
+
+        if (stop_) {
+            if (dirty_) {
+                save(lock);
+            }
+            return;
+        }
+
+        if (refresh_) {
+            refresh_ = false;
+            lock.unlock();
+            refresh();
+            notify();
+            lock.lock();
+            if (dirty_) {
+                save(lock);
+            }
+        } else if (!updates_.empty()) {
+            std::string path = std::move(updates_.front());
+            updates_.pop_front();
+            lock.unlock();
+            reparse(path);
+            notify();
+            lock.lock();
+        } else if (dirty_ && std::chrono::steady_clock::now() >= last_write_ + kWriteDelay) {
+            save(lock);
+        }
+    }
+}
+
+// Re-parses notes whose size or mtime changed since the graph was saved and drops
+// files that are gone
+void LinkGraph::refresh() {
+    std::unordered_set<std::string> seen;
+    bool stopped = false;
+    DirScanner::walk_files(root_, [&](const std::filesystem::path& path, const struct stat& st) {
+        std::string file_path = path.string();
+        seen.insert(file_path);
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (stop_) {
+                stopped = true;
+                return false;
+            }
+            auto it = files_.find(file_path);
+            if (it != files_.end() && it->second.size == static_cast<uint64_t>(st.st_size) &&
+                it->second.mtime_ns == mtime_ns(st)) {
+                return true;
+            }
+        }
+        reparse(file_path);
+        return true;
+    }, rules_.get());
+    if (stopped) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<std::string> gone;
+    for (const auto& [path, entry] : files_) {
+        if (!seen.count(path)) {
+            gone.push_back(path);
+        }
+    }
+    for (const auto& path : gone) {
+        remove_file(path);
+    }
+}
+
+// Reads the note outside the lock, then swaps its edges in
+void LinkGraph::reparse(const std::string& file_path) {
+    struct stat st {};
+    if (stat(file_path.c_str(), &st) != 0 || !S_ISREG(st.st_mode)) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        remove_file(file_path);
+        return;
+    }
+
+    FileEntry entry;
+    entry.size = st.st_size;
+    entry.mtime_ns = mtime_ns(st);
+    if (is_note(file_path) && entry.size <= kMaxNoteSize) {
+        std::ifstream file(file_path, std::ios::binary);
+        std::stringstream buffer;
+        buffer << file.rdbuf();
+        entry.links = parse_links(buffer.str());
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    set_file(file_path, std::move(entry));
+}
+
+void LinkGraph::set_file(const std::string& file_path, FileEntry entry) {
+    auto it = files_.find(file_path);
+    if (it == files_.end()) {
+        resolver_.add_file(file_path);
+        it = files_.emplace(file_path, FileEntry()).first;
+    }
+
+    for (const NoteLink& link : it->second.links) {
+        auto referrers = referrers_.find(resolver_.link_key(file_path, link));
+        if (referrers != referrers_.end()) {
+            referrers->second.erase(file_path);
+            if (referrers->second.empty()) {
+                referrers_.erase(referrers);
+            }
+        }
+    }
+    for (const NoteLink& link : entry.links) {
+        referrers_[resolver_.link_key(file_path, link)].insert(file_path);
+    }
+    it->second = std::move(entry);
+    dirty_ = true;
+}
+
+void LinkGraph::remove_file(const std::string& file_path) {
+    auto it = files_.find(file_path);
+    if (it == files_.end()) {
+        return;
+    }
+
+    set_file(file_path, FileEntry());
+    resolver_.remove_file(file_path);
+    files_.erase(file_path);
+    dirty_ = true;
+}
+
+void LinkGraph::load() {
+    std::ifstream file(graph_path_, std::ios::binary);
+    if (!file) {
+        return;
+    }
+    std::stringstream buffer;
+    buffer << file.rdbuf();
+    std::string data = buffer.str();
+    if (data.size() < sizeof(kMagic) || std::memcmp(data.data(), kMagic, sizeof(kMagic)) != 0) {
+        std::cerr << "Ignoring invalid link graph: " << graph_path_ << std::endl;
+        return;
+    }
+
+    size_t pos = sizeof(kMagic);
+    while (pos < data.size()) {
+        std::string path;
+        FileEntry entry;
+        uint32_t count;
+        if (!get_string(data, pos, path) || !get(data, pos, entry.size) || !get(data, pos, entry.mtime_ns) ||
+            !get(data, pos, count)) {
+            break;
+        }
+        bool complete = true;
+        for (uint32_t i = 0; i < count && complete; i++) {
+            uint8_t kind = NoteLink::Wiki;
+            NoteLink link{NoteLink::Wiki, {}};
+            complete = get(data, pos, kind) && get_string(data, pos, link.target);
+            if (complete) {
+                link.kind = kind == NoteLink::Path ? NoteLink::Path : NoteLink::Wiki;
+                entry.links.push_back(std::move(link));
+            }
+        }
+        if (!complete) {
+            break;
+        }
+        set_file(path, std::move(entry));
+    }
+    dirty_ = false;
+}
+
+// Serializes under the lock, writes without it
+void LinkGraph::save(std::unique_lock<std::mutex>& lock) {
+    std::string data(kMagic, sizeof(kMagic));
+    for (const auto& [path, entry] : files_) {
+        put_string(data, path);
+        put_u64(data, entry.size);
+        put_u64(data, static_cast<uint64_t>(entry.mtime_ns));
+        put_u32(data, static_cast<uint32_t>(entry.links.size()));
+        for (const NoteLink& link : entry.links) {
+            data.push_back(static_cast<char>(link.kind));
+            put_string(data, link.target);
+        }
+    }
+    dirty_ = false;
+    last_write_ = std::chrono::steady_clock::now();
+    std::string graph_path = graph_path_;
+    lock.unlock();
+
+    std::error_code ec;
+    std::filesystem::create_directories(std::filesystem::path(graph_path).parent_path(), ec);
+    std::string error;
+    if (!SaveQueue::write_atomically(graph_path, data, error)) {
+        std::cerr << "Error writing link graph: " << graph_path << ": " << error << std::endl;
+    }
+    lock.lock();
+}
+
+void LinkGraph::notify() {
+    std::function<void()> notify;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        notify = notify_;
+    }
+    if (notify) {
+        notify();
+    }
+}
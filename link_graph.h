@@ -0,0 +1,126 @@
+#ifndef LINK_GRAPH_H
+#define LINK_GRAPH_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "file_watcher.h"
+#include "ignore_rules.h"
+
+struct NoteLink {
+    enum Kind { Wiki, Path };
+
+    Kind kind;
+    // As written: "Some note" for [[Some note|alias]], "../a.md" for [text](../a.md#x)
+    std::string target;
+};
+
+// Resolves links against a filename index of the workspace, so nothing has to probe
+// the filesystem. Const methods are safe to call from several threads at once.
+class LinkResolver {
+public:
+    void set_root(std::filesystem::path root) { root_ = std::move(root); }
+    void add_file(const std::string& file_path);
+    void remove_file(const std::string& file_path);
+    bool contains(const std::string& file_path) const { return files_.count(file_path) != 0; }
+
+    // Lowercased name for wiki links, absolute path for path links
+    std::string link_key(const std::string& source, const NoteLink& link) const;
+    // Path a link in source points to, or "" if it doesn't resolve
+    std::string resolve(const std::string& source, const NoteLink& link) const;
+
+    // What a wiki link has to say to reach a file: its name, minus the extension for notes
+    static std::string name_key(const std::string& file_name);
+
+private:
+    std::filesystem::path root_;
+    std::unordered_set<std::string> files_;
+    // Lowercased file name without extension -> files with that name
+    std::unordered_map<std::string, std::vector<std::string>> by_name_;
+};
+
+// Links between the notes of the workspace. Every note's outgoing [[wiki-links]] and
+// relative Markdown links are kept, together with a filename index of the workspace
+// used to resolve them, so nothing has to probe the filesystem. Backlinks come from a
+// reverse map from link key (lowercased name or absolute path) to the notes using it.
+//
+// The graph is saved to a file and reloaded on open; after that only notes whose size
+// or mtime changed are parsed again, and a saved note only replaces its own edges.
+class LinkGraph {
+public:
+    LinkGraph();
+    ~LinkGraph();
+
+    LinkGraph(const LinkGraph&) = delete;
+    LinkGraph& operator=(const LinkGraph&) = delete;
+
+    // Loads the graph saved at graph_path and starts checking root for changes
+    void open(const std::string& graph_path, const std::filesystem::path& root,
+              std::shared_ptr<const IgnoreRules> rules = nullptr);
+    // Re-parses one note right away, e.g. after it was saved
+    void update_file(const std::string& file_path);
+    // Files that were added, removed or renamed; a folder change rechecks the workspace
+    void apply_changes(const std::vector<FsChange>& changes);
+
+    // Notes linking to file_path, sorted
+    std::vector<std::string> backlinks(const std::string& file_path);
+    // Path a link in source points to, or "" if it doesn't resolve
+    std::string resolve(const std::string& source, const NoteLink& link);
+
+    // Called from the worker thread whenever links changed
+    void set_notify(std::function<void()> notify);
+
+    static std::vector<NoteLink> parse_links(std::string_view text);
+    static bool is_note(const std::filesystem::path& path);
+
+private:
+    struct FileEntry {
+        uint64_t size = 0;
+        int64_t mtime_ns = 0;
+        std::vector<NoteLink> links;
+    };
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::deque<std::string> updates_;
+    bool refresh_ = false;
+    bool stop_ = false;
+    std::function<void()> notify_;
+    std::string graph_path_;
+    std::filesystem::path root_;
+    std::shared_ptr<const IgnoreRules> rules_;
+
+    // Every file of the workspace, notes with their outgoing links
+    std::unordered_map<std::string, FileEntry> files_;
+    LinkResolver resolver_;
+    // Link key -> notes with a link using it
+    std::unordered_map<std::string, std::unordered_set<std::string>> referrers_;
+    bool dirty_ = false;
+    std::chrono::steady_clock::time_point last_write_;
+
+    std::thread worker_;
+
+    void run();
+    void refresh();
+    void queue_update(const std::string& file_path);
+    void reparse(const std::string& file_path);
+    void set_file(const std::string& file_path, FileEntry entry);
+    void remove_file(const std::string& file_path);
+    void load();
+    void save(std::unique_lock<std::mutex>& lock);
+    void notify();
+};
+
+#endif // LINK_GRAPH_H
@@ -1,12 +1,82 @@
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
 #include <iostream>
+#include <memory>
+#include <string>
 
+#include "ignore_rules.h"
+#include "site_export.h"
+#include "trace.h"
 #include "window.h"
 
+namespace {
+
+// librenote --export <out-dir> [--jobs N]: renders the workspace (the current folder,
+// as in the explorer) to a static site without opening a window
+int run_export(int argc, char *argv[], const char* trace_path) {
+    std::string out_dir;
+    size_t jobs = 0;
+    for (int i = 2; i < argc; i++) {
+        if (std::strcmp(argv[i], "--jobs") == 0 && i + 1 < argc) {
+            jobs = std::strtoul(argv[++i], nullptr, 10);
+        } else if (out_dir.empty() && argv[i][0] != '-') {
+            out_dir = argv[i];
+        } else {
+            out_dir.clear();
+            break;
+        }
+    }
+    if (out_dir.empty()) {
+        std::cerr << "Usage: librenote --export <out-dir> [--jobs N]" << std::endl;
+        return 2;
+    }
+
+    auto started = std::chrono::steady_clock::now();
+    std::filesystem::path root = std::filesystem::current_path();
+    SiteExporter exporter(root, out_dir, IgnoreRules::load(root));
+    ExportStats stats;
+    bool ok = exporter.run(stats, jobs);
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - started);
+    std::cout << "Exported " << stats.notes << " notes and " << stats.files << " other files to " << out_dir << ": "
+              << stats.rendered << " rendered, " << stats.copied << " copied, " << stats.removed << " removed, "
+              << stats.failed << " failed, " << stats.pruned << " ignored in " << elapsed.count() << " ms" << std::endl;
+
+    if (trace_path) {
+        std::string error;
+        if (!Tracer::write_chrome_trace(trace_path, error)) {
+            std::cerr << "Error writing trace: " << trace_path << ": " << error << std::endl;
+        }
+    }
+    return ok ? 0 : 1;
+}
+
+} // namespace
 
 int main(int argc, char *argv[]) {
+    // LIBRENOTE_TRACE=<file> records spans and writes them there as a Chrome trace
+    const char* trace_path = std::getenv("LIBRENOTE_TRACE");
+    if (trace_path && *trace_path) {
+        Tracer::set_enabled(true);
+        Tracer::set_thread_name("main");
+    }
+
+    // Headless, before GTK gets to parse (and reject) the arguments
+    if (argc >= 2 && std::strcmp(argv[1], "--export") == 0) {
+        return run_export(argc, argv, Tracer::enabled() ? trace_path : nullptr);
+    }
+
     auto app = Gtk::Application::create(argc, argv, "com.torbenconto.librenote");
 
-    Window window;
+    std::unique_ptr<Window> window;
+    {
+        TRACE_SCOPE("Startup");
+        window = std::make_unique<Window>();
+    }
+    if (Tracer::enabled()) {
+        window->set_trace_path(trace_path);
+    }
 
-    app->run(window);
+    app->run(*window);
 }
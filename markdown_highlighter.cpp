@@ -0,0 +1,162 @@
+#include "markdown_highlighter.h"
+
+#include <algorithm>
+#include <chrono>
+#include <glibmm/main.h>
+
+namespace {
+
+const auto kSliceBudget = std::chrono::microseconds(1000);
+// Lines lexed between two looks at the clock
+const int kLinesPerCheck = 16;
+
+} // namespace
+
+MarkdownHighlighter::MarkdownHighlighter(const Glib::RefPtr<Gtk::TextBuffer>& buffer) : buffer_(buffer) {
+    Glib::RefPtr<Gtk::TextBuffer::TagTable> table = buffer_->get_tag_table();
+    auto tag = [&](const char* name) {
+        Glib::RefPtr<Gtk::TextTag> existing = table->lookup(name);
+        Glib::RefPtr<Gtk::TextTag> created = existing ? existing : buffer_->create_tag(name);
+        tags_.push_back(created);
+        return created;
+    };
+
+    // Same order as MdStyle
+    Glib::RefPtr<Gtk::TextTag> t;
+    t = tag("md-heading1");
+    t->property_weight() = Pango::WEIGHT_BOLD;
+    t->property_scale() = 1.6;
+    t = tag("md-heading2");
+    t->property_weight() = Pango::WEIGHT_BOLD;
+    t->property_scale() = 1.35;
+    t = tag("md-heading3");
+    t->property_weight() = Pango::WEIGHT_BOLD;
+    t->property_scale() = 1.15;
+    t = tag("md-emphasis");
+    t->property_style() = Pango::STYLE_ITALIC;
+    t = tag("md-strong");
+    t->property_weight() = Pango::WEIGHT_BOLD;
+    t = tag("md-code");
+    t->property_family() = "monospace";
+    t->property_foreground() = "#8f5902";
+    t = tag("md-code-block");
+    t->property_family() = "monospace";
+    t->property_foreground() = "#4e9a06";
+    t = tag("md-link");
+    t->property_foreground() = "#3465a4";
+    t->property_underline() = Pango::UNDERLINE_SINGLE;
+    t = tag("md-quote");
+    t->property_style() = Pango::STYLE_ITALIC;
+    t->property_foreground() = "#75507b";
+    t = tag("md-list-marker");
+    t->property_weight() = Pango::WEIGHT_BOLD;
+    t->property_foreground() = "#c4a000";
+
+    // The before handlers see the old line count, the after handlers the new one
+    connections_.push_back(buffer_->signal_insert().connect([this](const Gtk::TextBuffer::iterator& pos, const Glib::ustring&, int) {
+        before_edit(pos);
+    }, false));
+    connections_.push_back(buffer_->signal_insert().connect([this](const Gtk::TextBuffer::iterator&, const Glib::ustring&, int) {
+        after_edit();
+    }, true));
+    connections_.push_back(buffer_->signal_erase().connect([this](const Gtk::TextBuffer::iterator& start, const Gtk::TextBuffer::iterator&) {
+        before_edit(start);
+    }, false));
+    connections_.push_back(buffer_->signal_erase().connect([this](const Gtk::TextBuffer::iterator&, const Gtk::TextBuffer::iterator&) {
+        after_edit();
+    }, true));
+
+    states_.assign(buffer_->get_line_count(), MdLineState{});
+    mark_dirty(0, static_cast<int>(states_.size()) - 1);
+}
+
+MarkdownHighlighter::~MarkdownHighlighter() {
+    for (auto& connection : connections_) {
+        connection.disconnect();
+    }
+    idle_.disconnect();
+}
+
+void MarkdownHighlighter::before_edit(const Gtk::TextBuffer::iterator& pos) {
+    editLine_ = pos.get_line();
+    lineCountBefore_ = buffer_->get_line_count();
+}
+
+// Line counts come from the buffer itself, which knows about \r, \r\n and U+2029 too
+void MarkdownHighlighter::after_edit() {
+    int delta = buffer_->get_line_count() - lineCountBefore_;
+    auto at = states_.begin() + std::min<size_t>(editLine_ + 1, states_.size());
+    if (delta > 0) {
+        states_.insert(at, delta, MdLineState{});
+    } else if (delta < 0) {
+        states_.erase(at, at + std::min<ptrdiff_t>(-delta, states_.end() - at));
+    }
+
+    if (dirtyFrom_ >= 0 && dirtyTo_ > editLine_) {
+        dirtyTo_ = std::max(dirtyTo_ + delta, editLine_);
+    }
+    mark_dirty(editLine_, editLine_ + std::max(delta, 0));
+}
+
+void MarkdownHighlighter::mark_dirty(int from, int to) {
+    if (dirtyFrom_ < 0) {
+        dirtyFrom_ = from;
+        dirtyTo_ = to;
+    } else {
+        dirtyFrom_ = std::min(dirtyFrom_, from);
+        dirtyTo_ = std::max(dirtyTo_, to);
+    }
+    if (!idle_.connected()) {
+        // Ahead of redrawing, so a keystroke shows up already highlighted
+        idle_ = Glib::signal_idle().connect(sigc::mem_fun(*this, &MarkdownHighlighter::on_idle), Glib::PRIORITY_HIGH_IDLE);
+    }
+}
+
+bool MarkdownHighlighter::on_idle() {
+    auto start = std::chrono::steady_clock::now();
+    int line_count = static_cast<int>(states_.size());
+    while (dirtyFrom_ >= 0) {
+        for (int i = 0; i < kLinesPerCheck && dirtyFrom_ >= 0; i++) {
+            int line = dirtyFrom_;
+            if (line >= line_count) {
+                dirtyFrom_ = -1;
+                break;
+            }
+            MdLineState next = highlight_line(line);
+            if (line + 1 >= line_count) {
+                dirtyFrom_ = -1;
+                break;
+            }
+            // Past the edit and the next line starts as it did before: nothing further changes
+            bool settled = line >= dirtyTo_ && states_[line + 1] == next;
+            states_[line + 1] = next;
+            dirtyFrom_ = settled ? -1 : line + 1;
+        }
+        if (std::chrono::steady_clock::now() - start >= kSliceBudget) {
+            break;
+        }
+    }
+    return dirtyFrom_ >= 0;
+}
+
+MdLineState MarkdownHighlighter::highlight_line(int line) {
+    Gtk::TextBuffer::iterator start = buffer_->get_iter_at_line(line);
+    Gtk::TextBuffer::iterator end = start;
+    if (!end.ends_line()) {
+        end.forward_to_line_end();
+    }
+    for (const auto& tag : tags_) {
+        buffer_->remove_tag(tag, start, end);
+    }
+
+    Glib::ustring text = buffer_->get_text(start, end, true);
+    spans_.clear();
+    MdLineState next = lex_markdown_line(text.raw(), states_[line], spans_);
+    for (const MdSpan& span : spans_) {
+        if (span.start < span.end) {
+            buffer_->apply_tag(tags_[static_cast<size_t>(span.style)], buffer_->get_iter_at_line_index(line, span.start),
+                               buffer_->get_iter_at_line_index(line, span.end));
+        }
+    }
+    return next;
+}
@@ -0,0 +1,44 @@
+#ifndef MARKDOWN_HIGHLIGHTER_H
+#define MARKDOWN_HIGHLIGHTER_H
+
+#include <gtkmm/textbuffer.h>
+#include <vector>
+
+#include "markdown_lexer.h"
+
+// Highlights Markdown in a TextBuffer without ever re-tagging the whole document on
+// an edit. It remembers the lexer state each line starts in; an edit marks only its
+// own lines dirty, and re-lexing continues past them only while the state flowing
+// into the next line differs from before (e.g. after typing a code fence). The work
+// runs in idle slices of about a millisecond, so large backlogs never stall typing.
+class MarkdownHighlighter {
+public:
+    explicit MarkdownHighlighter(const Glib::RefPtr<Gtk::TextBuffer>& buffer);
+    ~MarkdownHighlighter();
+
+    MarkdownHighlighter(const MarkdownHighlighter&) = delete;
+    MarkdownHighlighter& operator=(const MarkdownHighlighter&) = delete;
+
+private:
+    Glib::RefPtr<Gtk::TextBuffer> buffer_;
+    std::vector<Glib::RefPtr<Gtk::TextTag>> tags_;
+    // Lexer state at the start of each line
+    std::vector<MdLineState> states_;
+    // Lines [dirtyFrom_, dirtyTo_] still need lexing, dirtyFrom_ is -1 when clean
+    int dirtyFrom_ = -1;
+    int dirtyTo_ = -1;
+    // Captured before an edit to see how many lines it added or removed
+    int editLine_ = 0;
+    int lineCountBefore_ = 0;
+    std::vector<MdSpan> spans_;
+    std::vector<sigc::connection> connections_;
+    sigc::connection idle_;
+
+    void before_edit(const Gtk::TextBuffer::iterator& pos);
+    void after_edit();
+    void mark_dirty(int from, int to);
+    bool on_idle();
+    MdLineState highlight_line(int line);
+};
+
+#endif // MARKDOWN_HIGHLIGHTER_H
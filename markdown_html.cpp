@@ -0,0 +1,413 @@
+#include "markdown_html.h"
+
+#include <cctype>
+#include <unordered_map>
+#include <vector>
+
+#include "markdown_lexer.h"
+
+namespace {
+
+std::string_view trim(std::string_view text) {
+    while (!text.empty() && (text.front() == ' ' || text.front() == '\t')) {
+        text.remove_prefix(1);
+    }
+    while (!text.empty() && (text.back() == ' ' || text.back() == '\t' || text.back() == '\r')) {
+        text.remove_suffix(1);
+    }
+    return text;
+}
+
+void append_escaped(std::string_view text, std::string& out) {
+    for (char c : text) {
+        switch (c) {
+        case '&': out += "&amp;"; break;
+        case '<': out += "&lt;"; break;
+        case '>': out += "&gt;"; break;
+        case '"': out += "&quot;"; break;
+        default: out.push_back(c);
+        }
+    }
+}
+
+// Plain text between spans: escaped, with backslash escapes resolved
+void append_text(std::string_view text, std::string& out) {
+    size_t start = 0;
+    for (size_t i = 0; i + 1 < text.size(); i++) {
+        if (text[i] == '\\' && std::ispunct(static_cast<unsigned char>(text[i + 1]))) {
+            append_escaped(text.substr(start, i - start), out);
+            start = ++i;
+        }
+    }
+    append_escaped(text.substr(start), out);
+}
+
+// Anchor for a heading: lowercase ASCII letters and digits, dashes for the rest.
+// UTF-8 is kept as is.
+std::string slug(std::string_view text) {
+    std::string id;
+    for (char c : text) {
+        unsigned char u = static_cast<unsigned char>(c);
+        if (u >= 0x80 || std::isalnum(u) || c == '_') {
+            id.push_back(static_cast<char>(std::tolower(u)));
+        } else if (!id.empty() && id.back() != '-') {
+            id.push_back('-');
+        }
+    }
+    while (!id.empty() && id.back() == '-') {
+        id.pop_back();
+    }
+    return id;
+}
+
+bool is_rule(std::string_view line) {
+    if (line.size() < 3 || (line[0] != '-' && line[0] != '*' && line[0] != '_')) {
+        return false;
+    }
+    size_t marks = 0;
+    for (char c : line) {
+        if (c == line[0]) {
+            marks++;
+        } else if (c != ' ' && c != '\t') {
+            return false;
+        }
+    }
+    return marks >= 3;
+}
+
+class HtmlRenderer {
+public:
+    HtmlRenderer(const LinkHref& href, std::string& out, std::string* title) : href_(href), out_(out), title_(title) {}
+
+    void line(std::string_view line) {
+        std::vector<MdSpan> spans;
+        MdLineState previous = state_;
+        state_ = lex_markdown_line(line, previous, spans);
+
+        if (previous.in_fence()) {
+            if (!state_.in_fence()) {
+                out_ += "</code></pre>\n";
+            } else {
+                append_escaped(line, out_);
+                out_.push_back('\n');
+            }
+            return;
+        }
+
+        std::string_view trimmed = trim(line);
+        if (state_.in_fence()) {
+            close_block();
+            // The info string's first word names the language
+            size_t fence = trimmed.find_first_not_of(trimmed[0]);
+            std::string_view info = fence == std::string_view::npos ? std::string_view() : trim(trimmed.substr(fence));
+            info = info.substr(0, info.find_first_of(" \t{"));
+            out_ += "<pre><code";
+            if (!info.empty()) {
+                out_ += " class=\"language-";
+                append_escaped(info, out_);
+                out_ += "\"";
+            }
+            out_ += ">";
+            return;
+        }
+
+        if (trimmed.empty()) {
+            if (block_ == Block::Quote) {
+                pending_ += "\n\n";
+            } else {
+                close_block();
+            }
+            return;
+        }
+        if (is_rule(trimmed)) {
+            close_block();
+            out_ += "<hr>\n";
+            return;
+        }
+
+        size_t hashes = 0;
+        while (hashes < trimmed.size() && trimmed[hashes] == '#') {
+            hashes++;
+        }
+        if (hashes >= 1 && hashes <= 6 && line.find_first_not_of(" \t") < 4 &&
+            (hashes == trimmed.size() || trimmed[hashes] == ' ' || trimmed[hashes] == '\t')) {
+            close_block();
+            heading(hashes, trimmed.substr(hashes));
+            return;
+        }
+
+        if (trimmed[0] == '>') {
+            if (block_ != Block::Quote) {
+                close_block();
+                block_ = Block::Quote;
+            }
+            std::string_view content = trim(trimmed.substr(1));
+            if (content.empty()) {
+                pending_ += "\n\n";
+            } else {
+                if (!pending_.empty() && pending_.back() != '\n') {
+                    pending_.push_back('\n');
+                }
+                pending_ += content;
+            }
+            return;
+        }
+
+        for (const MdSpan& span : spans) {
+            if (span.style == MdStyle::ListMarker) {
+                bool ordered = line[span.start] >= '0' && line[span.start] <= '9';
+                if (block_ != Block::List || ordered != ordered_) {
+                    close_block();
+                    block_ = Block::List;
+                    ordered_ = ordered;
+                    out_ += ordered ? "<ol>\n" : "<ul>\n";
+                } else {
+                    close_item();
+                }
+                pending_ = trim(line.substr(span.end));
+                return;
+            }
+        }
+
+        // Anything else starts a paragraph or continues the open block
+        if (block_ == Block::None) {
+            block_ = Block::Paragraph;
+        } else if (!pending_.empty() && pending_.back() != '\n') {
+            pending_.push_back('\n');
+        }
+        pending_ += trimmed;
+    }
+
+    void finish() {
+        if (state_.in_fence()) {
+            out_ += "</code></pre>\n";
+        }
+        close_block();
+    }
+
+private:
+    enum class Block { None, Paragraph, Quote, List };
+
+    const LinkHref& href_;
+    std::string& out_;
+    std::string* title_;
+    MdLineState state_;
+    Block block_ = Block::None;
+    bool ordered_ = false;
+    // Inline text of the open paragraph, quote or list item
+    std::string pending_;
+    std::unordered_map<std::string, int> ids_;
+
+    void heading(size_t level, std::string_view text) {
+        text = trim(text);
+        // Closing hashes are decoration
+        size_t end = text.find_last_not_of('#');
+        if (end == std::string_view::npos) {
+            text = {};
+        } else if (end + 1 < text.size() && (text[end] == ' ' || text[end] == '\t')) {
+            text = trim(text.substr(0, end));
+        }
+        if (title_ && title_->empty()) {
+            *title_ = std::string(text);
+        }
+
+        std::string id = slug(text);
+        int& seen = ids_[id];
+        if (seen++ > 0) {
+            id += "-" + std::to_string(seen - 1);
+        }
+        char level_digit = static_cast<char>('0' + level);
+        out_ += "<h";
+        out_.push_back(level_digit);
+        if (!id.empty()) {
+            out_ += " id=\"" + id + "\"";
+        }
+        out_ += ">";
+        inline_html(text);
+        out_ += "</h";
+        out_.push_back(level_digit);
+        out_ += ">\n";
+    }
+
+    void close_item() {
+        out_ += "<li>";
+        inline_html(pending_);
+        out_ += "</li>\n";
+        pending_.clear();
+    }
+
+    void close_block() {
+        switch (block_) {
+        case Block::None:
+            break;
+        case Block::Paragraph:
+            out_ += "<p>";
+            inline_html(pending_);
+            out_ += "</p>\n";
+            break;
+        case Block::Quote: {
+            out_ += "<blockquote>\n";
+            std::string_view text = pending_;
+            while (!text.empty()) {
+                size_t end = text.find("\n\n");
+                std::string_view paragraph = trim(text.substr(0, end));
+                if (!paragraph.empty()) {
+                    out_ += "<p>";
+                    inline_html(paragraph);
+                    out_ += "</p>\n";
+                }
+                text = end == std::string_view::npos ? std::string_view() : text.substr(end + 2);
+            }
+            out_ += "</blockquote>\n";
+            break;
+        }
+        case Block::List:
+            close_item();
+            out_ += ordered_ ? "</ol>\n" : "</ul>\n";
+            break;
+        }
+        block_ = Block::None;
+        pending_.clear();
+    }
+
+    void inline_html(std::string_view text) {
+        std::vector<MdSpan> spans;
+        lex_markdown_inline(text, spans);
+        size_t pos = 0;
+        for (const MdSpan& span : spans) {
+            if (span.start < pos) {
+                continue;
+            }
+            append_text(text.substr(pos, span.start - pos), out_);
+            std::string_view content = text.substr(span.start, span.end - span.start);
+            switch (span.style) {
+            case MdStyle::Code: {
+                size_t ticks = 0;
+                while (ticks < content.size() && content[ticks] == '`') {
+                    ticks++;
+                }
+                std::string_view code = ticks * 2 < content.size() ? content.substr(ticks, content.size() - 2 * ticks) : std::string_view();
+                if (code.size() >= 2 && code.front() == ' ' && code.back() == ' ') {
+                    code = code.substr(1, code.size() - 2);
+                }
+                out_ += "<code>";
+                append_escaped(code, out_);
+                out_ += "</code>";
+                break;
+            }
+            case MdStyle::Strong:
+                out_ += "<strong>";
+                inline_html(content.substr(2, content.size() - 4));
+                out_ += "</strong>";
+                break;
+            case MdStyle::Emphasis:
+                out_ += "<em>";
+                inline_html(content.substr(1, content.size() - 2));
+                out_ += "</em>";
+                break;
+            case MdStyle::Link:
+                link(content);
+                break;
+            default:
+                append_text(content, out_);
+                break;
+            }
+            pos = span.end;
+        }
+        append_text(text.substr(pos), out_);
+    }
+
+    void link(std::string_view text) {
+        bool image = text[0] == '!';
+        if (image) {
+            text.remove_prefix(1);
+        }
+
+        std::string href;
+        std::string_view label;
+        bool resolved = true;
+        if (text.substr(0, 2) == "[[") {
+            // [[target#heading|label]]
+            std::string_view inner = text.substr(2, text.size() - 4);
+            size_t bar = inner.find('|');
+            std::string_view target = trim(inner.substr(0, bar));
+            label = bar == std::string_view::npos ? target : trim(inner.substr(bar + 1));
+            size_t hash = target.find('#');
+            std::string_view name = trim(target.substr(0, hash));
+            if (!name.empty()) {
+                href = href_({NoteLink::Wiki, std::string(name)});
+                resolved = !href.empty();
+            }
+            if (resolved && hash != std::string_view::npos) {
+                href += "#" + slug(target.substr(hash + 1));
+            }
+        } else {
+            // [label](url "title")
+            size_t close = text.find("](");
+            label = text.substr(1, close - 1);
+            std::string_view url = trim(text.substr(close + 2, text.size() - close - 3));
+            if (!url.empty() && url.front() == '<') {
+                url = url.substr(1, url.find('>') - 1);
+            } else {
+                url = url.substr(0, url.find(' '));
+            }
+            href = std::string(url);
+            bool external = url.find("://") != std::string_view::npos || url.substr(0, 7) == "mailto:";
+            if (!url.empty() && url.front() != '#' && !external) {
+                std::string target = href_({NoteLink::Path, std::string(url)});
+                if (!target.empty()) {
+                    size_t fragment = url.find('#');
+                    href = target + (fragment == std::string_view::npos ? "" : std::string(url.substr(fragment)));
+                }
+            }
+        }
+
+        if (!resolved) {
+            out_ += "<span class=\"broken-link\">";
+            append_text(label, out_);
+            out_ += "</span>";
+        } else if (image) {
+            out_ += "<img src=\"";
+            append_escaped(href, out_);
+            out_ += "\" alt=\"";
+            append_escaped(label, out_);
+            out_ += "\">";
+        } else {
+            out_ += "<a href=\"";
+            append_escaped(href, out_);
+            out_ += "\">";
+            inline_html(label);
+            out_ += "</a>";
+        }
+    }
+};
+
+} // namespace
+
+std::string render_markdown_html(std::string_view text, const LinkHref& href, std::string* title) {
+    std::string out;
+    out.reserve(text.size() + text.size() / 4);
+    HtmlRenderer renderer(href, out, title);
+    size_t line_start = 0;
+    while (line_start < text.size()) {
+        size_t line_end = text.find('\n', line_start);
+        if (line_end == std::string_view::npos) {
+            line_end = text.size();
+        }
+        std::string_view line = text.substr(line_start, line_end - line_start);
+        if (!line.empty() && line.back() == '\r') {
+            line.remove_suffix(1);
+        }
+        renderer.line(line);
+        line_start = line_end + 1;
+    }
+    renderer.finish();
+    return out;
+}
+
+std::string html_escape(std::string_view text) {
+    std::string out;
+    out.reserve(text.size());
+    append_escaped(text, out);
+    return out;
+}
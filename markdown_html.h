@@ -0,0 +1,22 @@
+#ifndef MARKDOWN_HTML_H
+#define MARKDOWN_HTML_H
+
+#include <functional>
+#include <string>
+#include <string_view>
+
+#include "link_graph.h"
+
+// Turns a link as written in a note into an href, "" when it leads nowhere
+using LinkHref = std::function<std::string(const NoteLink& link)>;
+
+// Renders a note to an HTML fragment. Lines are classified by lex_markdown_line, so a
+// page shows the same headings, lists, quotes and code the editor highlights. Wiki
+// links and relative links go through href; wiki links it can't resolve are rendered
+// as <span class="broken-link">. title, if given, receives the first heading's text.
+std::string render_markdown_html(std::string_view text, const LinkHref& href, std::string* title = nullptr);
+
+// Escapes &, <, > and " so text can go into element content and attribute values
+std::string html_escape(std::string_view text);
+
+#endif // MARKDOWN_HTML_H
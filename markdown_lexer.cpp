@@ -0,0 +1,170 @@
+#include "markdown_lexer.h"
+
+#include <algorithm>
+
+namespace {
+
+size_t skip_indent(std::string_view line) {
+    size_t i = 0;
+    while (i < line.size() && i < 4 && line[i] == ' ') {
+        i++;
+    }
+    return i;
+}
+
+size_t run_length(std::string_view line, size_t i, char c) {
+    size_t n = 0;
+    while (i + n < line.size() && line[i + n] == c) {
+        n++;
+    }
+    return n;
+}
+
+bool is_space(char c) {
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+bool is_alnum(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9');
+}
+
+void lex_inline(std::string_view line, size_t from, std::vector<MdSpan>& spans) {
+    size_t i = from;
+    while (i < line.size()) {
+        char c = line[i];
+
+        if (c == '\\' && i + 1 < line.size()) {
+            i += 2;
+            continue;
+        }
+
+        if (c == '`') {
+            // A code span closes with a backtick run of the same length
+            size_t n = run_length(line, i, '`');
+            size_t j = i + n;
+            while (j < line.size()) {
+                size_t m = run_length(line, j, '`');
+                if (m == n) {
+                    spans.push_back({i, j + m, MdStyle::Code});
+                    break;
+                }
+                j += m ? m : 1;
+            }
+            i = j < line.size() ? j + n : i + n;
+            continue;
+        }
+
+        if (c == '[') {
+            bool wiki = i + 1 < line.size() && line[i + 1] == '[';
+            size_t close = line.find(wiki ? "]]" : "]", i + 1);
+            if (close != std::string_view::npos) {
+                size_t end = close + (wiki ? 2 : 1);
+                if (!wiki && end < line.size() && line[end] == '(') {
+                    size_t paren = line.find(')', end);
+                    if (paren == std::string_view::npos) {
+                        i++;
+                        continue;
+                    }
+                    end = paren + 1;
+                } else if (!wiki) {
+                    i++;
+                    continue;
+                }
+                // Include the '!' of an image
+                size_t start = i > 0 && line[i - 1] == '!' ? i - 1 : i;
+                spans.push_back({start, end, MdStyle::Link});
+                i = end;
+                continue;
+            }
+        }
+
+        if (c == '*' || c == '_') {
+            size_t n = run_length(line, i, c);
+            bool opens = i + n < line.size() && !is_space(line[i + n]);
+            // snake_case_words aren't emphasis
+            bool intraword = c == '_' && i > 0 && is_alnum(line[i - 1]);
+            if (opens && !intraword && n <= 3) {
+                size_t len = n >= 2 ? 2 : 1;
+                std::string_view marker = line.substr(i, len);
+                size_t close = line.find(marker, i + len);
+                while (close != std::string_view::npos && is_space(line[close - 1])) {
+                    close = line.find(marker, close + len);
+                }
+                if (close != std::string_view::npos) {
+                    spans.push_back({i, close + len, len == 2 ? MdStyle::Strong : MdStyle::Emphasis});
+                    i = close + len;
+                    continue;
+                }
+            }
+            i += n;
+            continue;
+        }
+
+        i++;
+    }
+}
+
+} // namespace
+
+MdLineState lex_markdown_line(std::string_view line, MdLineState state, std::vector<MdSpan>& spans) {
+    size_t indent = skip_indent(line);
+
+    if (state.in_fence()) {
+        spans.push_back({0, line.size(), MdStyle::CodeBlock});
+        // A shorter run is part of the code, e.g. ``` inside a ```` block
+        bool closes = run_length(line, indent, state.fence) >= state.fence_length;
+        return closes ? MdLineState{} : state;
+    }
+
+    if (indent < line.size() && (line[indent] == '`' || line[indent] == '~')) {
+        size_t run = run_length(line, indent, line[indent]);
+        if (run >= 3) {
+            spans.push_back({0, line.size(), MdStyle::CodeBlock});
+            return {line[indent], static_cast<uint8_t>(std::min<size_t>(run, UINT8_MAX))};
+        }
+    }
+
+    size_t hashes = run_length(line, indent, '#');
+    if (hashes >= 1 && hashes <= 6 && (indent + hashes == line.size() || is_space(line[indent + hashes]))) {
+        MdStyle style = hashes == 1 ? MdStyle::Heading1 : hashes == 2 ? MdStyle::Heading2 : MdStyle::Heading3;
+        spans.push_back({0, line.size(), style});
+        lex_inline(line, indent + hashes, spans);
+        return MdLineState{};
+    }
+
+    size_t i = indent;
+    if (i < line.size() && line[i] == '>') {
+        spans.push_back({0, line.size(), MdStyle::Quote});
+        i++;
+        while (i < line.size() && line[i] == ' ') {
+            i++;
+        }
+    }
+
+    // List items: "- ", "* ", "+ ", "1. ", "1) "
+    size_t marker = i;
+    while (marker < line.size() && line[marker] == ' ') {
+        marker++;
+    }
+    size_t digits = 0;
+    while (marker + digits < line.size() && line[marker + digits] >= '0' && line[marker + digits] <= '9') {
+        digits++;
+    }
+    size_t marker_end = std::string_view::npos;
+    if (digits > 0 && digits <= 9 && marker + digits < line.size() && (line[marker + digits] == '.' || line[marker + digits] == ')')) {
+        marker_end = marker + digits + 1;
+    } else if (digits == 0 && marker < line.size() && (line[marker] == '-' || line[marker] == '*' || line[marker] == '+')) {
+        marker_end = marker + 1;
+    }
+    if (marker_end != std::string_view::npos && (marker_end == line.size() || line[marker_end] == ' ')) {
+        spans.push_back({marker, marker_end, MdStyle::ListMarker});
+        i = marker_end;
+    }
+
+    lex_inline(line, i, spans);
+    return MdLineState{};
+}
+
+void lex_markdown_inline(std::string_view text, std::vector<MdSpan>& spans) {
+    lex_inline(text, 0, spans);
+}
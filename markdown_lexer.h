@@ -0,0 +1,50 @@
+#ifndef MARKDOWN_LEXER_H
+#define MARKDOWN_LEXER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+enum class MdStyle : uint8_t {
+    Heading1,
+    Heading2,
+    Heading3,
+    Emphasis,
+    Strong,
+    Code,
+    CodeBlock,
+    Link,
+    Quote,
+    ListMarker,
+    Count,
+};
+
+// The only state carried from one line to the next: whether it is inside a fenced
+// code block, and which fence closes it. Everything else in Markdown that matters for
+// highlighting is local to a line, so a line can be re-lexed knowing just this.
+struct MdLineState {
+    // '`' or '~' inside a fenced code block, 0 outside
+    char fence = 0;
+    // Of the opening fence; only a run at least this long closes the block
+    uint8_t fence_length = 0;
+
+    bool in_fence() const { return fence != 0; }
+    bool operator==(const MdLineState& other) const { return fence == other.fence && fence_length == other.fence_length; }
+    bool operator!=(const MdLineState& other) const { return !(*this == other); }
+};
+
+struct MdSpan {
+    // Byte offsets within the line
+    size_t start;
+    size_t end;
+    MdStyle style;
+};
+
+// Appends the styled spans of one line (without its newline) to spans and returns the
+// state the next line starts in
+MdLineState lex_markdown_line(std::string_view line, MdLineState state, std::vector<MdSpan>& spans);
+// Just the inline spans (code, emphasis, links) of text, e.g. inside another span
+void lex_markdown_inline(std::string_view text, std::vector<MdSpan>& spans);
+
+#endif // MARKDOWN_LEXER_H
@@ -0,0 +1,495 @@
+#include "path_index.h"
+
+#include <algorithm>
+#include <cstring>
+#include <sys/stat.h>
+#include <unordered_set>
+
+#include "dir_scanner.h"
+#include "trace.h"
+
+namespace {
+
+const int kMatch = 16;
+const int kGapStart = -3;
+const int kGapExtension = -1;
+const int kBonusSegmentStart = 10;
+const int kBonusBoundary = 8;
+const int kBonusCamel = 7;
+const int kBonusConsecutive = 5;
+// The whole pattern fits in the file name
+const int kBonusFileName = 32;
+
+const size_t kMinSlice = 4096;
+const auto kMinRefreshInterval = std::chrono::seconds(5);
+
+inline char lower(char c) {
+    return c >= 'A' && c <= 'Z' ? static_cast<char>(c + 32) : c;
+}
+
+inline bool is_upper(char c) {
+    return c >= 'A' && c <= 'Z';
+}
+
+inline bool is_lower(char c) {
+    return c >= 'a' && c <= 'z';
+}
+
+int bonus_at(std::string_view text, size_t i) {
+    if (i == 0 || text[i - 1] == '/') {
+        return kBonusSegmentStart;
+    }
+    char prev = text[i - 1];
+    if (prev == '_' || prev == '-' || prev == '.' || prev == ' ') {
+        return kBonusBoundary;
+    }
+    if (is_lower(prev) && is_upper(text[i])) {
+        return kBonusCamel;
+    }
+    return 0;
+}
+
+// End of the leftmost match of pattern as a subsequence of lowered, 0 if none
+inline size_t match_end(std::string_view pattern, std::string_view lowered) {
+    const char* p = lowered.data();
+    const char* end = p + lowered.size();
+    for (char c : pattern) {
+        p = static_cast<const char*>(std::memchr(p, c, end - p));
+        if (p == nullptr) {
+            return 0;
+        }
+        p++;
+    }
+    return p - lowered.data();
+}
+
+// Scores the shortest window ending at the leftmost complete match, found backwards
+// from there. pattern and lowered are lowercase, text has the original case for
+// camelCase bonuses; positions get base added.
+int score_window(std::string_view pattern, std::string_view text, std::string_view lowered, size_t base, std::vector<size_t>* positions) {
+    size_t end = match_end(pattern, lowered);
+    if (end == 0) {
+        return -1;
+    }
+
+    size_t start = end;
+    for (size_t p = pattern.size(); p > 0; ) {
+        start--;
+        if (lowered[start] == pattern[p - 1]) {
+            p--;
+        }
+    }
+
+    int score = 0;
+    int run_bonus = 0;
+    bool in_gap = false;
+    bool prev_matched = false;
+    size_t p = 0;
+    for (size_t i = start; i < end; i++) {
+        if (p < pattern.size() && lowered[i] == pattern[p]) {
+            int bonus = bonus_at(text, i);
+            // A run keeps the bonus of the boundary it started on
+            if (prev_matched) {
+                bonus = std::max({bonus, run_bonus, kBonusConsecutive});
+            } else {
+                run_bonus = bonus;
+            }
+            score += kMatch + (p == 0 ? bonus * 2 : bonus);
+            if (positions) {
+                positions->push_back(base + i);
+            }
+            p++;
+            prev_matched = true;
+            in_gap = false;
+        } else {
+            score += in_gap ? kGapExtension : kGapStart;
+            in_gap = true;
+            prev_matched = false;
+        }
+    }
+    return score;
+}
+
+int score_lowered(std::string_view pattern, std::string_view path, std::string_view lowered, std::vector<size_t>* positions) {
+    // Most candidates fail here, in a few memchr calls
+    if (match_end(pattern, lowered) == 0) {
+        return -1;
+    }
+    size_t name_start = path.rfind('/') + 1;
+    int name_score = score_window(pattern, path.substr(name_start), lowered.substr(name_start), name_start, positions);
+    if (name_score >= 0) {
+        return name_score + kBonusFileName;
+    }
+    return score_window(pattern, path, lowered, 0, positions);
+}
+
+bool better(const PathMatch& a, const PathMatch& b) {
+    if (a.score != b.score) {
+        return a.score > b.score;
+    }
+    if (a.path.size() != b.path.size()) {
+        return a.path.size() < b.path.size();
+    }
+    return a.path < b.path;
+}
+
+} // namespace
+
+struct PathIndex::Query {
+    std::string pattern;
+    uint64_t mask = 0;
+    size_t max_results = 0;
+    std::shared_ptr<const PathIndex::Paths> paths;
+    std::atomic<bool> cancelled{false};
+    std::atomic<size_t> pending{0};
+    // Guarded by the index mutex
+    std::vector<PathMatch> best;
+    bool done = false;
+};
+
+void PathIndex::Paths::add(std::string_view path) {
+    arena.append(path);
+    for (char c : path) {
+        lowered += lower(c);
+    }
+    offsets.push_back(static_cast<uint32_t>(arena.size()));
+    masks.push_back(char_mask(path));
+}
+
+PathIndex::PathIndex() : worker_(&PathIndex::run, this) {}
+
+PathIndex::~PathIndex() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+        if (current_) {
+            current_->cancelled = true;
+        }
+    }
+    cv_.notify_all();
+    worker_.join();
+}
+
+void PathIndex::open(const std::filesystem::path& root, std::shared_ptr<const IgnoreRules> rules) {
+    root_ = root;
+    rules_ = std::move(rules);
+    refresh();
+}
+
+void PathIndex::refresh() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        bool recent = paths_ && std::chrono::steady_clock::now() - lastWalk_ < kMinRefreshInterval;
+        if (walking_ || recent) {
+            return;
+        }
+        walking_ = true;
+        jobs_.emplace_back();
+    }
+    cv_.notify_all();
+}
+
+void PathIndex::apply_changes(const std::vector<FsChange>& changes) {
+    if (changes.empty()) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        jobs_.push_back(changes);
+    }
+    cv_.notify_all();
+}
+
+size_t PathIndex::size() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return paths_ ? paths_->size() : 0;
+}
+
+void PathIndex::query(const std::string& pattern, size_t max_results) {
+    auto query = std::make_shared<Query>();
+    for (char c : pattern) {
+        if (c != ' ') {
+            query->pattern += lower(c);
+        }
+    }
+    query->mask = char_mask(query->pattern);
+    query->max_results = max_results;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (current_) {
+            current_->cancelled = true;
+        }
+        query->paths = paths_;
+        current_ = query;
+        lastPattern_ = pattern;
+        lastMax_ = max_results;
+
+        size_t count = query->paths ? query->paths->size() : 0;
+        if (count == 0 || query->pattern.empty()) {
+            for (size_t i = 0; i < std::min(count, max_results); i++) {
+                query->best.push_back({std::string(query->paths->at(i)), 0});
+            }
+            query->done = true;
+        }
+    }
+    if (query->done) {
+        notify();
+        return;
+    }
+
+    size_t count = query->paths->size();
+    size_t slice = std::max(kMinSlice, count / (pool_.size() * 4) + 1);
+    query->pending = (count + slice - 1) / slice;
+    for (size_t begin = 0; begin < count; begin += slice) {
+        size_t end = std::min(begin + slice, count);
+        pool_.submit([this, query, begin, end]() {
+            score_slice(query, begin, end);
+        });
+    }
+}
+
+std::vector<PathMatch> PathIndex::results(bool& done) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!current_) {
+        done = true;
+        return {};
+    }
+    done = current_->done;
+    return current_->best;
+}
+
+void PathIndex::set_notify(std::function<void()> notify) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    notify_ = std::move(notify);
+}
+
+int PathIndex::score(std::string_view pattern, std::string_view path, std::vector<size_t>* positions) {
+    std::string lowered;
+    for (char c : pattern) {
+        if (c != ' ') {
+            lowered += lower(c);
+        }
+    }
+    if (lowered.empty()) {
+        return 0;
+    }
+    std::string lowered_path(path);
+    std::transform(lowered_path.begin(), lowered_path.end(), lowered_path.begin(), lower);
+    return score_lowered(lowered, path, lowered_path, positions);
+}
+
+// Letters and digits get a bit each, everything else shares the rest by hash
+uint64_t PathIndex::char_mask(std::string_view text) {
+    uint64_t mask = 0;
+    for (char c : text) {
+        c = lower(c);
+        unsigned bit;
+        if (c >= 'a' && c <= 'z') {
+            bit = c - 'a';
+        } else if (c >= '0' && c <= '9') {
+            bit = 26 + (c - '0');
+        } else {
+            bit = 36 + static_cast<unsigned char>(c) % 28;
+        }
+        mask |= uint64_t(1) << bit;
+    }
+    return mask;
+}
+
+void PathIndex::score_slice(const std::shared_ptr<Query>& query, size_t begin, size_t end) {
+    std::vector<PathMatch> found;
+    if (!query->cancelled) {
+        const Paths& paths = *query->paths;
+        const uint64_t* masks = paths.masks.data();
+        const uint64_t mask = query->mask;
+
+        // Branch-free so the compiler can vectorize it; most paths stop here
+        std::vector<uint32_t> candidates(end - begin);
+        size_t count = 0;
+        for (size_t i = begin; i < end; i++) {
+            candidates[count] = static_cast<uint32_t>(i);
+            count += (masks[i] & mask) == mask;
+        }
+
+        // Min-heap of the best max_results, worst on top; ties prefer shorter paths
+        auto worse = [&paths](const std::pair<int, uint32_t>& a, const std::pair<int, uint32_t>& b) {
+            if (a.first != b.first) {
+                return a.first > b.first;
+            }
+            return paths.at(a.second).size() < paths.at(b.second).size();
+        };
+        std::vector<std::pair<int, uint32_t>> top;
+        top.reserve(query->max_results + 1);
+        for (size_t k = 0; k < count && !query->cancelled; k++) {
+            uint32_t i = candidates[k];
+            int score = score_lowered(query->pattern, paths.at(i), paths.lowered_at(i), nullptr);
+            if (score < 0 || (top.size() == query->max_results && score < top.front().first)) {
+                continue;
+            }
+            top.emplace_back(score, i);
+            std::push_heap(top.begin(), top.end(), worse);
+            if (top.size() > query->max_results) {
+                std::pop_heap(top.begin(), top.end(), worse);
+                top.pop_back();
+            }
+        }
+        for (const auto& [score, i] : top) {
+            found.push_back({std::string(paths.at(i)), score});
+        }
+        std::sort(found.begin(), found.end(), better);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (current_ != query) {
+            return;
+        }
+        if (!found.empty()) {
+            std::vector<PathMatch> merged;
+            merged.reserve(query->best.size() + found.size());
+            std::merge(std::make_move_iterator(query->best.begin()), std::make_move_iterator(query->best.end()),
+                       std::make_move_iterator(found.begin()), std::make_move_iterator(found.end()),
+                       std::back_inserter(merged), better);
+            merged.resize(std::min(merged.size(), query->max_results));
+            query->best.swap(merged);
+        }
+        query->done = --query->pending == 0;
+        if (found.empty() && !query->done) {
+            return;
+        }
+    }
+    notify();
+}
+
+void PathIndex::notify() {
+    std::function<void()> notify;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        notify = notify_;
+    }
+    if (notify) {
+        notify();
+    }
+}
+
+void PathIndex::run() {
+    Tracer::set_thread_name("PathIndex");
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        cv_.wait(lock, [this] { return stop_ || !jobs_.empty(); });
+        if (stop_) {
+            return;
+        }
+
+        std::vector<FsChange> changes = std::move(jobs_.front());
+        jobs_.pop_front();
+        std::shared_ptr<const Paths> old = paths_;
+
+        lock.unlock();
+        std::shared_ptr<Paths> built = changes.empty() || !old ? walk() : update(*old, changes);
+        lock.lock();
+
+        paths_ = built;
+        if (changes.empty()) {
+            walking_ = false;
+            lastWalk_ = std::chrono::steady_clock::now();
+        }
+        bool rerun = current_ != nullptr;
+        std::string pattern = lastPattern_;
+        size_t max_results = lastMax_;
+
+        lock.unlock();
+        // Whatever was shown came from the old paths
+        if (rerun) {
+            query(pattern, max_results);
+        } else {
+            notify();
+        }
+        lock.lock();
+    }
+}
+
+std::shared_ptr<PathIndex::Paths> PathIndex::walk() {
+    TRACE_SCOPE("Walk paths", root_.string());
+    auto paths = std::make_shared<Paths>();
+    size_t prefix = root_.native().size() + 1;
+    DirScanner::walk_files(root_, [this, &paths, prefix](const std::filesystem::path& path, const struct stat&) {
+        paths->add(std::string_view(path.native()).substr(prefix));
+        return !stop_;
+    }, rules_.get());
+    return paths;
+}
+
+// Rebuilds old without removed and re-added paths, then appends what was added
+std::shared_ptr<PathIndex::Paths> PathIndex::update(const Paths& old, const std::vector<FsChange>& changes) {
+    TRACE_SCOPE("Update paths");
+    const std::string& root = root_.native();
+    auto relative = [&root](const std::filesystem::path& path, std::string& out) {
+        const std::string& full = path.native();
+        if (full.size() <= root.size() + 1 || full.compare(0, root.size(), root) != 0 || full[root.size()] != '/') {
+            return false;
+        }
+        out = full.substr(root.size() + 1);
+        return true;
+    };
+
+    std::unordered_set<std::string> removed;
+    std::vector<std::string> added;
+    std::string rel;
+    for (const auto& change : changes) {
+        if (change.kind == FsChange::Renamed && relative(change.old_path, rel)) {
+            removed.insert(rel);
+        }
+        if (!relative(change.path, rel)) {
+            continue;
+        }
+        // Added paths are dropped first too, so a repeated add never duplicates them
+        removed.insert(rel);
+        if (change.kind == FsChange::Removed) {
+            continue;
+        }
+
+        struct stat st {};
+        if (lstat(change.path.c_str(), &st) != 0) {
+            continue;
+        }
+        if (S_ISDIR(st.st_mode)) {
+            size_t prefix = root.size() + 1;
+            if (rules_ && rules_->is_ignored_path(rel, true)) {
+                continue;
+            }
+            DirScanner::walk_files(change.path, [&added, prefix](const std::filesystem::path& path, const struct stat&) {
+                added.push_back(path.native().substr(prefix));
+                return true;
+            }, rules_.get());
+        } else if (S_ISREG(st.st_mode) && !(rules_ && rules_->is_ignored_path(rel, false))) {
+            added.push_back(rel);
+        }
+    }
+
+    // A path goes if it or any folder above it was removed
+    auto is_removed = [&removed](std::string_view path) {
+        for (size_t end = path.size(); end != std::string_view::npos && end > 0; end = path.rfind('/', end - 1)) {
+            if (removed.count(std::string(path.substr(0, end)))) {
+                return true;
+            }
+        }
+        return false;
+    };
+
+    auto paths = std::make_shared<Paths>();
+    paths->arena.reserve(old.arena.size());
+    paths->lowered.reserve(old.arena.size());
+    paths->masks.reserve(old.size() + added.size());
+    paths->offsets.reserve(old.size() + added.size() + 1);
+    for (size_t i = 0; i < old.size(); i++) {
+        if (!is_removed(old.at(i))) {
+            paths->add(old.at(i));
+        }
+    }
+    for (const auto& path : added) {
+        paths->add(path);
+    }
+    return paths;
+}
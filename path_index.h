@@ -0,0 +1,114 @@
+#ifndef PATH_INDEX_H
+#define PATH_INDEX_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "file_watcher.h"
+#include "work_pool.h"
+
+struct PathMatch {
+    // Relative to the root
+    std::string path;
+    int score = 0;
+};
+
+// Every file path under the workspace root, for fuzzy quick-open. Paths are packed into
+// one string with a 64-bit mask of the characters each contains, so a query first
+// drops every path missing one of its characters with a single AND before any scoring.
+//
+// Queries are split over a work pool; each slice merges its best paths into the
+// query's ranking as it finishes, so results arrive best first while the rest is
+// still being scored. The set of paths is immutable once built: walks and watcher
+// changes build a new one on the worker and swap it in.
+class PathIndex {
+public:
+    PathIndex();
+    ~PathIndex();
+
+    PathIndex(const PathIndex&) = delete;
+    PathIndex& operator=(const PathIndex&) = delete;
+
+    // Walks root in the background, leaving out what rules ignore
+    void open(const std::filesystem::path& root, std::shared_ptr<const IgnoreRules> rules = nullptr);
+    // Walks again to pick up changes the watcher didn't see; ignored while a walk is
+    // pending or if the last one finished moments ago
+    void refresh();
+    void apply_changes(const std::vector<FsChange>& changes);
+    const std::filesystem::path& root() const { return root_; }
+    size_t size();
+
+    // Ranks every path against pattern, cancelling the previous query. An empty
+    // pattern lists paths in walk order.
+    void query(const std::string& pattern, size_t max_results);
+    // Best matches of the current query so far, best first
+    std::vector<PathMatch> results(bool& done);
+    // Called from worker threads when results change or the paths were rebuilt
+    void set_notify(std::function<void()> notify);
+
+    // Higher is better, -1 if pattern isn't a subsequence of path (ignoring ASCII
+    // case). Matches at the start of words and in the file name score higher.
+    // positions receives the byte offsets of the matched characters.
+    static int score(std::string_view pattern, std::string_view path, std::vector<size_t>* positions = nullptr);
+
+private:
+    struct Paths {
+        std::string arena;
+        // Same with ASCII lowercased, for matching
+        std::string lowered;
+        // Path i is arena[offsets[i], offsets[i + 1])
+        std::vector<uint32_t> offsets{0};
+        std::vector<uint64_t> masks;
+
+        size_t size() const { return masks.size(); }
+        std::string_view at(size_t i) const {
+            return std::string_view(arena).substr(offsets[i], offsets[i + 1] - offsets[i]);
+        }
+        std::string_view lowered_at(size_t i) const {
+            return std::string_view(lowered).substr(offsets[i], offsets[i + 1] - offsets[i]);
+        }
+        void add(std::string_view path);
+    };
+
+    struct Query;
+
+    std::filesystem::path root_;
+    std::shared_ptr<const IgnoreRules> rules_;
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    // Work for the worker; an empty batch means walk everything
+    std::deque<std::vector<FsChange>> jobs_;
+    bool walking_ = false;
+    std::chrono::steady_clock::time_point lastWalk_;
+    std::atomic<bool> stop_{false};
+    std::shared_ptr<const Paths> paths_;
+    std::shared_ptr<Query> current_;
+    std::string lastPattern_;
+    size_t lastMax_ = 0;
+    std::function<void()> notify_;
+    std::thread worker_;
+
+    // Declared last so its workers are joined before anything they use goes away
+    WorkPool pool_;
+
+    void run();
+    std::shared_ptr<Paths> walk();
+    std::shared_ptr<Paths> update(const Paths& old, const std::vector<FsChange>& changes);
+    void score_slice(const std::shared_ptr<Query>& query, size_t begin, size_t end);
+    void notify();
+    static uint64_t char_mask(std::string_view text);
+};
+
+#endif // PATH_INDEX_H
@@ -0,0 +1,377 @@
+#include "piece_table.h"
+
+#include <algorithm>
+#include <cstring>
+#include <utility>
+
+namespace {
+
+// Pieces never grow past this, which bounds the in-piece scans of the lookups
+const size_t kBlockSize = 64 * 1024;
+
+size_t count_newlines(const char* data, size_t len) {
+    return std::count(data, data + len, '\n');
+}
+
+size_t count_chars(const char* data, size_t len) {
+    size_t chars = 0;
+    for (size_t i = 0; i < len; i++) {
+        chars += (static_cast<unsigned char>(data[i]) & 0xc0) != 0x80;
+    }
+    return chars;
+}
+
+} // namespace
+
+struct PieceTable::Block {
+    std::unique_ptr<char[]> data;
+    size_t capacity;
+
+    explicit Block(size_t size) : data(new char[size]), capacity(size) {}
+};
+
+struct PieceTable::Node {
+    std::shared_ptr<const Block> block;
+    size_t start;
+    size_t len;
+    size_t chars;
+    size_t newlines;
+    uint32_t priority;
+    std::shared_ptr<const Node> left;
+    std::shared_ptr<const Node> right;
+    size_t total_len;
+    size_t total_chars;
+    size_t total_newlines;
+
+    const char* data() const { return block->data.get() + start; }
+};
+
+namespace {
+
+using NodePtr = std::shared_ptr<const PieceTable::Node>;
+
+size_t total_len(const NodePtr& node) {
+    return node ? node->total_len : 0;
+}
+
+size_t total_chars(const NodePtr& node) {
+    return node ? node->total_chars : 0;
+}
+
+size_t total_newlines(const NodePtr& node) {
+    return node ? node->total_newlines : 0;
+}
+
+NodePtr make_node(const PieceTable::Node& piece, NodePtr left, NodePtr right) {
+    auto node = std::make_shared<PieceTable::Node>(piece);
+    node->left = std::move(left);
+    node->right = std::move(right);
+    node->total_len = total_len(node->left) + node->len + total_len(node->right);
+    node->total_chars = total_chars(node->left) + node->chars + total_chars(node->right);
+    node->total_newlines = total_newlines(node->left) + node->newlines + total_newlines(node->right);
+    return node;
+}
+
+// Copy of piece covering [from, from + len) of its text
+PieceTable::Node sub_piece(const PieceTable::Node& piece, size_t from, size_t len) {
+    PieceTable::Node sub = piece;
+    sub.start = piece.start + from;
+    sub.len = len;
+    sub.chars = count_chars(sub.data(), len);
+    sub.newlines = count_newlines(sub.data(), len);
+    return sub;
+}
+
+NodePtr merge(const NodePtr& a, const NodePtr& b) {
+    if (!a) {
+        return b;
+    }
+    if (!b) {
+        return a;
+    }
+    if (a->priority > b->priority) {
+        return make_node(*a, a->left, merge(a->right, b));
+    }
+    return make_node(*b, merge(a, b->left), b->right);
+}
+
+struct SplitResult {
+    NodePtr left;
+    NodePtr cut;
+    NodePtr right;
+};
+
+// Splits into the first pos bytes and the rest. A piece straddling pos is cut in two:
+// the head stays in place, the tail is returned on its own in cut.
+SplitResult split_at(const NodePtr& node, size_t pos, uint32_t tail_priority) {
+    if (!node) {
+        return {};
+    }
+
+    size_t left_len = total_len(node->left);
+    if (pos <= left_len) {
+        SplitResult r = split_at(node->left, pos, tail_priority);
+        r.right = make_node(*node, r.right, node->right);
+        return r;
+    }
+    if (pos >= left_len + node->len) {
+        SplitResult r = split_at(node->right, pos - left_len - node->len, tail_priority);
+        r.left = make_node(*node, node->left, r.left);
+        return r;
+    }
+
+    size_t cut = pos - left_len;
+    PieceTable::Node head = sub_piece(*node, 0, cut);
+    PieceTable::Node tail = sub_piece(*node, cut, node->len - cut);
+    tail.priority = tail_priority;
+    return {make_node(head, node->left, nullptr), make_node(tail, nullptr, nullptr), node->right};
+}
+
+// Grows the last piece by bytes that were appended right behind it in its block
+NodePtr extend_rightmost(const NodePtr& node, const char* data, size_t len) {
+    if (node->right) {
+        return make_node(*node, node->left, extend_rightmost(node->right, data, len));
+    }
+    PieceTable::Node grown = *node;
+    grown.len += len;
+    grown.chars += count_chars(data, len);
+    grown.newlines += count_newlines(data, len);
+    return make_node(grown, node->left, nullptr);
+}
+
+const PieceTable::Node* rightmost(const NodePtr& node) {
+    const PieceTable::Node* n = node.get();
+    while (n && n->right) {
+        n = n->right.get();
+    }
+    return n;
+}
+
+void for_each(const NodePtr& node, size_t from, size_t to, const std::function<void(const char*, size_t)>& fn) {
+    if (!node || from >= to) {
+        return;
+    }
+
+    size_t left_len = total_len(node->left);
+    if (from < left_len) {
+        for_each(node->left, from, std::min(to, left_len), fn);
+    }
+
+    size_t piece_from = std::max(from, left_len);
+    size_t piece_to = std::min(to, left_len + node->len);
+    if (piece_from < piece_to) {
+        fn(node->data() + (piece_from - left_len), piece_to - piece_from);
+    }
+
+    size_t right_start = left_len + node->len;
+    if (to > right_start) {
+        for_each(node->right, from > right_start ? from - right_start : 0, to - right_start, fn);
+    }
+}
+
+} // namespace
+
+size_t PieceTable::Snapshot::size() const {
+    return total_len(root_);
+}
+
+size_t PieceTable::Snapshot::line_count() const {
+    return total_newlines(root_) + 1;
+}
+
+void PieceTable::Snapshot::for_each_chunk(const std::function<void(const char*, size_t)>& fn) const {
+    for_each(root_, 0, size(), fn);
+}
+
+std::string PieceTable::Snapshot::substr(size_t offset, size_t len) const {
+    std::string text;
+    size_t end = std::min(size(), offset + len);
+    if (offset < end) {
+        text.reserve(end - offset);
+        for_each(root_, offset, end, [&text](const char* data, size_t n) {
+            text.append(data, n);
+        });
+    }
+    return text;
+}
+
+PieceTable::PieceTable() : seed_(0x9e3779b9u ^ static_cast<uint32_t>(reinterpret_cast<uintptr_t>(this))) {}
+
+uint32_t PieceTable::next_priority() {
+    // xorshift32
+    seed_ ^= seed_ << 13;
+    seed_ ^= seed_ >> 17;
+    seed_ ^= seed_ << 5;
+    return seed_;
+}
+
+std::pair<std::shared_ptr<const PieceTable::Node>, std::shared_ptr<const PieceTable::Node>>
+PieceTable::split(const std::shared_ptr<const Node>& node, size_t pos) {
+    // The cut-off tail gets a fresh priority, so merge it back in rather than hang it
+    // under nodes it might outrank
+    SplitResult r = split_at(node, pos, next_priority());
+    return {r.left, merge(r.cut, r.right)};
+}
+
+// Copies data into the append buffers and returns it as a subtree of pieces
+std::shared_ptr<const PieceTable::Node> PieceTable::make_pieces(const char* data, size_t len) {
+    NodePtr pieces;
+    while (len > 0) {
+        if (!block_ || block_used_ == block_->capacity) {
+            block_ = std::make_shared<Block>(kBlockSize);
+            block_used_ = 0;
+        }
+
+        size_t n = std::min(len, block_->capacity - block_used_);
+        std::memcpy(block_->data.get() + block_used_, data, n);
+
+        Node piece{};
+        piece.block = block_;
+        piece.start = block_used_;
+        piece.len = n;
+        piece.chars = count_chars(data, n);
+        piece.newlines = count_newlines(data, n);
+        piece.priority = next_priority();
+        pieces = merge(pieces, make_node(piece, nullptr, nullptr));
+
+        block_used_ += n;
+        data += n;
+        len -= n;
+    }
+    return pieces;
+}
+
+void PieceTable::insert(size_t offset, const char* data, size_t len) {
+    if (len == 0) {
+        return;
+    }
+    offset = std::min(offset, size());
+    auto [left, right] = split(root_, offset);
+
+    // Typing appends to the piece it just created instead of adding a new one per key
+    const Node* last = rightmost(left);
+    if (last && block_ && last->block == block_ && last->start + last->len == block_used_ &&
+        last->len + len <= kBlockSize && block_used_ + len <= block_->capacity) {
+        std::memcpy(block_->data.get() + block_used_, data, len);
+        block_used_ += len;
+        root_ = merge(extend_rightmost(left, data, len), right);
+        return;
+    }
+
+    root_ = merge(merge(left, make_pieces(data, len)), right);
+}
+
+void PieceTable::erase(size_t offset, size_t len) {
+    if (len == 0 || offset >= size()) {
+        return;
+    }
+    auto [left, rest] = split(root_, offset);
+    auto [removed, right] = split(rest, len);
+    root_ = merge(left, right);
+}
+
+void PieceTable::clear() {
+    root_.reset();
+    block_.reset();
+    block_used_ = 0;
+}
+
+size_t PieceTable::size() const {
+    return total_len(root_);
+}
+
+size_t PieceTable::char_count() const {
+    return total_chars(root_);
+}
+
+size_t PieceTable::line_count() const {
+    return total_newlines(root_) + 1;
+}
+
+size_t PieceTable::byte_offset(size_t char_offset) const {
+    size_t offset = 0;
+    const Node* node = root_.get();
+    while (node) {
+        size_t left_chars = total_chars(node->left);
+        if (char_offset < left_chars) {
+            node = node->left.get();
+            continue;
+        }
+        offset += total_len(node->left);
+        char_offset -= left_chars;
+        if (char_offset < node->chars) {
+            const char* data = node->data();
+            size_t i = 0;
+            for (size_t chars = 0; i < node->len; i++) {
+                if ((static_cast<unsigned char>(data[i]) & 0xc0) != 0x80 && chars++ == char_offset) {
+                    break;
+                }
+            }
+            return offset + i;
+        }
+        offset += node->len;
+        char_offset -= node->chars;
+        node = node->right.get();
+    }
+    return offset;
+}
+
+size_t PieceTable::line_start(size_t line) const {
+    if (line == 0) {
+        return 0;
+    }
+    if (line > total_newlines(root_)) {
+        return size();
+    }
+
+    // Find the newline that ends line - 1
+    size_t offset = 0;
+    size_t remaining = line;
+    const Node* node = root_.get();
+    while (node) {
+        size_t left_newlines = total_newlines(node->left);
+        if (remaining <= left_newlines) {
+            node = node->left.get();
+            continue;
+        }
+        offset += total_len(node->left);
+        remaining -= left_newlines;
+        if (remaining <= node->newlines) {
+            const char* data = node->data();
+            const char* p = data;
+            for (size_t i = 0; i < remaining; i++) {
+                p = static_cast<const char*>(std::memchr(p, '\n', node->len - (p - data))) + 1;
+            }
+            return offset + (p - data);
+        }
+        offset += node->len;
+        remaining -= node->newlines;
+        node = node->right.get();
+    }
+    return size();
+}
+
+size_t PieceTable::line_at(size_t offset) const {
+    size_t line = 0;
+    const Node* node = root_.get();
+    while (node) {
+        size_t left_len = total_len(node->left);
+        if (offset < left_len) {
+            node = node->left.get();
+            continue;
+        }
+        line += total_newlines(node->left);
+        offset -= left_len;
+        if (offset < node->len) {
+            return line + count_newlines(node->data(), offset);
+        }
+        line += node->newlines;
+        offset -= node->len;
+        node = node->right.get();
+    }
+    return line;
+}
+
+std::string PieceTable::substr(size_t offset, size_t len) const {
+    return snapshot().substr(offset, len);
+}
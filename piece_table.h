@@ -0,0 +1,77 @@
+#ifndef PIECE_TABLE_H
+#define PIECE_TABLE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <utility>
+
+// Text document stored as a balanced tree of pieces pointing into append-only
+// buffers. Edits, offset lookups and line lookups are O(log n); nothing ever copies
+// the whole text. Tree nodes are immutable and shared, so a snapshot is just a
+// pointer to the current root and stays valid (and safe to read from another
+// thread) no matter how the document is edited afterwards.
+//
+// Offsets are in bytes unless a method says otherwise; byte_offset() converts from
+// character offsets (Gtk::TextIter::get_offset()).
+class PieceTable {
+public:
+    struct Node;
+
+    class Snapshot {
+    public:
+        Snapshot() = default;
+
+        size_t size() const;
+        bool empty() const { return size() == 0; }
+        size_t line_count() const;
+        // Calls fn for every contiguous run of text, in order
+        void for_each_chunk(const std::function<void(const char*, size_t)>& fn) const;
+        std::string substr(size_t offset, size_t len) const;
+        std::string text() const { return substr(0, size()); }
+
+    private:
+        friend class PieceTable;
+        explicit Snapshot(std::shared_ptr<const Node> root) : root_(std::move(root)) {}
+
+        std::shared_ptr<const Node> root_;
+    };
+
+    PieceTable();
+
+    void insert(size_t offset, const char* data, size_t len);
+    void insert(size_t offset, const std::string& text) { insert(offset, text.data(), text.size()); }
+    void erase(size_t offset, size_t len);
+    void clear();
+
+    size_t size() const;
+    bool empty() const { return size() == 0; }
+    size_t char_count() const;
+    size_t line_count() const;
+
+    size_t byte_offset(size_t char_offset) const;
+    // Byte offset of the first character of a (0-based) line
+    size_t line_start(size_t line) const;
+    // Line containing a byte offset
+    size_t line_at(size_t offset) const;
+
+    std::string substr(size_t offset, size_t len) const;
+    Snapshot snapshot() const { return Snapshot(root_); }
+
+private:
+    struct Block;
+
+    std::shared_ptr<const Node> root_;
+    std::shared_ptr<Block> block_;
+    size_t block_used_ = 0;
+    uint32_t seed_;
+
+    uint32_t next_priority();
+    std::pair<std::shared_ptr<const Node>, std::shared_ptr<const Node>> split(const std::shared_ptr<const Node>& node,
+                                                                               size_t pos);
+    std::shared_ptr<const Node> make_pieces(const char* data, size_t len);
+};
+
+#endif // PIECE_TABLE_H
@@ -0,0 +1,180 @@
+#include "quick_open.h"
+
+#include <algorithm>
+#include <glibmm/convert.h>
+#include <glibmm/markup.h>
+
+namespace {
+
+const size_t kMaxResults = 50;
+
+} // namespace
+
+QuickOpen::QuickOpen() : box_(Gtk::ORIENTATION_VERTICAL) {
+    set_title("Open file");
+    set_decorated(false);
+    set_skip_taskbar_hint(true);
+    set_type_hint(Gdk::WINDOW_TYPE_HINT_DIALOG);
+    set_position(Gtk::WIN_POS_CENTER_ON_PARENT);
+    set_default_size(600, 400);
+    set_border_width(5);
+
+    entry_.set_placeholder_text("Go to file");
+    statusLabel_.set_halign(Gtk::ALIGN_END);
+    box_.set_spacing(5);
+    box_.pack_start(entry_, Gtk::PACK_SHRINK);
+    box_.pack_start(statusLabel_, Gtk::PACK_SHRINK);
+
+    listModel_ = Gtk::ListStore::create(columns_);
+    treeView_.set_model(listModel_);
+    treeView_.set_headers_visible(false);
+    treeView_.set_can_focus(false);
+    Gtk::CellRendererText* renderer = Gtk::manage(new Gtk::CellRendererText());
+    Gtk::TreeViewColumn* column = Gtk::manage(new Gtk::TreeViewColumn("Path", *renderer));
+    column->add_attribute(renderer->property_markup(), columns_.column_markup);
+    treeView_.append_column(*column);
+
+    scrolledWindow_.set_policy(Gtk::POLICY_NEVER, Gtk::POLICY_AUTOMATIC);
+    scrolledWindow_.add(treeView_);
+    box_.pack_start(scrolledWindow_, Gtk::PACK_EXPAND_WIDGET);
+    add(box_);
+
+    // changed rather than search-changed, which waits for a pause in typing
+    entry_.signal_changed().connect(sigc::mem_fun(*this, &QuickOpen::on_entry_changed));
+    entry_.signal_key_press_event().connect(sigc::mem_fun(*this, &QuickOpen::on_entry_key_press), false);
+    treeView_.signal_row_activated().connect(sigc::mem_fun(*this, &QuickOpen::on_row_activated));
+
+    resultsDispatcher_.connect(sigc::mem_fun(*this, &QuickOpen::on_results_ready));
+    index_.set_notify([this]() { resultsDispatcher_.emit(); });
+
+    show_all_children();
+}
+
+void QuickOpen::open_index(const std::filesystem::path& root, std::shared_ptr<const IgnoreRules> rules) {
+    index_.open(root, std::move(rules));
+}
+
+void QuickOpen::apply_changes(const std::vector<FsChange>& changes) {
+    index_.apply_changes(changes);
+}
+
+void QuickOpen::popup(Gtk::Window& parent) {
+    set_transient_for(parent);
+    // Catches changes in folders the explorer never listed, so it isn't watching
+    index_.refresh();
+    if (entry_.get_text().empty()) {
+        on_entry_changed();
+    } else {
+        entry_.set_text("");
+    }
+    show();
+    present();
+    entry_.grab_focus();
+}
+
+sigc::signal<void, const std::string&> QuickOpen::signal_file_chosen() {
+    return file_chosen_signal_;
+}
+
+void QuickOpen::on_entry_changed() {
+    pattern_ = entry_.get_text().raw();
+    index_.query(pattern_, kMaxResults);
+}
+
+void QuickOpen::on_results_ready() {
+    bool done;
+    std::vector<PathMatch> results = index_.results(done);
+
+    listModel_->clear();
+    for (const auto& match : results) {
+        Gtk::TreeModel::Row row = *listModel_->append();
+        row[columns_.column_markup] = match_markup(match.path);
+        row[columns_.column_path] = match.path;
+    }
+    if (!results.empty()) {
+        treeView_.set_cursor(Gtk::TreeModel::Path("0"));
+    }
+
+    size_t total = index_.size();
+    if (total == 0) {
+        statusLabel_.set_text("Indexing...");
+    } else {
+        std::string status = std::to_string(total) + " files";
+        statusLabel_.set_text(done ? status : status + "...");
+    }
+}
+
+bool QuickOpen::on_entry_key_press(GdkEventKey* event) {
+    switch (event->keyval) {
+    case GDK_KEY_Escape:
+        hide();
+        return true;
+    case GDK_KEY_Return:
+    case GDK_KEY_KP_Enter:
+        choose_selected();
+        return true;
+    case GDK_KEY_Down:
+        move_selection(1);
+        return true;
+    case GDK_KEY_Up:
+        move_selection(-1);
+        return true;
+    default:
+        return false;
+    }
+}
+
+void QuickOpen::on_row_activated(const Gtk::TreeModel::Path& path, Gtk::TreeViewColumn* column) {
+    treeView_.set_cursor(path);
+    choose_selected();
+}
+
+bool QuickOpen::on_focus_out_event(GdkEventFocus* event) {
+    hide();
+    return Gtk::Window::on_focus_out_event(event);
+}
+
+void QuickOpen::move_selection(int delta) {
+    int rows = static_cast<int>(listModel_->children().size());
+    if (rows == 0) {
+        return;
+    }
+    Gtk::TreeModel::Path path;
+    Gtk::TreeViewColumn* column;
+    treeView_.get_cursor(path, column);
+    int row = path.empty() ? 0 : path[0] + delta;
+    row = std::max(0, std::min(row, rows - 1));
+    treeView_.set_cursor(Gtk::TreeModel::Path(std::to_string(row)));
+}
+
+void QuickOpen::choose_selected() {
+    Gtk::TreeModel::iterator iter = treeView_.get_selection()->get_selected();
+    if (!iter) {
+        return;
+    }
+    std::string path = (*iter)[columns_.column_path];
+    hide();
+    file_chosen_signal_.emit((index_.root() / path).string());
+}
+
+Glib::ustring QuickOpen::match_markup(const std::string& path) const {
+    if (!Glib::ustring(path).validate()) {
+        return Glib::Markup::escape_text(Glib::convert_with_fallback(path, "UTF-8", "ISO-8859-1"));
+    }
+
+    std::vector<size_t> positions;
+    PathIndex::score(pattern_, path, &positions);
+    std::string markup;
+    size_t done = 0;
+    for (size_t position : positions) {
+        // Only ASCII characters are matched case-insensitively; leave the rest plain
+        if (static_cast<unsigned char>(path[position]) >= 0x80) {
+            continue;
+        }
+        markup += Glib::Markup::escape_text(path.substr(done, position - done));
+        markup += "<b>" + Glib::Markup::escape_text(path.substr(position, 1)) + "</b>";
+        done = position + 1;
+    }
+    markup += Glib::Markup::escape_text(path.substr(done));
+    return markup;
+}
@@ -0,0 +1,68 @@
+#ifndef QUICK_OPEN_H
+#define QUICK_OPEN_H
+
+#include <gtkmm/box.h>
+#include <gtkmm/label.h>
+#include <gtkmm/liststore.h>
+#include <gtkmm/scrolledwindow.h>
+#include <gtkmm/searchentry.h>
+#include <gtkmm/treeview.h>
+#include <gtkmm/window.h>
+#include <glibmm/dispatcher.h>
+
+#include "path_index.h"
+
+// Ctrl+P palette: type a few characters of a path, Enter opens the best match.
+// Ranking runs in the PathIndex on every keystroke and rows update as results stream in.
+class QuickOpen : public Gtk::Window {
+public:
+    QuickOpen();
+
+    // Starts indexing right away so the first Ctrl+P already has paths
+    void open_index(const std::filesystem::path& root, std::shared_ptr<const IgnoreRules> rules);
+    void apply_changes(const std::vector<FsChange>& changes);
+    void popup(Gtk::Window& parent);
+
+    // Absolute path of the chosen file
+    sigc::signal<void, const std::string&> signal_file_chosen();
+
+protected:
+    class ModelColumns : public Gtk::TreeModel::ColumnRecord {
+    public:
+        ModelColumns() {
+            add(column_markup);
+            add(column_path);
+        }
+
+        // Relative path with the matched characters in bold
+        Gtk::TreeModelColumn<Glib::ustring> column_markup;
+        Gtk::TreeModelColumn<std::string> column_path;
+    };
+
+    ModelColumns columns_;
+    Gtk::Box box_;
+    Gtk::SearchEntry entry_;
+    Gtk::Label statusLabel_;
+    Gtk::ScrolledWindow scrolledWindow_;
+    Glib::RefPtr<Gtk::ListStore> listModel_;
+    Gtk::TreeView treeView_;
+    std::string pattern_;
+
+    // Declared before the index so it outlives the index's workers
+    Glib::Dispatcher resultsDispatcher_;
+    PathIndex index_;
+
+    void on_entry_changed();
+    void on_results_ready();
+    bool on_entry_key_press(GdkEventKey* event);
+    void on_row_activated(const Gtk::TreeModel::Path& path, Gtk::TreeViewColumn* column);
+    bool on_focus_out_event(GdkEventFocus* event) override;
+    void move_selection(int delta);
+    void choose_selected();
+    Glib::ustring match_markup(const std::string& path) const;
+
+private:
+    sigc::signal<void, const std::string&> file_chosen_signal_;
+};
+
+#endif // QUICK_OPEN_H
@@ -0,0 +1,127 @@
+#include "reload_checker.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "content_hash.h"
+#include "trace.h"
+
+ReloadChecker::ReloadChecker() : worker_(&ReloadChecker::run, this) {}
+
+ReloadChecker::~ReloadChecker() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    cv_.notify_all();
+    worker_.join();
+}
+
+void ReloadChecker::check(const std::string& file_path, uint64_t known_hash, PieceTable::Snapshot document, uint64_t version) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = std::find_if(jobs_.begin(), jobs_.end(), [&file_path](const Job& job) {
+            return job.file_path == file_path;
+        });
+        if (it != jobs_.end()) {
+            *it = {file_path, known_hash, std::move(document), version};
+        } else {
+            jobs_.push_back({file_path, known_hash, std::move(document), version});
+        }
+    }
+    cv_.notify_one();
+}
+
+std::vector<ReloadResult> ReloadChecker::take_results() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<ReloadResult> results;
+    results.swap(results_);
+    return results;
+}
+
+void ReloadChecker::set_notify(std::function<void()> notify) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    notify_ = std::move(notify);
+}
+
+void ReloadChecker::run() {
+    Tracer::set_thread_name("ReloadChecker");
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        cv_.wait(lock, [this] { return stop_ || !jobs_.empty(); });
+        if (stop_) {
+            return;
+        }
+
+        Job job = std::move(jobs_.front());
+        jobs_.pop_front();
+
+        lock.unlock();
+        ReloadResult result;
+        result.file_path = job.file_path;
+        result.version = job.version;
+        check_file(job, result);
+        job.document = PieceTable::Snapshot();
+        lock.lock();
+
+        results_.push_back(std::move(result));
+        if (notify_) {
+            notify_();
+        }
+    }
+}
+
+void ReloadChecker::check_file(const Job& job, ReloadResult& result) {
+    TRACE_SCOPE("Check file", job.file_path);
+    int fd = open(job.file_path.c_str(), O_RDONLY | O_CLOEXEC);
+    struct stat st {};
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        result.error = std::strerror(errno);
+        if (fd >= 0) {
+            close(fd);
+        }
+        return;
+    }
+
+    std::string bytes(static_cast<size_t>(st.st_size), '\0');
+    size_t used = 0;
+    while (true) {
+        if (used == bytes.size()) {
+            // Still growing
+            bytes.resize(bytes.size() + 64 * 1024);
+        }
+        ssize_t n = read(fd, &bytes[used], bytes.size() - used);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            result.error = std::strerror(errno);
+            close(fd);
+            return;
+        }
+        if (n == 0) {
+            break;
+        }
+        used += n;
+    }
+    close(fd);
+    bytes.resize(used);
+
+    result.ok = true;
+    result.hash = ContentHash::hash(bytes.data(), bytes.size());
+    result.changed = result.hash != job.known_hash;
+    if (!result.changed) {
+        return;
+    }
+
+    result.encoding = detect_encoding(bytes.data(), bytes.size());
+    TextDecoder decoder(result.encoding);
+    std::string carry;
+    decoder.decode(bytes, carry, true);
+    result.lossy = decoder.lossy();
+    result.edits = line_diff(job.document.text(), bytes);
+}
@@ -0,0 +1,66 @@
+#ifndef RELOAD_CHECKER_H
+#define RELOAD_CHECKER_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "line_diff.h"
+#include "piece_table.h"
+#include "text_encoding.h"
+
+struct ReloadResult {
+    std::string file_path;
+    // Of the document the edits apply to
+    uint64_t version = 0;
+    bool ok = false;
+    std::string error;
+    // The file's bytes hash to something else than they did last time
+    bool changed = false;
+    uint64_t hash = 0;
+    TextEncoding encoding;
+    bool lossy = false;
+    // Turn the document into the file's new contents; empty if it already matches
+    std::vector<TextEdit> edits;
+};
+
+// Re-reads files that were written behind the editor's back, on a worker thread. A file
+// whose bytes hash the same as when it was loaded or saved is left alone, so touching
+// it or saving the same text again costs a read and nothing more. Otherwise the new
+// text is diffed by line against the document it was open with.
+class ReloadChecker {
+public:
+    ReloadChecker();
+    ~ReloadChecker();
+
+    // A check queued while an older one for the same file is still waiting replaces it
+    void check(const std::string& file_path, uint64_t known_hash, PieceTable::Snapshot document, uint64_t version);
+    std::vector<ReloadResult> take_results();
+    void set_notify(std::function<void()> notify);
+
+private:
+    struct Job {
+        std::string file_path;
+        uint64_t known_hash;
+        PieceTable::Snapshot document;
+        uint64_t version;
+    };
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::deque<Job> jobs_;
+    std::vector<ReloadResult> results_;
+    std::function<void()> notify_;
+    bool stop_ = false;
+    std::thread worker_;
+
+    void run();
+    static void check_file(const Job& job, ReloadResult& result);
+};
+
+#endif // RELOAD_CHECKER_H
@@ -0,0 +1,230 @@
+#include "save_queue.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <fstream>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "content_hash.h"
+#include "trace.h"
+
+namespace {
+
+const size_t kWriteChunkSize = 1024 * 1024;
+
+bool write_all(int fd, const char* data, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, data, std::min(len, kWriteChunkSize));
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += n;
+        len -= n;
+    }
+    return true;
+}
+
+// The process umask, read without setting it where the kernel allows: umask() can only
+// be queried by changing it, which would race with files other threads create
+mode_t current_umask() {
+    static const mode_t mask = [] {
+        std::ifstream status("/proc/self/status");
+        std::string line;
+        while (std::getline(status, line)) {
+            if (line.compare(0, 6, "Umask:") == 0) {
+                return static_cast<mode_t>(std::stoul(line.substr(6), nullptr, 8));
+            }
+        }
+        mode_t old = umask(022);
+        umask(old);
+        return old;
+    }();
+    return mask;
+}
+
+} // namespace
+
+SaveQueue::SaveQueue() : worker_(&SaveQueue::run, this) {}
+
+SaveQueue::~SaveQueue() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    cv_.notify_all();
+    worker_.join();
+}
+
+void SaveQueue::save(const std::string& file_path, PieceTable::Snapshot contents, uint64_t version, TextEncoding encoding) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = std::find_if(jobs_.begin(), jobs_.end(), [&file_path](const Job& job) {
+            return job.file_path == file_path;
+        });
+        if (it != jobs_.end()) {
+            it->contents = std::move(contents);
+            it->version = version;
+            it->encoding = encoding;
+        } else {
+            jobs_.push_back({file_path, std::move(contents), version, encoding});
+        }
+    }
+    cv_.notify_one();
+}
+
+std::vector<SaveResult> SaveQueue::take_results() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<SaveResult> results;
+    results.swap(results_);
+    return results;
+}
+
+void SaveQueue::set_notify(std::function<void()> notify) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    notify_ = std::move(notify);
+}
+
+bool SaveQueue::write_atomically(const std::string& file_path, const std::string& contents, std::string& error,
+                                 uint64_t* hash, bool durable) {
+    if (hash) {
+        *hash = ContentHash::hash(contents.data(), contents.size());
+    }
+    return replace_file(file_path, [&contents](int fd) {
+        return write_all(fd, contents.data(), contents.size());
+    }, error, durable);
+}
+
+bool SaveQueue::write_atomically(const std::string& file_path, const PieceTable::Snapshot& contents, std::string& error,
+                                 uint64_t* hash) {
+    ContentHash hasher;
+    bool written = replace_file(file_path, [&contents, &hasher](int fd) {
+        // Pieces are small, so gather them into large writes
+        std::string staging;
+        staging.reserve(std::min(contents.size(), kWriteChunkSize));
+        bool ok = true;
+        contents.for_each_chunk([&](const char* data, size_t len) {
+            if (!ok) {
+                return;
+            }
+            hasher.update(data, len);
+            if (staging.size() + len > kWriteChunkSize && !staging.empty()) {
+                ok = write_all(fd, staging.data(), staging.size());
+                staging.clear();
+            }
+            if (len >= kWriteChunkSize) {
+                ok = ok && write_all(fd, data, len);
+            } else {
+                staging.append(data, len);
+            }
+        });
+        return ok && write_all(fd, staging.data(), staging.size());
+    }, error);
+    if (hash) {
+        *hash = hasher.digest();
+    }
+    return written;
+}
+
+bool SaveQueue::replace_file(const std::string& file_path, const std::function<bool(int)>& write, std::string& error,
+                             bool durable) {
+    // Replace the target of a symlink, not the link itself
+    std::error_code ec;
+    std::filesystem::path path(file_path);
+    if (std::filesystem::is_symlink(path, ec)) {
+        path = std::filesystem::canonical(path, ec);
+        if (ec) {
+            error = ec.message();
+            return false;
+        }
+    }
+    std::filesystem::path dir = path.parent_path().empty() ? "." : path.parent_path();
+    std::string tmp_path = (dir / ("." + path.filename().string() + ".librenote-XXXXXX")).string();
+
+    int fd = mkstemp(&tmp_path[0]);
+    if (fd < 0) {
+        error = std::strerror(errno);
+        return false;
+    }
+
+    // Keep the permissions of the file we're replacing; a new one gets what creating it
+    // directly would have, not mkstemp's 0600
+    struct stat st {};
+    if (stat(path.c_str(), &st) == 0) {
+        fchmod(fd, st.st_mode & 07777);
+    } else {
+        fchmod(fd, 0666 & ~current_umask());
+    }
+
+    bool ok = write(fd) && (!durable || fsync(fd) == 0);
+    if (!ok) {
+        error = std::strerror(errno);
+    }
+    if (close(fd) != 0 && ok) {
+        error = std::strerror(errno);
+        ok = false;
+    }
+    if (ok && rename(tmp_path.c_str(), path.c_str()) != 0) {
+        error = std::strerror(errno);
+        ok = false;
+    }
+    if (!ok) {
+        unlink(tmp_path.c_str());
+        return false;
+    }
+
+    if (!durable) {
+        return true;
+    }
+    // Make the rename itself durable
+    int dir_fd = open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dir_fd >= 0) {
+        fsync(dir_fd);
+        close(dir_fd);
+    }
+    return true;
+}
+
+void SaveQueue::run() {
+    Tracer::set_thread_name("SaveQueue");
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        cv_.wait(lock, [this] { return stop_ || !jobs_.empty(); });
+        if (jobs_.empty()) {
+            return;
+        }
+
+        // Pending saves are still flushed on shutdown
+        Job job = std::move(jobs_.front());
+        jobs_.pop_front();
+
+        lock.unlock();
+        SaveResult result{job.file_path, job.version, false, {}};
+        TRACE_SCOPE("Write file", job.file_path);
+        if (job.encoding.is_utf8()) {
+            result.ok = write_atomically(job.file_path, job.contents, result.error, &result.hash);
+        } else {
+            std::string text;
+            text.reserve(job.contents.size());
+            job.contents.for_each_chunk([&text](const char* data, size_t len) {
+                text.append(data, len);
+            });
+            std::string encoded;
+            result.ok = encode_text(text, job.encoding, encoded, result.error) &&
+                        write_atomically(job.file_path, encoded, result.error, &result.hash);
+        }
+        job.contents = PieceTable::Snapshot();
+        lock.lock();
+
+        results_.push_back(std::move(result));
+        if (notify_) {
+            notify_();
+        }
+    }
+}
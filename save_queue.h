@@ -0,0 +1,70 @@
+#ifndef SAVE_QUEUE_H
+#define SAVE_QUEUE_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "piece_table.h"
+#include "text_encoding.h"
+
+struct SaveResult {
+    std::string file_path;
+    uint64_t version = 0;
+    bool ok = false;
+    std::string error;
+    // ContentHash of the bytes written
+    uint64_t hash = 0;
+};
+
+// Writes files on a worker thread. Each save goes to a temporary file in the same
+// directory which is fsynced and then renamed over the original, so a crash leaves
+// either the old or the new contents on disk, never a truncated mix. A save queued
+// while an older one for the same file is still waiting replaces it.
+class SaveQueue {
+public:
+    SaveQueue();
+    ~SaveQueue();
+
+    // version is handed back in the result so the caller can tell which edit got saved;
+    // contents are UTF-8 and get converted to encoding on the worker
+    void save(const std::string& file_path, PieceTable::Snapshot contents, uint64_t version, TextEncoding encoding = TextEncoding());
+    std::vector<SaveResult> take_results();
+    void set_notify(std::function<void()> notify);
+
+    // hash, if given, receives the ContentHash of what was written. Without durable the
+    // file isn't fsynced: readers still see old or new contents, but a crash may lose
+    // both, for callers that write many files and sync once.
+    static bool write_atomically(const std::string& file_path, const std::string& contents, std::string& error,
+                                 uint64_t* hash = nullptr, bool durable = true);
+    static bool write_atomically(const std::string& file_path, const PieceTable::Snapshot& contents, std::string& error,
+                                 uint64_t* hash = nullptr);
+
+private:
+    struct Job {
+        std::string file_path;
+        PieceTable::Snapshot contents;
+        uint64_t version;
+        TextEncoding encoding;
+    };
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::deque<Job> jobs_;
+    std::vector<SaveResult> results_;
+    std::function<void()> notify_;
+    bool stop_ = false;
+    std::thread worker_;
+
+    void run();
+    // Does the temp file + rename dance around write, which fills the open file
+    static bool replace_file(const std::string& file_path, const std::function<bool(int)>& write, std::string& error,
+                             bool durable = true);
+};
+
+#endif // SAVE_QUEUE_H
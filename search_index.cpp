@@ -0,0 +1,814 @@
+#include "search_index.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <unordered_set>
+
+#include "dir_scanner.h"
+#include "file_sniffer.h"
+#include "save_queue.h"
+#include "trace.h"
+
+namespace {
+
+const char kMagic[8] = {'L', 'N', 'I', 'D', 'X', '0', '0', '1'};
+// Bigger files are logs or data dumps, not notes
+const size_t kMaxFileSize = 16 * 1024 * 1024;
+const size_t kMaxWordLength = 64;
+const auto kWriteDelay = std::chrono::seconds(5);
+// Trigram terms start with this byte, which never shows up in a word
+const char kTrigramTag = '\x01';
+const size_t kMaxContextLines = 3;
+const size_t kMaxContextLength = 200;
+// Candidates read per search; past these the ranking is unlikely to be wrong enough to matter
+const size_t kMaxCandidates = 200;
+
+struct Header {
+    char magic[8];
+    uint32_t doc_count;
+    uint32_t term_count;
+    // Start of the blob holding paths, terms and postings
+    uint64_t blob_offset;
+    uint64_t blob_size;
+};
+
+struct DocRecord {
+    uint64_t path_offset;
+    uint32_t path_len;
+    uint32_t reserved;
+    uint64_t size;
+    int64_t mtime_ns;
+};
+
+bool is_word_byte(unsigned char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_' || c >= 0x80;
+}
+
+char fold(char c) {
+    return (c >= 'A' && c <= 'Z') ? c - 'A' + 'a' : c;
+}
+
+std::string fold(std::string_view text) {
+    std::string folded(text);
+    std::transform(folded.begin(), folded.end(), folded.begin(), [](char c) { return fold(c); });
+    return folded;
+}
+
+template <typename Fn>
+void for_each_word(std::string_view text, Fn fn) {
+    size_t i = 0;
+    while (i < text.size()) {
+        while (i < text.size() && !is_word_byte(text[i])) {
+            i++;
+        }
+        size_t start = i;
+        while (i < text.size() && is_word_byte(text[i])) {
+            i++;
+        }
+        if (i > start && i - start <= kMaxWordLength) {
+            fn(text.substr(start, i - start));
+        }
+    }
+}
+
+void put_varint(std::string& out, uint64_t value) {
+    while (value >= 0x80) {
+        out.push_back(static_cast<char>(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<char>(value));
+}
+
+uint64_t get_varint(const char*& p, const char* end) {
+    uint64_t value = 0;
+    for (int shift = 0; p < end && shift < 64; shift += 7) {
+        auto byte = static_cast<unsigned char>(*p++);
+        value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            break;
+        }
+    }
+    return value;
+}
+
+int64_t mtime_ns(const struct stat& st) {
+    return static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+}
+
+bool read_file(const std::string& path, std::string& contents) {
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    contents.clear();
+    char buffer[64 * 1024];
+    ssize_t n;
+    while ((n = read(fd, buffer, sizeof(buffer))) > 0 && contents.size() < kMaxFileSize) {
+        contents.append(buffer, n);
+    }
+    close(fd);
+    return n >= 0;
+}
+
+// Lines of text containing any of the words, case-insensitively
+std::vector<std::pair<size_t, std::string>> matching_lines(const std::string& text, const std::vector<std::string>& words,
+                                                           std::vector<bool>& found) {
+    std::vector<std::pair<size_t, std::string>> lines;
+    found.assign(words.size(), false);
+    size_t line = 1;
+    size_t start = 0;
+    while (start < text.size()) {
+        size_t end = text.find('\n', start);
+        if (end == std::string::npos) {
+            end = text.size();
+        }
+        std::string folded = fold(std::string_view(text).substr(start, end - start));
+        bool match = false;
+        for (size_t i = 0; i < words.size(); i++) {
+            if (folded.find(words[i]) != std::string::npos) {
+                found[i] = true;
+                match = true;
+            }
+        }
+        if (match && lines.size() < kMaxContextLines) {
+            size_t len = std::min(end - start, kMaxContextLength);
+            // Don't cut a UTF-8 sequence in half
+            while (len < end - start && len > 0 && (static_cast<unsigned char>(text[start + len]) & 0xc0) == 0x80) {
+                len--;
+            }
+            std::string context = text.substr(start, len);
+            if (!context.empty() && context.back() == '\r') {
+                context.pop_back();
+            }
+            lines.emplace_back(line, std::move(context));
+        }
+        if (lines.size() == kMaxContextLines && std::all_of(found.begin(), found.end(), [](bool f) { return f; })) {
+            break;
+        }
+        start = end + 1;
+        line++;
+    }
+    return lines;
+}
+
+// Collects the words and tagged trigrams of a file with their number of occurrences
+bool index_file(const std::string& path, uint64_t size, std::unordered_map<std::string, uint32_t>& terms) {
+    if (size > kMaxFileSize || sniff_file(path).kind != FileKind::Text) {
+        return false;
+    }
+    std::string text;
+    if (!read_file(path, text)) {
+        return false;
+    }
+
+    std::string folded = fold(text);
+    for_each_word(folded, [&terms](std::string_view word) {
+        terms[std::string(word)]++;
+    });
+
+    std::unordered_set<uint32_t> trigrams;
+    for (size_t i = 0; i + 3 <= folded.size(); i++) {
+        if (folded[i] == '\n' || folded[i + 1] == '\n' || folded[i + 2] == '\n') {
+            continue;
+        }
+        trigrams.insert(static_cast<unsigned char>(folded[i]) << 16 | static_cast<unsigned char>(folded[i + 1]) << 8 |
+                        static_cast<unsigned char>(folded[i + 2]));
+    }
+    std::string trigram(4, kTrigramTag);
+    for (uint32_t t : trigrams) {
+        trigram[1] = static_cast<char>(t >> 16);
+        trigram[2] = static_cast<char>(t >> 8);
+        trigram[3] = static_cast<char>(t);
+        terms[trigram] = 1;
+    }
+    return true;
+}
+
+} // namespace
+
+struct SearchIndex::TermRecord {
+    uint64_t term_offset;
+    uint64_t postings_offset;
+    uint32_t term_len;
+    uint32_t postings_len;
+    uint32_t doc_freq;
+    uint32_t reserved;
+};
+
+SearchIndex::SearchIndex() : worker_(&SearchIndex::run, this) {}
+
+SearchIndex::~SearchIndex() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    cv_.notify_all();
+    worker_.join();
+    cancel_search();
+    // A search may still be ranking on the searcher thread
+    std::lock_guard<std::mutex> lock(index_mutex_);
+    unmap_index();
+}
+
+void SearchIndex::open(const std::string& index_path, const std::filesystem::path& root,
+                       std::shared_ptr<const IgnoreRules> rules) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        index_path_ = index_path;
+        root_ = root;
+        rules_ = std::move(rules);
+        remap_ = true;
+        refresh_ = true;
+    }
+    cv_.notify_one();
+}
+
+void SearchIndex::update_file(const std::string& file_path) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        queue_update(file_path);
+    }
+    cv_.notify_one();
+}
+
+void SearchIndex::apply_changes(const std::vector<FsChange>& changes) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (const FsChange& change : changes) {
+            if (change.is_directory) {
+                // Whatever the folder holds moved with it
+                refresh_ = true;
+                continue;
+            }
+            queue_update(change.path.string());
+            if (change.kind == FsChange::Renamed) {
+                queue_update(change.old_path.string());
+            }
+        }
+    }
+    cv_.notify_one();
+}
+
+// Called with mutex_ held
+void SearchIndex::queue_update(const std::string& file_path) {
+    if (rules_ && rules_->is_ignored_absolute(file_path, false)) {
+        return;
+    }
+    if (std::find(updates_.begin(), updates_.end(), file_path) == updates_.end()) {
+        updates_.push_back(file_path);
+    }
+}
+
+void SearchIndex::start_search(const std::string& query, size_t max_hits) {
+    cancel_search();
+    std::vector<std::string> words;
+    for_each_word(fold(query), [&words](std::string_view word) {
+        if (std::find(words.begin(), words.end(), word) == words.end()) {
+            words.emplace_back(word);
+        }
+    });
+    if (words.empty()) {
+        return;
+    }
+
+    uint64_t id;
+    {
+        std::lock_guard<std::mutex> lock(search_mutex_);
+        id = next_search_id_++;
+        search_id_ = id;
+        search_done_ = false;
+    }
+    searcher_.submit([this, id, words = std::move(words), max_hits]() { run_search(id, words, max_hits); });
+}
+
+void SearchIndex::cancel_search() {
+    std::lock_guard<std::mutex> lock(search_mutex_);
+    // The searcher notices the id change and stops reading candidates
+    search_id_ = 0;
+    hits_.clear();
+    search_done_ = true;
+}
+
+std::vector<SearchHit> SearchIndex::take_hits() {
+    std::lock_guard<std::mutex> lock(search_mutex_);
+    std::vector<SearchHit> hits;
+    hits.swap(hits_);
+    return hits;
+}
+
+bool SearchIndex::search_done() {
+    std::lock_guard<std::mutex> lock(search_mutex_);
+    return search_done_;
+}
+
+void SearchIndex::set_notify(std::function<void()> notify) {
+    std::lock_guard<std::mutex> lock(search_mutex_);
+    notify_ = std::move(notify);
+}
+
+void SearchIndex::run_search(uint64_t id, const std::vector<std::string>& words, size_t max_hits) {
+    TRACE_SCOPE("SearchIndex::run_search");
+    if (search_id_ != id) {
+        return;
+    }
+    std::vector<SearchHit> candidates = rank(words);
+    if (candidates.size() > kMaxCandidates) {
+        candidates.resize(kMaxCandidates);
+    }
+
+    // Trigrams can match words that aren't there, and the file may have changed
+    // since it was indexed, so confirm against the file while collecting context
+    size_t confirmed = 0;
+    std::string text;
+    std::vector<bool> found;
+    for (auto& hit : candidates) {
+        if (confirmed == max_hits || search_id_ != id) {
+            break;
+        }
+        if (!read_file(hit.file_path, text)) {
+            continue;
+        }
+        hit.lines = matching_lines(text, words, found);
+        if (std::all_of(found.begin(), found.end(), [](bool f) { return f; })) {
+            add_hit(id, &hit);
+            confirmed++;
+        }
+    }
+    add_hit(id, nullptr);
+}
+
+// Hands one hit over, or marks the search done when hit is null
+void SearchIndex::add_hit(uint64_t id, SearchHit* hit) {
+    // Notified under the lock, so set_notify() can't return while a call is under way
+    std::lock_guard<std::mutex> lock(search_mutex_);
+    if (search_id_ != id) {
+        return;
+    }
+    if (hit) {
+        hits_.push_back(std::move(*hit));
+    } else {
+        search_done_ = true;
+    }
+    if (notify_) {
+        notify_();
+    }
+}
+
+// Docs containing every word, scored but not yet confirmed, best first
+std::vector<SearchHit> SearchIndex::rank(const std::vector<std::string>& words) {
+    std::vector<SearchHit> candidates;
+    {
+        std::lock_guard<std::mutex> lock(index_mutex_);
+        std::unordered_map<uint32_t, double> scores;
+        for (size_t w = 0; w < words.size(); w++) {
+            const std::string& word = words[w];
+
+            // Docs containing the word anywhere: all of its trigrams, or a word
+            // starting with it when it is too short to have any
+            std::vector<Posting> matches;
+            if (word.size() >= 3) {
+                std::string trigram(4, kTrigramTag);
+                for (size_t i = 0; i + 3 <= word.size(); i++) {
+                    trigram.replace(1, 3, word, i, 3);
+                    std::vector<Posting> docs = postings(trigram);
+                    if (i == 0) {
+                        matches = std::move(docs);
+                        continue;
+                    }
+                    std::vector<Posting> both;
+                    std::set_intersection(matches.begin(), matches.end(), docs.begin(), docs.end(), std::back_inserter(both),
+                                          [](const Posting& a, const Posting& b) { return a.doc < b.doc; });
+                    matches = std::move(both);
+                }
+            } else {
+                matches = prefix_postings(word);
+            }
+
+            std::unordered_map<uint32_t, uint32_t> exact;
+            for (const Posting& p : postings(word)) {
+                exact[p.doc] = p.freq;
+            }
+
+            // Whole-word hits count for more than substring ones, rare words more than common ones
+            double idf = std::log(1.0 + static_cast<double>(live_count_) / std::max<size_t>(matches.size(), 1));
+            std::unordered_map<uint32_t, double> next;
+            for (const Posting& p : matches) {
+                auto freq = exact.find(p.doc);
+                double score = idf * (freq != exact.end() ? 1.0 + std::log(freq->second) : 0.5);
+                if (w == 0) {
+                    next[p.doc] = score;
+                } else if (auto prev = scores.find(p.doc); prev != scores.end()) {
+                    next[p.doc] = prev->second + score;
+                }
+            }
+            scores = std::move(next);
+            if (scores.empty()) {
+                return {};
+            }
+        }
+
+        for (const auto& [doc, score] : scores) {
+            candidates.push_back({docs_[doc].path, score, {}});
+        }
+    }
+
+    std::sort(candidates.begin(), candidates.end(), [](const SearchHit& a, const SearchHit& b) {
+        return a.score != b.score ? a.score > b.score : a.file_path < b.file_path;
+    });
+    return candidates;
+}
+
+void SearchIndex::run() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        auto has_work = [this] { return stop_ || refresh_ || !updates_.empty(); };
+        if (dirty_) {
+            cv_.wait_until(lock, last_write_ + kWriteDelay, has_work);
+        } else {
+            cv_.wait(lock, has_work);
+        }
+
+        if (stop_) {
+            lock.unlock();
+            if (dirty_) {
+                write_index();
+            }
+            return;
+        }
+
+        if (refresh_) {
+            refresh_ = false;
+            bool remap = remap_;
+            remap_ = false;
+            lock.unlock();
+            if (remap) {
+                // Loading the doc table is O(docs), so it stays off the caller's thread
+                std::lock_guard<std::mutex> index_lock(index_mutex_);
+                unmap_index();
+                map_index();
+            }
+            refresh();
+            if (dirty_) {
+                write_index();
+            }
+            lock.lock();
+        } else if (!updates_.empty()) {
+            std::string path = std::move(updates_.front());
+            updates_.pop_front();
+            lock.unlock();
+            reindex(path);
+            lock.lock();
+        } else if (dirty_ && std::chrono::steady_clock::now() >= last_write_ + kWriteDelay) {
+            lock.unlock();
+            write_index();
+            lock.lock();
+        }
+    }
+}
+
+// Walks the workspace and re-indexes files whose size or mtime changed since the
+// index was written; files that are gone are dropped
+void SearchIndex::refresh() {
+    std::unordered_set<std::string> seen;
+    bool stopped = false;
+    size_t pruned = DirScanner::walk_files(root_, [&](const std::filesystem::path& path, const struct stat& st) {
+        // Saves don't wait for the whole walk
+        std::string update;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (stop_) {
+                stopped = true;
+                return false;
+            }
+            if (!updates_.empty()) {
+                update = std::move(updates_.front());
+                updates_.pop_front();
+            }
+        }
+        if (!update.empty()) {
+            reindex(update);
+        }
+
+        std::string file_path = path.string();
+        seen.insert(file_path);
+        auto id = doc_ids_.find(file_path);
+        if (id == doc_ids_.end() || docs_[id->second].size != static_cast<uint64_t>(st.st_size) ||
+            docs_[id->second].mtime_ns != mtime_ns(st)) {
+            reindex(file_path);
+        }
+        return true;
+    }, rules_.get());
+    if (stopped) {
+        return;
+    }
+    if (pruned > 0 && Tracer::enabled()) {
+        uint64_t now = Tracer::now_ns();
+        Tracer::record("Pruned ignored entries", now, now, std::to_string(pruned) + " in the search index walk");
+    }
+
+    std::vector<std::string> gone;
+    for (const auto& [path, id] : doc_ids_) {
+        if (!seen.count(path)) {
+            gone.push_back(path);
+        }
+    }
+    std::lock_guard<std::mutex> lock(index_mutex_);
+    for (const auto& path : gone) {
+        remove_doc(path);
+    }
+}
+
+// Reads and tokenizes the file outside the lock, then swaps it into the index
+void SearchIndex::reindex(const std::string& file_path) {
+    struct stat st {};
+    std::unordered_map<std::string, uint32_t> terms;
+    bool indexed = stat(file_path.c_str(), &st) == 0 && S_ISREG(st.st_mode) && index_file(file_path, st.st_size, terms);
+
+    std::lock_guard<std::mutex> lock(index_mutex_);
+    remove_doc(file_path);
+    if (!indexed) {
+        return;
+    }
+
+    auto id = static_cast<uint32_t>(docs_.size());
+    docs_.push_back({file_path, static_cast<uint64_t>(st.st_size), mtime_ns(st), true});
+    doc_ids_[file_path] = id;
+    live_count_++;
+    for (const auto& [term, freq] : terms) {
+        delta_[term].push_back({id, freq});
+    }
+    dirty_ = true;
+}
+
+void SearchIndex::remove_doc(const std::string& file_path) {
+    auto it = doc_ids_.find(file_path);
+    if (it == doc_ids_.end()) {
+        return;
+    }
+    // Its postings stay behind until the next write_index() drops them
+    docs_[it->second].live = false;
+    doc_ids_.erase(it);
+    live_count_--;
+    dirty_ = true;
+}
+
+// Merges the mapped index with everything indexed since into a new file, then maps that
+void SearchIndex::write_index() {
+    if (index_path_.empty()) {
+        return;
+    }
+
+    std::vector<uint32_t> renumber(docs_.size(), UINT32_MAX);
+    std::string blob;
+    std::string docs;
+    uint32_t doc_count = 0;
+    for (size_t i = 0; i < docs_.size(); i++) {
+        if (!docs_[i].live) {
+            continue;
+        }
+        renumber[i] = doc_count++;
+        DocRecord record{blob.size(), static_cast<uint32_t>(docs_[i].path.size()), 0, docs_[i].size, docs_[i].mtime_ns};
+        blob += docs_[i].path;
+        docs.append(reinterpret_cast<const char*>(&record), sizeof(record));
+    }
+
+    std::string terms;
+    uint32_t term_count = 0;
+    std::vector<Posting> merged;
+    auto add_term = [&](std::string_view term) {
+        uint32_t prev = 0;
+        TermRecord record{blob.size(), 0, static_cast<uint32_t>(term.size()), 0, 0, 0};
+        blob += term;
+        record.postings_offset = blob.size();
+        for (const Posting& p : merged) {
+            if (renumber[p.doc] == UINT32_MAX) {
+                continue;
+            }
+            put_varint(blob, renumber[p.doc] - prev);
+            put_varint(blob, p.freq);
+            prev = renumber[p.doc];
+            record.doc_freq++;
+        }
+        if (record.doc_freq == 0) {
+            blob.resize(record.term_offset);
+            return;
+        }
+        record.postings_len = static_cast<uint32_t>(blob.size() - record.postings_offset);
+        terms.append(reinterpret_cast<const char*>(&record), sizeof(record));
+        term_count++;
+    };
+
+    // Both term lists are sorted, so merge them in order
+    size_t i = 0;
+    auto delta = delta_.begin();
+    while (i < term_count_ || delta != delta_.end()) {
+        merged.clear();
+        std::string_view term;
+        bool from_base = i < term_count_ && (delta == delta_.end() || term_at(i) <= delta->first);
+        bool from_delta = delta != delta_.end() && (i >= term_count_ || delta->first <= term_at(i));
+        if (from_base) {
+            term = term_at(i);
+            base_postings(i++, merged);
+        }
+        if (from_delta) {
+            term = delta->first;
+            merged.insert(merged.end(), delta->second.begin(), delta->second.end());
+            ++delta;
+        }
+        add_term(term);
+    }
+
+    Header header{};
+    std::memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.doc_count = doc_count;
+    header.term_count = term_count;
+    header.blob_offset = sizeof(Header) + docs.size() + terms.size();
+    header.blob_size = blob.size();
+
+    std::string contents(reinterpret_cast<const char*>(&header), sizeof(header));
+    contents += docs;
+    contents += terms;
+    contents += blob;
+
+    std::error_code ec;
+    std::filesystem::create_directories(std::filesystem::path(index_path_).parent_path(), ec);
+    std::string error;
+    last_write_ = std::chrono::steady_clock::now();
+    if (!SaveQueue::write_atomically(index_path_, contents, error)) {
+        std::cerr << "Error writing search index: " << index_path_ << ": " << error << std::endl;
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(index_mutex_);
+    unmap_index();
+    map_index();
+}
+
+// Maps the index file and loads its doc table; an unreadable or outdated file just
+// leaves the index empty so the next refresh rebuilds it
+bool SearchIndex::map_index() {
+    docs_.clear();
+    doc_ids_.clear();
+    delta_.clear();
+    live_count_ = 0;
+    dirty_ = false;
+
+    int fd = ::open(index_path_.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st {};
+    if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(Header)) {
+        close(fd);
+        return false;
+    }
+    void* map = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return false;
+    }
+    map_ = static_cast<const char*>(map);
+    map_size_ = st.st_size;
+
+    Header header;
+    std::memcpy(&header, map_, sizeof(header));
+    // Every range the lookups follow is checked here, so a damaged file is rebuilt
+    // rather than read out of bounds
+    auto in_blob = [&header](uint64_t offset, uint64_t len) {
+        return offset <= header.blob_size && len <= header.blob_size - offset;
+    };
+    auto reject = [this]() {
+        std::cerr << "Ignoring invalid search index: " << index_path_ << std::endl;
+        unmap_index();
+        docs_.clear();
+        doc_ids_.clear();
+        return false;
+    };
+
+    size_t tables = sizeof(Header) + static_cast<size_t>(header.doc_count) * sizeof(DocRecord) +
+                    static_cast<size_t>(header.term_count) * sizeof(TermRecord);
+    if (std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 || header.blob_offset != tables ||
+        header.blob_offset > map_size_ || header.blob_size != map_size_ - header.blob_offset) {
+        return reject();
+    }
+
+    const char* blob = map_ + header.blob_offset;
+    auto records = reinterpret_cast<const DocRecord*>(map_ + sizeof(Header));
+    auto terms = reinterpret_cast<const TermRecord*>(records + header.doc_count);
+    for (uint32_t i = 0; i < header.term_count; i++) {
+        if (!in_blob(terms[i].term_offset, terms[i].term_len) ||
+            !in_blob(terms[i].postings_offset, terms[i].postings_len)) {
+            return reject();
+        }
+    }
+    docs_.reserve(header.doc_count);
+    for (uint32_t i = 0; i < header.doc_count; i++) {
+        const DocRecord& record = records[i];
+        if (!in_blob(record.path_offset, record.path_len)) {
+            return reject();
+        }
+        docs_.push_back({std::string(blob + record.path_offset, record.path_len), record.size, record.mtime_ns, true});
+        doc_ids_[docs_.back().path] = i;
+    }
+    live_count_ = docs_.size();
+    base_docs_ = header.doc_count;
+    terms_ = terms;
+    term_count_ = header.term_count;
+    return true;
+}
+
+void SearchIndex::unmap_index() {
+    if (map_) {
+        munmap(const_cast<char*>(map_), map_size_);
+    }
+    map_ = nullptr;
+    map_size_ = 0;
+    terms_ = nullptr;
+    term_count_ = 0;
+    base_docs_ = 0;
+}
+
+std::string_view SearchIndex::term_at(size_t i) const {
+    const char* blob = map_ + reinterpret_cast<const Header*>(map_)->blob_offset;
+    return {blob + terms_[i].term_offset, terms_[i].term_len};
+}
+
+void SearchIndex::base_postings(size_t i, std::vector<Posting>& out) const {
+    const char* blob = map_ + reinterpret_cast<const Header*>(map_)->blob_offset;
+    const char* p = blob + terms_[i].postings_offset;
+    const char* end = std::min(p + terms_[i].postings_len, map_ + map_size_);
+    uint32_t doc = 0;
+    while (p < end) {
+        doc += static_cast<uint32_t>(get_varint(p, end));
+        auto freq = static_cast<uint32_t>(get_varint(p, end));
+        if (doc < base_docs_) {
+            out.push_back({doc, freq});
+        }
+    }
+}
+
+// Live postings of a term, sorted by doc
+std::vector<SearchIndex::Posting> SearchIndex::postings(const std::string& term) const {
+    std::vector<Posting> all;
+    size_t lo = 0, hi = term_count_;
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (term_at(mid) < term) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    if (lo < term_count_ && term_at(lo) == term) {
+        base_postings(lo, all);
+    }
+    // Docs indexed since all come after the mapped ones
+    auto delta = delta_.find(term);
+    if (delta != delta_.end()) {
+        all.insert(all.end(), delta->second.begin(), delta->second.end());
+    }
+    all.erase(std::remove_if(all.begin(), all.end(), [this](const Posting& p) { return !docs_[p.doc].live; }), all.end());
+    return all;
+}
+
+// Live docs containing a word that starts with prefix, sorted by doc
+std::vector<SearchIndex::Posting> SearchIndex::prefix_postings(const std::string& prefix) const {
+    std::unordered_map<uint32_t, uint32_t> freqs;
+    size_t lo = 0, hi = term_count_;
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (term_at(mid) < prefix) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    std::vector<Posting> docs;
+    for (size_t i = lo; i < term_count_ && term_at(i).substr(0, prefix.size()) == prefix; i++) {
+        docs.clear();
+        base_postings(i, docs);
+        for (const Posting& p : docs) {
+            freqs[p.doc] += p.freq;
+        }
+    }
+    for (auto it = delta_.lower_bound(prefix); it != delta_.end() && it->first.compare(0, prefix.size(), prefix) == 0; ++it) {
+        for (const Posting& p : it->second) {
+            freqs[p.doc] += p.freq;
+        }
+    }
+
+    std::vector<Posting> all;
+    for (const auto& [doc, freq] : freqs) {
+        if (docs_[doc].live) {
+            all.push_back({doc, freq});
+        }
+    }
+    std::sort(all.begin(), all.end(), [](const Posting& a, const Posting& b) { return a.doc < b.doc; });
+    return all;
+}
@@ -0,0 +1,148 @@
+#ifndef SEARCH_INDEX_H
+#define SEARCH_INDEX_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "file_watcher.h"
+#include "ignore_rules.h"
+#include "work_pool.h"
+
+struct SearchHit {
+    std::string file_path;
+    double score = 0;
+    // 1-based line number and text of the lines matching the query
+    std::vector<std::pair<size_t, std::string>> lines;
+};
+
+// Full-text index of every note under the workspace root. Words go into an inverted
+// index for ranking, and every trigram of every line too, so substring queries only
+// have to look at files that contain all of their trigrams.
+//
+// The index lives in a single file that the worker mmaps after open, so startup doesn't
+// wait for it. Files re-indexed afterwards (changed on disk or saved from the editor) are
+// kept in memory and merged into a fresh index file once the worker goes idle.
+//
+// Searches run off the calling thread: candidates are ranked from the index, then the
+// best of them are read to confirm the match and collect context, and hits are streamed
+// back as they're confirmed. Starting a search cancels the previous one.
+class SearchIndex {
+public:
+    SearchIndex();
+    ~SearchIndex();
+
+    SearchIndex(const SearchIndex&) = delete;
+    SearchIndex& operator=(const SearchIndex&) = delete;
+
+    // Has the worker map the index at index_path and re-index files under root whose
+    // size or mtime no longer match it. Files the rules ignore are left out.
+    void open(const std::string& index_path, const std::filesystem::path& root,
+              std::shared_ptr<const IgnoreRules> rules = nullptr);
+    // Re-indexes one file right away, e.g. after it was saved
+    void update_file(const std::string& file_path);
+    // Files that were added, removed or renamed; a folder change rechecks the workspace
+    void apply_changes(const std::vector<FsChange>& changes);
+
+    // Looks for files containing every word of the query; hits arrive best first
+    // through take_hits()
+    void start_search(const std::string& query, size_t max_hits = 50);
+    void cancel_search();
+    // Hits of the current search confirmed since the last call
+    std::vector<SearchHit> take_hits();
+    // The current search has checked all the candidates it will
+    bool search_done();
+    // Called from the search thread whenever new hits or completion are available
+    void set_notify(std::function<void()> notify);
+
+private:
+    struct Doc {
+        std::string path;
+        uint64_t size = 0;
+        int64_t mtime_ns = 0;
+        bool live = true;
+    };
+
+    struct Posting {
+        uint32_t doc;
+        uint32_t freq;
+    };
+
+    struct TermRecord;
+
+    // Guards the work queue
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::deque<std::string> updates_;
+    bool refresh_ = false;
+    // open() was called and the worker hasn't mapped the index yet
+    bool remap_ = false;
+    bool stop_ = false;
+    std::string index_path_;
+    std::filesystem::path root_;
+    std::shared_ptr<const IgnoreRules> rules_;
+
+    // Guards everything below. Only the worker modifies it, so the worker reads it
+    // without locking and searches lock it to read.
+    std::mutex index_mutex_;
+
+    // The mapped index file
+    const char* map_ = nullptr;
+    size_t map_size_ = 0;
+    const TermRecord* terms_ = nullptr;
+    size_t term_count_ = 0;
+    uint32_t base_docs_ = 0;
+
+    // Docs of the mapped file first, then the ones indexed since
+    std::vector<Doc> docs_;
+    std::unordered_map<std::string, uint32_t> doc_ids_;
+    size_t live_count_ = 0;
+    std::map<std::string, std::vector<Posting>> delta_;
+    bool dirty_ = false;
+    std::chrono::steady_clock::time_point last_write_;
+
+    std::thread worker_;
+
+    // Guards the results of the current search
+    std::mutex search_mutex_;
+    std::vector<SearchHit> hits_;
+    std::function<void()> notify_;
+    bool search_done_ = true;
+    std::atomic<uint64_t> search_id_{0};
+    uint64_t next_search_id_ = 1;
+
+    // Declared last so its thread is joined before anything it uses goes away
+    WorkPool searcher_{1};
+
+    void run();
+    void run_search(uint64_t id, const std::vector<std::string>& words, size_t max_hits);
+    std::vector<SearchHit> rank(const std::vector<std::string>& words);
+    void add_hit(uint64_t id, SearchHit* hit);
+    void refresh();
+    void queue_update(const std::string& file_path);
+    void reindex(const std::string& file_path);
+    void remove_doc(const std::string& file_path);
+    void write_index();
+    bool map_index();
+    void unmap_index();
+
+    std::string_view term_at(size_t i) const;
+    void base_postings(size_t i, std::vector<Posting>& out) const;
+    std::vector<Posting> postings(const std::string& term) const;
+    std::vector<Posting> prefix_postings(const std::string& prefix) const;
+};
+
+#endif // SEARCH_INDEX_H
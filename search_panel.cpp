@@ -0,0 +1,112 @@
+#include "search_panel.h"
+
+#include <filesystem>
+
+SearchPanel::SearchPanel(SearchIndex& index) : Gtk::Box(Gtk::ORIENTATION_VERTICAL), index_(index) {
+    searchEntry_.set_placeholder_text("Search notes");
+    pack_start(searchEntry_, Gtk::PACK_SHRINK);
+
+    regexButton_.set_label("Regex");
+    caseButton_.set_label("Match case");
+    statusLabel_.set_halign(Gtk::ALIGN_END);
+    optionsBox_.pack_start(regexButton_, Gtk::PACK_SHRINK);
+    optionsBox_.pack_start(caseButton_, Gtk::PACK_SHRINK);
+    optionsBox_.pack_start(statusLabel_, Gtk::PACK_EXPAND_WIDGET);
+    pack_start(optionsBox_, Gtk::PACK_SHRINK);
+
+    listModel_ = Gtk::ListStore::create(columns_);
+    treeView_.set_model(listModel_);
+    treeView_.set_headers_visible(false);
+    treeView_.append_column("Location", columns_.column_location);
+    treeView_.append_column("Match", columns_.column_context);
+
+    scrolledWindow_.set_policy(Gtk::POLICY_AUTOMATIC, Gtk::POLICY_AUTOMATIC);
+    scrolledWindow_.add(treeView_);
+    pack_start(scrolledWindow_, Gtk::PACK_EXPAND_WIDGET);
+
+    // SearchEntry already waits for a pause in typing before emitting this
+    searchEntry_.signal_search_changed().connect(sigc::mem_fun(*this, &SearchPanel::on_search_changed));
+    regexButton_.signal_toggled().connect(sigc::mem_fun(*this, &SearchPanel::on_search_changed));
+    caseButton_.signal_toggled().connect(sigc::mem_fun(*this, &SearchPanel::on_search_changed));
+    treeView_.signal_row_activated().connect(sigc::mem_fun(*this, &SearchPanel::on_row_activated));
+
+    indexDispatcher_.connect(sigc::mem_fun(*this, &SearchPanel::on_index_ready));
+    index_.set_notify([this]() { indexDispatcher_.emit(); });
+    findDispatcher_.connect(sigc::mem_fun(*this, &SearchPanel::on_find_ready));
+    fileSearch_.set_notify([this]() { findDispatcher_.emit(); });
+
+    show_all_children();
+}
+
+SearchPanel::~SearchPanel() {
+    // The index outlives the panel
+    index_.set_notify(nullptr);
+    index_.cancel_search();
+}
+
+void SearchPanel::set_ignore_rules(std::shared_ptr<const IgnoreRules> rules) {
+    ignoreRules_ = std::move(rules);
+}
+
+sigc::signal<void, const std::string&, int> SearchPanel::signal_result_activated() {
+    return result_activated_signal_;
+}
+
+void SearchPanel::on_search_changed() {
+    listModel_->clear();
+    statusLabel_.set_text("");
+    fileSearch_.cancel();
+    index_.cancel_search();
+
+    std::string query = searchEntry_.get_text().raw();
+    if (regexButton_.get_active() || caseButton_.get_active()) {
+        // Matches arrive through on_find_ready
+        std::string error;
+        findCount_ = 0;
+        FindQuery find{query, regexButton_.get_active(), caseButton_.get_active()};
+        if (!fileSearch_.start(std::filesystem::current_path(), ignoreRules_, find, error)) {
+            statusLabel_.set_text(error);
+        } else if (!query.empty()) {
+            statusLabel_.set_text("Searching...");
+        }
+        return;
+    }
+
+    // Hits arrive through on_index_ready
+    index_.start_search(query);
+}
+
+void SearchPanel::on_index_ready() {
+    for (const auto& hit : index_.take_hits()) {
+        for (const auto& [line, text] : hit.lines) {
+            append_row(hit.file_path, line, text);
+        }
+    }
+}
+
+void SearchPanel::on_find_ready() {
+    for (const auto& match : fileSearch_.take_matches()) {
+        append_row(match.file_path, match.line, match.text);
+        findCount_++;
+    }
+    std::string status = std::to_string(findCount_) + (findCount_ == 1 ? " match" : " matches");
+    statusLabel_.set_text(fileSearch_.done() ? status : status + "...");
+}
+
+void SearchPanel::append_row(const std::string& file_path, size_t line, const std::string& text) {
+    Gtk::TreeModel::Row row = *listModel_->append();
+    row[columns_.column_location] = std::filesystem::path(file_path).filename().string() + ":" + std::to_string(line);
+    // Notes aren't always valid UTF-8
+    row[columns_.column_context] = Glib::ustring(text).validate() ? text : Glib::convert_with_fallback(text, "UTF-8", "ISO-8859-1");
+    row[columns_.column_path] = file_path;
+    row[columns_.column_line] = static_cast<int>(line);
+}
+
+void SearchPanel::on_row_activated(const Gtk::TreeModel::Path& path, Gtk::TreeViewColumn* column) {
+    Gtk::TreeModel::iterator iter = listModel_->get_iter(path);
+    if (iter) {
+        std::string file_path = (*iter)[columns_.column_path];
+        int line = (*iter)[columns_.column_line];
+        result_activated_signal_.emit(file_path, line);
+    }
+}
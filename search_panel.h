@@ -0,0 +1,72 @@
+#ifndef SEARCH_PANEL_H
+#define SEARCH_PANEL_H
+
+#include <gtkmm/box.h>
+#include <gtkmm/checkbutton.h>
+#include <gtkmm/label.h>
+#include <gtkmm/liststore.h>
+#include <gtkmm/scrolledwindow.h>
+#include <gtkmm/searchentry.h>
+#include <gtkmm/treeview.h>
+#include <glibmm/dispatcher.h>
+
+#include "file_search.h"
+#include "search_index.h"
+
+// Search box plus a list of matching lines. Plain queries go to the workspace index;
+// regex or case-sensitive ones scan the files. Either way matches stream in as they're found.
+class SearchPanel : public Gtk::Box {
+public:
+    explicit SearchPanel(SearchIndex& index);
+    ~SearchPanel() override;
+
+    // Used by regex and case-sensitive searches, which walk the files themselves
+    void set_ignore_rules(std::shared_ptr<const IgnoreRules> rules);
+
+    // File path and 1-based line of the activated result
+    sigc::signal<void, const std::string&, int> signal_result_activated();
+
+protected:
+    class ModelColumns : public Gtk::TreeModel::ColumnRecord {
+    public:
+        ModelColumns() {
+            add(column_location);
+            add(column_context);
+            add(column_path);
+            add(column_line);
+        }
+
+        Gtk::TreeModelColumn<Glib::ustring> column_location;
+        Gtk::TreeModelColumn<Glib::ustring> column_context;
+        Gtk::TreeModelColumn<std::string> column_path;
+        Gtk::TreeModelColumn<int> column_line;
+    };
+
+    SearchIndex& index_;
+    ModelColumns columns_;
+    Gtk::SearchEntry searchEntry_;
+    Gtk::Box optionsBox_;
+    Gtk::CheckButton regexButton_;
+    Gtk::CheckButton caseButton_;
+    Gtk::Label statusLabel_;
+    Gtk::ScrolledWindow scrolledWindow_;
+    Glib::RefPtr<Gtk::ListStore> listModel_;
+    Gtk::TreeView treeView_;
+
+    Glib::Dispatcher indexDispatcher_;
+    Glib::Dispatcher findDispatcher_;
+    FileSearch fileSearch_;
+    std::shared_ptr<const IgnoreRules> ignoreRules_;
+    size_t findCount_ = 0;
+
+    void on_search_changed();
+    void on_index_ready();
+    void on_find_ready();
+    void append_row(const std::string& file_path, size_t line, const std::string& text);
+    void on_row_activated(const Gtk::TreeModel::Path& path, Gtk::TreeViewColumn* column);
+
+private:
+    sigc::signal<void, const std::string&, int> result_activated_signal_;
+};
+
+#endif // SEARCH_PANEL_H
@@ -0,0 +1,346 @@
+#include "site_export.h"
+
+#include <algorithm>
+#include <cctype>
+#include <condition_variable>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "binary_io.h"
+#include "content_hash.h"
+#include "dir_scanner.h"
+#include "markdown_html.h"
+#include "save_queue.h"
+#include "text_encoding.h"
+#include "trace.h"
+#include "work_pool.h"
+
+namespace {
+
+// The last byte is bumped whenever pages would come out differently, so an upgrade
+// renders everything once
+const char kMagic[8] = {'L', 'N', 'E', 'X', 'P', 'O', 'R', '1'};
+const char* const kManifestName = ".librenote-export";
+// Files per task: small enough to balance, big enough that queueing doesn't dominate
+const size_t kBatchSize = 64;
+
+int64_t mtime_ns(const struct stat& st) {
+    return static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+}
+
+bool read_file(const std::string& file_path, uint64_t size, std::string& contents) {
+    std::ifstream file(file_path, std::ios::binary);
+    if (!file) {
+        return false;
+    }
+    contents.resize(size);
+    file.read(&contents[0], size);
+    contents.resize(file.gcount());
+    // Grew since it was listed
+    if (file && file.peek() != EOF) {
+        std::ostringstream rest;
+        rest << file.rdbuf();
+        contents += rest.str();
+    }
+    return !file.bad();
+}
+
+// Without a trailing separator, so relative paths are a plain substr away
+std::filesystem::path normalized(const std::filesystem::path& path) {
+    std::filesystem::path normal = std::filesystem::absolute(path).lexically_normal();
+    return normal.has_filename() ? normal : normal.parent_path();
+}
+
+} // namespace
+
+SiteExporter::SiteExporter(const std::filesystem::path& root, const std::filesystem::path& out_dir,
+                           std::shared_ptr<const IgnoreRules> rules)
+    : root_(normalized(root)), out_(normalized(out_dir)), rules_(std::move(rules)),
+      manifest_path_((out_ / kManifestName).string()) {
+    resolver_.set_root(root_);
+}
+
+bool SiteExporter::run(ExportStats& stats, size_t threads) {
+    TRACE_SCOPE("SiteExporter::run", root_.string());
+    if (out_ == root_) {
+        std::cerr << "Export folder can't be the workspace itself: " << out_ << std::endl;
+        return false;
+    }
+    load_manifest();
+
+    // The export itself may live in the workspace
+    std::string out_prefix = out_.string() + "/";
+    std::vector<Source> sources;
+    size_t root_length = root_.native().size() + 1;
+    stats.pruned = DirScanner::walk_files(root_, [&](const std::filesystem::path& path, const struct stat& st) {
+        std::string file_path = path.string();
+        if (file_path.compare(0, out_prefix.size(), out_prefix) == 0) {
+            return true;
+        }
+        Source source;
+        source.relative = file_path.substr(root_length);
+        source.size = st.st_size;
+        source.mtime_ns = mtime_ns(st);
+        source.note = LinkGraph::is_note(path);
+        resolver_.add_file(file_path);
+        source.path = std::move(file_path);
+        (source.note ? stats.notes : stats.files)++;
+        sources.push_back(std::move(source));
+        return true;
+    }, rules_.get());
+
+    // Every task writes only its own slots, and the resolver and manifest stay as they
+    // are until all of them are done
+    std::vector<Entry> entries(sources.size());
+    std::vector<Outcome> outcomes(sources.size(), Outcome::Failed);
+    {
+        WorkPool pool(threads);
+        std::mutex mutex;
+        std::condition_variable done;
+        size_t pending = 0;
+        for (size_t first = 0; first < sources.size(); first += kBatchSize) {
+            size_t last = std::min(first + kBatchSize, sources.size());
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                pending++;
+            }
+            pool.submit([&, first, last]() {
+                for (size_t i = first; i < last; i++) {
+                    outcomes[i] = export_file(sources[i], entries[i]);
+                }
+                std::lock_guard<std::mutex> lock(mutex);
+                if (--pending == 0) {
+                    done.notify_one();
+                }
+            });
+        }
+        std::unique_lock<std::mutex> lock(mutex);
+        done.wait(lock, [&pending] { return pending == 0; });
+    }
+
+    for (Outcome outcome : outcomes) {
+        switch (outcome) {
+        case Outcome::Unchanged: break;
+        case Outcome::Rendered: stats.rendered++; break;
+        case Outcome::Copied: stats.copied++; break;
+        case Outcome::Failed: stats.failed++; break;
+        }
+    }
+
+    for (const auto& [relative, entry] : manifest_) {
+        if (resolver_.contains((root_ / relative).string())) {
+            continue;
+        }
+        std::error_code ec;
+        if (std::filesystem::remove(output_path(relative), ec)) {
+            stats.removed++;
+        }
+    }
+
+    // One sync for all pages instead of an fsync each, before the manifest vouches for them
+    if (stats.rendered + stats.copied > 0) {
+        sync();
+    }
+    bool saved = save_manifest(sources, entries, outcomes);
+    return saved && stats.failed == 0;
+}
+
+SiteExporter::Outcome SiteExporter::export_file(const Source& source, Entry& entry) const {
+    std::string output = output_path(source.relative);
+    auto old = manifest_.find(source.relative);
+    struct stat st {};
+    bool reusable = old != manifest_.end() && stat(output.c_str(), &st) == 0;
+    if (reusable && old->second.size == source.size && old->second.mtime_ns == source.mtime_ns &&
+        links_current(source, old->second)) {
+        entry = old->second;
+        return Outcome::Unchanged;
+    }
+
+    std::string contents;
+    if (!read_file(source.path, source.size, contents)) {
+        std::cerr << "Error reading file for export: " << source.path << std::endl;
+        return Outcome::Failed;
+    }
+    entry.size = source.size;
+    entry.mtime_ns = source.mtime_ns;
+    entry.hash = ContentHash::hash(contents.data(), contents.size());
+    // Touched but not changed
+    if (reusable && old->second.hash == entry.hash && links_current(source, old->second)) {
+        entry.links = old->second.links;
+        return Outcome::Unchanged;
+    }
+
+    if (source.note) {
+        contents = render_page(source, std::move(contents), entry.links);
+    }
+    std::error_code ec;
+    std::filesystem::create_directories(std::filesystem::path(output).parent_path(), ec);
+    std::string error;
+    if (!SaveQueue::write_atomically(output, contents, error, nullptr, false)) {
+        std::cerr << "Error writing export: " << output << ": " << error << std::endl;
+        return Outcome::Failed;
+    }
+    return source.note ? Outcome::Rendered : Outcome::Copied;
+}
+
+std::string SiteExporter::render_page(const Source& source, std::string text, std::vector<RenderedLink>& links) const {
+    TextDecoder decoder(detect_encoding(text.data(), text.size()));
+    std::string carry;
+    decoder.decode(text, carry, true);
+
+    std::string title;
+    std::string body = render_markdown_html(text, [&](const NoteLink& link) {
+        std::string resolved = resolve_relative(source, link);
+        bool seen = std::any_of(links.begin(), links.end(), [&link](const RenderedLink& known) {
+            return known.link.kind == link.kind && known.link.target == link.target;
+        });
+        if (!seen) {
+            links.push_back({link, resolved});
+        }
+        return resolved.empty() ? resolved : relative_href(source.relative, output_relative(resolved));
+    }, &title);
+    if (title.empty()) {
+        title = std::filesystem::path(source.relative).stem().string();
+    }
+
+    std::string page;
+    page.reserve(body.size() + 256);
+    page += "<!DOCTYPE html>\n<html>\n<head>\n<meta charset=\"utf-8\">\n";
+    page += "<meta name=\"viewport\" content=\"width=device-width, initial-scale=1\">\n";
+    page += "<title>" + html_escape(title) + "</title>\n";
+    page += "</head>\n<body>\n<article>\n";
+    page += body;
+    page += "</article>\n</body>\n</html>\n";
+    return page;
+}
+
+bool SiteExporter::links_current(const Source& source, const Entry& entry) const {
+    for (const RenderedLink& rendered : entry.links) {
+        if (resolve_relative(source, rendered.link) != rendered.resolved) {
+            return false;
+        }
+    }
+    return true;
+}
+
+std::string SiteExporter::resolve_relative(const Source& source, const NoteLink& link) const {
+    std::string resolved = resolver_.resolve(source.path, link);
+    return resolved.empty() ? resolved : resolved.substr(root_.native().size() + 1);
+}
+
+std::string SiteExporter::output_path(const std::string& relative) const {
+    return (out_ / output_relative(relative)).string();
+}
+
+std::string SiteExporter::output_relative(const std::string& relative) {
+    if (!LinkGraph::is_note(relative)) {
+        return relative;
+    }
+    return relative.substr(0, relative.rfind('.')) + ".html";
+}
+
+std::string SiteExporter::relative_href(std::string_view from_relative, std::string_view to_relative) {
+    // Skip the folders both share, then climb out of the rest of from's
+    size_t common = 0;
+    for (size_t i = 0; i < from_relative.size() && i < to_relative.size() && from_relative[i] == to_relative[i]; i++) {
+        if (from_relative[i] == '/') {
+            common = i + 1;
+        }
+    }
+    std::string href;
+    for (size_t i = common; i < from_relative.size(); i++) {
+        if (from_relative[i] == '/') {
+            href += "../";
+        }
+    }
+
+    static const char hex[] = "0123456789ABCDEF";
+    for (char c : to_relative.substr(common)) {
+        unsigned char u = static_cast<unsigned char>(c);
+        if (std::isalnum(u) || std::strchr("-._~/", c)) {
+            href.push_back(c);
+        } else {
+            href.push_back('%');
+            href.push_back(hex[u >> 4]);
+            href.push_back(hex[u & 15]);
+        }
+    }
+    return href;
+}
+
+void SiteExporter::load_manifest() {
+    manifest_.clear();
+    std::ifstream file(manifest_path_, std::ios::binary);
+    if (!file) {
+        return;
+    }
+    std::stringstream buffer;
+    buffer << file.rdbuf();
+    std::string data = buffer.str();
+    if (data.size() < sizeof(kMagic) || std::memcmp(data.data(), kMagic, sizeof(kMagic)) != 0) {
+        std::cerr << "Ignoring outdated export manifest: " << manifest_path_ << std::endl;
+        return;
+    }
+
+    size_t pos = sizeof(kMagic);
+    while (pos < data.size()) {
+        std::string relative;
+        Entry entry;
+        uint32_t count;
+        if (!get_string(data, pos, relative) || !get(data, pos, entry.size) || !get(data, pos, entry.mtime_ns) ||
+            !get(data, pos, entry.hash) || !get(data, pos, count)) {
+            break;
+        }
+        bool complete = true;
+        for (uint32_t i = 0; i < count && complete; i++) {
+            uint8_t kind = NoteLink::Wiki;
+            RenderedLink rendered{{NoteLink::Wiki, {}}, {}};
+            complete = get(data, pos, kind) && get_string(data, pos, rendered.link.target) &&
+                       get_string(data, pos, rendered.resolved);
+            if (complete) {
+                rendered.link.kind = kind == NoteLink::Path ? NoteLink::Path : NoteLink::Wiki;
+                entry.links.push_back(std::move(rendered));
+            }
+        }
+        if (!complete) {
+            break;
+        }
+        manifest_[relative] = std::move(entry);
+    }
+}
+
+// Sources that failed are left out, so they are exported again next time
+bool SiteExporter::save_manifest(const std::vector<Source>& sources, const std::vector<Entry>& entries,
+                                 const std::vector<Outcome>& outcomes) {
+    std::string data(kMagic, sizeof(kMagic));
+    for (size_t i = 0; i < sources.size(); i++) {
+        if (outcomes[i] == Outcome::Failed) {
+            continue;
+        }
+        const Entry& entry = entries[i];
+        put_string(data, sources[i].relative);
+        put_u64(data, entry.size);
+        put_u64(data, static_cast<uint64_t>(entry.mtime_ns));
+        put_u64(data, entry.hash);
+        put_u32(data, static_cast<uint32_t>(entry.links.size()));
+        for (const RenderedLink& rendered : entry.links) {
+            data.push_back(static_cast<char>(rendered.link.kind));
+            put_string(data, rendered.link.target);
+            put_string(data, rendered.resolved);
+        }
+    }
+
+    std::error_code ec;
+    std::filesystem::create_directories(out_, ec);
+    std::string error;
+    if (!SaveQueue::write_atomically(manifest_path_, data, error)) {
+        std::cerr << "Error writing export manifest: " << manifest_path_ << ": " << error << std::endl;
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,93 @@
+#ifndef SITE_EXPORT_H
+#define SITE_EXPORT_H
+
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "ignore_rules.h"
+#include "link_graph.h"
+
+struct ExportStats {
+    size_t notes = 0;
+    // Everything else in the workspace, copied along as is
+    size_t files = 0;
+    size_t rendered = 0;
+    size_t copied = 0;
+    // Outputs of sources that are gone
+    size_t removed = 0;
+    size_t failed = 0;
+    // Entries the ignore rules left out of the walk
+    size_t pruned = 0;
+};
+
+// Exports the workspace as a static site: every note becomes an HTML page at the same
+// relative path, other files are copied, and links between notes point at the pages.
+// Files are exported in parallel on a WorkPool and every output is written atomically.
+//
+// A manifest in the output folder keeps each source's size, mtime and ContentHash, and
+// for notes every link with what it resolved to. A re-export only reads sources whose
+// size or mtime changed and only writes those whose hash did. An unchanged note is
+// rendered again only when one of its links now resolves elsewhere, e.g. because the
+// note it pointed to was added, moved or removed.
+class SiteExporter {
+public:
+    SiteExporter(const std::filesystem::path& root, const std::filesystem::path& out_dir,
+                 std::shared_ptr<const IgnoreRules> rules = nullptr);
+
+    // threads == 0 uses one per core. Returns false if anything couldn't be exported;
+    // those files are tried again next time.
+    bool run(ExportStats& stats, size_t threads = 0);
+
+private:
+    enum class Outcome { Unchanged, Rendered, Copied, Failed };
+
+    struct Source {
+        std::string path;
+        std::string relative;
+        uint64_t size = 0;
+        int64_t mtime_ns = 0;
+        bool note = false;
+    };
+
+    struct RenderedLink {
+        NoteLink link;
+        // Relative to root, "" if it didn't resolve
+        std::string resolved;
+    };
+
+    struct Entry {
+        uint64_t size = 0;
+        int64_t mtime_ns = 0;
+        uint64_t hash = 0;
+        std::vector<RenderedLink> links;
+    };
+
+    std::filesystem::path root_;
+    std::filesystem::path out_;
+    std::shared_ptr<const IgnoreRules> rules_;
+    std::string manifest_path_;
+    // By relative path; only read while files are being exported
+    std::unordered_map<std::string, Entry> manifest_;
+    LinkResolver resolver_;
+
+    Outcome export_file(const Source& source, Entry& entry) const;
+    std::string render_page(const Source& source, std::string text, std::vector<RenderedLink>& links) const;
+    bool links_current(const Source& source, const Entry& entry) const;
+    std::string resolve_relative(const Source& source, const NoteLink& link) const;
+    std::string output_path(const std::string& relative) const;
+    void load_manifest();
+    bool save_manifest(const std::vector<Source>& sources, const std::vector<Entry>& entries,
+                       const std::vector<Outcome>& outcomes);
+
+    // Where relative ends up in the site: notes get .html instead of their extension
+    static std::string output_relative(const std::string& relative);
+    // URL of to_relative from a page at from_relative, both relative to the site root
+    static std::string relative_href(std::string_view from_relative, std::string_view to_relative);
+};
+
+#endif // SITE_EXPORT_H
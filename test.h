@@ -0,0 +1,93 @@
+#ifndef TEST_H
+#define TEST_H
+
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+// The small harness behind librenote_tests. Each test_*.cpp defines its tests with
+// TEST(suite, name) { ... } and checks with CHECK / CHECK_EQ; a failed check is
+// reported with its line and the test carries on.
+
+struct TestCase {
+    const char* suite;
+    const char* name;
+    void (*run)();
+};
+
+std::vector<TestCase>& test_registry();
+// Failed checks so far, over all tests
+extern size_t test_failures;
+
+struct TestRegistrar {
+    TestRegistrar(const char* suite, const char* name, void (*run)()) {
+        test_registry().push_back({suite, name, run});
+    }
+};
+
+#define TEST(suite, name)                                                                   \
+    static void test_##suite##_##name();                                                   \
+    static TestRegistrar test_##suite##_##name##_registrar(#suite, #name, test_##suite##_##name); \
+    static void test_##suite##_##name()
+
+#define CHECK(condition)                                                                   \
+    do {                                                                                   \
+        if (!(condition)) {                                                                \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": CHECK(" #condition ") failed" << std::endl; \
+            test_failures++;                                                               \
+        }                                                                                  \
+    } while (false)
+
+#define CHECK_EQ(actual, expected)                                                         \
+    do {                                                                                   \
+        if (!((actual) == (expected))) {                                                   \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": " #actual " is " << (actual)    \
+                      << ", expected " << (expected) << std::endl;                         \
+            test_failures++;                                                               \
+        }                                                                                  \
+    } while (false)
+
+// Up to max_len characters drawn from alphabet
+inline std::string random_text(std::mt19937& rng, size_t max_len, const char* alphabet) {
+    size_t alphabet_len = std::strlen(alphabet);
+    std::string text(rng() % (max_len + 1), ' ');
+    for (char& c : text) {
+        c = alphabet[rng() % alphabet_len];
+    }
+    return text;
+}
+
+// A fresh directory under the system temp dir, removed again on destruction
+class TempDir {
+public:
+    TempDir() {
+        std::string name = (std::filesystem::temp_directory_path() / "librenote-test-XXXXXX").string();
+        if (mkdtemp(&name[0])) {
+            path_ = name;
+        }
+    }
+    ~TempDir() {
+        std::error_code ec;
+        std::filesystem::remove_all(path_, ec);
+    }
+
+    const std::filesystem::path& path() const { return path_; }
+    std::string file(const std::string& name) const { return (path_ / name).string(); }
+
+private:
+    std::filesystem::path path_;
+};
+
+// Creates the folders above path as needed
+inline void write_file(const std::string& path, const std::string& data) {
+    std::error_code ec;
+    std::filesystem::create_directories(std::filesystem::path(path).parent_path(), ec);
+    std::ofstream(path, std::ios::binary) << data;
+}
+
+#endif // TEST_H
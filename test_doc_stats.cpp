@@ -0,0 +1,45 @@
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "doc_stats.h"
+#include "piece_table.h"
+#include "test.h"
+
+TEST(doc_stats, counts) {
+    CHECK_EQ(DocStats::count_words(""), 0u);
+    CHECK_EQ(DocStats::count_words("  one\ttwo\nthree  "), 3u);
+    CHECK_EQ(DocStats::count_words("caf\xc3\xa9 na\xc3\xafve"), 2u);
+    // Longer than one SSE block, with a word across the boundary
+    CHECK_EQ(DocStats::count_words("aaaaaaaaaaaaaaa bbbbbbbbbbbbbbbbbbbbbbbb c"), 3u);
+    CHECK_EQ(DocStats::reading_minutes(0), 0u);
+    CHECK_EQ(DocStats::reading_minutes(201), 2u);
+}
+
+TEST(doc_stats, random) {
+    std::mt19937 rng(5);
+    PieceTable document;
+    DocStats stats;
+    std::string text;
+    for (int i = 0; i < 5000; i++) {
+        if (!text.empty() && rng() % 3 == 0) {
+            size_t offset = rng() % text.size();
+            size_t len = 1 + rng() % std::min<size_t>(text.size() - offset, 8);
+            std::string erased = text.substr(offset, len);
+            stats.erase(document, offset, erased);
+            document.erase(offset, len);
+            text.erase(offset, len);
+        } else {
+            size_t offset = rng() % (text.size() + 1);
+            std::string inserted = random_text(rng, 40, "ab \n\t");
+            stats.insert(document, offset, inserted);
+            document.insert(offset, inserted);
+            text.insert(offset, inserted);
+        }
+        if (stats.words() != DocStats::count_words(text)) {
+            CHECK_EQ(stats.words(), DocStats::count_words(text));
+            break;
+        }
+    }
+}
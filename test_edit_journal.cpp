@@ -0,0 +1,166 @@
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "edit_journal.h"
+#include "text_encoding.h"
+#include "test.h"
+
+namespace {
+
+// Journals the edits that turn "café crème" into "café X crèmes", crashes (drops the
+// journal without saving) and recovers
+std::vector<RecoveredFile> edit_and_recover(const TempDir& dir, const std::string& file_path) {
+    {
+        EditJournal journal;
+        journal.open(dir.file("journal"));
+        journal.record_insert(file_path, 10, "s");
+        journal.record_insert(file_path, 5, "Y X ");
+        journal.record_delete(file_path, 5, 2);
+    }
+    EditJournal journal;
+    return journal.open(dir.file("journal"));
+}
+
+} // namespace
+
+TEST(edit_journal, replays_unsaved_edits) {
+    TempDir dir;
+    std::string file_path = dir.file("notes.md");
+    write_file(file_path, "hello");
+    {
+        EditJournal journal;
+        journal.open(dir.file("journal"));
+        journal.record_insert(file_path, 5, " world");
+        uint64_t checkpoint = journal.checkpoint(file_path);
+        write_file(file_path, "hello world");
+        journal.mark_saved(file_path, checkpoint);
+        // Only these are still unsaved
+        journal.record_insert(file_path, 11, "!");
+        journal.record_delete(file_path, 0, 1);
+    }
+    // A crash mid-append leaves a torn record at the end
+    std::ofstream(dir.file("journal"), std::ios::binary | std::ios::app) << std::string("\x02\x01\x00", 3);
+
+    EditJournal journal;
+    std::vector<RecoveredFile> recovered = journal.open(dir.file("journal"));
+    CHECK_EQ(recovered.size(), 1u);
+    if (!recovered.empty()) {
+        CHECK_EQ(recovered[0].text, "ello world!");
+    }
+}
+
+TEST(edit_journal, drops_saved_and_discarded_files) {
+    TempDir dir;
+    std::string saved = dir.file("saved.md");
+    std::string closed = dir.file("closed.md");
+    std::string changed = dir.file("changed.md");
+    write_file(saved, "a");
+    write_file(closed, "b");
+    write_file(changed, "c");
+    {
+        EditJournal journal;
+        journal.open(dir.file("journal"));
+        journal.record_insert(saved, 1, "x");
+        journal.record_insert(closed, 1, "y");
+        journal.record_insert(changed, 1, "z");
+        uint64_t checkpoint = journal.checkpoint(saved);
+        write_file(saved, "ax");
+        journal.mark_saved(saved, checkpoint);
+        journal.discard(closed);
+        // Changed behind the journal's back: the offsets no longer apply
+        write_file(changed, "something else");
+    }
+
+    EditJournal journal;
+    CHECK(journal.open(dir.file("journal")).empty());
+}
+
+TEST(edit_journal, compacts_saved_edits) {
+    TempDir dir;
+    std::string big = dir.file("big.md");
+    std::string small = dir.file("small.md");
+    write_file(big, "");
+    write_file(small, "small");
+    std::string journal_path = dir.file("journal");
+    {
+        EditJournal journal;
+        journal.open(journal_path);
+        std::string line(1023, 'x');
+        line += '\n';
+        for (size_t i = 0; i < 400; i++) {
+            journal.record_insert(big, i * line.size(), line);
+        }
+        journal.record_insert(small, 5, " note");
+        uint64_t checkpoint = journal.checkpoint(big);
+        write_file(big, std::string(400 * line.size(), 'x'));
+        journal.mark_saved(big, checkpoint);
+        journal.flush();
+        // Only the small file's edits are left
+        CHECK(std::filesystem::file_size(journal_path) < 1024);
+    }
+
+    EditJournal journal;
+    std::vector<RecoveredFile> recovered = journal.open(journal_path);
+    CHECK_EQ(recovered.size(), 1u);
+    if (!recovered.empty()) {
+        CHECK_EQ(recovered[0].file_path, small);
+        CHECK_EQ(recovered[0].text, "small note");
+    }
+}
+
+TEST(edit_journal, recovers_latin1) {
+    TempDir dir;
+    std::string file_path = dir.file("latin1.txt");
+    write_file(file_path, "caf\xe9 cr\xe8me");
+
+    std::vector<RecoveredFile> recovered = edit_and_recover(dir, file_path);
+    CHECK_EQ(recovered.size(), 1u);
+    if (!recovered.empty()) {
+        CHECK_EQ(recovered[0].file_path, file_path);
+        CHECK_EQ(recovered[0].text, "caf\xc3\xa9 X cr\xc3\xa8mes");
+        CHECK(recovered[0].encoding.charset == Charset::Windows1252);
+    }
+}
+
+TEST(edit_journal, recovers_utf16) {
+    TempDir dir;
+    std::string file_path = dir.file("utf16.txt");
+    TextEncoding utf16{Charset::Utf16LE, true};
+    std::string data;
+    std::string error;
+    CHECK(encode_text("caf\xc3\xa9 cr\xc3\xa8me", utf16, data, error));
+    write_file(file_path, data);
+
+    std::vector<RecoveredFile> recovered = edit_and_recover(dir, file_path);
+    CHECK_EQ(recovered.size(), 1u);
+    if (!recovered.empty()) {
+        CHECK_EQ(recovered[0].text, "caf\xc3\xa9 X cr\xc3\xa8mes");
+        CHECK(recovered[0].encoding.charset == Charset::Utf16LE);
+        CHECK(recovered[0].encoding.bom);
+    }
+}
+
+// What the editor does when a file with unsaved edits changes on disk
+TEST(edit_journal, rebase_on_changed_file) {
+    TempDir dir;
+    std::string file_path = dir.file("notes.md");
+    write_file(file_path, "old text");
+    {
+        EditJournal journal;
+        journal.open(dir.file("journal"));
+        journal.record_insert(file_path, 8, " and mine");
+        write_file(file_path, "new text from elsewhere");
+        journal.discard(file_path);
+        journal.record_delete(file_path, 0, 23);
+        journal.record_insert(file_path, 0, "old text and mine");
+    }
+
+    EditJournal journal;
+    std::vector<RecoveredFile> recovered = journal.open(dir.file("journal"));
+    CHECK_EQ(recovered.size(), 1u);
+    if (!recovered.empty()) {
+        CHECK_EQ(recovered[0].text, "old text and mine");
+    }
+}
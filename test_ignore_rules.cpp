@@ -0,0 +1,81 @@
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "dir_scanner.h"
+#include "ignore_rules.h"
+#include "test.h"
+
+TEST(ignore, globs) {
+    CHECK(IgnoreRules::glob_match("*.log", "debug.log"));
+    CHECK(!IgnoreRules::glob_match("*.log", "logs/debug.txt"));
+    CHECK(!IgnoreRules::glob_match("*", "a/b"));
+    CHECK(IgnoreRules::glob_match("a/**/b", "a/b"));
+    CHECK(IgnoreRules::glob_match("a/**/b", "a/x/y/b"));
+    CHECK(IgnoreRules::glob_match("**/b", "x/b"));
+    CHECK(IgnoreRules::glob_match("file?.md", "file1.md"));
+    CHECK(!IgnoreRules::glob_match("file?.md", "file10.md"));
+    CHECK(IgnoreRules::glob_match("[a-c]x", "bx"));
+    CHECK(!IgnoreRules::glob_match("[!a-c]x", "bx"));
+    CHECK(IgnoreRules::glob_match("\\*star", "*star"));
+    CHECK(!IgnoreRules::glob_match("\\*star", "xstar"));
+}
+
+TEST(ignore, rules) {
+    IgnoreRules rules("/workspace");
+    // Built in
+    CHECK(rules.is_ignored(".git", true));
+    CHECK(!rules.is_ignored(".git", false));
+    CHECK(rules.is_ignored("notes/a.md.librenote-partial", false));
+
+    rules.add_rules("# comment\n"
+                    "*.log\n"
+                    "!keep.log\n"
+                    "build/\n"
+                    "/todo.md\n"
+                    "docs/*.tmp\n"
+                    "node_modules\n");
+    CHECK(rules.is_ignored("debug.log", false));
+    CHECK(rules.is_ignored("deep/in/debug.log", false));
+    CHECK(!rules.is_ignored("keep.log", false));
+    CHECK(rules.is_ignored("build", true));
+    CHECK(!rules.is_ignored("build", false));
+    CHECK(rules.is_ignored("todo.md", false));
+    CHECK(!rules.is_ignored("notes/todo.md", false));
+    CHECK(rules.is_ignored("docs/x.tmp", false));
+    CHECK(!rules.is_ignored("other/docs/x.tmp", false));
+    CHECK(rules.is_ignored("a/node_modules", true));
+    CHECK(!rules.is_ignored("# comment", false));
+
+    // Later rules win
+    rules.add_rules("!debug.log\n");
+    CHECK(!rules.is_ignored("debug.log", false));
+
+    // Paths that didn't come from a walk also check the folders above
+    CHECK(!rules.is_ignored("build/out.md", false));
+    CHECK(rules.is_ignored_path("build/out.md", false));
+    CHECK(rules.is_ignored_absolute("/workspace/build/out.md", false));
+    CHECK(!rules.is_ignored_absolute("/elsewhere/build/out.md", false));
+}
+
+TEST(ignore, walk_files) {
+    TempDir dir;
+    for (const char* name : {"a.md", ".hidden/b.md", "sub/c.log", ".git/HEAD", ".librenote/journal",
+                             "sub/d.md.librenote-partial", "build/e.md"}) {
+        write_file(dir.file(name), "x");
+    }
+    IgnoreRules rules(dir.path());
+    rules.add_rules("*.log\nbuild/\n");
+
+    std::vector<std::string> files;
+    size_t root_length = dir.path().native().size() + 1;
+    size_t pruned = DirScanner::walk_files(dir.path(), [&](const std::filesystem::path& path, const struct stat&) {
+        files.push_back(path.native().substr(root_length));
+        return true;
+    }, &rules);
+    std::sort(files.begin(), files.end());
+
+    // Hidden folders are walked unless a rule says otherwise
+    CHECK(files == std::vector<std::string>({".hidden/b.md", "a.md"}));
+    CHECK_EQ(pruned, 5u);
+}
@@ -0,0 +1,73 @@
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "line_diff.h"
+#include "test.h"
+
+namespace {
+
+std::string apply_edits(std::string text, const std::vector<TextEdit>& edits) {
+    for (auto it = edits.rbegin(); it != edits.rend(); ++it) {
+        text.replace(it->offset, it->length, it->text);
+    }
+    return text;
+}
+
+std::string random_lines(std::mt19937& rng, size_t max_lines) {
+    static const char* const kLines[] = {"alpha\n", "beta\n", "gamma\n", "delta\n", "\n", "epsilon\n"};
+    std::string text;
+    size_t lines = rng() % (max_lines + 1);
+    for (size_t i = 0; i < lines; i++) {
+        text += kLines[rng() % 6];
+    }
+    if (rng() % 2 == 0) {
+        // No newline at the end
+        text += "omega";
+    }
+    return text;
+}
+
+} // namespace
+
+TEST(line_diff, random) {
+    std::mt19937 rng(3);
+    for (int round = 0; round < 500; round++) {
+        std::string old_text = random_lines(rng, 30);
+        std::string new_text = rng() % 3 == 0 ? random_lines(rng, 30) : old_text;
+        // Mostly small edits to the same text, as a reload usually is
+        for (int i = rng() % 4; i > 0; i--) {
+            size_t at = new_text.empty() ? 0 : rng() % new_text.size();
+            at = new_text.rfind('\n', at) == std::string::npos ? 0 : new_text.rfind('\n', at) + 1;
+            new_text.insert(at, rng() % 2 ? "inserted\n" : "");
+        }
+
+        std::vector<TextEdit> edits = line_diff(old_text, new_text);
+        CHECK(apply_edits(old_text, edits) == new_text);
+        for (size_t i = 1; i < edits.size(); i++) {
+            CHECK(edits[i - 1].offset + edits[i - 1].length <= edits[i].offset);
+        }
+        // A tiny change budget still gives a correct, if coarser, result
+        CHECK(apply_edits(old_text, line_diff(old_text, new_text, 1)) == new_text);
+    }
+
+    CHECK(line_diff("same\ntext\n", "same\ntext\n").empty());
+    std::vector<TextEdit> edits = line_diff("a\nb\nc\n", "a\nB\nc\n");
+    CHECK_EQ(edits.size(), 1u);
+    if (edits.size() == 1) {
+        CHECK_EQ(edits[0].offset, 2u);
+        CHECK_EQ(edits[0].length, 2u);
+        CHECK_EQ(edits[0].text, "B\n");
+    }
+}
+
+TEST(line_diff, counts_characters) {
+    // Offsets are in characters, as the buffer counts them
+    std::vector<TextEdit> edits = line_diff("\xc3\xa9t\xc3\xa9\nx\n", "\xc3\xa9t\xc3\xa9\ny\n");
+    CHECK_EQ(edits.size(), 1u);
+    if (edits.size() == 1) {
+        CHECK_EQ(edits[0].offset, 4u);
+        CHECK_EQ(edits[0].length, 2u);
+    }
+}
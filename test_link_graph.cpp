@@ -0,0 +1,83 @@
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "link_graph.h"
+#include "test.h"
+
+namespace {
+
+std::string describe(const std::vector<NoteLink>& links) {
+    std::string out;
+    for (const NoteLink& link : links) {
+        out += (link.kind == NoteLink::Wiki ? "wiki:" : "path:") + link.target + ";";
+    }
+    return out;
+}
+
+} // namespace
+
+TEST(link_graph, parse_links) {
+    CHECK_EQ(describe(LinkGraph::parse_links("See [[Some note|alias]] and [[other#part]].")),
+             "wiki:Some note;wiki:other;");
+    CHECK_EQ(describe(LinkGraph::parse_links("[a](../a.md#x) [b](<with space.md>) [c](c.md \"title\")")),
+             "path:../a.md#x;path:with space.md;path:c.md;");
+    // External links, anchors, code spans and fenced code don't count
+    CHECK_EQ(describe(LinkGraph::parse_links("[w](https://x.org) [m](mailto:a@b) [h](#top) `[[code]]`\n"
+                                             "```\n[[fenced]]\n```\n[[after]]")),
+             "wiki:after;");
+    CHECK_EQ(describe(LinkGraph::parse_links("[[]] [[ unterminated")), "");
+}
+
+TEST(link_graph, resolver) {
+    LinkResolver resolver;
+    resolver.set_root("/w");
+    for (const char* file : {"/w/a.md", "/w/notes/Plan.md", "/w/other/plan.md", "/w/img/pic.png", "/w/notes/b c.md",
+                             "/w/d.markdown"}) {
+        resolver.add_file(file);
+    }
+    const std::string source = "/w/notes/index.md";
+    CHECK_EQ(resolver.resolve(source, {NoteLink::Path, "../a.md"}), "/w/a.md");
+    CHECK_EQ(resolver.resolve(source, {NoteLink::Path, "/a"}), "/w/a.md");
+    CHECK_EQ(resolver.resolve(source, {NoteLink::Path, "b%20c.md#top"}), "/w/notes/b c.md");
+    CHECK_EQ(resolver.resolve(source, {NoteLink::Path, "missing.md"}), "");
+    CHECK_EQ(resolver.resolve(source, {NoteLink::Path, "../d"}), "/w/d.markdown");
+    // Same name in two folders: the source's own folder wins, unless the link says otherwise
+    CHECK_EQ(resolver.resolve(source, {NoteLink::Wiki, "PLAN"}), "/w/notes/Plan.md");
+    CHECK_EQ(resolver.resolve(source, {NoteLink::Wiki, "other/plan"}), "/w/other/plan.md");
+    CHECK_EQ(resolver.resolve(source, {NoteLink::Wiki, "pic.png"}), "/w/img/pic.png");
+
+    resolver.remove_file("/w/notes/Plan.md");
+    CHECK_EQ(resolver.resolve(source, {NoteLink::Wiki, "plan"}), "/w/other/plan.md");
+}
+
+TEST(link_graph, backlinks) {
+    TempDir dir;
+    write_file(dir.file("a.md"), "[to b](b) and [[C]] and [to d](d)\n");
+    write_file(dir.file("b.md"), "[back](a.md)\n");
+    write_file(dir.file("sub/c.md"), "nothing\n");
+    write_file(dir.file("d.markdown"), "nothing\n");
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool notified = false;
+    LinkGraph graph;
+    graph.set_notify([&]() {
+        std::lock_guard<std::mutex> lock(mutex);
+        notified = true;
+        cv.notify_all();
+    });
+    graph.open(dir.file(".librenote/links"), dir.path());
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        CHECK(cv.wait_for(lock, std::chrono::seconds(10), [&] { return notified; }));
+    }
+
+    CHECK(graph.backlinks(dir.file("a.md")) == std::vector<std::string>{dir.file("b.md")});
+    // Reached through an extensionless path link
+    CHECK(graph.backlinks(dir.file("b.md")) == std::vector<std::string>{dir.file("a.md")});
+    CHECK(graph.backlinks(dir.file("sub/c.md")) == std::vector<std::string>{dir.file("a.md")});
+    CHECK(graph.backlinks(dir.file("d.markdown")) == std::vector<std::string>{dir.file("a.md")});
+}
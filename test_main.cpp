@@ -0,0 +1,33 @@
+// Unit tests for the GTK-free core. Run librenote_tests (or ctest); it prints each
+// failed check and exits non-zero if there was one. Randomised tests use fixed seeds,
+// so a failure reproduces on every run.
+//
+//     librenote_tests [filter]
+//
+// The filter picks the tests whose "suite.name" contains it.
+
+#include "test.h"
+
+size_t test_failures = 0;
+
+std::vector<TestCase>& test_registry() {
+    static std::vector<TestCase> tests;
+    return tests;
+}
+
+int main(int argc, char** argv) {
+    const char* filter = argc > 1 ? argv[1] : "";
+    size_t run = 0;
+    for (const TestCase& test : test_registry()) {
+        std::string name = std::string(test.suite) + "." + test.name;
+        if (name.find(filter) == std::string::npos) {
+            continue;
+        }
+        size_t before = test_failures;
+        test.run();
+        run++;
+        std::cout << (test_failures == before ? "ok   " : "FAIL ") << name << std::endl;
+    }
+    std::cout << run << " tests, " << test_failures << " failed checks" << std::endl;
+    return test_failures == 0 ? 0 : 1;
+}
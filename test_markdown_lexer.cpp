@@ -0,0 +1,74 @@
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "markdown_lexer.h"
+#include "test.h"
+
+namespace {
+
+// "Style start-end" for each span of the line, e.g. "Code 2-7 Link 9-15"
+std::string lex(std::string_view line, MdLineState state = {}, MdLineState* next = nullptr) {
+    static const char* const kNames[] = {"H1", "H2", "H3", "Emphasis", "Strong", "Code", "CodeBlock", "Link", "Quote", "List"};
+    std::vector<MdSpan> spans;
+    MdLineState after = lex_markdown_line(line, state, spans);
+    if (next) {
+        *next = after;
+    }
+    std::string out;
+    for (const MdSpan& span : spans) {
+        out += (out.empty() ? "" : " ") + std::string(kNames[static_cast<int>(span.style)]) + " " +
+               std::to_string(span.start) + "-" + std::to_string(span.end);
+    }
+    return out;
+}
+
+} // namespace
+
+TEST(markdown_lexer, blocks) {
+    CHECK_EQ(lex("# Title"), "H1 0-7");
+    CHECK_EQ(lex("### `x`"), "H3 0-7 Code 4-7");
+    CHECK_EQ(lex("#hashtag"), "");
+    CHECK_EQ(lex("> quoted"), "Quote 0-8");
+    CHECK_EQ(lex("- item"), "List 0-1");
+    CHECK_EQ(lex("  12. item"), "List 2-5");
+    CHECK_EQ(lex("-not a list"), "");
+}
+
+TEST(markdown_lexer, inline_spans) {
+    CHECK_EQ(lex("a *em* b"), "Emphasis 2-6");
+    CHECK_EQ(lex("**strong** and __also__"), "Strong 0-10 Strong 15-23");
+    CHECK_EQ(lex("snake_case_name"), "");
+    CHECK_EQ(lex("a * b * c"), "");
+    CHECK_EQ(lex("``code with ` inside``"), "Code 0-22");
+    CHECK_EQ(lex("`*not em*`"), "Code 0-10");
+    CHECK_EQ(lex("\\*escaped*"), "");
+    CHECK_EQ(lex("see [[Note]] or [x](y.md) ![i](p.png)"), "Link 4-12 Link 16-25 Link 26-37");
+    CHECK_EQ(lex("[just brackets]"), "");
+}
+
+TEST(markdown_lexer, fences) {
+    MdLineState state;
+    CHECK_EQ(lex("```cpp", state, &state), "CodeBlock 0-6");
+    CHECK(state.fence == '`');
+    CHECK_EQ(lex("# not a heading", state, &state), "CodeBlock 0-15");
+    // A tilde fence doesn't close a backtick one
+    CHECK_EQ(lex("~~~", state, &state), "CodeBlock 0-3");
+    CHECK(state.fence == '`');
+    CHECK_EQ(lex("```", state, &state), "CodeBlock 0-3");
+    CHECK(!state.in_fence());
+    CHECK_EQ(lex("~~~~", state, &state), "CodeBlock 0-4");
+    CHECK(state.fence == '~');
+}
+
+TEST(markdown_lexer, fence_length) {
+    MdLineState state;
+    CHECK_EQ(lex("````md", state, &state), "CodeBlock 0-6");
+    // A shorter run is code inside the block, a longer one closes it
+    CHECK_EQ(lex("```", state, &state), "CodeBlock 0-3");
+    CHECK(state.in_fence());
+    CHECK_EQ(lex("# still code", state, &state), "CodeBlock 0-12");
+    CHECK_EQ(lex("`````", state, &state), "CodeBlock 0-5");
+    CHECK(!state.in_fence());
+    CHECK_EQ(lex("# Title", state, &state), "H1 0-7");
+}
@@ -0,0 +1,74 @@
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "piece_table.h"
+#include "test.h"
+
+TEST(piece_table, random) {
+    std::mt19937 rng(11);
+    PieceTable document;
+    std::string text;
+    PieceTable::Snapshot snapshot;
+    std::string snapshot_text;
+    for (int i = 0; i < 3000; i++) {
+        if (!text.empty() && rng() % 3 == 0) {
+            size_t offset = rng() % text.size();
+            size_t len = rng() % std::min<size_t>(text.size() - offset + 1, 50);
+            document.erase(offset, len);
+            text.erase(offset, len);
+        } else {
+            size_t offset = rng() % (text.size() + 1);
+            std::string inserted = random_text(rng, rng() % 10 == 0 ? 5000 : 20, "ab\n ");
+            document.insert(offset, inserted);
+            text.insert(offset, inserted);
+        }
+        if (i % 500 == 0) {
+            snapshot = document.snapshot();
+            snapshot_text = text;
+        }
+        if (i % 100 == 0) {
+            CHECK_EQ(document.size(), text.size());
+            CHECK(document.substr(0, document.size()) == text);
+            size_t offset = text.empty() ? 0 : rng() % text.size();
+            CHECK(document.substr(offset, 70) == text.substr(offset, 70));
+        }
+    }
+    CHECK(document.substr(0, document.size()) == text);
+    // Later edits never show through an older snapshot
+    CHECK(snapshot.text() == snapshot_text);
+
+    size_t newlines = std::count(text.begin(), text.end(), '\n');
+    CHECK_EQ(document.line_count(), newlines + 1);
+    size_t line = 0;
+    for (size_t offset = 0; offset <= text.size(); offset++) {
+        if (offset == 0 || text[offset - 1] == '\n') {
+            CHECK_EQ(document.line_start(line), offset);
+            line++;
+        }
+        if (offset % 97 == 0) {
+            CHECK_EQ(document.line_at(offset), static_cast<size_t>(std::count(text.begin(), text.begin() + offset, '\n')));
+        }
+    }
+
+    std::string chunks;
+    document.snapshot().for_each_chunk([&](const char* data, size_t len) { chunks.append(data, len); });
+    CHECK(chunks == text);
+
+    document.clear();
+    CHECK(document.empty());
+    CHECK_EQ(document.line_count(), 1u);
+}
+
+TEST(piece_table, utf8) {
+    PieceTable document;
+    // "é" and "€" take two and three bytes
+    document.insert(0, "caf\xc3\xa9 \xe2\x82\xac" "5\n");
+    CHECK_EQ(document.char_count(), 8u);
+    CHECK_EQ(document.byte_offset(4), 5u);
+    CHECK_EQ(document.byte_offset(6), 9u);
+    document.erase(3, 2);
+    CHECK_EQ(document.char_count(), 7u);
+    CHECK_EQ(document.byte_offset(5), 7u);
+}
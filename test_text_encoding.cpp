@@ -0,0 +1,81 @@
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "text_encoding.h"
+#include "test.h"
+
+namespace {
+
+// Decodes data in blocks split at random points, carrying partial characters over
+std::string decode_in_blocks(std::mt19937& rng, const std::string& data, TextEncoding encoding, bool& lossy) {
+    TextDecoder decoder(encoding);
+    std::string out;
+    std::string carry;
+    size_t pos = 0;
+    while (pos < data.size()) {
+        size_t len = std::min<size_t>(1 + rng() % 7, data.size() - pos);
+        std::string block = carry + data.substr(pos, len);
+        pos += len;
+        carry.clear();
+        decoder.decode(block, carry, pos == data.size());
+        out += block;
+    }
+    lossy = decoder.lossy();
+    return out;
+}
+
+} // namespace
+
+TEST(text_encoding, round_trip) {
+    std::mt19937 rng(13);
+    const std::string text = "Gr\xc3\xbc\xc3\x9f" "e \xe2\x82\xac 5, \xf0\x9f\x93\x9d notes\r\nline two\n";
+    const TextEncoding encodings[] = {
+        {Charset::Utf8, false}, {Charset::Utf8, true}, {Charset::Utf16LE, true},
+        {Charset::Utf16LE, false}, {Charset::Utf16BE, true}, {Charset::Utf16BE, false},
+    };
+    for (const TextEncoding& encoding : encodings) {
+        std::string encoded;
+        std::string error;
+        CHECK(encode_text(text, encoding, encoded, error));
+        TextEncoding detected = detect_encoding(encoded.data(), encoded.size());
+        if (encoding.bom || encoding.charset != Charset::Utf8) {
+            CHECK(detected.charset == encoding.charset);
+            CHECK_EQ(detected.bom, encoding.bom);
+        }
+        for (int round = 0; round < 20; round++) {
+            bool lossy = true;
+            CHECK(decode_in_blocks(rng, encoded, encoding, lossy) == text);
+            CHECK(!lossy);
+        }
+    }
+
+    // Windows-1252 only has some of the characters
+    std::string encoded;
+    std::string error;
+    TextEncoding windows{Charset::Windows1252, false};
+    CHECK(encode_text("caf\xc3\xa9 \xe2\x82\xac", windows, encoded, error));
+    CHECK(encoded == "caf\xe9 \x80");
+    bool lossy = true;
+    CHECK(decode_in_blocks(rng, encoded, windows, lossy) == "caf\xc3\xa9 \xe2\x82\xac");
+    CHECK(!encode_text("\xf0\x9f\x93\x9d", windows, encoded, error));
+    // A cut-off UTF-8 sequence at the very end could still be valid, so text follows it
+    CHECK(detect_encoding("caf\xe9 au lait", 12).charset == Charset::Windows1252);
+}
+
+TEST(text_encoding, invalid_utf8) {
+    const char valid[] = "plain ascii text that is longer than sixty-four bytes, to cover the fast path \xc3\xa9";
+    CHECK_EQ(utf8_valid_length(valid, sizeof(valid) - 1), sizeof(valid) - 1);
+    CHECK_EQ(utf8_valid_length("ab\xc3", 3), 2u);
+    CHECK_EQ(utf8_valid_length("ab\xff" "cd", 5), 2u);
+    // Overlong encodings and surrogates aren't UTF-8
+    CHECK_EQ(utf8_valid_length("\xc0\xaf", 2), 0u);
+    CHECK_EQ(utf8_valid_length("\xed\xa0\x80", 3), 0u);
+
+    std::mt19937 rng(21);
+    bool lossy = false;
+    std::string decoded = decode_in_blocks(rng, "a\xff" "b\xc3", TextEncoding(), lossy);
+    CHECK(decoded == "a\xef\xbf\xbd" "b\xef\xbf\xbd");
+    CHECK(lossy);
+}
@@ -0,0 +1,66 @@
+#include <string>
+#include <vector>
+
+#include "test.h"
+#include "tree_snapshot.h"
+
+namespace {
+
+std::vector<SnapshotDir> sample_tree() {
+    std::vector<SnapshotDir> dirs(3);
+    dirs[0].mtime_ns = 1700000000123456789;
+    dirs[0].expanded = true;
+    dirs[0].entries = {{"notes", true}, {"caf\xc3\xa9.md", false}, {"readme.md", false}};
+    dirs[1].relative_path = "notes";
+    dirs[1].mtime_ns = 42;
+    dirs[1].expanded = true;
+    dirs[1].entries = {{"empty", true}};
+    dirs[2].relative_path = "notes/empty";
+    return dirs;
+}
+
+bool same_tree(const std::vector<SnapshotDir>& a, const std::vector<SnapshotDir>& b) {
+    if (a.size() != b.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < a.size(); i++) {
+        if (a[i].relative_path != b[i].relative_path || a[i].mtime_ns != b[i].mtime_ns ||
+            a[i].expanded != b[i].expanded || a[i].entries.size() != b[i].entries.size()) {
+            return false;
+        }
+        for (size_t j = 0; j < a[i].entries.size(); j++) {
+            if (a[i].entries[j].name != b[i].entries[j].name ||
+                a[i].entries[j].is_directory != b[i].entries[j].is_directory) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+} // namespace
+
+TEST(tree_snapshot, round_trip) {
+    std::vector<SnapshotDir> dirs = sample_tree();
+    std::string data = encode_tree_snapshot("/workspace", dirs);
+    std::vector<SnapshotDir> decoded;
+    CHECK(decode_tree_snapshot(data, "/workspace", decoded));
+    CHECK(same_tree(decoded, dirs));
+}
+
+TEST(tree_snapshot, rejects_damage) {
+    std::vector<SnapshotDir> dirs = sample_tree();
+    std::string data = encode_tree_snapshot("/workspace", dirs);
+    std::vector<SnapshotDir> decoded;
+    CHECK(!decode_tree_snapshot(data, "/elsewhere", decoded));
+    CHECK(!decode_tree_snapshot("", "/workspace", decoded));
+    // Cut between two folders it is a smaller tree; anywhere else it is rejected
+    size_t accepted = 0;
+    for (size_t len = 0; len < data.size(); len++) {
+        if (decode_tree_snapshot(std::string_view(data).substr(0, len), "/workspace", decoded)) {
+            CHECK(same_tree(decoded, std::vector<SnapshotDir>(dirs.begin(), dirs.begin() + decoded.size())));
+            accepted++;
+        }
+    }
+    CHECK_EQ(accepted, dirs.size());
+}
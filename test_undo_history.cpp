@@ -0,0 +1,203 @@
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "undo_history.h"
+#include "test.h"
+
+namespace {
+
+// Applies ops the way the editor applies them to its buffer; offsets are in characters,
+// so tests that use this stick to ASCII
+void apply_ops(std::string& text, const std::vector<EditOp>& ops) {
+    for (const EditOp& op : ops) {
+        if (op.kind == EditOp::Insert) {
+            text.insert(op.offset, op.text);
+        } else {
+            text.erase(op.offset, op.text.size());
+        }
+    }
+}
+
+// Types text one character at a time at offset, recording as the editor does
+void type(UndoHistory& history, std::string& text, size_t offset, const std::string& typed) {
+    for (char c : typed) {
+        std::string key(1, c);
+        text.insert(offset, key);
+        history.record_insert(offset++, key);
+    }
+}
+
+size_t count_undo_steps(UndoHistory& history, std::string& text) {
+    std::vector<EditOp> ops;
+    size_t steps = 0;
+    while (history.undo(ops)) {
+        apply_ops(text, ops);
+        steps++;
+    }
+    return steps;
+}
+
+} // namespace
+
+TEST(undo, merges_typing) {
+    UndoHistory history;
+    std::string text;
+    type(history, text, 0, "hello world");
+    // A space after a word starts a new step
+    CHECK_EQ(count_undo_steps(history, text), 2u);
+    CHECK_EQ(text, "");
+
+    // Newlines are steps of their own
+    type(history, text, 0, "ab\ncd");
+    CHECK_EQ(count_undo_steps(history, text), 3u);
+
+    // Backspacing merges backwards
+    text = "abcdef";
+    for (size_t offset = 6; offset > 3; offset--) {
+        std::string erased = text.substr(offset - 1, 1);
+        text.erase(offset - 1, 1);
+        history.record_delete(offset - 1, erased);
+    }
+    CHECK_EQ(text, "abc");
+    CHECK_EQ(count_undo_steps(history, text), 1u);
+    CHECK_EQ(text, "abcdef");
+
+    // break_merge() ends the step even mid-word
+    text.clear();
+    type(history, text, 0, "ab");
+    history.break_merge();
+    type(history, text, 2, "cd");
+    CHECK_EQ(count_undo_steps(history, text), 2u);
+}
+
+TEST(undo, groups) {
+    UndoHistory history;
+    std::string text = "one two";
+    history.begin_group();
+    text.erase(0, 3);
+    history.record_delete(0, "one");
+    text.insert(0, "three");
+    history.record_insert(0, "three");
+    // Nested groups belong to the outer one
+    history.begin_group();
+    text.insert(text.size(), "!");
+    history.record_insert(text.size() - 1, "!");
+    history.end_group();
+    history.end_group();
+    CHECK_EQ(text, "three two!");
+
+    std::vector<EditOp> ops;
+    CHECK(history.undo(ops));
+    CHECK_EQ(ops.size(), 3u);
+    apply_ops(text, ops);
+    CHECK_EQ(text, "one two");
+    CHECK(!history.can_undo());
+
+    CHECK(history.redo(ops));
+    apply_ops(text, ops);
+    CHECK_EQ(text, "three two!");
+    CHECK(!history.can_redo());
+}
+
+TEST(undo, redo_random) {
+    std::mt19937 rng(8);
+    for (int round = 0; round < 50; round++) {
+        UndoHistory history;
+        std::string text = random_text(rng, 40, "abc \n");
+        std::string initial_text = text;
+        for (int i = 0; i < 200; i++) {
+            if (!text.empty() && rng() % 3 == 0) {
+                size_t offset = rng() % text.size();
+                size_t len = 1 + rng() % std::min<size_t>(text.size() - offset, 4);
+                std::string erased = text.substr(offset, len);
+                text.erase(offset, len);
+                history.record_delete(offset, erased);
+            } else {
+                size_t offset = rng() % (text.size() + 1);
+                std::string inserted = random_text(rng, 3, "abc \n");
+                text.insert(offset, inserted);
+                history.record_insert(offset, inserted);
+            }
+            if (rng() % 4 == 0) {
+                history.break_merge();
+            }
+        }
+        std::string final_text = text;
+
+        std::vector<EditOp> ops;
+        size_t steps = 0;
+        while (history.undo(ops)) {
+            apply_ops(text, ops);
+            steps++;
+        }
+        CHECK_EQ(text, initial_text);
+        for (size_t i = 0; i < steps; i++) {
+            CHECK(history.redo(ops));
+            apply_ops(text, ops);
+        }
+        CHECK_EQ(text, final_text);
+        CHECK(!history.can_redo());
+
+        // A new edit after undoing drops what could have been redone
+        CHECK(history.undo(ops));
+        apply_ops(text, ops);
+        text.insert(0, "x");
+        history.record_insert(0, "x");
+        CHECK(!history.can_redo());
+    }
+}
+
+TEST(undo, history_limit) {
+    UndoHistory history(nullptr, 4096);
+    std::string text;
+    for (int i = 0; i < 100; i++) {
+        std::string line = std::string(100, 'a' + i % 26) + "\n";
+        text += line;
+        history.record_insert(text.size() - line.size(), line);
+    }
+    CHECK(history.memory_usage() <= 4096);
+    // The newest steps are the ones kept
+    std::vector<EditOp> ops;
+    CHECK(history.undo(ops));
+    apply_ops(text, ops);
+    CHECK_EQ(text.size(), 99u * 101);
+
+    // An edit bigger than the whole limit can't be undone at all
+    history.record_insert(0, std::string(8192, 'z'));
+    CHECK(!history.can_undo());
+    CHECK_EQ(history.memory_usage(), 0u);
+}
+
+TEST(undo, budget_evicts_oldest) {
+    UndoBudget budget(1 << 20);
+    UndoHistory first(&budget);
+    UndoHistory second(&budget);
+    std::string chunk(1000, 'x');
+    for (int i = 0; i < 5; i++) {
+        first.record_insert(0, chunk);
+        first.break_merge();
+    }
+    for (int i = 0; i < 5; i++) {
+        second.record_insert(0, chunk);
+        second.break_merge();
+    }
+    CHECK_EQ(budget.usage(), first.memory_usage() + second.memory_usage());
+
+    // Room for about six steps: the first history's are the oldest, so they go first
+    budget.set_limit(6 * (first.memory_usage() / 5));
+    CHECK(budget.usage() <= 6 * (chunk.size() + 100));
+    std::string text(10000, 'x');
+    CHECK_EQ(count_undo_steps(second, text), 5u);
+    CHECK(first.can_undo());
+    CHECK(count_undo_steps(first, text) < 5);
+
+    // Histories leave the budget when they go
+    {
+        UndoHistory third(&budget);
+        third.record_insert(0, chunk);
+    }
+    first.clear();
+    CHECK_EQ(budget.usage(), second.memory_usage());
+}
@@ -0,0 +1,417 @@
+#include "text_encoding.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+const char kReplacement[] = "\xef\xbf\xbd";
+
+// Windows-1252 0x80-0x9f; the five unassigned bytes map to the C1 controls so every
+// byte survives a round trip
+const uint16_t kWindows1252High[32] = {
+    0x20ac, 0x0081, 0x201a, 0x0192, 0x201e, 0x2026, 0x2020, 0x2021,
+    0x02c6, 0x2030, 0x0160, 0x2039, 0x0152, 0x008d, 0x017d, 0x008f,
+    0x0090, 0x2018, 0x2019, 0x201c, 0x201d, 0x2022, 0x2013, 0x2014,
+    0x02dc, 0x2122, 0x0161, 0x203a, 0x0153, 0x009d, 0x017e, 0x0178,
+};
+
+// Offset of the first non-ASCII byte at or after i, or len
+inline size_t skip_ascii(const unsigned char* p, size_t i, size_t len) {
+#ifdef __SSE2__
+    for (; i + 64 <= len; i += 64) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i + 16));
+        __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i + 32));
+        __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i + 48));
+        if (_mm_movemask_epi8(_mm_or_si128(_mm_or_si128(a, b), _mm_or_si128(c, d))) != 0) {
+            break;
+        }
+    }
+    for (; i + 16 <= len; i += 16) {
+        int mask = _mm_movemask_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i)));
+        if (mask != 0) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+#endif
+    while (i < len && p[i] < 0x80) {
+        i++;
+    }
+    return i;
+}
+
+// Length of the well-formed sequence at p[i], 0 if it's invalid. Sets incomplete when the
+// bytes up to len are a valid start that the end of the data cut off.
+inline size_t sequence_length(const unsigned char* p, size_t i, size_t len, bool& incomplete) {
+    incomplete = false;
+    unsigned char c = p[i];
+    size_t n;
+    // Second-byte bounds rule out overlong forms, surrogates and code points above U+10FFFF
+    unsigned char lo = 0x80, hi = 0xbf;
+    if (c < 0x80) {
+        return 1;
+    } else if (c >= 0xc2 && c <= 0xdf) {
+        n = 2;
+    } else if (c == 0xe0) {
+        n = 3;
+        lo = 0xa0;
+    } else if (c == 0xed) {
+        n = 3;
+        hi = 0x9f;
+    } else if (c >= 0xe1 && c <= 0xef) {
+        n = 3;
+    } else if (c == 0xf0) {
+        n = 4;
+        lo = 0x90;
+    } else if (c >= 0xf1 && c <= 0xf3) {
+        n = 4;
+    } else if (c == 0xf4) {
+        n = 4;
+        hi = 0x8f;
+    } else {
+        return 0;
+    }
+
+    for (size_t k = 1; k < n; k++) {
+        if (i + k >= len) {
+            incomplete = true;
+            return 0;
+        }
+        unsigned char next = p[i + k];
+        if (k == 1 ? (next < lo || next > hi) : (next & 0xc0) != 0x80) {
+            return 0;
+        }
+    }
+    return n;
+}
+
+void append_utf8(std::string& out, uint32_t code) {
+    if (code < 0x80) {
+        out += static_cast<char>(code);
+    } else if (code < 0x800) {
+        out += static_cast<char>(0xc0 | (code >> 6));
+        out += static_cast<char>(0x80 | (code & 0x3f));
+    } else if (code < 0x10000) {
+        out += static_cast<char>(0xe0 | (code >> 12));
+        out += static_cast<char>(0x80 | ((code >> 6) & 0x3f));
+        out += static_cast<char>(0x80 | (code & 0x3f));
+    } else {
+        out += static_cast<char>(0xf0 | (code >> 18));
+        out += static_cast<char>(0x80 | ((code >> 12) & 0x3f));
+        out += static_cast<char>(0x80 | ((code >> 6) & 0x3f));
+        out += static_cast<char>(0x80 | (code & 0x3f));
+    }
+}
+
+// Decodes the sequence at p[i], which must be valid
+uint32_t utf8_code_point(const unsigned char* p, size_t i, size_t n) {
+    if (n == 1) {
+        return p[i];
+    }
+    uint32_t code = p[i] & (0x7f >> n);
+    for (size_t k = 1; k < n; k++) {
+        code = (code << 6) | (p[i + k] & 0x3f);
+    }
+    return code;
+}
+
+} // namespace
+
+std::string TextEncoding::name() const {
+    std::string result;
+    switch (charset) {
+    case Charset::Utf8:
+        result = "UTF-8";
+        break;
+    case Charset::Utf16LE:
+        result = "UTF-16LE";
+        break;
+    case Charset::Utf16BE:
+        result = "UTF-16BE";
+        break;
+    case Charset::Windows1252:
+        result = "Windows-1252";
+        break;
+    }
+    return bom ? result + " with BOM" : result;
+}
+
+size_t utf8_valid_length(const char* data, size_t len) {
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(data);
+    size_t i = 0;
+    while (true) {
+        i = skip_ascii(p, i, len);
+        // Stay on the scalar path through a run of non-ASCII text
+        while (i < len && p[i] >= 0x80) {
+            bool incomplete;
+            size_t n = sequence_length(p, i, len, incomplete);
+            if (n == 0) {
+                return i;
+            }
+            i += n;
+        }
+        if (i >= len) {
+            return len;
+        }
+    }
+}
+
+bool detect_utf16(const char* data, size_t len, TextEncoding& encoding) {
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(data);
+    if (len >= 2 && p[0] == 0xff && p[1] == 0xfe) {
+        encoding = {Charset::Utf16LE, true};
+        return true;
+    }
+    if (len >= 2 && p[0] == 0xfe && p[1] == 0xff) {
+        encoding = {Charset::Utf16BE, true};
+        return true;
+    }
+
+    // Mostly-Latin text has a NUL high byte in nearly every unit, and nowhere else
+    size_t pairs = std::min<size_t>(len, 8192) / 2;
+    if (pairs < 2) {
+        return false;
+    }
+    size_t even_nuls = 0;
+    size_t odd_nuls = 0;
+    for (size_t i = 0; i < pairs; i++) {
+        even_nuls += p[2 * i] == 0;
+        odd_nuls += p[2 * i + 1] == 0;
+    }
+    if (odd_nuls * 10 >= pairs * 4 && even_nuls * 20 < pairs) {
+        encoding = {Charset::Utf16LE, false};
+        return true;
+    }
+    if (even_nuls * 10 >= pairs * 4 && odd_nuls * 20 < pairs) {
+        encoding = {Charset::Utf16BE, false};
+        return true;
+    }
+    return false;
+}
+
+TextEncoding detect_encoding(const char* data, size_t len) {
+    TextEncoding encoding;
+    if (detect_utf16(data, len, encoding)) {
+        return encoding;
+    }
+    if (len >= 3 && std::memcmp(data, "\xef\xbb\xbf", 3) == 0) {
+        return {Charset::Utf8, true};
+    }
+
+    size_t valid = utf8_valid_length(data, len);
+    bool incomplete = false;
+    if (valid < len) {
+        sequence_length(reinterpret_cast<const unsigned char*>(data), valid, len, incomplete);
+    }
+    // A character cut off by the end of the sample doesn't count against UTF-8
+    if (valid < len && !incomplete) {
+        return {Charset::Windows1252, false};
+    }
+    return encoding;
+}
+
+void TextDecoder::decode(std::string& text, std::string& carry, bool last) {
+    if (!started_ && encoding_.bom) {
+        size_t bom_size = encoding_.charset == Charset::Utf8 ? 3 : 2;
+        if (text.size() < bom_size && !last) {
+            carry.swap(text);
+            text.clear();
+            return;
+        }
+        text.erase(0, std::min(bom_size, text.size()));
+    }
+    started_ = true;
+
+    switch (encoding_.charset) {
+    case Charset::Utf8:
+        decode_utf8(text, carry, last);
+        break;
+    case Charset::Utf16LE:
+    case Charset::Utf16BE:
+        decode_utf16(text, carry, last);
+        break;
+    case Charset::Windows1252:
+        decode_windows1252(text);
+        break;
+    }
+}
+
+// Valid text, by far the common case, is left untouched
+void TextDecoder::decode_utf8(std::string& text, std::string& carry, bool last) {
+    size_t valid = utf8_valid_length(text.data(), text.size());
+    if (valid == text.size()) {
+        return;
+    }
+
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(text.data());
+    bool incomplete;
+    sequence_length(p, valid, text.size(), incomplete);
+    if (incomplete && !last) {
+        carry.assign(text, valid, std::string::npos);
+        text.resize(valid);
+        return;
+    }
+
+    std::string out(text, 0, valid);
+    out.reserve(text.size() + 16);
+    size_t i = valid;
+    while (i < text.size()) {
+        size_t n = sequence_length(p, i, text.size(), incomplete);
+        if (incomplete && !last) {
+            carry.assign(text, i, std::string::npos);
+            break;
+        }
+        if (n == 0) {
+            out += kReplacement;
+            lossy_ = true;
+            i++;
+        } else {
+            out.append(text, i, n);
+            i += n;
+        }
+    }
+    text.swap(out);
+}
+
+void TextDecoder::decode_utf16(std::string& text, std::string& carry, bool last) {
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(text.data());
+    bool little_endian = encoding_.charset == Charset::Utf16LE;
+    auto unit_at = [p, little_endian](size_t i) -> uint32_t {
+        return little_endian ? p[i] | (p[i + 1] << 8) : (p[i] << 8) | p[i + 1];
+    };
+
+    std::string out;
+    out.reserve(text.size() + text.size() / 2);
+    size_t i = 0;
+    while (i + 2 <= text.size()) {
+        uint32_t unit = unit_at(i);
+        if (unit >= 0xd800 && unit <= 0xdbff) {
+            if (i + 4 > text.size() && !last) {
+                break;
+            }
+            uint32_t low = i + 4 <= text.size() ? unit_at(i + 2) : 0;
+            if (low >= 0xdc00 && low <= 0xdfff) {
+                append_utf8(out, 0x10000 + ((unit - 0xd800) << 10) + (low - 0xdc00));
+                i += 4;
+                continue;
+            }
+            out += kReplacement;
+            lossy_ = true;
+        } else if (unit >= 0xdc00 && unit <= 0xdfff) {
+            out += kReplacement;
+            lossy_ = true;
+        } else {
+            append_utf8(out, unit);
+        }
+        i += 2;
+    }
+
+    if (i < text.size()) {
+        if (last) {
+            out += kReplacement;
+            lossy_ = true;
+        } else {
+            carry.assign(text, i, std::string::npos);
+        }
+    }
+    text.swap(out);
+}
+
+void TextDecoder::decode_windows1252(std::string& text) {
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(text.data());
+    size_t first = skip_ascii(p, 0, text.size());
+    if (first == text.size()) {
+        return;
+    }
+
+    std::string out(text, 0, first);
+    out.reserve(text.size() + text.size() / 4);
+    size_t i = first;
+    while (i < text.size()) {
+        size_t next = skip_ascii(p, i, text.size());
+        out.append(text, i, next - i);
+        i = next;
+        while (i < text.size() && p[i] >= 0x80) {
+            append_utf8(out, p[i] < 0xa0 ? kWindows1252High[p[i] - 0x80] : p[i]);
+            i++;
+        }
+    }
+    text.swap(out);
+}
+
+bool encode_text(std::string_view utf8, const TextEncoding& encoding, std::string& out, std::string& error) {
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(utf8.data());
+    size_t len = utf8.size();
+    out.clear();
+
+    if (encoding.charset == Charset::Utf8) {
+        out.reserve(len + 3);
+        if (encoding.bom) {
+            out = "\xef\xbb\xbf";
+        }
+        out.append(utf8);
+        return true;
+    }
+
+    bool little_endian = encoding.charset == Charset::Utf16LE;
+    auto put_unit = [&out, little_endian](uint32_t unit) {
+        char lo = static_cast<char>(unit & 0xff);
+        char hi = static_cast<char>(unit >> 8);
+        out += little_endian ? lo : hi;
+        out += little_endian ? hi : lo;
+    };
+
+    if (encoding.charset == Charset::Windows1252) {
+        out.reserve(len);
+    } else {
+        out.reserve(len * 2 + 2);
+        if (encoding.bom) {
+            put_unit(0xfeff);
+        }
+    }
+
+    size_t i = 0;
+    size_t line = 1;
+    while (i < len) {
+        bool incomplete;
+        size_t n = sequence_length(p, i, len, incomplete);
+        if (n == 0) {
+            error = "invalid UTF-8 on line " + std::to_string(line);
+            return false;
+        }
+        uint32_t code = utf8_code_point(p, i, n);
+        line += code == '\n';
+        i += n;
+
+        if (encoding.charset != Charset::Windows1252) {
+            if (code >= 0x10000) {
+                put_unit(0xd800 + ((code - 0x10000) >> 10));
+                put_unit(0xdc00 + ((code - 0x10000) & 0x3ff));
+            } else {
+                put_unit(code);
+            }
+            continue;
+        }
+
+        if (code < 0x80 || (code >= 0xa0 && code <= 0xff)) {
+            out += static_cast<char>(code);
+            continue;
+        }
+        const uint16_t* found = std::find(kWindows1252High, kWindows1252High + 32, code);
+        if (found == kWindows1252High + 32) {
+            char code_name[16];
+            std::snprintf(code_name, sizeof(code_name), "U+%04X", code);
+            error = std::string(code_name) + " on line " + std::to_string(line) + " can't be saved as " + encoding.name();
+            return false;
+        }
+        out += static_cast<char>(0x80 + (found - kWindows1252High));
+    }
+    return true;
+}
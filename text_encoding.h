@@ -0,0 +1,61 @@
+#ifndef TEXT_ENCODING_H
+#define TEXT_ENCODING_H
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+enum class Charset {
+    Utf8,
+    Utf16LE,
+    Utf16BE,
+    // Legacy single-byte text; also covers Latin-1, which it extends
+    Windows1252,
+};
+
+// How a file was stored on disk. Buffers always hold UTF-8; this is what gets written
+// back on save so a file keeps its encoding and BOM.
+struct TextEncoding {
+    Charset charset = Charset::Utf8;
+    bool bom = false;
+
+    bool is_utf8() const { return charset == Charset::Utf8 && !bom; }
+    // "UTF-8", "UTF-16LE with BOM", ...
+    std::string name() const;
+};
+
+// Length of the longest valid UTF-8 prefix. ASCII runs are skipped 64 bytes at a time,
+// so typical text validates at close to memory speed.
+size_t utf8_valid_length(const char* data, size_t len);
+
+// Recognises UTF-16 by its BOM, or without one by NULs in every other byte
+bool detect_utf16(const char* data, size_t len, TextEncoding& encoding);
+// Guesses from the start of a file: BOMs first, then UTF-16, then UTF-8 if the bytes
+// validate, else Windows-1252
+TextEncoding detect_encoding(const char* data, size_t len);
+
+// Streams a file into UTF-8 block by block. Undecodable bytes become U+FFFD and set lossy.
+class TextDecoder {
+public:
+    TextDecoder() = default;
+    explicit TextDecoder(TextEncoding encoding) : encoding_(encoding) {}
+
+    // Converts text in place. Bytes of a character cut off by the end of the block are
+    // moved to carry, which the caller puts in front of the next block; last flushes them.
+    void decode(std::string& text, std::string& carry, bool last);
+    bool lossy() const { return lossy_; }
+
+private:
+    TextEncoding encoding_;
+    bool started_ = false;
+    bool lossy_ = false;
+
+    void decode_utf8(std::string& text, std::string& carry, bool last);
+    void decode_utf16(std::string& text, std::string& carry, bool last);
+    void decode_windows1252(std::string& text);
+};
+
+// Converts UTF-8 to encoding, BOM included; fails if a character has no representation
+bool encode_text(std::string_view utf8, const TextEncoding& encoding, std::string& out, std::string& error);
+
+#endif // TEXT_ENCODING_H
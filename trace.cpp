@@ -0,0 +1,179 @@
+#include "trace.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <unistd.h>
+#include <vector>
+
+#include "save_queue.h"
+
+namespace {
+
+// Per thread; at about 100 bytes an event this is ~1.6 MiB for a busy thread
+const size_t kRingSize = 16384;
+
+struct Event {
+    const char* name;
+    uint64_t start_ns;
+    uint64_t end_ns;
+    char detail[Tracer::kMaxDetail + 1];
+};
+
+struct ThreadBuffer {
+    // Only contended while a dump copies the buffer out
+    std::mutex mutex;
+    std::vector<Event> events;
+    // Total ever recorded; events[written % kRingSize] is the next slot
+    uint64_t written = 0;
+    uint32_t tid = 0;
+    std::string name;
+};
+
+// Buffers outlive their threads so a dump still shows what finished threads did
+std::mutex registry_mutex;
+std::vector<std::shared_ptr<ThreadBuffer>> registry;
+const auto epoch = std::chrono::steady_clock::now();
+
+struct ThreadState {
+    std::shared_ptr<ThreadBuffer> buffer;
+    std::string name;
+};
+
+thread_local ThreadState thread_state;
+
+// Created on the first recorded span, so threads never traced cost nothing
+ThreadBuffer& thread_buffer() {
+    std::shared_ptr<ThreadBuffer>& buffer = thread_state.buffer;
+    if (!buffer) {
+        buffer = std::make_shared<ThreadBuffer>();
+        buffer->events.resize(kRingSize);
+        buffer->name = thread_state.name;
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        buffer->tid = static_cast<uint32_t>(registry.size() + 1);
+        registry.push_back(buffer);
+    }
+    return *buffer;
+}
+
+void append_json_string(std::string& out, const char* text) {
+    out.push_back('"');
+    for (const char* p = text; *p; p++) {
+        unsigned char c = static_cast<unsigned char>(*p);
+        if (c == '"' || c == '\\') {
+            out.push_back('\\');
+            out.push_back(static_cast<char>(c));
+        } else if (c < 0x20) {
+            char escaped[8];
+            std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+            out += escaped;
+        } else {
+            out.push_back(static_cast<char>(c));
+        }
+    }
+    out.push_back('"');
+}
+
+// Microseconds with the nanoseconds kept as decimals
+void append_us(std::string& out, uint64_t ns) {
+    char text[32];
+    std::snprintf(text, sizeof(text), "%llu.%03llu", static_cast<unsigned long long>(ns / 1000),
+                  static_cast<unsigned long long>(ns % 1000));
+    out += text;
+}
+
+} // namespace
+
+std::atomic<bool> Tracer::enabled_{false};
+
+void Tracer::set_enabled(bool enabled) {
+    enabled_.store(enabled, std::memory_order_relaxed);
+}
+
+uint64_t Tracer::now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count();
+}
+
+void Tracer::record(const char* name, uint64_t start_ns, uint64_t end_ns, std::string_view detail) {
+    ThreadBuffer& buffer = thread_buffer();
+    std::lock_guard<std::mutex> lock(buffer.mutex);
+    Event& event = buffer.events[buffer.written % kRingSize];
+    event.name = name;
+    event.start_ns = start_ns;
+    event.end_ns = end_ns;
+    size_t len = std::min(detail.size(), kMaxDetail);
+    std::memcpy(event.detail, detail.data(), len);
+    event.detail[len] = '\0';
+    buffer.written++;
+}
+
+void Tracer::set_thread_name(const std::string& name) {
+    thread_state.name = name;
+    if (thread_state.buffer) {
+        std::lock_guard<std::mutex> lock(thread_state.buffer->mutex);
+        thread_state.buffer->name = name;
+    }
+}
+
+bool Tracer::write_chrome_trace(const std::string& file_path, std::string& error) {
+    std::vector<std::shared_ptr<ThreadBuffer>> buffers;
+    {
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        buffers = registry;
+    }
+
+    std::string pid = std::to_string(getpid());
+    std::string out = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    bool first = true;
+    auto begin_event = [&]() {
+        if (!first) {
+            out += ",\n";
+        }
+        first = false;
+    };
+
+    std::vector<Event> events;
+    for (const auto& buffer : buffers) {
+        std::string name;
+        uint32_t tid;
+        {
+            // Copy out so the thread can keep recording while this is formatted
+            std::lock_guard<std::mutex> lock(buffer->mutex);
+            size_t count = std::min<uint64_t>(buffer->written, kRingSize);
+            size_t oldest = buffer->written > kRingSize ? buffer->written % kRingSize : 0;
+            events.clear();
+            for (size_t i = 0; i < count; i++) {
+                events.push_back(buffer->events[(oldest + i) % kRingSize]);
+            }
+            name = buffer->name;
+            tid = buffer->tid;
+        }
+
+        if (!name.empty()) {
+            begin_event();
+            out += "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":" + pid + ",\"tid\":" + std::to_string(tid) + ",\"args\":{\"name\":";
+            append_json_string(out, name.c_str());
+            out += "}}";
+        }
+        for (const Event& event : events) {
+            begin_event();
+            out += "{\"ph\":\"X\",\"cat\":\"librenote\",\"name\":";
+            append_json_string(out, event.name);
+            out += ",\"pid\":" + pid + ",\"tid\":" + std::to_string(tid) + ",\"ts\":";
+            append_us(out, event.start_ns);
+            out += ",\"dur\":";
+            append_us(out, event.end_ns - event.start_ns);
+            if (event.detail[0]) {
+                out += ",\"args\":{\"detail\":";
+                append_json_string(out, event.detail);
+                out += "}";
+            }
+            out += "}";
+        }
+    }
+    out += "\n]}\n";
+    return SaveQueue::write_atomically(file_path, out, error);
+}
@@ -0,0 +1,74 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+// Scoped-span tracing for finding where time goes. Every thread records finished spans
+// into its own fixed-size ring buffer, so the oldest are overwritten and recording never
+// allocates; write_chrome_trace() dumps all of them in Chrome's Trace Event format, for
+// chrome://tracing or Perfetto. While disabled a span costs one relaxed atomic load.
+class Tracer {
+public:
+    // Longer details are truncated
+    static constexpr size_t kMaxDetail = 63;
+
+    static bool enabled() { return enabled_.load(std::memory_order_relaxed); }
+    static void set_enabled(bool enabled);
+
+    // Nanoseconds since the process started tracing
+    static uint64_t now_ns();
+    // name must outlive the tracer (a string literal); detail is copied, truncated
+    static void record(const char* name, uint64_t start_ns, uint64_t end_ns, std::string_view detail = {});
+    // Shown instead of the thread number in the trace viewer
+    static void set_thread_name(const std::string& name);
+
+    static bool write_chrome_trace(const std::string& file_path, std::string& error);
+
+private:
+    static std::atomic<bool> enabled_;
+};
+
+// Records the time between construction and destruction as a span
+class TraceSpan {
+public:
+    explicit TraceSpan(const char* name) : name_(Tracer::enabled() ? name : nullptr), start_ns_(name_ ? Tracer::now_ns() : 0) {}
+    ~TraceSpan() {
+        if (name_) {
+            Tracer::record(name_, start_ns_, Tracer::now_ns(), std::string_view(detail_, detail_len_));
+        }
+    }
+
+    TraceSpan(const TraceSpan&) = delete;
+    TraceSpan& operator=(const TraceSpan&) = delete;
+
+    bool active() const { return name_ != nullptr; }
+    // TRACE_SCOPE passes the name along with the detail; only called while active
+    void set_detail(const char*) {}
+    void set_detail(const char*, std::string_view detail) {
+        detail_len_ = std::min(detail.size(), Tracer::kMaxDetail);
+        std::memcpy(detail_, detail.data(), detail_len_);
+    }
+
+private:
+    const char* name_;
+    uint64_t start_ns_;
+    size_t detail_len_ = 0;
+    char detail_[Tracer::kMaxDetail];
+};
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+#define TRACE_NAME_(name, ...) name
+#define TRACE_SCOPE_(span, ...) \
+    TraceSpan span(TRACE_NAME_(__VA_ARGS__, "")); \
+    span.active() ? span.set_detail(__VA_ARGS__) : void()
+// TRACE_SCOPE("Save file") or TRACE_SCOPE("Save file", path) traces the enclosing block.
+// path is only evaluated while tracing is enabled, so it may build a string.
+#define TRACE_SCOPE(...) TRACE_SCOPE_(TRACE_CONCAT(trace_span_, __LINE__), __VA_ARGS__)
+
+#endif // TRACE_H
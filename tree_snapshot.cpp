@@ -0,0 +1,63 @@
+#include "tree_snapshot.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "binary_io.h"
+
+namespace {
+
+const char kMagic[8] = {'L', 'N', 'T', 'R', 'E', 'E', '0', '1'};
+const uint8_t kExpanded = 1;
+
+} // namespace
+
+std::string encode_tree_snapshot(const std::string& root, const std::vector<SnapshotDir>& dirs) {
+    std::string out(kMagic, sizeof(kMagic));
+    put_string(out, root);
+    for (const SnapshotDir& dir : dirs) {
+        put_string(out, dir.relative_path);
+        put_u64(out, static_cast<uint64_t>(dir.mtime_ns));
+        out.push_back(static_cast<char>(dir.expanded ? kExpanded : 0));
+        put_u32(out, static_cast<uint32_t>(dir.entries.size()));
+        for (const DirEntry& entry : dir.entries) {
+            out.push_back(static_cast<char>(entry.is_directory));
+            put_string(out, entry.name);
+        }
+    }
+    return out;
+}
+
+bool decode_tree_snapshot(std::string_view data, const std::string& root, std::vector<SnapshotDir>& dirs) {
+    std::string snapshot_root;
+    size_t pos = sizeof(kMagic);
+    if (data.size() < sizeof(kMagic) || std::memcmp(data.data(), kMagic, sizeof(kMagic)) != 0 ||
+        !get_string(data, pos, snapshot_root) || snapshot_root != root) {
+        return false;
+    }
+
+    dirs.clear();
+    while (pos < data.size()) {
+        SnapshotDir dir;
+        uint8_t flags;
+        uint32_t count;
+        if (!get_string(data, pos, dir.relative_path) || !get(data, pos, dir.mtime_ns) || !get(data, pos, flags) ||
+            !get(data, pos, count)) {
+            return false;
+        }
+        dir.expanded = flags & kExpanded;
+        // Every entry takes at least 5 bytes, so a damaged count can't reserve gigabytes
+        dir.entries.reserve(std::min<size_t>(count, (data.size() - pos) / 5));
+        for (uint32_t i = 0; i < count; i++) {
+            uint8_t is_directory;
+            DirEntry entry;
+            if (!get(data, pos, is_directory) || !get_string(data, pos, entry.name)) {
+                return false;
+            }
+            entry.is_directory = is_directory != 0;
+            dir.entries.push_back(std::move(entry));
+        }
+        dirs.push_back(std::move(dir));
+    }
+    return true;
+}
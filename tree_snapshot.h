@@ -0,0 +1,27 @@
+#ifndef TREE_SNAPSHOT_H
+#define TREE_SNAPSHOT_H
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "dir_scanner.h"
+
+// One listed folder of the workspace tree
+struct SnapshotDir {
+    // Relative to the workspace root, "" for the root itself
+    std::string relative_path;
+    // Of the folder when it was listed; -1 never matches, so the folder is listed again
+    int64_t mtime_ns = -1;
+    bool expanded = false;
+    std::vector<DirEntry> entries;
+};
+
+// The explorer's tree as kept between runs: one record per listed folder, parents
+// before their children, so the tree can be rebuilt in a single pass.
+std::string encode_tree_snapshot(const std::string& root, const std::vector<SnapshotDir>& dirs);
+// False if data is damaged or is the snapshot of another root
+bool decode_tree_snapshot(std::string_view data, const std::string& root, std::vector<SnapshotDir>& dirs);
+
+#endif // TREE_SNAPSHOT_H
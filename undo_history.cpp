@@ -0,0 +1,246 @@
+#include "undo_history.h"
+
+#include <algorithm>
+
+namespace {
+
+// Rough per-op bookkeeping cost on top of the text itself
+const size_t kOpOverhead = sizeof(EditOp) + 32;
+const auto kMergeWindow = std::chrono::milliseconds(1500);
+
+bool is_space(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+EditOp inverse(const EditOp& op) {
+    return {op.kind == EditOp::Insert ? EditOp::Delete : EditOp::Insert, op.offset, op.text, op.chars};
+}
+
+} // namespace
+
+void UndoBudget::set_limit(size_t limit) {
+    limit_ = limit;
+    enforce();
+}
+
+void UndoBudget::enforce() {
+    while (usage_ > limit_) {
+        UndoHistory* oldest = nullptr;
+        for (UndoHistory* history : histories_) {
+            // Never drop the step a history is still building
+            if (history->undo_.size() > 1 && (!oldest || history->undo_.front().seq < oldest->undo_.front().seq)) {
+                oldest = history;
+            }
+        }
+        if (!oldest) {
+            return;
+        }
+        oldest->drop_oldest();
+    }
+}
+
+UndoHistory::UndoHistory(UndoBudget* budget, size_t limit) : budget_(budget), limit_(limit) {
+    if (budget_) {
+        budget_->histories_.push_back(this);
+    }
+}
+
+UndoHistory::~UndoHistory() {
+    clear();
+    if (budget_) {
+        auto& histories = budget_->histories_;
+        histories.erase(std::remove(histories.begin(), histories.end(), this), histories.end());
+    }
+}
+
+void UndoHistory::record_insert(size_t offset, const std::string& text) {
+    record({EditOp::Insert, offset, text, 0});
+}
+
+void UndoHistory::record_delete(size_t offset, const std::string& text) {
+    record({EditOp::Delete, offset, text, 0});
+}
+
+void UndoHistory::begin_group() {
+    if (group_depth_++ == 0) {
+        group_started_ = false;
+    }
+}
+
+void UndoHistory::end_group() {
+    if (group_depth_ > 0 && --group_depth_ == 0) {
+        group_started_ = false;
+        enforce_limit();
+    }
+}
+
+void UndoHistory::break_merge() {
+    can_merge_ = false;
+}
+
+bool UndoHistory::undo(std::vector<EditOp>& ops) {
+    if (undo_.empty()) {
+        return false;
+    }
+
+    Step step = std::move(undo_.back());
+    undo_.pop_back();
+    ops.clear();
+    for (auto it = step.ops.rbegin(); it != step.ops.rend(); ++it) {
+        ops.push_back(inverse(*it));
+    }
+    redo_.push_back(std::move(step));
+    can_merge_ = false;
+    return true;
+}
+
+bool UndoHistory::redo(std::vector<EditOp>& ops) {
+    if (redo_.empty()) {
+        return false;
+    }
+
+    Step step = std::move(redo_.back());
+    redo_.pop_back();
+    ops = step.ops;
+    undo_.push_back(std::move(step));
+    can_merge_ = false;
+    return true;
+}
+
+void UndoHistory::set_limit(size_t limit) {
+    limit_ = limit;
+    enforce_limit();
+}
+
+void UndoHistory::clear() {
+    clear_redo();
+    while (!undo_.empty()) {
+        drop_oldest();
+    }
+    can_merge_ = false;
+}
+
+void UndoHistory::record(EditOp op) {
+    op.chars = 0;
+    for (char c : op.text) {
+        op.chars += (static_cast<unsigned char>(c) & 0xc0) != 0x80;
+    }
+    if (op.chars == 0) {
+        return;
+    }
+
+    clear_redo();
+
+    if (group_depth_ > 0 && group_started_ && !undo_.empty()) {
+        charge(undo_.back(), op);
+        undo_.back().ops.push_back(std::move(op));
+        can_merge_ = false;
+        return;
+    }
+
+    if (try_merge(op)) {
+        group_started_ = group_depth_ > 0;
+        return;
+    }
+
+    Step step;
+    step.seq = budget_ ? budget_->next_seq_++ : (undo_.empty() ? 1 : undo_.back().seq + 1);
+    step.time = std::chrono::steady_clock::now();
+    charge(step, op);
+    can_merge_ = op.chars == 1 && op.text != "\n";
+    step.ops.push_back(std::move(op));
+    undo_.push_back(std::move(step));
+    group_started_ = group_depth_ > 0;
+
+    if (group_depth_ == 0) {
+        enforce_limit();
+    }
+}
+
+// Typing "hello world" one key at a time gives two steps, "hello" and " world"
+bool UndoHistory::try_merge(const EditOp& op) {
+    if (!can_merge_ || undo_.empty() || op.chars != 1 || op.text == "\n") {
+        return false;
+    }
+
+    Step& last = undo_.back();
+    auto now = std::chrono::steady_clock::now();
+    if (last.ops.size() != 1 || last.ops.back().kind != op.kind || now - last.time > kMergeWindow) {
+        return false;
+    }
+
+    EditOp& prev = last.ops.back();
+    if (is_space(op.text[0]) && !is_space(prev.text.back())) {
+        return false;
+    }
+
+    if (op.kind == EditOp::Insert && op.offset == prev.offset + prev.chars) {
+        prev.text += op.text;
+    } else if (op.kind == EditOp::Delete && op.offset + op.chars == prev.offset) {
+        // Backspace
+        prev.text.insert(0, op.text);
+        prev.offset = op.offset;
+    } else if (op.kind == EditOp::Delete && op.offset == prev.offset) {
+        // Delete key
+        prev.text += op.text;
+    } else {
+        return false;
+    }
+
+    prev.chars += op.chars;
+    last.time = now;
+    size_t bytes = op.text.size();
+    last.bytes += bytes;
+    usage_ += bytes;
+    if (budget_) {
+        budget_->usage_ += bytes;
+    }
+    return true;
+}
+
+void UndoHistory::charge(Step& step, const EditOp& op) {
+    size_t bytes = op.text.size() + kOpOverhead;
+    step.bytes += bytes;
+    usage_ += bytes;
+    if (budget_) {
+        budget_->usage_ += bytes;
+    }
+}
+
+void UndoHistory::drop_oldest() {
+    if (undo_.empty()) {
+        return;
+    }
+
+    size_t bytes = undo_.front().bytes;
+    undo_.pop_front();
+    usage_ -= bytes;
+    if (budget_) {
+        budget_->usage_ -= bytes;
+    }
+}
+
+void UndoHistory::enforce_limit() {
+    while (usage_ > limit_ && undo_.size() > 1) {
+        drop_oldest();
+    }
+    if (usage_ > limit_ && group_depth_ == 0) {
+        // A single edit larger than the whole history budget can't be kept
+        clear_redo();
+        drop_oldest();
+        can_merge_ = false;
+    }
+    if (budget_) {
+        budget_->enforce();
+    }
+}
+
+void UndoHistory::clear_redo() {
+    for (const auto& step : redo_) {
+        usage_ -= step.bytes;
+        if (budget_) {
+            budget_->usage_ -= step.bytes;
+        }
+    }
+    redo_.clear();
+}
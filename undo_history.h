@@ -0,0 +1,103 @@
+#ifndef UNDO_HISTORY_H
+#define UNDO_HISTORY_H
+
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <vector>
+
+// A single change to a document. Offsets and lengths are in characters (like
+// Gtk::TextIter offsets), text is UTF-8.
+struct EditOp {
+    enum Kind { Insert, Delete };
+
+    Kind kind;
+    size_t offset;
+    std::string text;
+    size_t chars;
+};
+
+class UndoHistory;
+
+// Memory cap shared by every history; when it is exceeded the globally oldest
+// undo steps are dropped first, whichever document they belong to.
+class UndoBudget {
+public:
+    explicit UndoBudget(size_t limit) : limit_(limit) {}
+
+    void set_limit(size_t limit);
+    size_t usage() const { return usage_; }
+
+private:
+    friend class UndoHistory;
+
+    size_t limit_;
+    size_t usage_ = 0;
+    uint64_t next_seq_ = 1;
+    std::vector<UndoHistory*> histories_;
+
+    void enforce();
+};
+
+// Per-document undo/redo history. It stores the edits themselves, never snapshots,
+// so undoing or redoing costs the size of the edit regardless of document size.
+// Consecutive keystrokes that extend each other are merged into one step.
+//
+// It knows nothing about GTK: the editor records edits from the buffer signals and
+// applies the ops returned by undo()/redo() back to the buffer.
+class UndoHistory {
+public:
+    explicit UndoHistory(UndoBudget* budget = nullptr, size_t limit = 16 * 1024 * 1024);
+    ~UndoHistory();
+
+    UndoHistory(const UndoHistory&) = delete;
+    UndoHistory& operator=(const UndoHistory&) = delete;
+
+    void record_insert(size_t offset, const std::string& text);
+    void record_delete(size_t offset, const std::string& text);
+
+    // Everything recorded between begin_group() and end_group() is undone as one step
+    void begin_group();
+    void end_group();
+    // Stops the next edit from merging into the previous step
+    void break_merge();
+
+    bool can_undo() const { return !undo_.empty(); }
+    bool can_redo() const { return !redo_.empty(); }
+    // Fill ops with the changes to apply, in order, to undo/redo one step
+    bool undo(std::vector<EditOp>& ops);
+    bool redo(std::vector<EditOp>& ops);
+
+    void set_limit(size_t limit);
+    size_t memory_usage() const { return usage_; }
+    void clear();
+
+private:
+    friend class UndoBudget;
+
+    struct Step {
+        std::vector<EditOp> ops;
+        uint64_t seq = 0;
+        size_t bytes = 0;
+        std::chrono::steady_clock::time_point time;
+    };
+
+    UndoBudget* budget_;
+    size_t limit_;
+    size_t usage_ = 0;
+    std::deque<Step> undo_;
+    std::vector<Step> redo_;
+    int group_depth_ = 0;
+    bool group_started_ = false;
+    bool can_merge_ = false;
+
+    void record(EditOp op);
+    bool try_merge(const EditOp& op);
+    void charge(Step& step, const EditOp& op);
+    void drop_oldest();
+    void enforce_limit();
+    void clear_redo();
+};
+
+#endif // UNDO_HISTORY_H
@@ -4,24 +4,24 @@
 
 #include "util.h"
 
-#include <fstream>
 #include <gtkmm/messagedialog.h>
 
+#include "file_sniffer.h"
+#include "trace.h"
+
 void show_error_dialog(Gtk::Container* cont, const std::string& message) {
+    // A widget not yet in a window is its own toplevel; the dialog then has no parent
     auto *parent = dynamic_cast<Gtk::Window *>(cont);
+    if (!parent) {
+        Gtk::MessageDialog dialog(message, false, Gtk::MESSAGE_ERROR, Gtk::BUTTONS_OK, true);
+        dialog.run();
+        return;
+    }
     Gtk::MessageDialog dialog(*parent, message, false, Gtk::MESSAGE_ERROR, Gtk::BUTTONS_OK, true);
     dialog.run();
 }
 
 bool is_binary_file(const std::string& file_path) {
-    std::ifstream file(file_path, std::ios::binary);
-    if (file.is_open()) {
-        char ch;
-        while (file.get(ch)) {
-            if (ch == '\0') {
-                return true;
-            }
-        }
-    }
-    return false;
+    TRACE_SCOPE("is_binary_file", file_path);
+    return sniff_file(file_path).kind == FileKind::Binary;
 }
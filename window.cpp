@@ -4,9 +4,13 @@
 
 #include "window.h"
 
+#include <filesystem>
 #include <iostream>
 #include <gtkmm/messagedialog.h>
 #include <gtkmm/paned.h>
+#include <glibmm/main.h>
+
+#include "trace.h"
 
 
 Window::Window() {
@@ -19,7 +23,12 @@ Window::Window() {
     scrolled_window_explorer->set_policy(Gtk::POLICY_AUTOMATIC, Gtk::POLICY_AUTOMATIC);
     scrolled_window_explorer->set_min_content_width(200);
     scrolled_window_explorer->add(explorer_);
-    hpaned->add1(*scrolled_window_explorer);
+    Gtk::Box *files_page = manage(new Gtk::Box(Gtk::ORIENTATION_VERTICAL));
+    files_page->pack_start(*scrolled_window_explorer, Gtk::PACK_EXPAND_WIDGET);
+    files_page->pack_start(explorer_.operations_bar(), Gtk::PACK_SHRINK);
+    tabs_.append_page(*files_page, "Files");
+    tabs_.append_page(searchPanel_, "Search");
+    hpaned->add1(tabs_);
 
     Gtk::ScrolledWindow *scrolled_window_editor = manage(new Gtk::ScrolledWindow());
     scrolled_window_editor->set_policy(Gtk::POLICY_AUTOMATIC, Gtk::POLICY_AUTOMATIC);
@@ -32,13 +41,77 @@ Window::Window() {
 
     explorer_.signal_file_selected().connect(sigc::mem_fun(*this, &Window::on_file_selected));
 
+    std::filesystem::path root = std::filesystem::current_path();
+    searchIndex_.open((root / ".librenote" / "index").string(), root, explorer_.ignore_rules());
+    editor_.signal_file_saved().connect(sigc::mem_fun(searchIndex_, &SearchIndex::update_file));
+
+    linksDispatcher_.connect(sigc::mem_fun(editor_, static_cast<void (Editor::*)()>(&Editor::update_backlinks)));
+    linkGraph_.set_notify([this]() { linksDispatcher_.emit(); });
+    linkGraph_.open((root / ".librenote" / "links").string(), root, explorer_.ignore_rules());
+    editor_.set_link_graph(&linkGraph_);
+    editor_.signal_file_saved().connect(sigc::mem_fun(linkGraph_, &LinkGraph::update_file));
+    searchPanel_.set_ignore_rules(explorer_.ignore_rules());
+    searchPanel_.signal_result_activated().connect(sigc::mem_fun(editor_, &Editor::open_at_line));
+
+    quickOpen_.open_index(root, explorer_.ignore_rules());
+    explorer_.signal_changes().connect(sigc::mem_fun(quickOpen_, &QuickOpen::apply_changes));
+    explorer_.signal_changes().connect(sigc::mem_fun(searchIndex_, &SearchIndex::apply_changes));
+    explorer_.signal_changes().connect(sigc::mem_fun(linkGraph_, &LinkGraph::apply_changes));
+    quickOpen_.signal_file_chosen().connect(sigc::mem_fun(editor_, &Editor::open_new_tab));
+
     show_all_children();
 }
 
 
-Window::~Window() = default;
+Window::~Window() {
+    stallCheck_.disconnect();
+    if (!tracePath_.empty()) {
+        write_trace();
+    }
+}
+
+void Window::set_trace_path(const std::string& path) {
+    tracePath_ = path;
+    if (!stallCheck_.connected()) {
+        lastTick_ = Tracer::now_ns();
+        stallCheck_ = Glib::signal_timeout().connect(sigc::mem_fun(*this, &Window::on_stall_check), 10);
+    }
+}
+
+bool Window::on_key_press_event(GdkEventKey* event) {
+    if (event->keyval == GDK_KEY_F12 && !tracePath_.empty()) {
+        write_trace();
+        return true;
+    }
+    if ((event->state & GDK_CONTROL_MASK) && event->keyval == GDK_KEY_p) {
+        quickOpen_.popup(*this);
+        return true;
+    }
+    return Gtk::Window::on_key_press_event(event);
+}
+
+// A 10 ms tick that arrives much later means something held up the main loop that long
+bool Window::on_stall_check() {
+    const uint64_t interval_ns = 10 * 1000 * 1000;
+    const uint64_t stall_ns = 50 * 1000 * 1000;
+    uint64_t now = Tracer::now_ns();
+    if (now - lastTick_ > stall_ns) {
+        Tracer::record("Main loop stall", lastTick_ + interval_ns, now);
+    }
+    lastTick_ = now;
+    return true;
+}
+
+void Window::write_trace() {
+    std::string error;
+    if (Tracer::write_chrome_trace(tracePath_, error)) {
+        std::cout << "Trace written: " << tracePath_ << std::endl;
+    } else {
+        std::cerr << "Error writing trace: " << tracePath_ << ": " << error << std::endl;
+    }
+}
 
 void Window::on_file_selected(const std::string& file_path) {
-    std::cout << "File selected: " << file_path << std::endl;
+    TRACE_SCOPE("Window::on_file_selected", file_path);
     editor_.open_new_tab(file_path);
 }
@@ -10,18 +10,38 @@
 
 #include "editor.h"
 #include "explorer.h"
+#include "link_graph.h"
+#include "quick_open.h"
+#include "search_index.h"
+#include "search_panel.h"
 
 class Window : public Gtk::Window {
 public:
     Window();
     ~Window() override;
 
+    // Where the trace is written on F12 and on exit; also starts watching for stalls
+    void set_trace_path(const std::string& path);
+
 protected:
+    // Declared first so they outlive the widgets that query and update them
+    SearchIndex searchIndex_;
+    Glib::Dispatcher linksDispatcher_;
+    LinkGraph linkGraph_;
     Explorer explorer_;
     Editor editor_;
     Gtk::Notebook tabs_;
+    SearchPanel searchPanel_{searchIndex_};
+    QuickOpen quickOpen_;
+
+    std::string tracePath_;
+    sigc::connection stallCheck_;
+    uint64_t lastTick_ = 0;
 
     void on_file_selected(const std::string& file_path);
+    bool on_key_press_event(GdkEventKey* event) override;
+    bool on_stall_check();
+    void write_trace();
 };
 
 
@@ -0,0 +1,98 @@
+#include "work_pool.h"
+
+#include <algorithm>
+
+namespace {
+
+// Which pool and queue the current thread works for, if any
+thread_local const void* current_pool = nullptr;
+thread_local size_t current_queue = 0;
+
+} // namespace
+
+WorkPool::WorkPool(size_t threads) {
+    if (threads == 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    for (size_t i = 0; i < threads; i++) {
+        queues_.push_back(std::make_unique<Queue>());
+    }
+    for (size_t i = 0; i < threads; i++) {
+        threads_.emplace_back(&WorkPool::run, this, i);
+    }
+}
+
+WorkPool::~WorkPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    cv_.notify_all();
+    for (auto& thread : threads_) {
+        thread.join();
+    }
+}
+
+void WorkPool::submit(std::function<void()> task) {
+    size_t index;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        index = current_pool == this ? current_queue : next_queue_++ % queues_.size();
+        queued_++;
+    }
+    {
+        std::lock_guard<std::mutex> lock(queues_[index]->mutex);
+        queues_[index]->tasks.push_back(std::move(task));
+    }
+    cv_.notify_one();
+}
+
+bool WorkPool::pop(size_t index, std::function<void()>& task) {
+    {
+        Queue& own = *queues_[index];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.tasks.empty()) {
+            task = std::move(own.tasks.back());
+            own.tasks.pop_back();
+            return true;
+        }
+    }
+    for (size_t i = 1; i < queues_.size(); i++) {
+        Queue& other = *queues_[(index + i) % queues_.size()];
+        std::lock_guard<std::mutex> lock(other.mutex);
+        if (!other.tasks.empty()) {
+            task = std::move(other.tasks.front());
+            other.tasks.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+void WorkPool::run(size_t index) {
+    current_pool = this;
+    current_queue = index;
+
+    std::function<void()> task;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            // queued_ is bumped before the task is pushed, so a worker may briefly spin
+            // here until the task shows up in a queue
+            cv_.wait(lock, [this] { return stop_ || queued_ > 0; });
+            if (stop_) {
+                return;
+            }
+        }
+        if (!pop(index, task)) {
+            std::this_thread::yield();
+            continue;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            queued_--;
+        }
+        task();
+        task = nullptr;
+    }
+}
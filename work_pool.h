@@ -0,0 +1,49 @@
+#ifndef WORK_POOL_H
+#define WORK_POOL_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads with one task deque each. A worker runs its own tasks
+// newest first and, once it runs dry, steals the oldest task of another worker, so
+// uneven tasks (one huge file among many small ones) don't leave threads idle.
+// Tasks submitted from inside a task go to the submitting worker's own deque.
+//
+// Tasks still queued when the pool is destroyed are dropped.
+class WorkPool {
+public:
+    // threads == 0 uses one per core
+    explicit WorkPool(size_t threads = 0);
+    ~WorkPool();
+
+    WorkPool(const WorkPool&) = delete;
+    WorkPool& operator=(const WorkPool&) = delete;
+
+    void submit(std::function<void()> task);
+    size_t size() const { return threads_.size(); }
+
+private:
+    struct Queue {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    std::vector<std::unique_ptr<Queue>> queues_;
+    std::vector<std::thread> threads_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    size_t queued_ = 0;
+    size_t next_queue_ = 0;
+    bool stop_ = false;
+
+    void run(size_t index);
+    bool pop(size_t index, std::function<void()>& task);
+};
+
+#endif // WORK_POOL_H